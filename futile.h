@@ -50,6 +50,11 @@ typedef struct futile_coord_s {
     uint32_t z;
 } futile_coord_s;
 
+typedef struct {
+    size_t n;
+    futile_coord_s *coords;
+} futile_coord_group_s;
+
 /**
  * @brief Zoom a coordinate, updating column/row appropriately
  *
@@ -136,6 +141,163 @@ FUTILE_DEF void futile_coord_print(futile_coord_s *coord, FILE *out);
  */
 FUTILE_DEF void futile_coord_println(futile_coord_s *coord, FILE *out);
 
+/**
+ * @brief Longest possible serialized coordinate
+ *
+ * "<zoom>/<column>/<row>" with 10 digit values, without a \0 or
+ * newline.
+ */
+#define FUTILE_COORD_STR_MAX 32
+
+/**
+ * @brief Format a coordinate into a buffer
+ *
+ * futile_coord_format writes "<zoom>/<column>/<row>" into out. No \0
+ * is written.
+ *
+ * @param[in] coord Input coordinate
+ * @param[out] out Memory to format into
+ * @param[in] n_out Size of memory that out points to
+ * @return Number of characters written, or 0 if they would not fit
+ */
+FUTILE_DEF size_t futile_coord_format(futile_coord_s *coord, char *out, size_t n_out);
+
+/**
+ * @brief Parse a coordinate from a buffer
+ *
+ * futile_coord_parse parses "<zoom>/<column>/<row>" from the start
+ * of str, which does not need to be \0 terminated. It accepts the same
+ * input as futile_coord_deserialize: whitespace may precede each
+ * number, each number may have a sign and spans at most 10
+ * characters, negative values are rejected, and the coordinate must
+ * be valid for its zoom. Anything following the row is left
+ * unconsumed.
+ *
+ * @param[in] str Input characters
+ * @param[in] n_str Number of characters in str
+ * @param[out] out_coord Coordinate to update
+ * @return Number of characters consumed, or 0 if str could not be parsed
+ */
+FUTILE_DEF size_t futile_coord_parse(const char *str, size_t n_str, futile_coord_s *out_coord);
+
+/**
+ * @brief Callback for malformed lines
+ *
+ * Called by the line parsers with the byte offset of the start of a
+ * line that could not be parsed, relative to the start of the buffer.
+ */
+typedef void (*futile_parse_error_fn)(size_t offset, void *userdata);
+
+/**
+ * @brief Parse newline separated coordinates
+ *
+ * futile_coord_parse_lines parses lines of "<zoom>/<column>/<row>"
+ * from buf into group, validating each line like
+ * futile_coord_parse. The last line does not need a trailing
+ * newline. Malformed lines are skipped and reported to on_error.
+ *
+ * On input group->n is the space available in group->coords, and on
+ * output it is the number of coordinates parsed. Parsing stops early
+ * when the group is full, in which case the return value tells where
+ * to resume.
+ *
+ * @param[in] buf Input characters, not \0 terminated
+ * @param[in] n_buf Number of characters in buf
+ * @param[in,out] group Output coordinates
+ * @param[in] on_error Callback for malformed lines, can be NULL
+ * @param[in] userdata Baton passed into on_error
+ * @return Number of characters consumed, always at a line boundary
+ */
+FUTILE_DEF size_t futile_coord_parse_lines(const char *buf, size_t n_buf, futile_coord_group_s *group, futile_parse_error_fn on_error, void *userdata);
+
+/**
+ * @brief Format coordinates as newline separated lines
+ *
+ * futile_coord_format_lines writes one "<zoom>/<column>/<row>\n" line
+ * per coordinate into out, stopping at the first line that does not
+ * fit.
+ *
+ * @param[in] coords Input coordinates
+ * @param[in] n Number of coordinates
+ * @param[out] out Memory to format into
+ * @param[in] n_out Size of memory that out points to
+ * @param[out] out_n_formatted Number of coordinates formatted, can be NULL
+ * @return Number of characters written
+ */
+FUTILE_DEF size_t futile_coord_format_lines(futile_coord_s *coords, size_t n, char *out, size_t n_out, size_t *out_n_formatted);
+
+/**
+ * @brief A batch of coordinates read from a tile list
+ *
+ * Each chunk of a tile list file is parsed in one or more batches,
+ * which are handed to the chunk callback. The last batch of a chunk
+ * has last set, and every chunk gets at least one batch, even when it
+ * contains no lines.
+ */
+typedef struct futile_tile_list_chunk_s {
+    /** @brief index of the chunk, in file order */
+    size_t index;
+    /** @brief byte offset in the file of the first line of the batch */
+    size_t offset;
+    /** @brief true for the last batch of the chunk */
+    bool last;
+    /** @brief number of coordinates in the batch */
+    size_t n;
+    /** @brief parsed coordinates, NULL when marshalling */
+    futile_coord_s *coords;
+    /** @brief coordinates marshalled with futile_coord_marshall_int, NULL unless marshalling */
+    uint64_t *ids;
+} futile_tile_list_chunk_s;
+
+/**
+ * @brief Tile list chunk callback
+ *
+ * The batch is only valid for the duration of the call.
+ */
+typedef void (*futile_tile_list_chunk_fn)(futile_tile_list_chunk_s *chunk, void *userdata);
+
+/**
+ * @brief Options for futile_read_tile_list
+ *
+ * Zero initialized options are valid apart from on_chunk, and use a
+ * thread per cpu, 4MB chunks and unmarshalled coordinates.
+ */
+typedef struct futile_tile_list_options_s {
+    /** @brief number of threads to parse with, 0 for one per cpu */
+    unsigned int n_threads;
+    /** @brief approximate number of bytes per chunk, 0 for the default */
+    size_t chunk_size;
+    /** @brief maximum number of coordinates per batch, 0 for the default */
+    size_t batch_size;
+    /** @brief hand out marshalled ids instead of coordinates */
+    bool marshall;
+    /** @brief callback for each batch */
+    futile_tile_list_chunk_fn on_chunk;
+    /** @brief callback for malformed lines, with offsets from the start of the file, can be NULL */
+    futile_parse_error_fn on_error;
+    /** @brief baton passed into the callbacks */
+    void *userdata;
+} futile_tile_list_options_s;
+
+/**
+ * @brief Read a file of newline separated coordinates in parallel
+ *
+ * futile_read_tile_list memory maps a file of "<zoom>/<column>/<row>"
+ * lines, as written by osm2pgsql expiry, splits it into newline
+ * aligned chunks, and parses the chunks on several threads with
+ * futile_coord_parse_lines. Results are streamed to the chunk
+ * callback in batches, so memory use only depends on the number of
+ * threads and the batch size, not on the file size.
+ *
+ * The callbacks are called concurrently from the parsing threads, and
+ * chunks complete in no particular order.
+ *
+ * @param[in] path Path of the file to read
+ * @param[in] options Reader options
+ * @return false if the file could not be read, with errno set
+ */
+FUTILE_DEF bool futile_read_tile_list(const char *path, futile_tile_list_options_s *options);
+
 /**
  * @brief Compare two coordinates
  *
@@ -196,6 +358,212 @@ FUTILE_DEF void futile_coord_unmarshall_int(uint64_t val, futile_coord_s *out_co
 */
 FUTILE_DEF uint64_t futile_coord_int_zoom_up(uint64_t val);
 
+/**
+ * @brief Interleave a column and row into a Morton code
+ *
+ * futile_morton_encode interleaves the bits of x and y into a 64 bit
+ * Z-order (Morton) code, with x in the even bits and y in the odd
+ * bits. Read 2 bits at a time from the top, the code of a coordinate
+ * at zoom z spells out its quadkey.
+ *
+ * @param[in] x Column
+ * @param[in] y Row
+ * @return Interleaved bits of x and y
+ */
+FUTILE_DEF uint64_t futile_morton_encode(uint32_t x, uint32_t y);
+
+/**
+ * @brief Split a Morton code into a column and row
+ *
+ * futile_morton_decode is the inverse of futile_morton_encode.
+ *
+ * @param[in] code Morton code
+ * @param[out] out_x Column
+ * @param[out] out_y Row
+ */
+FUTILE_DEF void futile_morton_decode(uint64_t code, uint32_t *out_x, uint32_t *out_y);
+
+/**
+ * @brief Morton encode an array of coordinates
+ *
+ * futile_morton_encode_batch uses the BMI2 PDEP instruction when the
+ * cpu runs it fast and the instruction set level is
+ * FUTILE_SIMD_AVX2, and magic number bit spreading otherwise. AMD cpus
+ * before Zen 3 microcode PDEP, so they take the bit spreading path.
+ * Zooms are ignored.
+ *
+ * @param[in] coords Input coordinates
+ * @param[in] n Number of coordinates
+ * @param[out] out_codes Output Morton codes, space for n codes
+ */
+FUTILE_DEF void futile_morton_encode_batch(futile_coord_s *coords, size_t n, uint64_t *out_codes);
+
+/**
+ * @brief Morton decode an array of codes into coordinates
+ *
+ * futile_morton_decode_batch is the inverse of
+ * futile_morton_encode_batch, using PEXT where available.
+ *
+ * @param[in] codes Input Morton codes
+ * @param[in] n Number of codes
+ * @param[in] zoom Zoom level to give the output coordinates
+ * @param[out] out_coords Output coordinates, space for n coords
+ */
+FUTILE_DEF void futile_morton_decode_batch(uint64_t *codes, size_t n, uint32_t zoom, futile_coord_s *out_coords);
+
+/**
+ * @brief Highest zoom level a Z-order tile id can represent
+ */
+#define FUTILE_ZORDER_MAX_ZOOM 31
+
+/**
+ * @brief Convert a coordinate into a Z-order tile id
+ *
+ * futile_coord_to_zorder numbers tiles zoom by zoom, and within a
+ * zoom in Morton order: the id is the number of tiles in all lower
+ * zooms, plus the Morton code of the column and row. Sorting ids keeps
+ * spatial neighbours close, the 4 children of a tile have consecutive
+ * ids, and the descendants of a tile at any zoom form a contiguous
+ * range of ids.
+ *
+ * Unlike futile_coord_marshall_int, zooms up to
+ * FUTILE_ZORDER_MAX_ZOOM are supported.
+ *
+ * @param[in] coord Input coordinate
+ * @return Z-order tile id
+ */
+FUTILE_DEF uint64_t futile_coord_to_zorder(futile_coord_s *coord);
+
+/**
+ * @brief Convert a Z-order tile id into a coordinate
+ *
+ * @param[in] id Z-order tile id
+ * @param[out] out_coord Output coordinate
+ */
+FUTILE_DEF void futile_zorder_to_coord(uint64_t id, futile_coord_s *out_coord);
+
+/**
+ * @brief Zoom level of a Z-order tile id
+ *
+ * @param[in] id Z-order tile id
+ * @return Zoom level
+ */
+FUTILE_DEF uint32_t futile_zorder_zoom(uint64_t id);
+
+/**
+ * @brief Z-order tile id of a tile's parent
+ *
+ * futile_zorder_parent is the Z-order equivalent of
+ * futile_coord_parent.
+ *
+ * @param[in] id Z-order tile id
+ * @param[out] out_parent Parent tile id
+ * @return false if id is at zoom 0
+ */
+FUTILE_DEF bool futile_zorder_parent(uint64_t id, uint64_t *out_parent);
+
+/**
+ * @brief Z-order tile ids of a tile's children
+ *
+ * futile_zorder_children generates the 4 children of a tile, which
+ * are consecutive ids, in the same order as futile_coord_children.
+ *
+ * @param[in] id Z-order tile id, below FUTILE_ZORDER_MAX_ZOOM
+ * @param[out] out_children Output children ids, space for 4 ids
+ */
+FUTILE_DEF void futile_zorder_children(uint64_t id, uint64_t *out_children);
+
+/**
+ * @brief Range of Z-order tile ids of a tile's descendants at a zoom
+ *
+ * futile_zorder_descendants computes the inclusive range of ids
+ * covering every descendant of a tile at the given zoom, so that a
+ * store sorted by id can find them with a single range scan. A tile
+ * is its own descendant at its own zoom.
+ *
+ * @param[in] id Z-order tile id
+ * @param[in] zoom Zoom of the descendants
+ * @param[out] out_first First id of the range
+ * @param[out] out_last Last id of the range, inclusive
+ * @return false if zoom is below the zoom of id or above FUTILE_ZORDER_MAX_ZOOM
+ */
+FUTILE_DEF bool futile_zorder_descendants(uint64_t id, uint32_t zoom, uint64_t *out_first, uint64_t *out_last);
+
+/**
+ * @brief Convert a coordinate into a Hilbert tile id
+ *
+ * futile_coord_to_hilbert numbers tiles like futile_coord_to_zorder,
+ * zoom by zoom, but orders tiles within a zoom along a Hilbert curve,
+ * so that consecutive ids are always neighbouring tiles. The ids are
+ * the tile ids used by PMTiles. futile_zorder_zoom also gives the zoom
+ * of a Hilbert tile id.
+ *
+ * @param[in] coord Input coordinate, at most FUTILE_ZORDER_MAX_ZOOM
+ * @return Hilbert tile id
+ */
+FUTILE_DEF uint64_t futile_coord_to_hilbert(futile_coord_s *coord);
+
+/**
+ * @brief Convert a Hilbert tile id into a coordinate
+ *
+ * @param[in] id Hilbert tile id
+ * @param[out] out_coord Output coordinate
+ */
+FUTILE_DEF void futile_hilbert_to_coord(uint64_t id, futile_coord_s *out_coord);
+
+/**
+ * @brief Sort 64 bit tile ids
+ *
+ * futile_sort_ids sorts ids in ascending order with an LSD radix
+ * sort, skipping the bytes that are the same for every id. It works
+ * for any 64 bit id, such as futile_coord_marshall_int values, which
+ * sort by column, row and then zoom, or Z-order and Hilbert ids, which
+ * sort by zoom first.
+ *
+ * Arrays of more than a million ids are sorted with n_threads
+ * threads, smaller ones on the calling thread.
+ *
+ * @param[in,out] ids Ids to sort
+ * @param[in] n Number of ids
+ * @param[in] n_threads Number of threads to use, 0 for one per cpu
+ * @return false if scratch memory could not be allocated, in which case ids is unchanged
+ */
+FUTILE_DEF bool futile_sort_ids(uint64_t *ids, size_t n, unsigned int n_threads);
+
+/**
+ * @brief Sort coordinates
+ *
+ * futile_sort_coords sorts coordinates in futile_coord_cmp order with
+ * an LSD radix sort, see futile_sort_ids.
+ *
+ * @param[in,out] coords Coordinates to sort
+ * @param[in] n Number of coordinates
+ * @param[in] n_threads Number of threads to use, 0 for one per cpu
+ * @return false if scratch memory could not be allocated, in which case coords is unchanged
+ */
+FUTILE_DEF bool futile_sort_coords(futile_coord_s *coords, size_t n, unsigned int n_threads);
+
+/**
+ * @brief Remove duplicates from sorted ids
+ *
+ * futile_unique_ids moves the first of every run of equal ids to the
+ * front of the array.
+ *
+ * @param[in,out] ids Sorted ids
+ * @param[in] n Number of ids
+ * @return Number of unique ids
+ */
+FUTILE_DEF size_t futile_unique_ids(uint64_t *ids, size_t n);
+
+/**
+ * @brief Remove duplicates from sorted coordinates
+ *
+ * @param[in,out] coords Coordinates sorted with futile_sort_coords
+ * @param[in] n Number of coordinates
+ * @return Number of unique coordinates
+ */
+FUTILE_DEF size_t futile_unique_coords(futile_coord_s *coords, size_t n);
+
 typedef struct futile_bounds_s {
     /** @brief minimum x value */
     double minx;
@@ -251,6 +619,90 @@ FUTILE_DEF void futile_coord_to_lnglat(futile_coord_s *coord, futile_point_s *ou
  */
 FUTILE_DEF void futile_lnglat_to_coord(futile_point_s *lnglat, int zoom, futile_coord_s *out);
 
+/**
+ * @brief Instruction set levels used by the batch functions
+ *
+ * The batch functions dispatch at runtime to the best kernel that
+ * the cpu supports. Levels are ordered, so a higher level implies
+ * all the lower ones.
+ */
+typedef enum futile_simd_e {
+    /** @brief portable scalar code, using libm */
+    FUTILE_SIMD_SCALAR = 0,
+    /** @brief 2 doubles per instruction */
+    FUTILE_SIMD_SSE4 = 1,
+    /** @brief 4 doubles per instruction */
+    FUTILE_SIMD_AVX2 = 2
+} futile_simd_e;
+
+/**
+ * @brief Detect the best instruction set level the cpu supports
+ *
+ * Compiling with FUTILE_NO_SIMD defined, or for a non x86 target,
+ * makes this always return FUTILE_SIMD_SCALAR.
+ *
+ * @return Highest supported level
+ */
+FUTILE_DEF futile_simd_e futile_simd_detect(void);
+
+/**
+ * @brief Instruction set level currently used by the batch functions
+ *
+ * Defaults to the result of futile_simd_detect.
+ *
+ * @return Level in use
+ */
+FUTILE_DEF futile_simd_e futile_simd_level(void);
+
+/**
+ * @brief Select the instruction set level used by the batch functions
+ *
+ * futile_simd_set_level is mostly useful for testing and
+ * benchmarking. Levels above what the cpu supports are lowered to
+ * the detected level.
+ *
+ * @param[in] level Requested level
+ * @return Level actually selected
+ */
+FUTILE_DEF futile_simd_e futile_simd_set_level(futile_simd_e level);
+
+/**
+ * @brief Convert an array of lng/lat points to coordinates
+ *
+ * futile_lnglat_to_coord_batch converts n points, in degrees, to
+ * coordinates at a single zoom level. Points outside of the mercator
+ * square are clamped to the edge of the grid.
+ *
+ * Columns are always identical to futile_lnglat_to_coord. Rows
+ * computed by the vectorized kernels use polynomial approximations
+ * instead of libm, and agree with futile_lnglat_to_coord except for
+ * points whose projected y lies within 1e-14 of a tile edge, measured
+ * as a fraction of the height of the world. Those points can land one
+ * row apart.
+ *
+ * @param[in] lnglats Input longitude latitude points
+ * @param[in] n Number of points
+ * @param[in] zoom Zoom level
+ * @param[out] out_coords Output coordinates, space for n coords
+ */
+FUTILE_DEF void futile_lnglat_to_coord_batch(futile_point_s *lnglats, size_t n, int zoom, futile_coord_s *out_coords);
+
+/**
+ * @brief Convert separate lng and lat arrays to columns and rows
+ *
+ * futile_lnglat_to_coord_batch_soa is the struct of arrays variant of
+ * futile_lnglat_to_coord_batch, with the same accuracy. The zoom of
+ * every output is the zoom passed in.
+ *
+ * @param[in] lngs Input longitudes, in degrees
+ * @param[in] lats Input latitudes, in degrees
+ * @param[in] n Number of points
+ * @param[in] zoom Zoom level
+ * @param[out] out_x Output columns, space for n values
+ * @param[out] out_y Output rows, space for n values
+ */
+FUTILE_DEF void futile_lnglat_to_coord_batch_soa(double *lngs, double *lats, size_t n, int zoom, uint32_t *out_x, uint32_t *out_y);
+
 /**
  * @brief Generate a bounding box in 4326 to encompass the coordinate
  *
@@ -263,6 +715,91 @@ FUTILE_DEF void futile_lnglat_to_coord(futile_point_s *lnglat, int zoom, futile_
  */
 FUTILE_DEF void futile_coord_to_bounds(futile_coord_s *coord, futile_bounds_s *out);
 
+/**
+ * @brief Latitudes of the row edges at a single zoom level
+ *
+ * futile_lat_table_s caches the latitude of every row edge at a zoom
+ * level, so that the batch functions can look rows up instead of
+ * computing them. lats has 2^zoom + 1 entries: the top edge of each
+ * row, followed by the bottom edge of the last row.
+ */
+typedef struct futile_lat_table_s {
+    /** @brief zoom level of the table */
+    unsigned int zoom;
+    /** @brief row edge latitudes, in degrees */
+    double *lats;
+} futile_lat_table_s;
+
+/**
+ * @brief Number of doubles a latitude table needs
+ *
+ * @param[in] zoom Zoom level
+ * @return 2^zoom + 1
+ */
+FUTILE_DEF size_t futile_lat_table_size(unsigned int zoom);
+
+/**
+ * @brief Fill a latitude table for a zoom level
+ *
+ * futile_lat_table_init computes the row edge latitudes with the
+ * same math as futile_coord_to_lnglat, so that results looked up
+ * from the table are identical to the single coordinate functions.
+ *
+ * @param[out] table Table to initialize
+ * @param[in] zoom Zoom level
+ * @param[in] lats Memory for futile_lat_table_size(zoom) doubles, owned by the caller
+ */
+FUTILE_DEF void futile_lat_table_init(futile_lat_table_s *table, unsigned int zoom, double *lats);
+
+/**
+ * @brief Convert an array of coordinates to lng/lat
+ *
+ * futile_coord_to_lnglat_batch converts the top left corner of n
+ * coordinates, which can be at different zoom levels. Coordinates at
+ * the zoom of table, if one is passed, take their latitude from it.
+ *
+ * Longitudes are identical to futile_coord_to_lnglat. Latitudes
+ * computed by the vectorized kernels differ from
+ * futile_coord_to_lnglat by less than 1e-13 degrees.
+ *
+ * @param[in] coords Input coordinates
+ * @param[in] n Number of coordinates
+ * @param[in] table Optional latitude table, can be NULL
+ * @param[out] out Output points, space for n points
+ */
+FUTILE_DEF void futile_coord_to_lnglat_batch(futile_coord_s *coords, size_t n, futile_lat_table_s *table, futile_point_s *out);
+
+/**
+ * @brief Generate 4326 bounding boxes for an array of coordinates
+ *
+ * futile_coord_to_bounds_batch is the batch version of
+ * futile_coord_to_bounds, with the same accuracy as
+ * futile_coord_to_lnglat_batch.
+ *
+ * @param[in] coords Input coordinates
+ * @param[in] n Number of coordinates
+ * @param[in] table Optional latitude table, can be NULL
+ * @param[out] out Output bounds, space for n bounds
+ */
+FUTILE_DEF void futile_coord_to_bounds_batch(futile_coord_s *coords, size_t n, futile_lat_table_s *table, futile_bounds_s *out);
+
+/**
+ * @brief Generate 4326 bounding boxes for a range of coordinates
+ *
+ * futile_coord_range_to_bounds generates the bounds of every
+ * coordinate in an inclusive column and row range at one zoom level,
+ * in the order that futile_for_bounds visits them: rows, then
+ * columns. Each row and column edge is only computed once.
+ *
+ * @param[in] zoom Zoom level
+ * @param[in] start_x,start_y Top left coordinate of the range
+ * @param[in] end_x,end_y Bottom right coordinate of the range, inclusive
+ * @param[in] table Optional latitude table, can be NULL
+ * @param[out] out Output bounds, with space for every coordinate in the range
+ * @return Number of bounds generated, 0 if the range is reversed
+ */
+FUTILE_DEF size_t futile_coord_range_to_bounds(unsigned int zoom, unsigned int start_x, unsigned int start_y, unsigned int end_x, unsigned int end_y, futile_lat_table_s *table, futile_bounds_s *out);
+
 /**
  * @brief Generate coordinate(s) for bounds in 4326 lng/lat and zoom
  *
@@ -307,6 +844,51 @@ FUTILE_DEF void futile_mercator_to_lnglat(futile_point_s *in, futile_point_s *ou
  */
 FUTILE_DEF void futile_lnglat_to_mercator(futile_point_s *in, futile_point_s *out);
 
+/**
+ * @brief Accuracy of the batch mercator projections
+ *
+ * The approximate modes run vectorized polynomial kernels at the
+ * current futile_simd_level, and fall back to libm at
+ * FUTILE_SIMD_SCALAR. Errors are stated in degrees on the ground: for
+ * projected points, the mercator error divided by the scale factor
+ * sec(lat). Maximums measured over random points are noted per mode.
+ */
+typedef enum futile_accuracy_e {
+    /** @brief libm, identical to the single point functions */
+    FUTILE_ACCURACY_EXACT = 0,
+    /** @brief within 1e-9 degrees, measured 4e-10 */
+    FUTILE_ACCURACY_1E9 = 1,
+    /** @brief within 1e-6 degrees, measured 4e-8 */
+    FUTILE_ACCURACY_1E6 = 2
+} futile_accuracy_e;
+
+/**
+ * @brief Reproject 4326 lng/lat points to 3857 mercator in bulk
+ *
+ * futile_lnglat_to_mercator_batch is the array version of
+ * futile_lnglat_to_mercator. The approximate modes clamp latitudes to
+ * +-89.9 degrees first. in and out may be the same array.
+ *
+ * @param[in] in Input points in 4326 lng/lat
+ * @param[in] n Number of points
+ * @param[in] accuracy Accuracy mode, unknown values are FUTILE_ACCURACY_EXACT
+ * @param[out] out Output points in 3857 mercator
+ */
+FUTILE_DEF void futile_lnglat_to_mercator_batch(futile_point_s *in, size_t n, futile_accuracy_e accuracy, futile_point_s *out);
+
+/**
+ * @brief Reproject 3857 mercator points to 4326 lng/lat in bulk
+ *
+ * futile_mercator_to_lnglat_batch is the array version of
+ * futile_mercator_to_lnglat. in and out may be the same array.
+ *
+ * @param[in] in Input points in 3857 mercator
+ * @param[in] n Number of points
+ * @param[in] accuracy Accuracy mode, unknown values are FUTILE_ACCURACY_EXACT
+ * @param[out] out Output points in 4326 lng/lat
+ */
+FUTILE_DEF void futile_mercator_to_lnglat_batch(futile_point_s *in, size_t n, futile_accuracy_e accuracy, futile_point_s *out);
+
 /**
  * @brief Convert a coordinate to a 3857 mercator point
  *
@@ -363,52 +945,291 @@ FUTILE_DEF void futile_coord_to_mercator_bounds(futile_coord_s *in, futile_bound
 FUTILE_DEF int futile_mercator_bounds_to_coords(futile_bounds_s *in, int zoom, futile_coord_s *out);
 
 /**
- * @brief Convert a coord to its quadkey representation
- *
- * futile_coord_to_quadkey takes an input coordinate, and generates
- * its quad key representation. It's critical that quadkey contains
- * enough space to hold zoom + 1 characters (zoom chars + \0)
+ * @brief A point in tile local integer coordinates
  *
- * @param[in] coord Input coordinate
- * @param[out] out_quadkey Output quad key, must accommodate zoom + 1 characters
+ * The origin is the top left corner of the tile and y grows downwards,
+ * as in the vector tile spec.
  */
-FUTILE_DEF void futile_coord_to_quadkey(futile_coord_s *coord, char *out_quadkey);
+typedef struct futile_tile_point_s {
+    /** @brief x value */
+    int32_t x;
+    /** @brief y value */
+    int32_t y;
+} futile_tile_point_s;
 
 /**
- * @brief Convert a quadkey to a coordinate
+ * @brief Quantize 3857 mercator points into tile local coordinates
  *
- * futile_quadkey_to_coord will convert a quad key to a coordinate. It
- * returns false if a non quadkey char is detected. It assumes that
- * quadkey points to at least level_of_detail characters.
+ * futile_mercator_to_tile_batch maps n points in 3857 mercator
+ * meters into the integer grid of the tile at coord, where the tile
+ * spans [0, extent) on both axes, as used for vector tile (MVT)
+ * geometry. Values are rounded to the nearest grid unit and clamped
+ * to [-buffer, extent + buffer], so geometry past the buffer is
+ * pinned to its edge rather than wrapping.
  *
- * @param[in] quadkey Input quad key
- * @param[in] level_of_detail Level of detail for quad key, ie strlen(quadkey)+1
- * @param[out] out_coord Output coordinate
- * @return false if an invalid quadkey string is passed in
+ * When drop_duplicates is set, a point that quantizes to the same
+ * position as the previous point written is skipped. Consecutive
+ * points are compared across the whole array, so call once per ring
+ * or linestring to keep their endpoints. The result is the same at
+ * every SIMD level.
+ *
+ * @param[in] coord Tile to quantize into
+ * @param[in] extent Tile extent, typically 4096
+ * @param[in] buffer Grid units kept outside the tile on each side
+ * @param[in] in Input points in 3857 mercator
+ * @param[in] n Number of input points
+ * @param[in] drop_duplicates Skip repeated consecutive points
+ * @param[out] out Output points, space for n
+ * @return Number of points written
  */
-FUTILE_DEF bool futile_quadkey_to_coord(char *quadkey, size_t level_of_detail, futile_coord_s *out_coord);
+FUTILE_DEF size_t futile_mercator_to_tile_batch(futile_coord_s *coord, uint32_t extent, uint32_t buffer, futile_point_s *in, size_t n, bool drop_duplicates, futile_tile_point_s *out);
 
 /**
- * @brief Coordinate callback
+ * @brief Quantize 4326 lng/lat points into tile local coordinates
  *
- * For functions that generate multiple coordinates, this callback is
- * used to perform per coordinate operations. All functions that use
- * this callback type take in a userdata "baton", which gets passed
- * through to the callback.
+ * futile_lnglat_to_tile_batch is futile_mercator_to_tile_batch for
+ * points in degrees. Latitudes are clamped to the projectable range
+ * first. The vectorized projection may move a point that lies within
+ * about 1e-9 grid units of a rounding boundary by one unit compared to
+ * the scalar path.
+ *
+ * @param[in] coord Tile to quantize into
+ * @param[in] extent Tile extent, typically 4096
+ * @param[in] buffer Grid units kept outside the tile on each side
+ * @param[in] in Input points in 4326 lng/lat
+ * @param[in] n Number of input points
+ * @param[in] drop_duplicates Skip repeated consecutive points
+ * @param[out] out Output points, space for n
+ * @return Number of points written
  */
-typedef void (*futile_coord_fn)(futile_coord_s *coord, void *userdata);
+FUTILE_DEF size_t futile_lnglat_to_tile_batch(futile_coord_s *coord, uint32_t extent, uint32_t buffer, futile_point_s *in, size_t n, bool drop_duplicates, futile_tile_point_s *out);
 
-typedef struct {
-    unsigned int x;
-    unsigned int y;
-    unsigned int z;
-    unsigned int zoom_until;
-} futile_coord_cursor_s;
+/**
+ * @brief Number of bits in a world coordinate
+ *
+ * World coordinates are fixed point positions at zoom 32, so the
+ * tile at zoom z holding a world point is its x and y shifted right by
+ * 32 - z. One unit is about 9mm at the equator.
+ */
+#define FUTILE_WORLD_BITS 32
 
-typedef struct {
-    size_t n;
-    futile_coord_s *coords;
-} futile_coord_group_s;
+/**
+ * @brief A point in integer world coordinates
+ *
+ * Like tile coordinates, the origin is the top left of the mercator
+ * square and y grows downwards.
+ */
+typedef struct futile_world_point_s {
+    /** @brief x value */
+    uint32_t x;
+    /** @brief y value */
+    uint32_t y;
+} futile_world_point_s;
+
+/**
+ * @brief Inclusive bounds in integer world coordinates
+ *
+ * miny is the top edge. The max values are inclusive, which lets the
+ * bounds of the whole world fit in 32 bits.
+ */
+typedef struct futile_world_bounds_s {
+    /** @brief minimum x value */
+    uint32_t minx;
+    /** @brief minimum (top) y value */
+    uint32_t miny;
+    /** @brief maximum x value, inclusive */
+    uint32_t maxx;
+    /** @brief maximum (bottom) y value, inclusive */
+    uint32_t maxy;
+} futile_world_bounds_s;
+
+/**
+ * @brief Convert a 3857 mercator point to world coordinates
+ *
+ * futile_mercator_to_world maps a point in mercator meters onto the
+ * world grid, rounding down and clamping to the mercator square. NaN
+ * maps to 0.
+ *
+ * @param[in] in Input point in 3857 mercator
+ * @param[out] out Output point in world coordinates
+ */
+FUTILE_DEF void futile_mercator_to_world(futile_point_s *in, futile_world_point_s *out);
+
+/**
+ * @brief Convert world coordinates to a 3857 mercator point
+ *
+ * futile_world_to_mercator returns the center of the world unit, so
+ * that futile_mercator_to_world gives back the same point.
+ *
+ * @param[in] in Input point in world coordinates
+ * @param[out] out Output point in 3857 mercator
+ */
+FUTILE_DEF void futile_world_to_mercator(futile_world_point_s *in, futile_point_s *out);
+
+/**
+ * @brief Convert a 4326 lng/lat point to world coordinates
+ *
+ * futile_lnglat_to_world projects a point in degrees onto the world
+ * grid. Latitudes past the mercator limit clamp to the edge rows.
+ * Shifting the result to zoom z gives the same tile as
+ * futile_lnglat_to_coord.
+ *
+ * @param[in] in Input point in 4326 lng/lat
+ * @param[out] out Output point in world coordinates
+ */
+FUTILE_DEF void futile_lnglat_to_world(futile_point_s *in, futile_world_point_s *out);
+
+/**
+ * @brief Convert world coordinates to a 4326 lng/lat point
+ *
+ * futile_world_to_lnglat returns the center of the world unit in
+ * degrees.
+ *
+ * @param[in] in Input point in world coordinates
+ * @param[out] out Output point in 4326 lng/lat
+ */
+FUTILE_DEF void futile_world_to_lnglat(futile_world_point_s *in, futile_point_s *out);
+
+/**
+ * @brief Find the tile at a zoom holding a world point
+ *
+ * @param[in] in Input point in world coordinates
+ * @param[in] zoom Zoom level, at most FUTILE_WORLD_BITS
+ * @param[out] out Output coordinate
+ */
+FUTILE_DEF void futile_world_to_coord(futile_world_point_s *in, unsigned int zoom, futile_coord_s *out);
+
+/**
+ * @brief Convert a coordinate to its bounds in world coordinates
+ *
+ * @param[in] coord Input coordinate, at most zoom FUTILE_WORLD_BITS
+ * @param[out] out Output bounds in world coordinates
+ */
+FUTILE_DEF void futile_coord_to_world_bounds(futile_coord_s *coord, futile_world_bounds_s *out);
+
+/**
+ * @brief Convert bounds in 4326 lng/lat to world coordinates
+ *
+ * @param[in] bounds Input bounds in 4326 lng/lat
+ * @param[out] out Output bounds in world coordinates
+ */
+FUTILE_DEF void futile_bounds_to_world_bounds(futile_bounds_s *bounds, futile_world_bounds_s *out);
+
+/**
+ * @brief Find the coordinate(s) covering world bounds at a zoom
+ *
+ * futile_world_bounds_to_coords is futile_bounds_to_coords for world
+ * bounds. It only shifts the corners, so the result is exact at every
+ * zoom. It updates 1 coordinate if a single tile covers the bounds.
+ * Otherwise it updates 2: the topleft and bottomright tiles of the
+ * inclusive range.
+ *
+ * @param[in] bounds Input bounds in world coordinates
+ * @param[in] zoom Zoom level, at most FUTILE_WORLD_BITS
+ * @param[out] out_coords Output coordinate(s) (space for 2 coords)
+ * @return Number of coordinates updated
+ */
+FUTILE_DEF unsigned int futile_world_bounds_to_coords(futile_world_bounds_s *bounds, unsigned int zoom, futile_coord_s *out_coords);
+
+/**
+ * @brief Convert a coord to its quadkey representation
+ *
+ * futile_coord_to_quadkey takes an input coordinate, and generates
+ * its quad key representation. It's critical that quadkey contains
+ * enough space to hold zoom + 1 characters (zoom chars + \0)
+ *
+ * @param[in] coord Input coordinate
+ * @param[out] out_quadkey Output quad key, must accommodate zoom + 1 characters
+ */
+FUTILE_DEF void futile_coord_to_quadkey(futile_coord_s *coord, char *out_quadkey);
+
+/**
+ * @brief Convert a quadkey to a coordinate
+ *
+ * futile_quadkey_to_coord will convert a quad key to a coordinate. It
+ * returns false if a non quadkey char is detected. It assumes that
+ * quadkey points to at least level_of_detail characters.
+ *
+ * @param[in] quadkey Input quad key
+ * @param[in] level_of_detail Level of detail for quad key, ie strlen(quadkey)+1
+ * @param[out] out_coord Output coordinate
+ * @return false if an invalid quadkey string is passed in
+ */
+FUTILE_DEF bool futile_quadkey_to_coord(char *quadkey, size_t level_of_detail, futile_coord_s *out_coord);
+
+/**
+ * @brief Longest supported quadkey
+ *
+ * Quadkeys are decoded through 64 bit Morton codes, which hold 32
+ * levels.
+ */
+#define FUTILE_QUADKEY_MAX 32
+
+/**
+ * @brief Convert a coord to a quadkey, checking the output length
+ *
+ * futile_coord_to_quadkey_n writes the coord->z characters of the
+ * quadkey of coord into out, without a \0.
+ *
+ * @param[in] coord Input coordinate
+ * @param[out] out Output quad key
+ * @param[in] n_out Size of memory that out points to
+ * @return false if out can not hold the quadkey, or the zoom is above FUTILE_QUADKEY_MAX
+ */
+FUTILE_DEF bool futile_coord_to_quadkey_n(futile_coord_s *coord, char *out, size_t n_out);
+
+/**
+ * @brief Format coordinates as newline separated quadkeys
+ *
+ * futile_coord_to_quadkey_lines writes one quadkey line per
+ * coordinate into out, stopping at the first line that does not fit,
+ * or at a zoom above FUTILE_QUADKEY_MAX. It also stops at zoom 0,
+ * whose quadkey is empty, since futile_quadkey_parse_lines rejects
+ * empty lines. When it stops early, errno tells the two apart: ENOSPC
+ * when out is full, EINVAL for a zoom it can not format.
+ *
+ * @param[in] coords Input coordinates
+ * @param[in] n Number of coordinates
+ * @param[out] out Memory to format into
+ * @param[in] n_out Size of memory that out points to
+ * @param[out] out_n_formatted Number of coordinates formatted, can be NULL
+ * @return Number of characters written, errno is ENOSPC or EINVAL if not every coordinate was formatted
+ */
+FUTILE_DEF size_t futile_coord_to_quadkey_lines(futile_coord_s *coords, size_t n, char *out, size_t n_out, size_t *out_n_formatted);
+
+/**
+ * @brief Parse newline separated quadkeys
+ *
+ * futile_quadkey_parse_lines works like futile_coord_parse_lines, for
+ * lines holding a single quadkey. Empty lines, lines with characters
+ * other than 0-3, and lines longer than FUTILE_QUADKEY_MAX are
+ * malformed.
+ *
+ * @param[in] buf Input characters, not \0 terminated
+ * @param[in] n_buf Number of characters in buf
+ * @param[in,out] group Output coordinates
+ * @param[in] on_error Callback for malformed lines, can be NULL
+ * @param[in] userdata Baton passed into on_error
+ * @return Number of characters consumed, always at a line boundary
+ */
+FUTILE_DEF size_t futile_quadkey_parse_lines(const char *buf, size_t n_buf, futile_coord_group_s *group, futile_parse_error_fn on_error, void *userdata);
+
+/**
+ * @brief Coordinate callback
+ *
+ * For functions that generate multiple coordinates, this callback is
+ * used to perform per coordinate operations. All functions that use
+ * this callback type take in a userdata "baton", which gets passed
+ * through to the callback.
+ */
+typedef void (*futile_coord_fn)(futile_coord_s *coord, void *userdata);
+
+typedef struct {
+    unsigned int x;
+    unsigned int y;
+    unsigned int z;
+    unsigned int zoom_until;
+} futile_coord_cursor_s;
 
 /**
  * @brief Visit coordinates in a given range
@@ -425,6 +1246,60 @@ FUTILE_DEF void futile_for_zoom_range(unsigned int zoom_start, unsigned int zoom
 
 FUTILE_DEF bool futile_for_zoom_range_array(futile_coord_cursor_s *cursor, futile_coord_group_s *group);
 
+/**
+ * @brief Progress callback
+ *
+ * Called with the number of coordinates visited so far and the total
+ * to visit. Returning false cancels the remaining work.
+ */
+typedef bool (*futile_progress_fn)(uint64_t n_done, uint64_t n_total, void *userdata);
+
+/**
+ * @brief Options for the parallel coordinate visitors
+ *
+ * A zeroed structure uses one thread per cpu, passes a NULL userdata
+ * to every callback and reports no progress.
+ */
+typedef struct {
+    /** @brief number of worker threads, 0 for one per cpu */
+    unsigned int n_threads;
+    /** @brief coordinates per block of work, rounded down to a power of 2, 0 for 65536 */
+    uint64_t block_size;
+    /** @brief n_threads batons, one per worker thread, NULL to pass userdata to every thread. Needs n_threads to be set. */
+    void **thread_userdata;
+    /** @brief baton for every thread when thread_userdata is NULL */
+    void *userdata;
+    /** @brief called after each block, one call at a time, NULL for none */
+    futile_progress_fn on_progress;
+    /** @brief baton passed to on_progress */
+    void *progress_userdata;
+    /** @brief optional flag that cancels the remaining blocks once set to true */
+    bool *cancel;
+} futile_parallel_options_s;
+
+/**
+ * @brief Visit coordinates in a given range on many threads
+ *
+ * futile_for_zoom_range_parallel visits the same coordinates as
+ * futile_for_zoom_range. The pyramid is split into blocks of
+ * options->block_size coordinates, which the worker threads claim one
+ * at a time, so the work stays balanced whatever the zoom range. Within
+ * a block, coordinates are visited in the same order as
+ * futile_for_zoom_range.
+ *
+ * The callback runs on the worker threads, and receives the baton of
+ * the thread it runs on. The calling thread is one of the workers.
+ * Cancelling, through options->cancel or on_progress, stops workers
+ * once they finish their current block.
+ *
+ * @param[in] zoom_start Input start zoom
+ * @param[in] zoom_until Input end zoom (inclusive), at most FUTILE_ZORDER_MAX_ZOOM
+ * @param[in] for_coord Callback function for each coordinate
+ * @param[in] options Threads, batons, progress and cancellation, NULL for defaults
+ * @return false if the visit was cancelled or zoom_until is out of range. Also false, with errno set to EINVAL, if options->thread_userdata is set and options->n_threads is 0.
+ */
+FUTILE_DEF bool futile_for_zoom_range_parallel(unsigned int zoom_start, unsigned int zoom_until, futile_coord_fn for_coord, futile_parallel_options_s *options);
+
 FUTILE_DEF void futile_for_coord_zoom_range(unsigned int start_x, unsigned int start_y, unsigned int end_x, unsigned int end_y, unsigned int start_zoom, unsigned int end_zoom, futile_coord_fn for_coord, void *userdata);
 
 /**
@@ -446,8 +1321,8 @@ FUTILE_DEF void futile_for_coord_parents(futile_coord_s *start, unsigned int zoo
  * futile_n_for_zoom will return the total number of tiles in a
  * particular zoom level, and all those below it.
  *
- * @param[in] zoom Zoom level
- * @return[out] Total number of cumulative tiles for a given zoom level
+ * @param[in] zoom Zoom level, at most FUTILE_ZORDER_MAX_ZOOM
+ * @return[out] Total number of cumulative tiles for a given zoom level, or -1 if zoom is above FUTILE_ZORDER_MAX_ZOOM, where the count no longer fits
 */
 FUTILE_DEF long futile_n_for_zoom(unsigned int zoom);
 
@@ -465,477 +1340,7169 @@ FUTILE_DEF long futile_n_for_zoom(unsigned int zoom);
  */
 FUTILE_DEF void futile_for_bounds(futile_bounds_s *bounds, unsigned int zoom_start, unsigned int zoom_until, futile_coord_fn for_coord, void *userdata);
 
-FUTILE_DEF bool futile_coord_is_valid(futile_coord_s *coord);
+/**
+ * @brief Visit coordinates in a given range in Hilbert order
+ *
+ * futile_for_zoom_range_hilbert visits the same coordinates as
+ * futile_for_zoom_range, zoom by zoom, but orders each zoom along the
+ * Hilbert curve, which is increasing futile_coord_to_hilbert order.
+ *
+ * @param[in] zoom_start Input start zoom
+ * @param[in] zoom_until Input end zoom (inclusive)
+ * @param[in] for_coord Callback function for each coordinate
+ * @param[in] userdata Baton passed into callback function
+ */
+FUTILE_DEF void futile_for_zoom_range_hilbert(unsigned int zoom_start, unsigned int zoom_until, futile_coord_fn for_coord, void *userdata);
 
-#ifdef __cplusplus
-}
-#endif
+/**
+ * @brief Visit coordinates within bounds in Hilbert order
+ *
+ * futile_for_bounds_hilbert visits the same coordinates as
+ * futile_for_bounds, zoom by zoom, but orders each zoom in increasing
+ * futile_coord_to_hilbert order. Parts of the curve outside of the
+ * bounds are skipped whole, so the cost stays proportional to the
+ * number of coordinates visited.
+ *
+ * @param[in] bounds Input bounds
+ * @param[in] zoom_start Starting zoom level
+ * @param[in] zoom_until Ending zoom level, inclusive
+ * @param[in] for_coord Callback function for each coordinate
+ * @param[in] userdata Baton passed into callback function
+ */
+FUTILE_DEF void futile_for_bounds_hilbert(futile_bounds_s *bounds, unsigned int zoom_start, unsigned int zoom_until, futile_coord_fn for_coord, void *userdata);
 
-#ifdef FUTILE_IMPLEMENTATION
+/**
+ * @brief Work done by one worker thread of a parallel visit
+ */
+typedef struct {
+    /** @brief coordinates visited */
+    uint64_t n_coords;
+    /** @brief subtrees run, stolen ones included */
+    uint64_t n_subtrees;
+    /** @brief subtrees stolen from other workers */
+    uint64_t n_steals;
+    /** @brief rounds over the other workers that found nothing to steal */
+    uint64_t n_failed_steals;
+} futile_worker_stats_s;
 
-#include <math.h>
+/**
+ * @brief Visit coordinates within bounds on many threads
+ *
+ * futile_for_bounds_parallel visits the same coordinates as
+ * futile_for_bounds, with work stealing over quadtree subtrees. A
+ * worker runs a subtree by visiting its root and queueing the
+ * children within the bounds, then continues with the first child,
+ * depth first. A worker with an empty queue steals the oldest subtree,
+ * which is the largest, from another worker. Expensive parts of the
+ * pyramid are therefore shared out as they are discovered, instead of
+ * being fixed up front.
+ *
+ * Parents are visited before their children, but there is no order
+ * between subtrees. The callback runs on the worker threads with the
+ * baton of its thread, see futile_parallel_options_s. Here
+ * options->block_size is the number of coordinates a worker visits
+ * between progress reports and checks for cancellation.
+ *
+ * @param[in] bounds Input bounds
+ * @param[in] zoom_start Starting zoom level
+ * @param[in] zoom_until Ending zoom level, inclusive, at most FUTILE_ZORDER_MAX_ZOOM
+ * @param[in] for_coord Callback function for each coordinate
+ * @param[in] options Threads, batons, progress and cancellation, NULL for defaults
+ * @param[out] out_stats Stats for each of the options->n_threads workers, or NULL. Needs options->n_threads to be set.
+ * @return false if the visit was cancelled or zoom_until is out of range. Also false, with errno set to EINVAL, if options->thread_userdata or out_stats is set and options->n_threads is 0.
+ */
+FUTILE_DEF bool futile_for_bounds_parallel(futile_bounds_s *bounds, unsigned int zoom_start, unsigned int zoom_until, futile_coord_fn for_coord, futile_parallel_options_s *options, futile_worker_stats_s *out_stats);
 
-FUTILE_DEF void futile_coord_zoom(int delta, futile_coord_s *out) {
-    out->x *= pow(2, delta);
-    out->y *= pow(2, delta);
-    out->z += delta;
-}
+/**
+ * @brief Resumable position within futile_for_bounds
+ *
+ * A cursor is a range of positions in the order futile_for_bounds
+ * visits coordinates: zoom by zoom, then rows, then columns. It holds
+ * only plain values, so it can be copied, saved with
+ * futile_bounds_cursor_serialize and resumed later.
+ */
+typedef struct {
+    /** @brief bounds to visit */
+    futile_bounds_s bounds;
+    /** @brief starting zoom level */
+    unsigned int zoom_start;
+    /** @brief ending zoom level, inclusive */
+    unsigned int zoom_until;
+    /** @brief index of the next coordinate to visit */
+    uint64_t position;
+    /** @brief index after the last coordinate to visit */
+    uint64_t end;
+} futile_bounds_cursor_s;
 
-FUTILE_DEF bool futile_coord_parent(futile_coord_s *coord, futile_coord_s *out_coord) {
-    if (coord->z <= 0) {
-        return false;
-    }
-    if (out_coord != coord) {
-        *out_coord = *coord;
-    }
-    out_coord->z -= 1;
-    out_coord->x >>= 1;
-    out_coord->y >>= 1;
-    return true;
-}
+/**
+ * @brief Resumable position within futile_for_coord_zoom_range
+ *
+ * As futile_bounds_cursor_s, in the order futile_for_coord_zoom_range
+ * visits coordinates: zoom by zoom, then columns, then rows.
+ */
+typedef struct {
+    /** @brief first column at zoom_start */
+    unsigned int start_x;
+    /** @brief first row at zoom_start */
+    unsigned int start_y;
+    /** @brief last column at zoom_start, inclusive */
+    unsigned int end_x;
+    /** @brief last row at zoom_start, inclusive */
+    unsigned int end_y;
+    /** @brief starting zoom level */
+    unsigned int zoom_start;
+    /** @brief ending zoom level, inclusive */
+    unsigned int zoom_until;
+    /** @brief index of the next coordinate to visit */
+    uint64_t position;
+    /** @brief index after the last coordinate to visit */
+    uint64_t end;
+} futile_coord_range_cursor_s;
 
-FUTILE_DEF void futile_coord_children(futile_coord_s *coord, futile_coord_s *out_children) {
-    futile_coord_s *first_child = &out_children[0];
-    *first_child = *coord;
-    first_child->z++;
-    first_child->x <<= 1;
-    first_child->y <<= 1;
+/**
+ * @brief Longest possible serialized cursor, including the \0
+ */
+#define FUTILE_CURSOR_STR_MAX 192
 
-    out_children[1] = *first_child;
-    out_children[1].x++;
+/**
+ * @brief Start a cursor over coordinates within bounds
+ *
+ * @param[out] cursor Cursor to initialize
+ * @param[in] bounds Input bounds
+ * @param[in] zoom_start Starting zoom level
+ * @param[in] zoom_until Ending zoom level, inclusive, at most FUTILE_ZORDER_MAX_ZOOM
+ * @return false if zoom_until is out of range
+ */
+FUTILE_DEF bool futile_bounds_cursor_init(futile_bounds_cursor_s *cursor, futile_bounds_s *bounds, unsigned int zoom_start, unsigned int zoom_until);
 
-    out_children[2] = *first_child;
-    out_children[2].y++;
+/**
+ * @brief Fill a group with the next coordinates within bounds
+ *
+ * futile_for_bounds_array is the batch form of futile_for_bounds. Up
+ * to group->n coordinates are written to group->coords, group->n is
+ * set to the number written, and the cursor moves past them.
+ *
+ * @param[in,out] cursor Position to continue from
+ * @param[in,out] group Memory for coordinates, and the number written
+ * @return true once the cursor has no coordinates left
+ */
+FUTILE_DEF bool futile_for_bounds_array(futile_bounds_cursor_s *cursor, futile_coord_group_s *group);
 
-    out_children[3] = *first_child;
-    out_children[3].x++;
-    out_children[3].y++;
-}
+/**
+ * @brief Number of coordinates a cursor has left to visit
+ */
+FUTILE_DEF uint64_t futile_bounds_cursor_remaining(futile_bounds_cursor_s *cursor);
 
-FUTILE_DEF bool futile_coord_is_valid(futile_coord_s *coord) {
-    bool result = false;
-    int max_row_col = pow(2, coord->z);
-    if (coord->x < max_row_col && coord->y < max_row_col) {
-        result = true;
-    }
-    return result;
-}
+/**
+ * @brief Split a cursor into disjoint cursors
+ *
+ * futile_bounds_cursor_split divides the coordinates left in cursor
+ * between k cursors, in order, whose sizes differ by at most one.
+ * Together they visit the same coordinates as cursor.
+ *
+ * @param[in] cursor Cursor to split
+ * @param[in] k Number of cursors to split into
+ * @param[out] out_cursors Memory for k cursors
+ */
+FUTILE_DEF void futile_bounds_cursor_split(futile_bounds_cursor_s *cursor, size_t k, futile_bounds_cursor_s *out_cursors);
 
-FUTILE_DEF bool futile_coord_serialize(futile_coord_s *coord, ssize_t n_out, char *out) {
-    int n_required = snprintf(out, n_out, "%d/%d/%d", coord->z, coord->x, coord->y);
-    return n_required <= n_out;
-}
+/**
+ * @brief Serialize a cursor to a string
+ *
+ * The string is a single line of text, and bounds are written with
+ * enough digits to be read back exactly.
+ *
+ * @param[in] cursor Input cursor
+ * @param[in] n_out Size of memory that out points to, which should include \0
+ * @param[out] out The memory to serialize the string to
+ * @return false if memory could not hold serialized string
+ */
+FUTILE_DEF bool futile_bounds_cursor_serialize(futile_bounds_cursor_s *cursor, size_t n_out, char *out);
 
-FUTILE_DEF bool futile_coord_deserialize(char *coord_str, futile_coord_s *out) {
-    bool result = false;
-    int x, y, z;
-    if (sscanf(coord_str, "%10d/%10d/%10d", &z, &x, &y) == 3) {
-        if (z >= 0 && x >= 0 && y >= 0) {
-            out->z = z;
-            out->x = x;
-            out->y = y;
-            result = futile_coord_is_valid(out);
-        }
-    }
-    return result;
-}
+/**
+ * @brief Deserialize a cursor from a string
+ *
+ * @param[in] str String from futile_bounds_cursor_serialize
+ * @param[out] out_cursor Cursor to update
+ * @return false if str could not be parsed, or is not a valid cursor
+ */
+FUTILE_DEF bool futile_bounds_cursor_deserialize(const char *str, futile_bounds_cursor_s *out_cursor);
 
-FUTILE_DEF void futile_coord_print(futile_coord_s *coord, FILE *out) {
-    fprintf(out, "%d/%d/%d", coord->z, coord->x, coord->y);
-}
+/**
+ * @brief Start a cursor over the descendants of a coordinate range
+ *
+ * The arguments are the same as for futile_for_coord_zoom_range.
+ *
+ * @return false if end_zoom is out of range, or the range is not within zoom start_zoom
+ */
+FUTILE_DEF bool futile_coord_range_cursor_init(futile_coord_range_cursor_s *cursor, unsigned int start_x, unsigned int start_y, unsigned int end_x, unsigned int end_y, unsigned int start_zoom, unsigned int end_zoom);
+
+/**
+ * @brief Fill a group with the next coordinates of a coordinate range
+ *
+ * The batch form of futile_for_coord_zoom_range, see futile_for_bounds_array.
+ */
+FUTILE_DEF bool futile_for_coord_zoom_range_array(futile_coord_range_cursor_s *cursor, futile_coord_group_s *group);
+
+/**
+ * @brief Number of coordinates a cursor has left to visit
+ */
+FUTILE_DEF uint64_t futile_coord_range_cursor_remaining(futile_coord_range_cursor_s *cursor);
+
+/**
+ * @brief Split a cursor into disjoint cursors, see futile_bounds_cursor_split
+ */
+FUTILE_DEF void futile_coord_range_cursor_split(futile_coord_range_cursor_s *cursor, size_t k, futile_coord_range_cursor_s *out_cursors);
+
+/**
+ * @brief Serialize a cursor to a string, see futile_bounds_cursor_serialize
+ */
+FUTILE_DEF bool futile_coord_range_cursor_serialize(futile_coord_range_cursor_s *cursor, size_t n_out, char *out);
+
+/**
+ * @brief Deserialize a cursor from a string, see futile_bounds_cursor_deserialize
+ */
+FUTILE_DEF bool futile_coord_range_cursor_deserialize(const char *str, futile_coord_range_cursor_s *out_cursor);
+
+/**
+ * @brief Count coordinates within bounds for a zoom level range
+ *
+ * futile_n_for_bounds returns the number of coordinates that
+ * futile_for_bounds visits, exactly, without visiting them.
+ *
+ * @param[in] bounds Input bounds
+ * @param[in] zoom_start Starting zoom level
+ * @param[in] zoom_until Ending zoom level, inclusive, at most FUTILE_ZORDER_MAX_ZOOM
+ * @return Number of coordinates
+ */
+FUTILE_DEF uint64_t futile_n_for_bounds(futile_bounds_s *bounds, unsigned int zoom_start, unsigned int zoom_until);
+
+/**
+ * @brief A square block of tiles at one zoom, rendered together
+ *
+ * Metatile x, y at zoom z holds the tiles x * size to x * size + size
+ * - 1 in both directions at the same zoom. At zooms with fewer than
+ * size tiles across, the one metatile 0, 0 holds the whole world, and
+ * only the tiles that exist.
+ */
+typedef struct {
+    /** @brief metatile column, the tile column divided by size */
+    uint32_t x;
+    /** @brief metatile row, the tile row divided by size */
+    uint32_t y;
+    /** @brief zoom of the member tiles */
+    uint32_t z;
+    /** @brief tiles across, a power of 2 */
+    uint32_t size;
+} futile_metatile_s;
+
+/**
+ * @brief Metatile callback function
+ */
+typedef void (*futile_metatile_fn)(futile_metatile_s *metatile, void *userdata);
+
+/**
+ * @brief Find the metatile holding a coordinate
+ *
+ * @param[in] coord Input coordinate
+ * @param[in] size Tiles across the metatile, a power of 2
+ * @param[out] out Metatile
+ * @return false if size is not a power of 2, with errno set to EINVAL
+ */
+FUTILE_DEF bool futile_coord_to_metatile(futile_coord_s *coord, uint32_t size, futile_metatile_s *out);
+
+/**
+ * @brief Number of tiles in a metatile
+ *
+ * @param[in] metatile Input metatile
+ * @return size * size, or fewer at zooms with fewer tiles across than size
+ */
+FUTILE_DEF size_t futile_metatile_n_coords(futile_metatile_s *metatile);
+
+/**
+ * @brief Split a metatile back into its tiles
+ *
+ * Tiles are written row by row, from the top left.
+ *
+ * @param[in] metatile Input metatile
+ * @param[out] out Member tiles, space for futile_metatile_n_coords coordinates
+ * @return Number of tiles written
+ */
+FUTILE_DEF size_t futile_metatile_to_coords(futile_metatile_s *metatile, futile_coord_s *out);
+
+/**
+ * @brief Convert a metatile to bounds in mercator meters
+ *
+ * The bounds cover every member tile, grown on each side by buffer
+ * tiles, and clamped to the world. A buffer of 0.125 grows a 256
+ * pixel tile by 32 pixels.
+ *
+ * @param[in] metatile Input metatile
+ * @param[in] buffer Margin in tiles of the metatile zoom
+ * @param[out] out Output bounds in mercator meters
+ */
+FUTILE_DEF void futile_metatile_to_mercator_bounds(futile_metatile_s *metatile, double buffer, futile_bounds_s *out);
+
+/**
+ * @brief Visit metatiles in a given range
+ *
+ * futile_for_zoom_range_metatile covers the same tiles as
+ * futile_for_zoom_range, one metatile at a time.
+ *
+ * @param[in] zoom_start Input start zoom
+ * @param[in] zoom_until Input end zoom (inclusive), at most FUTILE_ZORDER_MAX_ZOOM
+ * @param[in] size Tiles across each metatile, a power of 2
+ * @param[in] for_metatile Callback function for each metatile
+ * @param[in] userdata Baton passed into callback function
+ * @return false if size is not a power of 2 or zoom_until is out of range, with errno set to EINVAL
+ */
+FUTILE_DEF bool futile_for_zoom_range_metatile(unsigned int zoom_start, unsigned int zoom_until, uint32_t size, futile_metatile_fn for_metatile, void *userdata);
+
+/**
+ * @brief Visit metatiles within bounds for a zoom level range
+ *
+ * futile_for_bounds_metatile visits every metatile holding a tile
+ * that futile_for_bounds visits, row by row, once each.
+ *
+ * @param[in] bounds Input bounds
+ * @param[in] zoom_start Starting zoom level
+ * @param[in] zoom_until Ending zoom level, inclusive, at most FUTILE_ZORDER_MAX_ZOOM
+ * @param[in] size Tiles across each metatile, a power of 2
+ * @param[in] for_metatile Callback function for each metatile
+ * @param[in] userdata Baton passed into callback function
+ * @return false if size is not a power of 2 or zoom_until is out of range, with errno set to EINVAL
+ */
+FUTILE_DEF bool futile_for_bounds_metatile(futile_bounds_s *bounds, unsigned int zoom_start, unsigned int zoom_until, uint32_t size, futile_metatile_fn for_metatile, void *userdata);
+
+/**
+ * @brief Shard weight callback
+ *
+ * Returns the cost of each coordinate at zoom within region, which is
+ * a coordinate at zoom or above. Per zoom weights can ignore region.
+ */
+typedef double (*futile_shard_weight_fn)(futile_coord_s *region, unsigned int zoom, void *userdata);
+
+/**
+ * @brief Options for futile_bounds_shard
+ *
+ * A zeroed structure balances shards by coordinate count.
+ */
+typedef struct {
+    /** @brief cost of coordinates, NULL to balance by count */
+    futile_shard_weight_fn weight;
+    /** @brief baton passed to weight */
+    void *userdata;
+    /** @brief deepest zoom of the regions passed to weight, 0 for per zoom weights */
+    unsigned int weight_zoom;
+} futile_shard_options_s;
+
+/**
+ * @brief A contiguous part of a pyramid
+ *
+ * Shards are ranges of futile_coord_to_hilbert ids, which order
+ * coordinates by zoom, then along the Hilbert curve. A shard holds the
+ * coordinates of its range that are within the bounds that were
+ * sharded.
+ */
+typedef struct {
+    /** @brief first Hilbert id of the range */
+    uint64_t first_id;
+    /** @brief last Hilbert id of the range, inclusive */
+    uint64_t last_id;
+    /** @brief number of coordinates within bounds */
+    uint64_t n_coords;
+    /** @brief total weight of the coordinates, or n_coords without a weight function */
+    double weight;
+} futile_shard_s;
+
+/**
+ * @brief Split coordinates within bounds into balanced shards
+ *
+ * futile_bounds_shard cuts the coordinates that futile_for_bounds
+ * visits into n_shards contiguous ranges of near equal count, or near
+ * equal weight. Shards cover the whole zoom range in increasing order
+ * without gaps. Shards never split a coordinate, so with weights a
+ * single heavy coordinate may take a whole shard, and fewer shards are
+ * written.
+ *
+ * Planning walks one path down the quadtree per shard, so it takes
+ * time proportional to n_shards and the number of zooms, not to the
+ * number of coordinates. Region weights add up to 4^weight_zoom calls
+ * to options->weight for each zoom and shard.
+ *
+ * @param[in] bounds Input bounds
+ * @param[in] zoom_start Starting zoom level
+ * @param[in] zoom_until Ending zoom level, inclusive, at most FUTILE_ZORDER_MAX_ZOOM
+ * @param[in] n_shards Number of shards to make
+ * @param[in] options Weight function, NULL to balance by count
+ * @param[out] out_shards Memory for n_shards shards
+ * @return Number of shards written, fewer than n_shards when there is too little to share
+ */
+FUTILE_DEF size_t futile_bounds_shard(futile_bounds_s *bounds, unsigned int zoom_start, unsigned int zoom_until, size_t n_shards, futile_shard_options_s *options, futile_shard_s *out_shards);
+
+/**
+ * @brief Visit coordinates within bounds of one shard
+ *
+ * futile_for_shard visits the coordinates of a shard from
+ * futile_bounds_shard, in increasing Hilbert id order, as
+ * futile_for_bounds_hilbert does.
+ *
+ * @param[in] bounds The bounds that were sharded
+ * @param[in] shard Shard to visit
+ * @param[in] for_coord Callback function for each coordinate
+ * @param[in] userdata Baton passed into callback function
+ */
+FUTILE_DEF void futile_for_shard(futile_bounds_s *bounds, futile_shard_s *shard, futile_coord_fn for_coord, void *userdata);
+
+/**
+ * @brief A run of coordinates along a row
+ */
+typedef struct {
+    /** @brief zoom of the run */
+    uint32_t z;
+    /** @brief row of the run */
+    uint32_t y;
+    /** @brief first column */
+    uint32_t start_x;
+    /** @brief last column, inclusive */
+    uint32_t until_x;
+} futile_coord_run_s;
+
+/**
+ * @brief Coordinate run callback
+ *
+ * Tile covers report their coordinates as runs, in increasing zoom,
+ * row, then column order. Runs along a row do not touch.
+ */
+typedef void (*futile_coord_run_fn)(futile_coord_run_s *run, void *userdata);
+
+/**
+ * @brief Cover points with coordinates
+ *
+ * futile_cover_points reports the coordinates that contain any of
+ * the points, in degrees, for each zoom between zoom_start and
+ * zoom_until. Latitudes past the mercator limit land on the edge rows.
+ *
+ * @param[in] lnglats Input points
+ * @param[in] n Number of points
+ * @param[in] zoom_start Starting zoom level
+ * @param[in] zoom_until Ending zoom level, inclusive, at most FUTILE_ZORDER_MAX_ZOOM
+ * @param[in] for_run Callback function for each run of coordinates
+ * @param[in] userdata Baton passed into callback function
+ * @return false if zoom_until is out of range or memory ran out
+ */
+FUTILE_DEF bool futile_cover_points(futile_point_s *lnglats, size_t n, unsigned int zoom_start, unsigned int zoom_until, futile_coord_run_fn for_run, void *userdata);
+
+/**
+ * @brief Cover a linestring with coordinates
+ *
+ * futile_cover_linestring reports the coordinates that the line
+ * through lnglats passes through, walking each segment from tile to
+ * tile, see futile_cover_points.
+ */
+FUTILE_DEF bool futile_cover_linestring(futile_point_s *lnglats, size_t n, unsigned int zoom_start, unsigned int zoom_until, futile_coord_run_fn for_run, void *userdata);
+
+/**
+ * @brief Cover a polygon with coordinates
+ *
+ * futile_cover_polygon reports the coordinates that intersect the
+ * polygon, see futile_cover_points. The rings are stored one after the
+ * other in lnglats, and ring_ends holds the index after the last point
+ * of each ring. Rings close themselves, and repeating the first point
+ * is allowed. The inside is found with the even-odd rule, so the first
+ * ring is the outside and the rest are holes, whatever their winding.
+ *
+ * Tiles crossed by the rings are walked as with
+ * futile_cover_linestring, and the tiles between them are filled row
+ * by row from where the rings cross the middle of the row, so no tile
+ * is tested against the polygon.
+ *
+ * @param[in] lnglats Points of all rings
+ * @param[in] ring_ends Index after the last point of each ring
+ * @param[in] n_rings Number of rings
+ * @param[in] zoom_start Starting zoom level
+ * @param[in] zoom_until Ending zoom level, inclusive, at most FUTILE_ZORDER_MAX_ZOOM
+ * @param[in] for_run Callback function for each run of coordinates
+ * @param[in] userdata Baton passed into callback function
+ * @return false if zoom_until is out of range or memory ran out
+ */
+FUTILE_DEF bool futile_cover_polygon(futile_point_s *lnglats, size_t *ring_ends, size_t n_rings, unsigned int zoom_start, unsigned int zoom_until, futile_coord_run_fn for_run, void *userdata);
+
+/**
+ * @brief Cover a polygon with coordinates of mixed zooms
+ *
+ * futile_cover_polygon_mixed reports the same area as
+ * futile_cover_polygon does at zoom, with the fewest coordinates:
+ * wherever all four children of a coordinate are in the cover, the
+ * parent is reported instead, up the pyramid. Interior tiles end up as
+ * coarse as the polygon allows, and the tiles along the rings stay at
+ * zoom. Expanding each coordinate down to zoom, with
+ * futile_for_coord_zoom_range, gives back the cover at zoom.
+ *
+ * When the result has more than max_coords coordinates, the cover is
+ * coarsened a zoom at a time until it fits. A coarsened cover holds
+ * the cover at zoom, and more.
+ *
+ * Coordinates are reported in increasing zoom, row, then column order.
+ * The work follows the runs along rows, so it grows with the size of
+ * the rings rather than the area.
+ *
+ * @param[in] lnglats Points of all rings, see futile_cover_polygon
+ * @param[in] ring_ends Index after the last point of each ring
+ * @param[in] n_rings Number of rings
+ * @param[in] zoom Zoom of the finest coordinates, at most FUTILE_ZORDER_MAX_ZOOM
+ * @param[in] max_coords Most coordinates to report, or 0 for no limit
+ * @param[in] for_coord Callback function for each coordinate
+ * @param[in] userdata Baton passed into callback function
+ * @return false if zoom is out of range or memory ran out
+ */
+FUTILE_DEF bool futile_cover_polygon_mixed(futile_point_s *lnglats, size_t *ring_ends, size_t n_rings, unsigned int zoom, uint64_t max_coords, futile_coord_fn for_coord, void *userdata);
+
+/**
+ * @brief Cover many bounds with coordinates
+ *
+ * futile_cover_bounds reports each coordinate that futile_for_bounds
+ * visits for any of the bounds once, as runs, see futile_cover_points.
+ * Overlapping bounds cost nothing extra, so the output grows with the
+ * area of the union rather than the sum of the areas.
+ *
+ * The bounds are projected to world coordinates once, see
+ * futile_bounds_to_world_bounds, and shifted down to each zoom. Bounds
+ * with minx above maxx or miny above maxy cover nothing.
+ *
+ * Each zoom is swept row by row, keeping how many bounds cover each
+ * column range in a tree over the columns where bounds start and end.
+ * The runs are only recomputed on rows where a bounds starts or ends,
+ * and a bounds covering the same tiles as another one is left out.
+ *
+ * @param[in] bounds Input bounds, in degrees
+ * @param[in] n Number of bounds, at most UINT32_MAX
+ * @param[in] zoom_start Starting zoom level
+ * @param[in] zoom_until Ending zoom level, inclusive, at most FUTILE_ZORDER_MAX_ZOOM
+ * @param[in] for_run Callback function for each run of coordinates
+ * @param[in] userdata Baton passed into callback function
+ * @return false if zoom_until is out of range, n is above UINT32_MAX or memory ran out
+ */
+FUTILE_DEF bool futile_cover_bounds(futile_bounds_s *bounds, size_t n, unsigned int zoom_start, unsigned int zoom_until, futile_coord_run_fn for_run, void *userdata);
+
+FUTILE_DEF bool futile_coord_is_valid(futile_coord_s *coord);
+
+/**
+ * @brief Tile set container
+ *
+ * A container holds the tiles of a tile set whose Morton codes share
+ * everything but the lowest 16 bits, which is an aligned 256x256 block
+ * of the tile grid. Depending on what is smallest, the tiles are
+ * stored as a sorted array of the low bits, a bitmap of all 65536
+ * positions, or a sorted array of runs of consecutive positions.
+ */
+typedef struct {
+    /** @brief Morton code of the block, shifted down by 16 bits */
+    uint64_t key;
+    /** @brief Number of tiles in the container */
+    uint32_t cardinality;
+    /** @brief Representation of data, internal */
+    uint32_t type;
+    /** @brief Number of array values or runs in data */
+    uint32_t n;
+    /** @brief Number of array values or runs data has room for */
+    uint32_t capacity;
+    void *data;
+} futile_tile_container_s;
+
+/**
+ * @brief Containers for one zoom of a tile set, sorted by key
+ */
+typedef struct {
+    size_t n;
+    size_t capacity;
+    futile_tile_container_s *containers;
+} futile_tile_zoom_set_s;
+
+/**
+ * @brief Compressed set of tiles
+ *
+ * futile_tile_set_s is a roaring bitmap style set of tiles, keyed by
+ * zoom and then by Morton code. Tiles that are close together share
+ * containers, so typical expiry sets take a fraction of a byte per
+ * tile, against 8 bytes for a sorted array of
+ * futile_coord_marshall_int values.
+ *
+ * A zeroed structure is an empty set, and futile_tile_set_free
+ * releases its memory. Zooms up to FUTILE_ZORDER_MAX_ZOOM are
+ * supported.
+ */
+typedef struct {
+    futile_tile_zoom_set_s zooms[FUTILE_ZORDER_MAX_ZOOM + 1];
+} futile_tile_set_s;
+
+/**
+ * @brief Initialize an empty tile set
+ *
+ * @param[out] set Set to initialize
+ */
+FUTILE_DEF void futile_tile_set_init(futile_tile_set_s *set);
+
+/**
+ * @brief Free the memory held by a tile set
+ *
+ * futile_tile_set_free releases the containers of the set, and leaves
+ * it empty.
+ *
+ * @param[in] set Set to free
+ */
+FUTILE_DEF void futile_tile_set_free(futile_tile_set_s *set);
+
+/**
+ * @brief Add a coordinate to a tile set
+ *
+ * Adding a coordinate that is already in the set does nothing.
+ *
+ * @param[in] set Set to add to
+ * @param[in] coord Coordinate to add
+ * @return false if the coordinate is not valid or memory could not be allocated
+ */
+FUTILE_DEF bool futile_tile_set_add(futile_tile_set_s *set, futile_coord_s *coord);
+
+/**
+ * @brief Check if a tile set contains a coordinate
+ *
+ * @param[in] set Set to check
+ * @param[in] coord Coordinate to look for
+ * @return true if the coordinate is in the set
+ */
+FUTILE_DEF bool futile_tile_set_contains(futile_tile_set_s *set, futile_coord_s *coord);
+
+/**
+ * @brief Number of coordinates in a tile set
+ *
+ * @param[in] set Input set
+ * @return Number of coordinates in the set, across all zooms
+ */
+FUTILE_DEF uint64_t futile_tile_set_cardinality(futile_tile_set_s *set);
+
+/**
+ * @brief Union of two tile sets
+ *
+ * futile_tile_set_union initializes out_set with every coordinate
+ * that is in either lhs or rhs. out_set must not be one of the inputs,
+ * and is freed with futile_tile_set_free. Bitmap containers are
+ * combined with the selected SIMD kernels, see futile_simd_level.
+ *
+ * @param[in] lhs Input set
+ * @param[in] rhs Input set
+ * @param[out] out_set Output set
+ * @return false if memory could not be allocated, in which case out_set is empty
+ */
+FUTILE_DEF bool futile_tile_set_union(futile_tile_set_s *lhs, futile_tile_set_s *rhs, futile_tile_set_s *out_set);
+
+/**
+ * @brief Intersection of two tile sets
+ *
+ * futile_tile_set_intersect initializes out_set with every coordinate
+ * that is in both lhs and rhs, see futile_tile_set_union.
+ *
+ * @param[in] lhs Input set
+ * @param[in] rhs Input set
+ * @param[out] out_set Output set
+ * @return false if memory could not be allocated, in which case out_set is empty
+ */
+FUTILE_DEF bool futile_tile_set_intersect(futile_tile_set_s *lhs, futile_tile_set_s *rhs, futile_tile_set_s *out_set);
+
+/**
+ * @brief Difference of two tile sets
+ *
+ * futile_tile_set_difference initializes out_set with every
+ * coordinate that is in lhs but not in rhs, see futile_tile_set_union.
+ *
+ * @param[in] lhs Input set
+ * @param[in] rhs Set of coordinates to remove
+ * @param[out] out_set Output set
+ * @return false if memory could not be allocated, in which case out_set is empty
+ */
+FUTILE_DEF bool futile_tile_set_difference(futile_tile_set_s *lhs, futile_tile_set_s *rhs, futile_tile_set_s *out_set);
+
+/**
+ * @brief Compact the containers of a tile set
+ *
+ * Containers that grow through futile_tile_set_add stay arrays until
+ * they turn into bitmaps, and only become run containers through set
+ * operations. futile_tile_set_optimize switches every container to
+ * its smallest representation, which is worth doing once a set has
+ * been filled.
+ *
+ * @param[in] set Set to compact
+ * @return false if memory could not be allocated, in which case the set is unchanged
+ */
+FUTILE_DEF bool futile_tile_set_optimize(futile_tile_set_s *set);
+
+/**
+ * @brief Memory used by a tile set
+ *
+ * @param[in] set Input set
+ * @return Number of bytes used by the set, including the structure itself
+ */
+FUTILE_DEF size_t futile_tile_set_size_bytes(futile_tile_set_s *set);
+
+/**
+ * @brief Visit the coordinates of a tile set
+ *
+ * futile_tile_set_for_each calls the given coord callback function
+ * for every coordinate in the set, zoom by zoom, in increasing
+ * futile_coord_to_zorder order.
+ *
+ * @param[in] set Input set
+ * @param[in] for_coord Callback function for each coordinate
+ * @param[in] userdata Baton passed into callback function
+ */
+FUTILE_DEF void futile_tile_set_for_each(futile_tile_set_s *set, futile_coord_fn for_coord, void *userdata);
+
+/**
+ * @brief Highest zoom level of a marshalled integer coordinate
+ */
+#define FUTILE_MARSHALL_MAX_ZOOM 29
+
+/**
+ * @brief Unique tiles at every zoom of a pyramid
+ *
+ * Zooms that have no tiles have a count of 0 and NULL ids.
+ */
+typedef struct {
+    /** @brief number of unique tiles at each zoom */
+    size_t n[FUTILE_MARSHALL_MAX_ZOOM + 1];
+    /** @brief sorted futile_coord_marshall_int ids at each zoom */
+    uint64_t *ids[FUTILE_MARSHALL_MAX_ZOOM + 1];
+} futile_rollup_s;
+
+/**
+ * @brief Roll leaf tiles up into every unique ancestor
+ *
+ * futile_rollup_ints takes marshalled leaf tiles, which can be at any
+ * zoom and contain duplicates, and computes the unique tiles at each
+ * zoom from zoom_until up to the highest leaf zoom: the leaves
+ * themselves plus all of their ancestors. Leaves below zoom_until are
+ * ignored.
+ *
+ * Each level is sorted and collapsed before its parents are computed
+ * with futile_coord_int_zoom_up, so the cost follows the number of
+ * unique tiles rather than the number of leaves times their depth.
+ * The leaves are split into chunks that are rolled up in parallel,
+ * and the chunks are then merged a zoom per thread.
+ *
+ * @param[in] ids Marshalled leaf tiles, not modified
+ * @param[in] n Number of leaf tiles
+ * @param[in] zoom_until Lowest zoom to roll up to, inclusive
+ * @param[in] n_threads Number of threads to use, 0 for one per cpu
+ * @param[out] out_rollup Unique tiles per zoom, freed with futile_rollup_free
+ * @return false if a leaf is above FUTILE_MARSHALL_MAX_ZOOM or memory could not be allocated, with errno set
+ */
+FUTILE_DEF bool futile_rollup_ints(uint64_t *ids, size_t n, unsigned int zoom_until, unsigned int n_threads, futile_rollup_s *out_rollup);
+
+/**
+ * @brief Roll leaf coordinates up into every unique ancestor
+ *
+ * futile_rollup_coords marshalls the coordinates and then works like
+ * futile_rollup_ints.
+ *
+ * @param[in] coords Leaf coordinates
+ * @param[in] n Number of leaf coordinates
+ * @param[in] zoom_until Lowest zoom to roll up to, inclusive
+ * @param[in] n_threads Number of threads to use, 0 for one per cpu
+ * @param[out] out_rollup Unique tiles per zoom, freed with futile_rollup_free
+ * @return false if a leaf is above FUTILE_MARSHALL_MAX_ZOOM or memory could not be allocated, with errno set
+ */
+FUTILE_DEF bool futile_rollup_coords(futile_coord_s *coords, size_t n, unsigned int zoom_until, unsigned int n_threads, futile_rollup_s *out_rollup);
+
+/**
+ * @brief Free the memory held by a rollup
+ *
+ * @param[in] rollup Rollup to free
+ */
+FUTILE_DEF void futile_rollup_free(futile_rollup_s *rollup);
+
+/**
+ * @brief Points bucketed by tile at one zoom
+ *
+ * Tiles are listed in increasing futile_coord_to_zorder order, so the
+ * children of a tile are next to each other at every finer zoom.
+ */
+typedef struct {
+    /** @brief zoom of the tiles */
+    unsigned int zoom;
+    /** @brief number of tiles that hold points */
+    size_t n;
+    /** @brief futile_coord_to_zorder ids of the tiles, increasing */
+    uint64_t *ids;
+    /** @brief number of points in each tile */
+    uint64_t *counts;
+    /** @brief n + 1 offsets into the point order of each tile, or NULL */
+    size_t *offsets;
+} futile_bucket_zoom_s;
+
+/**
+ * @brief Count points per tile
+ *
+ * futile_bucket_points projects the points, in degrees, to tile ids
+ * at zoom in parallel with futile_lnglat_to_coord_batch, radix sorts
+ * the ids, and collapses them into per tile counts. Besides the
+ * output, this needs 8 bytes per point for the ids, and the radix sort
+ * as much again.
+ *
+ * When out_order is given, it is filled with the point indexes grouped
+ * by tile, in id order, with the points of each tile in input order,
+ * and out_bucket->offsets gives the range of each tile in it. This is
+ * a CSR layout that futile_bucket_coarsen keeps for coarser zooms.
+ * When the tile and the point index fit in 64 bits together, as they
+ * do up to z16 for 4 billion points, they are sorted as one key, and
+ * otherwise points are placed with a lookup of their tile.
+ *
+ * @param[in] lnglats Input points
+ * @param[in] n Number of points
+ * @param[in] zoom Zoom level, at most FUTILE_ZORDER_MAX_ZOOM
+ * @param[in] n_threads Number of threads to use, 0 for one per cpu
+ * @param[out] out_order Memory for n point indexes, or NULL for counts only
+ * @param[out] out_bucket Tiles and counts, freed with futile_bucket_free
+ * @return false if zoom is out of range or memory could not be allocated, with errno set
+ */
+FUTILE_DEF bool futile_bucket_points(futile_point_s *lnglats, size_t n, unsigned int zoom, unsigned int n_threads, size_t *out_order, futile_bucket_zoom_s *out_bucket);
+
+/**
+ * @brief Sum bucketed points up to a coarser zoom
+ *
+ * futile_bucket_coarsen adds up the counts of the children of each
+ * tile instead of projecting the points again, in a single pass over
+ * the tiles of bucket. Offsets, when bucket has them, still index the
+ * same point order. Coarsening from the previous coarser result keeps
+ * each step proportional to the tiles at the zoom before.
+ *
+ * @param[in] bucket Bucketed points
+ * @param[in] zoom Zoom level, at most bucket->zoom
+ * @param[out] out_bucket Tiles and counts, freed with futile_bucket_free
+ * @return false if zoom is out of range or memory could not be allocated, with errno set
+ */
+FUTILE_DEF bool futile_bucket_coarsen(futile_bucket_zoom_s *bucket, unsigned int zoom, futile_bucket_zoom_s *out_bucket);
+
+/**
+ * @brief Free the memory held by bucketed points
+ *
+ * @param[in] bucket Bucketed points to free
+ */
+FUTILE_DEF void futile_bucket_free(futile_bucket_zoom_s *bucket);
+
+/**
+ * @brief A value held by a futile_tile_cache_s
+ *
+ * Values returned by futile_tile_cache_get stay valid until they are
+ * passed to futile_tile_cache_release, even if the cache evicts or
+ * replaces them in the meantime. Only key, size and data are meant to
+ * be read.
+ */
+typedef struct futile_tile_cache_value_s {
+    /** @brief key the value was stored under */
+    uint64_t key;
+    /** @brief number of bytes at data */
+    size_t size;
+    /** @brief the cached bytes */
+    const void *data;
+    /** @brief internal, references held by the cache and by readers */
+    uint32_t n_refs;
+    /** @brief internal, set on access and cleared by the CLOCK hand */
+    bool is_referenced;
+    /** @brief internal, link in the list of values waiting to be freed */
+    struct futile_tile_cache_value_s *next_retired;
+} futile_tile_cache_value_s;
+
+/**
+ * @brief One shard of a futile_tile_cache_s, internal
+ */
+struct futile_tile_cache_shard_s;
+
+/**
+ * @brief Concurrent cache of tile data keyed by marshalled coordinates
+ *
+ * futile_tile_cache_s maps 64 bit keys, typically from
+ * futile_coord_marshall_int, to copies of tile data. Keys are spread
+ * over shards, each an open addressing table with its own byte budget
+ * and CLOCK eviction.
+ *
+ * Reads take no locks: a lookup registers with the shard's current
+ * epoch, probes the table and takes a reference on the value.
+ * Writers serialize on a per shard mutex. Evicted and replaced values
+ * are freed by a later write to the shard, once every reader that
+ * could have seen them has left.
+ */
+typedef struct {
+    /** @brief shards, internal */
+    struct futile_tile_cache_shard_s *shards;
+    /** @brief number of shards, a power of 2 */
+    unsigned int n_shards;
+    /** @brief byte budget of each shard */
+    size_t shard_max_bytes;
+} futile_tile_cache_s;
+
+/**
+ * @brief Counters summed over the shards of a futile_tile_cache_s
+ */
+typedef struct {
+    /** @brief number of values in the cache */
+    uint64_t n_values;
+    /** @brief bytes charged against the budget, data plus overhead */
+    uint64_t n_bytes;
+    /** @brief values evicted to stay within the budget */
+    uint64_t n_evictions;
+} futile_tile_cache_stats_s;
+
+/**
+ * @brief Initialize an empty tile cache
+ *
+ * The budget is split evenly between the shards, and every value is
+ * charged its size plus a fixed overhead.
+ *
+ * @param[out] cache Cache to initialize, freed with futile_tile_cache_free
+ * @param[in] max_bytes Total byte budget
+ * @param[in] n_shards Number of shards, rounded up to a power of 2, 0 for 4 per cpu
+ * @return false if max_bytes is 0 or memory could not be allocated, with errno set
+ */
+FUTILE_DEF bool futile_tile_cache_init(futile_tile_cache_s *cache, size_t max_bytes, unsigned int n_shards);
+
+/**
+ * @brief Free a tile cache and every value in it
+ *
+ * No other thread may use the cache, and every value returned by
+ * futile_tile_cache_get must have been released.
+ *
+ * @param[in] cache Cache to free
+ */
+FUTILE_DEF void futile_tile_cache_free(futile_tile_cache_s *cache);
+
+/**
+ * @brief Store a copy of tile data in the cache
+ *
+ * futile_tile_cache_put replaces any value stored under key, and then
+ * evicts values from the shard until it is within budget again.
+ *
+ * @param[in] cache Cache
+ * @param[in] key Key, typically from futile_coord_marshall_int
+ * @param[in] data Bytes to copy
+ * @param[in] size Number of bytes
+ * @return false if the value is larger than a shard's budget or memory could not be allocated, with errno set
+ */
+FUTILE_DEF bool futile_tile_cache_put(futile_tile_cache_s *cache, uint64_t key, const void *data, size_t size);
+
+/**
+ * @brief Look up tile data in the cache
+ *
+ * futile_tile_cache_get takes no locks and may run concurrently with
+ * any other cache function except futile_tile_cache_free.
+ *
+ * @param[in] cache Cache
+ * @param[in] key Key to look up
+ * @return The value, to pass to futile_tile_cache_release, or NULL if the key is not cached
+ */
+FUTILE_DEF futile_tile_cache_value_s *futile_tile_cache_get(futile_tile_cache_s *cache, uint64_t key);
+
+/**
+ * @brief Release a value returned by futile_tile_cache_get
+ *
+ * @param[in] value Value to release
+ */
+FUTILE_DEF void futile_tile_cache_release(futile_tile_cache_value_s *value);
+
+/**
+ * @brief Remove a key from the cache
+ *
+ * @param[in] cache Cache
+ * @param[in] key Key to remove
+ * @return Whether the key was cached
+ */
+FUTILE_DEF bool futile_tile_cache_remove(futile_tile_cache_s *cache, uint64_t key);
+
+/**
+ * @brief Sum the counters of every shard
+ *
+ * @param[in] cache Cache
+ * @param[out] out_stats Counters
+ */
+FUTILE_DEF void futile_tile_cache_stats(futile_tile_cache_s *cache, futile_tile_cache_stats_s *out_stats);
+
+/**
+ * @brief Per thread registration counters of a futile_dedup_set_s, internal
+ */
+struct futile_dedup_stripe_s;
+
+/**
+ * @brief Concurrent insert only set of 64 bit tile ids
+ *
+ * futile_dedup_set_s collects unique ids, typically from
+ * futile_coord_marshall_int, from many producer threads. Producers
+ * insert without locks: an id already present costs a probe of a
+ * shared table, and a new id one compare and swap. A consumer calls
+ * futile_dedup_set_drain to swap in an empty table for the next
+ * epoch and take the unique ids of the current one. Producers never
+ * wait for a drain.
+ *
+ * Each epoch holds about capacity ids. The table has twice as many
+ * slots, so probes stay short until it fills.
+ */
+typedef struct {
+    /** @brief slots of the tables of even and odd epochs, id + 1 or 0, internal */
+    uint64_t *tables[2];
+    /** @brief number of slots per table minus 1, internal */
+    size_t mask;
+    /** @brief current epoch, internal */
+    uint64_t epoch;
+    /** @brief producer registration counters, internal */
+    struct futile_dedup_stripe_s *stripes;
+    /** @brief ids in the tables of even and odd epochs, when counted against a limit, internal */
+    uint64_t n_limited[2];
+} futile_dedup_set_s;
+
+/**
+ * @brief Initialize an empty dedup set
+ *
+ * @param[out] set Set to initialize, freed with futile_dedup_set_free
+ * @param[in] capacity Number of unique ids an epoch should hold
+ * @return false if memory could not be allocated, with errno set
+ */
+FUTILE_DEF bool futile_dedup_set_init(futile_dedup_set_s *set, size_t capacity);
+
+/**
+ * @brief Free a dedup set
+ *
+ * @param[in] set Set to free, with no producer or consumer running
+ */
+FUTILE_DEF void futile_dedup_set_free(futile_dedup_set_s *set);
+
+/**
+ * @brief Number of ids futile_dedup_set_drain can return at most
+ *
+ * @param[in] set Set
+ * @return Number of slots in a table
+ */
+FUTILE_DEF size_t futile_dedup_set_slots(futile_dedup_set_s *set);
+
+/**
+ * @brief Add a tile id to the current epoch
+ *
+ * Safe to call from any number of threads, concurrently with
+ * futile_dedup_set_drain.
+ *
+ * @param[in] set Set
+ * @param[in] id Id to add
+ * @return false if the epoch is full or id is UINT64_MAX, with errno set to ENOSPC or EINVAL
+ */
+FUTILE_DEF bool futile_dedup_set_add(futile_dedup_set_s *set, uint64_t id);
+
+/**
+ * @brief Add many tile ids to the current epoch
+ *
+ * futile_dedup_set_add for an array. The batch registers with the
+ * epoch once, so this is the faster way to feed bursts of ids. All of
+ * them land in the same epoch.
+ *
+ * @param[in] set Set
+ * @param[in] ids Ids to add
+ * @param[in] n Number of ids
+ * @return Number of ids added before the epoch filled up or an id was UINT64_MAX, n on success, errno is ENOSPC or EINVAL otherwise
+ */
+FUTILE_DEF size_t futile_dedup_set_add_many(futile_dedup_set_s *set, uint64_t *ids, size_t n);
+
+/**
+ * @brief Take the unique ids of the current epoch
+ *
+ * futile_dedup_set_drain starts a new epoch, waits for producers still
+ * adding to the old one, and then moves its ids out, in no particular
+ * order. An id added during the drain lands in the new epoch. Only one
+ * drain may run at a time.
+ *
+ * @param[in] set Set
+ * @param[out] out_ids Unique ids, space for futile_dedup_set_slots ids
+ * @return Number of ids written
+ */
+FUTILE_DEF size_t futile_dedup_set_drain(futile_dedup_set_s *set, uint64_t *out_ids);
+
+/**
+ * @brief Settings of a futile_expiry_pipeline_s
+ */
+typedef struct {
+    /** @brief time from the first change of a window until it is emitted */
+    uint64_t window_ns;
+    /** @brief unique leaf tiles a window can hold before ingest pushes back, repeats of a pending tile are free */
+    size_t max_pending;
+    /** @brief emitted batches not yet released before emitting pauses, 0 for 1 */
+    unsigned int max_batches;
+    /** @brief lowest zoom to propagate changes up to, inclusive */
+    unsigned int zoom_until;
+    /** @brief threads used to roll a window up, 0 for one per cpu */
+    unsigned int n_threads;
+} futile_expiry_options_s;
+
+/**
+ * @brief Tiles to re-render for one debounce window
+ *
+ * Owned by the consumer until futile_expiry_batch_release. The id
+ * arrays are handed over as built, without copying.
+ */
+typedef struct {
+    /** @brief sorted unique futile_coord_marshall_int ids per zoom, the changed leaves and their ancestors */
+    futile_rollup_s tiles;
+    /** @brief number of unique changed leaves */
+    size_t n_leaves;
+    /** @brief time of the first change in the window */
+    uint64_t window_start_ns;
+    /** @brief time the batch was emitted */
+    uint64_t emitted_ns;
+} futile_expiry_batch_s;
+
+/**
+ * @brief Debounced expiry from changed tiles to per zoom work lists
+ *
+ * futile_expiry_pipeline_s takes changed tiles from any number of
+ * producer threads and deduplicates them in a futile_dedup_set_s, so
+ * ingesting takes no locks. A window opens with the first change after
+ * the previous emit. Once it is window_ns old, futile_expiry_poll rolls
+ * its unique leaves up to every ancestor down to zoom_until and emits
+ * them as a futile_expiry_batch_s.
+ *
+ * Memory is bounded by max_pending ids per window and max_batches
+ * outstanding batches. When the consumer holds max_batches, emitting
+ * pauses and changes keep collecting in the open window. Once a window
+ * holds max_pending unique leaves, futile_expiry_ingest pushes back new
+ * ones with EAGAIN, while repeats of pending leaves still go in.
+ *
+ * Time is passed in by the caller, in any monotonic nanosecond clock,
+ * so the pipeline runs no threads of its own. A time before the window
+ * opened, as read on another thread just before it, finds the window
+ * not yet due.
+ */
+typedef struct {
+    /** @brief unique changed leaves of the open window, internal */
+    futile_dedup_set_s pending;
+    /** @brief leaves drained from pending, waiting for a rollup, internal */
+    uint64_t *drained;
+    /** @brief number of drained leaves, internal */
+    size_t n_drained;
+    /** @brief start of the open window, UINT64_MAX when closed, internal */
+    uint64_t window_start_ns;
+    /** @brief start of the window the drained leaves came from, internal */
+    uint64_t drained_start_ns;
+    /** @brief emitted batches not yet released, internal */
+    unsigned int n_batches;
+    /** @brief settings */
+    futile_expiry_options_s options;
+} futile_expiry_pipeline_s;
+
+/**
+ * @brief Initialize an expiry pipeline
+ *
+ * @param[out] pipeline Pipeline to initialize, freed with futile_expiry_pipeline_free
+ * @param[in] options Settings, copied
+ * @return false if max_pending is 0, zoom_until is above FUTILE_MARSHALL_MAX_ZOOM or memory could not be allocated, with errno set
+ */
+FUTILE_DEF bool futile_expiry_pipeline_init(futile_expiry_pipeline_s *pipeline, futile_expiry_options_s *options);
+
+/**
+ * @brief Free an expiry pipeline
+ *
+ * Batches that were emitted and not released stay valid, and are
+ * freed with futile_rollup_free and free instead.
+ *
+ * @param[in] pipeline Pipeline to free, with no producer or consumer running
+ */
+FUTILE_DEF void futile_expiry_pipeline_free(futile_expiry_pipeline_s *pipeline);
+
+/**
+ * @brief Add changed tiles to the open window
+ *
+ * Safe to call from any number of threads, concurrently with
+ * futile_expiry_poll.
+ *
+ * @param[in] pipeline Pipeline
+ * @param[in] ids Changed tiles, from futile_coord_marshall_int
+ * @param[in] n Number of ids
+ * @param[in] now_ns Current time
+ * @return Number of ids taken, n on success. Otherwise errno is EAGAIN if the window is full, or EINVAL for an id above FUTILE_MARSHALL_MAX_ZOOM.
+ */
+FUTILE_DEF size_t futile_expiry_ingest(futile_expiry_pipeline_s *pipeline, uint64_t *ids, size_t n, uint64_t now_ns);
+
+/**
+ * @brief Emit the open window if it is due
+ *
+ * Only one thread may poll at a time. out_batch is set to NULL if no
+ * window is due, or if max_batches are outstanding.
+ *
+ * @param[in] pipeline Pipeline
+ * @param[in] now_ns Current time
+ * @param[out] out_batch Emitted batch, released with futile_expiry_batch_release, or NULL
+ * @return false if memory could not be allocated, with errno set. The window is kept for the next poll.
+ */
+FUTILE_DEF bool futile_expiry_poll(futile_expiry_pipeline_s *pipeline, uint64_t now_ns, futile_expiry_batch_s **out_batch);
+
+/**
+ * @brief Emit the open window now
+ *
+ * futile_expiry_flush is futile_expiry_poll without waiting for the
+ * window to be due, for shutting down. It still respects max_batches.
+ *
+ * @param[in] pipeline Pipeline
+ * @param[in] now_ns Current time
+ * @param[out] out_batch Emitted batch, released with futile_expiry_batch_release, or NULL
+ * @return false if memory could not be allocated, with errno set
+ */
+FUTILE_DEF bool futile_expiry_flush(futile_expiry_pipeline_s *pipeline, uint64_t now_ns, futile_expiry_batch_s **out_batch);
+
+/**
+ * @brief Hand a batch back to the pipeline
+ *
+ * May be called from any thread.
+ *
+ * @param[in] pipeline Pipeline that emitted the batch
+ * @param[in] batch Batch to free
+ */
+FUTILE_DEF void futile_expiry_batch_release(futile_expiry_pipeline_s *pipeline, futile_expiry_batch_s *batch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef FUTILE_IMPLEMENTATION
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if !defined(FUTILE_NO_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FUTILE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+#ifdef FUTILE_X86_SIMD
+#define FUTILE_TARGET_AVX2 __attribute__((target("avx2")))
+#define FUTILE_TARGET_SSE4 __attribute__((target("sse4.1")))
+// PDEP and PEXT only exist for 64 bit operands in 64 bit mode
+#ifdef __x86_64__
+#define FUTILE_BMI2 1
+#include <cpuid.h>
+#define FUTILE_TARGET_BMI2 __attribute__((target("bmi2")))
+#endif
+#endif
+
+// read and written atomically, since kernels running on worker
+// threads may be the first to ask for it
+static int simd_level_selected = -1;
+
+FUTILE_DEF futile_simd_e futile_simd_detect(void) {
+#ifdef FUTILE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return FUTILE_SIMD_AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        return FUTILE_SIMD_SSE4;
+    }
+#endif
+    return FUTILE_SIMD_SCALAR;
+}
+
+FUTILE_DEF futile_simd_e futile_simd_level(void) {
+    int level = __atomic_load_n(&simd_level_selected, __ATOMIC_RELAXED);
+    if (level < 0) {
+        // every thread detects the same level, so racing stores agree
+        level = futile_simd_detect();
+        __atomic_store_n(&simd_level_selected, level, __ATOMIC_RELAXED);
+    }
+    return level;
+}
+
+FUTILE_DEF futile_simd_e futile_simd_set_level(futile_simd_e level) {
+    futile_simd_e detected = futile_simd_detect();
+    level = level > detected ? detected : level;
+    __atomic_store_n(&simd_level_selected, (int)level, __ATOMIC_RELAXED);
+    return level;
+}
+
+FUTILE_DEF void futile_coord_zoom(int delta, futile_coord_s *out) {
+    out->x *= pow(2, delta);
+    out->y *= pow(2, delta);
+    out->z += delta;
+}
+
+FUTILE_DEF bool futile_coord_parent(futile_coord_s *coord, futile_coord_s *out_coord) {
+    if (coord->z <= 0) {
+        return false;
+    }
+    if (out_coord != coord) {
+        *out_coord = *coord;
+    }
+    out_coord->z -= 1;
+    out_coord->x >>= 1;
+    out_coord->y >>= 1;
+    return true;
+}
+
+FUTILE_DEF void futile_coord_children(futile_coord_s *coord, futile_coord_s *out_children) {
+    futile_coord_s *first_child = &out_children[0];
+    *first_child = *coord;
+    first_child->z++;
+    first_child->x <<= 1;
+    first_child->y <<= 1;
+
+    out_children[1] = *first_child;
+    out_children[1].x++;
+
+    out_children[2] = *first_child;
+    out_children[2].y++;
+
+    out_children[3] = *first_child;
+    out_children[3].x++;
+    out_children[3].y++;
+}
+
+FUTILE_DEF bool futile_coord_is_valid(futile_coord_s *coord) {
+    bool result = false;
+    int max_row_col = pow(2, coord->z);
+    if (coord->x < max_row_col && coord->y < max_row_col) {
+        result = true;
+    }
+    return result;
+}
+
+FUTILE_DEF bool futile_coord_serialize(futile_coord_s *coord, ssize_t n_out, char *out) {
+    if (n_out <= 0) {
+        return false;
+    }
+    // leave room for the \0
+    size_t n = futile_coord_format(coord, out, n_out - 1);
+    if (n == 0) {
+        return false;
+    }
+    out[n] = '\0';
+    return true;
+}
+
+FUTILE_DEF bool futile_coord_deserialize(char *coord_str, futile_coord_s *out) {
+    return futile_coord_parse(coord_str, strlen(coord_str), out) != 0;
+}
+
+FUTILE_DEF void futile_coord_print(futile_coord_s *coord, FILE *out) {
+    char str[FUTILE_COORD_STR_MAX];
+    size_t n = futile_coord_format(coord, str, sizeof(str));
+    fwrite(str, 1, n, out);
+}
+
+FUTILE_DEF void futile_coord_println(futile_coord_s *coord, FILE *out) {
+    futile_coord_print(coord, out);
+    fputc('\n', out);
+}
+
+static bool is_scanf_space(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+// Parses one field the way sscanf's "%10d" does: whitespace is
+// skipped, then at most 10 characters of sign and digits are read.
+static bool parse_coord_field(const char **p, const char *end, uint32_t *out) {
+    const char *s = *p;
+    while (s < end && is_scanf_space(*s)) {
+        s++;
+    }
+    const char *limit = end - s > 10 ? s + 10 : end;
+    bool negative = false;
+    if (s < limit && (*s == '+' || *s == '-')) {
+        negative = *s == '-';
+        s++;
+    }
+    const char *digits = s;
+    uint64_t value = 0;
+    while (s < limit && *s >= '0' && *s <= '9') {
+        value = value * 10 + (*s - '0');
+        s++;
+    }
+    // "-0" is fine, as it is for sscanf, but values that overflow an
+    // int are not
+    if (s == digits || value > INT32_MAX || (negative && value != 0)) {
+        return false;
+    }
+    *out = value;
+    *p = s;
+    return true;
+}
+
+// Same as futile_coord_is_valid for any values that fit an int. From
+// zoom 31 on every such column and row is valid.
+static bool is_parsed_coord_valid(uint32_t x, uint32_t y, uint32_t z) {
+    if (z >= 31) {
+        return true;
+    }
+    return x < (1U << z) && y < (1U << z);
+}
+
+FUTILE_DEF size_t futile_coord_parse(const char *str, size_t n_str, futile_coord_s *out_coord) {
+    const char *p = str;
+    const char *end = str + n_str;
+    uint32_t x, y, z;
+    if (!parse_coord_field(&p, end, &z) || p == end || *p++ != '/' ||
+        !parse_coord_field(&p, end, &x) || p == end || *p++ != '/' ||
+        !parse_coord_field(&p, end, &y)) {
+        return 0;
+    }
+    if (!is_parsed_coord_valid(x, y, z)) {
+        return 0;
+    }
+    out_coord->x = x;
+    out_coord->y = y;
+    out_coord->z = z;
+    return p - str;
+}
+
+typedef bool (*parse_line_fn)(const char *line, size_t n_line, futile_coord_s *out_coord);
+
+// Splits buf into lines and parses one coordinate from each, shared
+// by the text formats that hold a coordinate per line
+static size_t parse_lines(const char *buf, size_t n_buf, parse_line_fn parse_line, futile_coord_group_s *group, futile_parse_error_fn on_error, void *userdata) {
+    size_t n_coords = 0;
+    size_t offset = 0;
+    while (offset < n_buf && n_coords < group->n) {
+        const char *line = buf + offset;
+        const char *newline = memchr(line, '\n', n_buf - offset);
+        size_t n_line = newline ? (size_t)(newline - line) : n_buf - offset;
+        if (parse_line(line, n_line, &group->coords[n_coords])) {
+            n_coords++;
+        } else if (on_error) {
+            on_error(offset, userdata);
+        }
+        offset += newline ? n_line + 1 : n_line;
+    }
+    group->n = n_coords;
+    return offset;
+}
+
+static bool parse_coord_line(const char *line, size_t n_line, futile_coord_s *out_coord) {
+    return futile_coord_parse(line, n_line, out_coord) != 0;
+}
+
+FUTILE_DEF size_t futile_coord_parse_lines(const char *buf, size_t n_buf, futile_coord_group_s *group, futile_parse_error_fn on_error, void *userdata) {
+    return parse_lines(buf, n_buf, parse_coord_line, group, on_error, userdata);
+}
+
+static const char digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static size_t n_decimal_digits(uint32_t value) {
+    size_t n = 1;
+    while (value >= 10) {
+        value /= 10;
+        n++;
+    }
+    return n;
+}
+
+// Writes value as exactly n digits, filling from the end two at a time
+static void format_decimal(uint32_t value, char *out, size_t n) {
+    char *p = out + n;
+    while (value >= 100) {
+        const char *pair = &digit_pairs[(value % 100) * 2];
+        value /= 100;
+        *--p = pair[1];
+        *--p = pair[0];
+    }
+    if (value >= 10) {
+        const char *pair = &digit_pairs[value * 2];
+        *--p = pair[1];
+        *--p = pair[0];
+    } else {
+        *--p = '0' + value;
+    }
+}
+
+FUTILE_DEF size_t futile_coord_format(futile_coord_s *coord, char *out, size_t n_out) {
+    size_t n_z = n_decimal_digits(coord->z);
+    size_t n_x = n_decimal_digits(coord->x);
+    size_t n_y = n_decimal_digits(coord->y);
+    size_t n = n_z + n_x + n_y + 2;
+    if (n > n_out) {
+        return 0;
+    }
+    format_decimal(coord->z, out, n_z);
+    out[n_z] = '/';
+    format_decimal(coord->x, out + n_z + 1, n_x);
+    out[n_z + n_x + 1] = '/';
+    format_decimal(coord->y, out + n_z + n_x + 2, n_y);
+    return n;
+}
+
+FUTILE_DEF size_t futile_coord_format_lines(futile_coord_s *coords, size_t n, char *out, size_t n_out, size_t *out_n_formatted) {
+    size_t offset = 0;
+    size_t i = 0;
+    for (; i < n; i++) {
+        // leave room for the newline
+        size_t n_line = offset < n_out ? futile_coord_format(&coords[i], out + offset, n_out - offset - 1) : 0;
+        if (n_line == 0) {
+            break;
+        }
+        offset += n_line;
+        out[offset++] = '\n';
+    }
+    if (out_n_formatted) {
+        *out_n_formatted = i;
+    }
+    return offset;
+}
+
+static unsigned int default_n_threads(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? n : 1;
+}
+
+typedef void (*parallel_task_fn)(size_t index, void *userdata);
+
+typedef struct {
+    size_t n_tasks;
+    size_t next_task;
+    parallel_task_fn task;
+    void *userdata;
+} parallel_for_s;
+
+static void *parallel_for_worker(void *arg) {
+    parallel_for_s *pf = arg;
+    size_t index;
+    while ((index = __atomic_fetch_add(&pf->next_task, 1, __ATOMIC_RELAXED)) < pf->n_tasks) {
+        pf->task(index, pf->userdata);
+    }
+    return NULL;
+}
+
+// Run task for every index below n_tasks on up to n_threads threads.
+// As with the tile list reader, the calling thread is the first
+// worker, and if creating more threads fails, the ones that exist
+// pick up the rest.
+static void parallel_for(unsigned int n_threads, size_t n_tasks, parallel_task_fn task, void *userdata) {
+    parallel_for_s pf = {.n_tasks=n_tasks, .task=task, .userdata=userdata};
+    if (n_threads > n_tasks) {
+        n_threads = n_tasks;
+    }
+    pthread_t *threads = n_threads > 1 ? malloc(sizeof(pthread_t) * n_threads) : NULL;
+    unsigned int n_started = 1;
+    if (threads) {
+        for (; n_started < n_threads; n_started++) {
+            if (pthread_create(&threads[n_started], NULL, parallel_for_worker, &pf) != 0) {
+                break;
+            }
+        }
+    }
+    parallel_for_worker(&pf);
+    for (unsigned int i = 1; i < n_started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+}
+
+static const size_t default_tile_list_chunk_size = 4 << 20;
+static const size_t default_tile_list_batch_size = 1 << 16;
+
+typedef struct {
+    const char *data;
+    size_t size;
+    futile_tile_list_options_s *options;
+    size_t chunk_size;
+    size_t batch_size;
+    size_t n_chunks;
+    size_t next_chunk;
+} tile_list_reader_s;
+
+typedef struct {
+    tile_list_reader_s *reader;
+    futile_coord_s *coords;
+    uint64_t *ids;
+    // file offset of the buffer currently being parsed
+    size_t base_offset;
+} tile_list_worker_s;
+
+// Chunks start at the first line that begins at or after their
+// nominal offset, so that they can be found independently
+static size_t tile_list_chunk_start(tile_list_reader_s *reader, size_t index) {
+    if (index == 0) {
+        return 0;
+    }
+    size_t nominal = index * reader->chunk_size;
+    if (nominal >= reader->size) {
+        return reader->size;
+    }
+    const char *newline = memchr(reader->data + nominal - 1, '\n', reader->size - nominal + 1);
+    return newline ? (size_t)(newline - reader->data) + 1 : reader->size;
+}
+
+static void tile_list_on_error(size_t offset, void *userdata) {
+    tile_list_worker_s *worker = userdata;
+    futile_tile_list_options_s *options = worker->reader->options;
+    options->on_error(worker->base_offset + offset, options->userdata);
+}
+
+static void *tile_list_worker(void *arg) {
+    tile_list_worker_s *worker = arg;
+    tile_list_reader_s *reader = worker->reader;
+    futile_tile_list_options_s *options = reader->options;
+    size_t index;
+    while ((index = __atomic_fetch_add(&reader->next_chunk, 1, __ATOMIC_RELAXED)) < reader->n_chunks) {
+        size_t start = tile_list_chunk_start(reader, index);
+        size_t end = tile_list_chunk_start(reader, index + 1);
+        do {
+            futile_coord_group_s group = {.n=reader->batch_size, .coords=worker->coords};
+            worker->base_offset = start;
+            size_t consumed = futile_coord_parse_lines(reader->data + start, end - start, &group,
+                                                       options->on_error ? tile_list_on_error : NULL, worker);
+            futile_tile_list_chunk_s chunk = {
+                .index=index,
+                .offset=start,
+                .last=start + consumed >= end,
+                .n=group.n,
+                .coords=worker->coords
+            };
+            if (options->marshall) {
+                for (size_t i = 0; i < group.n; i++) {
+                    worker->ids[i] = futile_coord_marshall_int(&worker->coords[i]);
+                }
+                chunk.coords = NULL;
+                chunk.ids = worker->ids;
+            }
+            options->on_chunk(&chunk, options->userdata);
+            start += consumed;
+        } while (start < end);
+    }
+    return NULL;
+}
+
+FUTILE_DEF bool futile_read_tile_list(const char *path, futile_tile_list_options_s *options) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return true;
+    }
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    tile_list_reader_s reader = {
+        .data=data,
+        .size=st.st_size,
+        .options=options,
+        .chunk_size=options->chunk_size ? options->chunk_size : default_tile_list_chunk_size,
+        .batch_size=options->batch_size ? options->batch_size : default_tile_list_batch_size
+    };
+    reader.n_chunks = (reader.size + reader.chunk_size - 1) / reader.chunk_size;
+    unsigned int n_threads = options->n_threads ? options->n_threads : default_n_threads();
+    if (n_threads > reader.n_chunks) {
+        n_threads = reader.n_chunks;
+    }
+
+    bool result = false;
+    tile_list_worker_s *workers = calloc(n_threads, sizeof(tile_list_worker_s));
+    pthread_t *threads = calloc(n_threads, sizeof(pthread_t));
+    if (!workers || !threads) {
+        goto done;
+    }
+    for (unsigned int i = 0; i < n_threads; i++) {
+        workers[i].reader = &reader;
+        workers[i].coords = malloc(sizeof(futile_coord_s) * reader.batch_size);
+        workers[i].ids = options->marshall ? malloc(sizeof(uint64_t) * reader.batch_size) : NULL;
+        if (!workers[i].coords || (options->marshall && !workers[i].ids)) {
+            goto done;
+        }
+    }
+    // the calling thread is the first worker, and if creating more
+    // threads fails, the ones that exist pick up the rest
+    unsigned int n_started = 1;
+    for (; n_started < n_threads; n_started++) {
+        if (pthread_create(&threads[n_started], NULL, tile_list_worker, &workers[n_started]) != 0) {
+            break;
+        }
+    }
+    tile_list_worker(&workers[0]);
+    for (unsigned int i = 1; i < n_started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    result = true;
+
+done:
+    if (workers) {
+        for (unsigned int i = 0; i < n_threads; i++) {
+            free(workers[i].coords);
+            free(workers[i].ids);
+        }
+    }
+    free(workers);
+    free(threads);
+    munmap(data, reader.size);
+    if (!result) {
+        errno = ENOMEM;
+    }
+    return result;
+}
+
+FUTILE_DEF int futile_coord_cmp(futile_coord_s *lhs, futile_coord_s *rhs) {
+    if (lhs->z < rhs->z) return -1;
+    if (lhs->z > rhs->z) return 1;
+    if (lhs->x < rhs->x) return -1;
+    if (lhs->x > rhs->x) return 1;
+    if (lhs->y < rhs->y) return -1;
+    if (lhs->y > rhs->y) return 1;
+    return 0;
+}
+
+FUTILE_DEF bool futile_coord_equal(futile_coord_s *lhs, futile_coord_s *rhs) {
+    return futile_coord_cmp(lhs, rhs) == 0;
+}
+
+// This is how the data is encoded into a 64 bit integer:
+// 1 bit unused | 29 bits column | 29 bits row | 5 bits zoom
+
+static const unsigned int zoom_mask = 31;       // 2^5 - 1
+static const unsigned int row_mask = 536870911; // 2^29 - 1
+static const unsigned int col_mask = 536870911; // 2^29 - 1
+static const unsigned int row_offset = 5;       // zoom bits
+static const unsigned int col_offset = 5 + 29;  // zoom bits + row bits
+
+// the high row mask is all 1 bits except for the highest row bit
+static const uint64_t high_row_mask = 18446744065119617023ULL;
+// all 1 bits except for all zoom bits
+static const uint64_t all_but_zoom_mask = 18446744073709551584ULL;
+
+FUTILE_DEF uint64_t futile_coord_marshall_int(futile_coord_s *coord) {
+    uint64_t x = coord->x;
+    uint64_t y = coord->y;
+    uint64_t z = coord->z;
+    return z | (y << row_offset) | (x << col_offset);
+}
+
+FUTILE_DEF void futile_coord_unmarshall_int(uint64_t val, futile_coord_s *out_coord) {
+    out_coord->z = zoom_mask & val;
+    out_coord->y = row_mask  & (val >> row_offset);
+    out_coord->x = col_mask  & (val >> col_offset);
+}
+
+FUTILE_DEF uint64_t futile_coord_int_zoom_up(uint64_t val) {
+    // First we'll update the row/col values both simultaneously by
+    // shifting all bits to the right in an attempt to divide both by
+    // 2. This is *almost* correct; we just need to account for the
+    // fact that the lowest bit of the column value can "leak" into the
+    // high bit of the row, which we do by zero'ing out just that bit
+    // via the high_row_mask.
+    uint64_t coord_int_shifted = (val >> 1) & high_row_mask;
+
+    int zoom = zoom_mask & val;
+    // Given that the row/col bits are now set correctly, all that
+    // remains is to update the zoom bits. This is done by applying a
+    // mask to zero out all the zoom bits, and then or'ing the new
+    // parent zoom bits into place
+    uint64_t parent_coord_int = (coord_int_shifted & all_but_zoom_mask) | (zoom - 1);
+    return parent_coord_int;
+}
+
+// Spread the 32 bits of v out to the even bits of a 64 bit integer
+static uint64_t spread_bits(uint32_t v) {
+    uint64_t x = v;
+    x = (x | (x << 16)) & 0x0000FFFF0000FFFFULL;
+    x = (x | (x << 8)) & 0x00FF00FF00FF00FFULL;
+    x = (x | (x << 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    x = (x | (x << 2)) & 0x3333333333333333ULL;
+    x = (x | (x << 1)) & 0x5555555555555555ULL;
+    return x;
+}
+
+// Gather the even bits of x back into 32 bits
+static uint32_t compact_bits(uint64_t x) {
+    x &= 0x5555555555555555ULL;
+    x = (x | (x >> 1)) & 0x3333333333333333ULL;
+    x = (x | (x >> 2)) & 0x0F0F0F0F0F0F0F0FULL;
+    x = (x | (x >> 4)) & 0x00FF00FF00FF00FFULL;
+    x = (x | (x >> 8)) & 0x0000FFFF0000FFFFULL;
+    x = (x | (x >> 16)) & 0x00000000FFFFFFFFULL;
+    return x;
+}
+
+FUTILE_DEF uint64_t futile_morton_encode(uint32_t x, uint32_t y) {
+    return spread_bits(x) | (spread_bits(y) << 1);
+}
+
+FUTILE_DEF void futile_morton_decode(uint64_t code, uint32_t *out_x, uint32_t *out_y) {
+    *out_x = compact_bits(code);
+    *out_y = compact_bits(code >> 1);
+}
+
+#ifdef FUTILE_BMI2
+
+// PDEP and PEXT are microcoded on AMD before Zen 3, family 0x19, and
+// take hundreds of cycles there, far slower than shifting and masking.
+// Those cpus report AVX2 as well, so the vendor and family are checked.
+static bool cpu_has_slow_bmi2(void) {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(0, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    // "AuthenticAMD", and "HygonGenuine" for the Zen 1 based Hygon cpus
+    bool is_amd = (ebx == 0x68747541 && edx == 0x69746e65 && ecx == 0x444d4163) ||
+                  (ebx == 0x6f677948 && edx == 0x6e65476e && ecx == 0x656e6975);
+    if (!is_amd || !__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    unsigned int family = (eax >> 8) & 0xf;
+    if (family == 0xf) {
+        family += (eax >> 20) & 0xff;
+    }
+    return family < 0x19;
+}
+
+static bool cpu_has_fast_bmi2(void) {
+    static int has_fast_bmi2 = -1;
+    int has = __atomic_load_n(&has_fast_bmi2, __ATOMIC_RELAXED);
+    if (has < 0) {
+        __builtin_cpu_init();
+        has = __builtin_cpu_supports("bmi2") && !cpu_has_slow_bmi2();
+        __atomic_store_n(&has_fast_bmi2, has, __ATOMIC_RELAXED);
+    }
+    return has;
+}
+
+// every BMI2 cpu has AVX2, so the level only matters when
+// futile_simd_set_level turns the vector kernels off, which turns
+// PDEP and PEXT off with them
+static bool use_bmi2(void) {
+    return futile_simd_level() >= FUTILE_SIMD_AVX2 && cpu_has_fast_bmi2();
+}
+
+FUTILE_TARGET_BMI2
+static void morton_encode_bmi2(futile_coord_s *coords, size_t n, uint64_t *out_codes) {
+    for (size_t i = 0; i < n; i++) {
+        out_codes[i] = _pdep_u64(coords[i].x, 0x5555555555555555ULL) |
+                       _pdep_u64(coords[i].y, 0xAAAAAAAAAAAAAAAAULL);
+    }
+}
+
+FUTILE_TARGET_BMI2
+static void morton_decode_bmi2(uint64_t *codes, size_t n, uint32_t zoom, futile_coord_s *out_coords) {
+    for (size_t i = 0; i < n; i++) {
+        out_coords[i].x = _pext_u64(codes[i], 0x5555555555555555ULL);
+        out_coords[i].y = _pext_u64(codes[i], 0xAAAAAAAAAAAAAAAAULL);
+        out_coords[i].z = zoom;
+    }
+}
+
+#endif
+
+FUTILE_DEF void futile_morton_encode_batch(futile_coord_s *coords, size_t n, uint64_t *out_codes) {
+#ifdef FUTILE_BMI2
+    if (use_bmi2()) {
+        morton_encode_bmi2(coords, n, out_codes);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < n; i++) {
+        out_codes[i] = futile_morton_encode(coords[i].x, coords[i].y);
+    }
+}
+
+FUTILE_DEF void futile_morton_decode_batch(uint64_t *codes, size_t n, uint32_t zoom, futile_coord_s *out_coords) {
+#ifdef FUTILE_BMI2
+    if (use_bmi2()) {
+        morton_decode_bmi2(codes, n, zoom, out_coords);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < n; i++) {
+        futile_morton_decode(codes[i], &out_coords[i].x, &out_coords[i].y);
+        out_coords[i].z = zoom;
+    }
+}
+
+// Number of tiles in all zooms below zoom, (4^zoom - 1) / 3, which
+// has every even bit below 2 * zoom set
+static uint64_t zoom_base_id(uint32_t zoom) {
+    return zoom == 0 ? 0 : 0x5555555555555555ULL >> (64 - 2 * zoom);
+}
+
+// Zoom of a tile id that numbers zooms one after the other:
+// zoom_base_id(z) <= id < zoom_base_id(z + 1) means 4^z <= 3 id + 1 < 4^(z + 1)
+static uint32_t zoom_of_id(uint64_t id) {
+    return (63 - __builtin_clzll(3 * id + 1)) / 2;
+}
+
+FUTILE_DEF uint64_t futile_coord_to_zorder(futile_coord_s *coord) {
+    return zoom_base_id(coord->z) + futile_morton_encode(coord->x, coord->y);
+}
+
+FUTILE_DEF void futile_zorder_to_coord(uint64_t id, futile_coord_s *out_coord) {
+    uint32_t zoom = zoom_of_id(id);
+    futile_morton_decode(id - zoom_base_id(zoom), &out_coord->x, &out_coord->y);
+    out_coord->z = zoom;
+}
+
+FUTILE_DEF uint32_t futile_zorder_zoom(uint64_t id) {
+    return zoom_of_id(id);
+}
+
+FUTILE_DEF bool futile_zorder_parent(uint64_t id, uint64_t *out_parent) {
+    uint32_t zoom = zoom_of_id(id);
+    if (zoom == 0) {
+        return false;
+    }
+    *out_parent = zoom_base_id(zoom - 1) + ((id - zoom_base_id(zoom)) >> 2);
+    return true;
+}
+
+FUTILE_DEF void futile_zorder_children(uint64_t id, uint64_t *out_children) {
+    uint32_t zoom = zoom_of_id(id);
+    uint64_t first = zoom_base_id(zoom + 1) + ((id - zoom_base_id(zoom)) << 2);
+    for (int i = 0; i < 4; i++) {
+        out_children[i] = first + i;
+    }
+}
+
+FUTILE_DEF bool futile_zorder_descendants(uint64_t id, uint32_t zoom, uint64_t *out_first, uint64_t *out_last) {
+    uint32_t id_zoom = zoom_of_id(id);
+    if (zoom < id_zoom || zoom > FUTILE_ZORDER_MAX_ZOOM) {
+        return false;
+    }
+    uint32_t shift = 2 * (zoom - id_zoom);
+    uint64_t first = zoom_base_id(zoom) + ((id - zoom_base_id(id_zoom)) << shift);
+    *out_first = first;
+    *out_last = first + (((uint64_t)1 << shift) - 1);
+    return true;
+}
+
+// Hilbert curve position of a tile within its zoom, using the same
+// rotations as the PMTiles reference implementation
+static void hilbert_rotate(uint32_t n, uint32_t *x, uint32_t *y, uint32_t rx, uint32_t ry) {
+    if (ry == 0) {
+        if (rx == 1) {
+            *x = n - 1 - *x;
+            *y = n - 1 - *y;
+        }
+        uint32_t t = *x;
+        *x = *y;
+        *y = t;
+    }
+}
+
+FUTILE_DEF uint64_t futile_coord_to_hilbert(futile_coord_s *coord) {
+    uint32_t x = coord->x, y = coord->y;
+    uint64_t d = 0;
+    for (uint32_t s = ((uint64_t)1 << coord->z) >> 1; s > 0; s >>= 1) {
+        uint32_t rx = (x & s) > 0;
+        uint32_t ry = (y & s) > 0;
+        d += (uint64_t)s * s * ((3 * rx) ^ ry);
+        hilbert_rotate(s, &x, &y, rx, ry);
+    }
+    return zoom_base_id(coord->z) + d;
+}
+
+FUTILE_DEF void futile_hilbert_to_coord(uint64_t id, futile_coord_s *out_coord) {
+    uint32_t zoom = zoom_of_id(id);
+    uint64_t t = id - zoom_base_id(zoom);
+    uint32_t x = 0, y = 0;
+    for (uint64_t s = 1; s < (uint64_t)1 << zoom; s <<= 1) {
+        uint32_t rx = 1 & (t >> 1);
+        uint32_t ry = 1 & (t ^ rx);
+        hilbert_rotate(s, &x, &y, rx, ry);
+        x += s * rx;
+        y += s * ry;
+        t >>= 2;
+    }
+    out_coord->x = x;
+    out_coord->y = y;
+    out_coord->z = zoom;
+}
+
+// sorts below this size do not gain from threads
+#define RADIX_PARALLEL_MIN (1 << 20)
+#define RADIX_MAX_DIGITS 12
+
+typedef struct {
+    // either ids or coords are sorted
+    bool coords;
+    void *src;
+    void *dst;
+    size_t n;
+    size_t n_chunks;
+    unsigned int digit;
+    unsigned int n_digits;
+    // per chunk counts of every digit value, for n_digits digits
+    size_t *counts;
+    // per chunk next output position of every digit value
+    size_t *offsets;
+} radix_sort_s;
+
+static inline unsigned int id_digit(uint64_t id, unsigned int digit) {
+    return (id >> (8 * digit)) & 0xff;
+}
+
+// coordinates sort by zoom, column and row, so the row holds the
+// least significant digits
+static inline unsigned int coord_digit(futile_coord_s *coord, unsigned int digit) {
+    uint32_t field = digit < 4 ? coord->y : digit < 8 ? coord->x : coord->z;
+    return (field >> (8 * (digit % 4))) & 0xff;
+}
+
+static void radix_chunk_range(radix_sort_s *sort, size_t index, size_t *start, size_t *end) {
+    *start = sort->n * index / sort->n_chunks;
+    *end = sort->n * (index + 1) / sort->n_chunks;
+}
+
+// Count the digits from sort->digit on, for one chunk
+static void radix_count_chunk(size_t index, void *userdata) {
+    radix_sort_s *sort = userdata;
+    size_t start, end;
+    radix_chunk_range(sort, index, &start, &end);
+    size_t *counts = &sort->counts[index * RADIX_MAX_DIGITS * 256];
+    memset(counts, 0, sizeof(size_t) * RADIX_MAX_DIGITS * 256);
+    if (sort->coords) {
+        futile_coord_s *coords = sort->src;
+        for (size_t i = start; i < end; i++) {
+            for (unsigned int d = 0; d < sort->n_digits; d++) {
+                counts[d * 256 + coord_digit(&coords[i], sort->digit + d)]++;
+            }
+        }
+    } else {
+        uint64_t *ids = sort->src;
+        for (size_t i = start; i < end; i++) {
+            for (unsigned int d = 0; d < sort->n_digits; d++) {
+                counts[d * 256 + id_digit(ids[i], sort->digit + d)]++;
+            }
+        }
+    }
+}
+
+// Move one chunk into place by sort->digit
+static void radix_scatter_chunk(size_t index, void *userdata) {
+    radix_sort_s *sort = userdata;
+    size_t start, end;
+    radix_chunk_range(sort, index, &start, &end);
+    size_t *offsets = &sort->offsets[index * 256];
+    if (sort->coords) {
+        futile_coord_s *src = sort->src, *dst = sort->dst;
+        for (size_t i = start; i < end; i++) {
+            dst[offsets[coord_digit(&src[i], sort->digit)]++] = src[i];
+        }
+    } else {
+        uint64_t *src = sort->src, *dst = sort->dst;
+        for (size_t i = start; i < end; i++) {
+            dst[offsets[id_digit(src[i], sort->digit)]++] = src[i];
+        }
+    }
+}
+
+static bool radix_sort(void *data, size_t n, size_t item_size, bool coords, unsigned int n_threads) {
+    if (n < 2) {
+        return true;
+    }
+    n_threads = n_threads ? n_threads : default_n_threads();
+    radix_sort_s sort = {
+        .coords = coords,
+        .src = data,
+        .n = n,
+        .n_chunks = n >= RADIX_PARALLEL_MIN ? n_threads : 1,
+        .n_digits = coords ? 12 : 8,
+    };
+    void *scratch = malloc(item_size * n);
+    sort.counts = malloc(sizeof(size_t) * RADIX_MAX_DIGITS * 256 * sort.n_chunks);
+    sort.offsets = malloc(sizeof(size_t) * 256 * sort.n_chunks);
+    if (!scratch || !sort.counts || !sort.offsets) {
+        free(scratch);
+        free(sort.counts);
+        free(sort.offsets);
+        errno = ENOMEM;
+        return false;
+    }
+    sort.dst = scratch;
+
+    // counting every digit up front finds the digits that are the same
+    // for every item, which the passes can skip
+    unsigned int n_digits = sort.n_digits;
+    bool skip[RADIX_MAX_DIGITS];
+    parallel_for(n_threads, sort.n_chunks, radix_count_chunk, &sort);
+    for (unsigned int d = 0; d < n_digits; d++) {
+        skip[d] = false;
+        for (unsigned int v = 0; v < 256; v++) {
+            size_t total = 0;
+            for (size_t c = 0; c < sort.n_chunks; c++) {
+                total += sort.counts[c * RADIX_MAX_DIGITS * 256 + d * 256 + v];
+            }
+            if (total == n) {
+                skip[d] = true;
+            }
+        }
+    }
+
+    bool counted = true;
+    sort.n_digits = 1;
+    for (unsigned int d = 0; d < n_digits; d++) {
+        if (skip[d]) {
+            continue;
+        }
+        sort.digit = d;
+        // after the first pass the chunks hold different items, so
+        // their counts have to be redone
+        if (!counted) {
+            parallel_for(n_threads, sort.n_chunks, radix_count_chunk, &sort);
+        }
+        unsigned int count_digit = counted ? d : 0;
+        size_t offset = 0;
+        for (unsigned int v = 0; v < 256; v++) {
+            for (size_t c = 0; c < sort.n_chunks; c++) {
+                sort.offsets[c * 256 + v] = offset;
+                offset += sort.counts[c * RADIX_MAX_DIGITS * 256 + count_digit * 256 + v];
+            }
+        }
+        parallel_for(n_threads, sort.n_chunks, radix_scatter_chunk, &sort);
+        counted = sort.n_chunks == 1 && counted;
+        void *tmp = sort.src;
+        sort.src = sort.dst;
+        sort.dst = tmp;
+    }
+    if (sort.src != data) {
+        memcpy(data, sort.src, item_size * n);
+    }
+    free(scratch);
+    free(sort.counts);
+    free(sort.offsets);
+    return true;
+}
+
+FUTILE_DEF bool futile_sort_ids(uint64_t *ids, size_t n, unsigned int n_threads) {
+    return radix_sort(ids, n, sizeof(uint64_t), false, n_threads);
+}
+
+FUTILE_DEF bool futile_sort_coords(futile_coord_s *coords, size_t n, unsigned int n_threads) {
+    return radix_sort(coords, n, sizeof(futile_coord_s), true, n_threads);
+}
+
+FUTILE_DEF size_t futile_unique_ids(uint64_t *ids, size_t n) {
+    size_t n_unique = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (n_unique == 0 || ids[n_unique - 1] != ids[i]) {
+            ids[n_unique++] = ids[i];
+        }
+    }
+    return n_unique;
+}
+
+FUTILE_DEF size_t futile_unique_coords(futile_coord_s *coords, size_t n) {
+    size_t n_unique = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (n_unique == 0 || !futile_coord_equal(&coords[n_unique - 1], &coords[i])) {
+            coords[n_unique++] = coords[i];
+        }
+    }
+    return n_unique;
+}
+
+static double min(double a, double b) {
+    return a < b ? a : b;
+}
+
+static double max(double a, double b) {
+    return a > b ? a : b;
+}
+
+static double radians_to_degrees(double radians) {
+    return radians * 180 / M_PI;
+}
+
+static double degrees_to_radians(double degrees) {
+    return degrees * M_PI / 180;
+}
+
+// The batch functions work through fixed size blocks, which lets
+// array of structs entry points stage their data on the stack in
+// struct of arrays layout for the kernels.
+#define FUTILE_BATCH_BLOCK 256
+
+static size_t min_size(size_t a, size_t b) {
+    return a < b ? a : b;
+}
+
+// Taylor coefficients of sin(x) / x in powers of x^2. Through x^21
+// the truncation error on [0, pi/2] is below 2e-18.
+static const double sin_coeffs[] = {
+    1.0,
+    -1.0 / 6.0,
+    1.0 / 120.0,
+    -1.0 / 5040.0,
+    1.0 / 362880.0,
+    -1.0 / 39916800.0,
+    1.0 / 6227020800.0,
+    -1.0 / 1307674368000.0,
+    1.0 / 355687428096000.0,
+    -1.0 / 121645100408832000.0,
+    1.0 / 51090942171709440000.0
+};
+
+// Taylor coefficients of atanh(t) / t in powers of t^2. log(m) is
+// computed as 2 atanh((m - 1) / (m + 1)), and with m in
+// [sqrt(2)/2, sqrt(2)] |t| stays below 0.172, so through t^21 the
+// truncation error is below 2e-19.
+static const double atanh_coeffs[] = {
+    1.0, 1.0 / 3, 1.0 / 5, 1.0 / 7, 1.0 / 9, 1.0 / 11,
+    1.0 / 13, 1.0 / 15, 1.0 / 17, 1.0 / 19, 1.0 / 21
+};
+
+#define FUTILE_N_COEFFS(coeffs) (sizeof(coeffs) / sizeof(coeffs[0]))
+
+// Taylor coefficients of exp(r), 1 / k!. exp(x) is computed as
+// 2^k exp(r) with |r| <= log(2)/2, where through r^13 the truncation
+// error is below 5e-18.
+static const double exp_coeffs[] = {
+    1.0, 1.0, 1.0 / 2, 1.0 / 6, 1.0 / 24, 1.0 / 120, 1.0 / 720,
+    1.0 / 5040, 1.0 / 40320, 1.0 / 362880, 1.0 / 3628800,
+    1.0 / 39916800, 1.0 / 479001600, 1.0 / 6227020800.0
+};
+
+// Rational approximation of atan(x) on [0, 0.66], from the cephes
+// math library: atan(x) = x + x^3 P(x^2) / Q(x^2). Larger arguments
+// are reduced with atan(x) = pi/4 + atan((x - 1) / (x + 1)) and
+// atan(x) = pi/2 - atan(1 / x).
+static const double atan_p_coeffs[] = {
+    -6.485021904942025371773E1, -1.228866684490136173410E2,
+    -7.500855792314704667340E1, -1.615753718733365076637E1,
+    -8.750608600031904122785E-1
+};
+static const double atan_q_coeffs[] = {
+    1.945506571482613964425E2, 4.853903996359136964868E2,
+    4.328810604912902668951E2, 1.650270098316988542046E2,
+    2.485846490142306297962E1, 1.0
+};
+// tan(3 pi / 8)
+static const double atan_t3p8 = 2.41421356237309504880;
+
+// pi/2 and log(2) split into a high part and a small correction, so
+// that the high parts can be used in exact arithmetic
+static const double pio2_hi = 1.57079632679489655800e+00;
+static const double pio2_lo = 6.12323399573676603587e-17;
+static const double ln2_hi = 6.93147180369123816490e-01;
+static const double ln2_lo = 1.90821492927058770002e-10;
+
+// 2^52, and its bit pattern. Adding it to a non negative integral
+// double below 2^52 leaves that integer in the low mantissa bits.
+static const double two_pow_52 = 4503599627370496.0;
+static const int64_t two_pow_52_bits = 0x4330000000000000LL;
+static const int64_t mantissa_mask = 0x000FFFFFFFFFFFFFLL;
+static const int64_t one_bits = 0x3FF0000000000000LL;
+
+// Latitudes are clamped to this before projecting, which keeps the
+// vectorized math finite. Anything past the mercator limit of ~85.05
+// lands on the edge rows either way.
+static const double max_projected_latitude = 89.9;
+
+static uint32_t clamp_tile_index(double v, double n_tiles) {
+    // written so that NaN also ends up at 0
+    if (!(v >= 0)) {
+        return 0;
+    }
+    if (v >= n_tiles) {
+        return n_tiles - 1;
+    }
+    return v;
+}
+
+#ifdef FUTILE_X86_SIMD
+
+FUTILE_TARGET_AVX2
+static inline __m256d avx2_poly(__m256d x, const double *coeffs, int n_coeffs) {
+    __m256d p = _mm256_set1_pd(coeffs[n_coeffs - 1]);
+    for (int i = n_coeffs - 2; i >= 0; i--) {
+        p = _mm256_add_pd(_mm256_mul_pd(p, x), _mm256_set1_pd(coeffs[i]));
+    }
+    return p;
+}
+
+// sin(x) for x in [0, pi/2], using the first n_terms of sin_coeffs
+FUTILE_TARGET_AVX2
+static inline __m256d avx2_sin_terms(__m256d x, int n_terms) {
+    __m256d x2 = _mm256_mul_pd(x, x);
+    return _mm256_mul_pd(x, avx2_poly(x2, sin_coeffs, n_terms));
+}
+
+FUTILE_TARGET_AVX2
+static inline __m256d avx2_sin(__m256d x) {
+    return avx2_sin_terms(x, FUTILE_N_COEFFS(sin_coeffs));
+}
+
+// log(x) for finite x > 0, using the first n_terms of atanh_coeffs
+FUTILE_TARGET_AVX2
+static inline __m256d avx2_log_terms(__m256d x, int n_terms) {
+    __m256d one = _mm256_set1_pd(1.0);
+    __m256i bits = _mm256_castpd_si256(x);
+    // the biased exponent becomes a double by placing it in the
+    // mantissa of 2^52
+    __m256i e_bits = _mm256_or_si256(_mm256_srli_epi64(bits, 52), _mm256_set1_epi64x(two_pow_52_bits));
+    __m256d e = _mm256_sub_pd(_mm256_castsi256_pd(e_bits), _mm256_set1_pd(two_pow_52 + 1023));
+    // the mantissa scaled into [1, 2), then into [sqrt(2)/2, sqrt(2))
+    __m256i m_bits = _mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi64x(mantissa_mask)), _mm256_set1_epi64x(one_bits));
+    __m256d m = _mm256_castsi256_pd(m_bits);
+    __m256d is_big = _mm256_cmp_pd(m, _mm256_set1_pd(M_SQRT2), _CMP_GT_OQ);
+    m = _mm256_blendv_pd(m, _mm256_mul_pd(m, _mm256_set1_pd(0.5)), is_big);
+    e = _mm256_add_pd(e, _mm256_and_pd(is_big, one));
+
+    __m256d t = _mm256_div_pd(_mm256_sub_pd(m, one), _mm256_add_pd(m, one));
+    __m256d p = avx2_poly(_mm256_mul_pd(t, t), atanh_coeffs, n_terms);
+    __m256d log_m = _mm256_mul_pd(_mm256_add_pd(t, t), p);
+    __m256d lo = _mm256_add_pd(_mm256_mul_pd(e, _mm256_set1_pd(ln2_lo)), log_m);
+    return _mm256_add_pd(_mm256_mul_pd(e, _mm256_set1_pd(ln2_hi)), lo);
+}
+
+FUTILE_TARGET_AVX2
+static inline __m256d avx2_log(__m256d x) {
+    return avx2_log_terms(x, FUTILE_N_COEFFS(atanh_coeffs));
+}
+
+// Floor and clamp 4 tile positions into [0, n_tiles - 1], storing
+// them as integers
+FUTILE_TARGET_AVX2
+static inline void avx2_store_tile_indexes(__m256d v, __m256d n_tiles, uint32_t *out) {
+    v = _mm256_floor_pd(v);
+    // max picks its second argument for NaN
+    v = _mm256_max_pd(v, _mm256_setzero_pd());
+    v = _mm256_min_pd(v, _mm256_sub_pd(n_tiles, _mm256_set1_pd(1.0)));
+    __m256i bits = _mm256_castpd_si256(_mm256_add_pd(v, _mm256_set1_pd(two_pow_52)));
+    __m256i packed = _mm256_permutevar8x32_epi32(bits, _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6));
+    _mm_storeu_si128((__m128i *)out, _mm256_castsi256_si128(packed));
+}
+
+FUTILE_TARGET_SSE4
+static inline __m128d sse4_poly(__m128d x, const double *coeffs, int n_coeffs) {
+    __m128d p = _mm_set1_pd(coeffs[n_coeffs - 1]);
+    for (int i = n_coeffs - 2; i >= 0; i--) {
+        p = _mm_add_pd(_mm_mul_pd(p, x), _mm_set1_pd(coeffs[i]));
+    }
+    return p;
+}
+
+// see avx2_sin_terms
+FUTILE_TARGET_SSE4
+static inline __m128d sse4_sin_terms(__m128d x, int n_terms) {
+    __m128d x2 = _mm_mul_pd(x, x);
+    return _mm_mul_pd(x, sse4_poly(x2, sin_coeffs, n_terms));
+}
+
+FUTILE_TARGET_SSE4
+static inline __m128d sse4_sin(__m128d x) {
+    return sse4_sin_terms(x, FUTILE_N_COEFFS(sin_coeffs));
+}
+
+// log(x) for finite x > 0, see avx2_log_terms
+FUTILE_TARGET_SSE4
+static inline __m128d sse4_log_terms(__m128d x, int n_terms) {
+    __m128d one = _mm_set1_pd(1.0);
+    __m128i bits = _mm_castpd_si128(x);
+    __m128i e_bits = _mm_or_si128(_mm_srli_epi64(bits, 52), _mm_set1_epi64x(two_pow_52_bits));
+    __m128d e = _mm_sub_pd(_mm_castsi128_pd(e_bits), _mm_set1_pd(two_pow_52 + 1023));
+    __m128i m_bits = _mm_or_si128(_mm_and_si128(bits, _mm_set1_epi64x(mantissa_mask)), _mm_set1_epi64x(one_bits));
+    __m128d m = _mm_castsi128_pd(m_bits);
+    __m128d is_big = _mm_cmpgt_pd(m, _mm_set1_pd(M_SQRT2));
+    m = _mm_blendv_pd(m, _mm_mul_pd(m, _mm_set1_pd(0.5)), is_big);
+    e = _mm_add_pd(e, _mm_and_pd(is_big, one));
+
+    __m128d t = _mm_div_pd(_mm_sub_pd(m, one), _mm_add_pd(m, one));
+    __m128d p = sse4_poly(_mm_mul_pd(t, t), atanh_coeffs, n_terms);
+    __m128d log_m = _mm_mul_pd(_mm_add_pd(t, t), p);
+    __m128d lo = _mm_add_pd(_mm_mul_pd(e, _mm_set1_pd(ln2_lo)), log_m);
+    return _mm_add_pd(_mm_mul_pd(e, _mm_set1_pd(ln2_hi)), lo);
+}
+
+FUTILE_TARGET_SSE4
+static inline __m128d sse4_log(__m128d x) {
+    return sse4_log_terms(x, FUTILE_N_COEFFS(atanh_coeffs));
+}
+
+// see avx2_store_tile_indexes
+FUTILE_TARGET_SSE4
+static inline void sse4_store_tile_indexes(__m128d v, __m128d n_tiles, uint32_t *out) {
+    v = _mm_floor_pd(v);
+    v = _mm_max_pd(v, _mm_setzero_pd());
+    v = _mm_min_pd(v, _mm_sub_pd(n_tiles, _mm_set1_pd(1.0)));
+    __m128i bits = _mm_castpd_si128(_mm_add_pd(v, _mm_set1_pd(two_pow_52)));
+    __m128i packed = _mm_shuffle_epi32(bits, _MM_SHUFFLE(2, 0, 2, 0));
+    _mm_storel_epi64((__m128i *)out, packed);
+}
+
+// exp(x) for |x| <= 700, using the first n_terms of exp_coeffs
+FUTILE_TARGET_AVX2
+static inline __m256d avx2_exp_terms(__m256d x, int n_terms) {
+    __m256d k = _mm256_round_pd(_mm256_mul_pd(x, _mm256_set1_pd(M_LOG2E)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256d r = _mm256_sub_pd(x, _mm256_mul_pd(k, _mm256_set1_pd(ln2_hi)));
+    r = _mm256_sub_pd(r, _mm256_mul_pd(k, _mm256_set1_pd(ln2_lo)));
+    __m256d p = avx2_poly(r, exp_coeffs, n_terms);
+    // 2^k, built by placing k + 1023 in the exponent bits
+    __m256i k_bits = _mm256_castpd_si256(_mm256_add_pd(k, _mm256_set1_pd(two_pow_52 + 1023)));
+    __m256d scale = _mm256_castsi256_pd(_mm256_slli_epi64(k_bits, 52));
+    return _mm256_mul_pd(p, scale);
+}
+
+FUTILE_TARGET_AVX2
+static inline __m256d avx2_exp(__m256d x) {
+    return avx2_exp_terms(x, FUTILE_N_COEFFS(exp_coeffs));
+}
+
+FUTILE_TARGET_AVX2
+static inline __m256d avx2_atan(__m256d x) {
+    __m256d one = _mm256_set1_pd(1.0);
+    __m256d sign_mask = _mm256_set1_pd(-0.0);
+    __m256d sign = _mm256_and_pd(x, sign_mask);
+    x = _mm256_andnot_pd(sign_mask, x);
+
+    __m256d is_big = _mm256_cmp_pd(x, _mm256_set1_pd(atan_t3p8), _CMP_GT_OQ);
+    __m256d is_mid = _mm256_andnot_pd(is_big, _mm256_cmp_pd(x, _mm256_set1_pd(0.66), _CMP_GT_OQ));
+    __m256d reduced_big = _mm256_div_pd(_mm256_set1_pd(-1.0), x);
+    __m256d reduced_mid = _mm256_div_pd(_mm256_sub_pd(x, one), _mm256_add_pd(x, one));
+    x = _mm256_blendv_pd(_mm256_blendv_pd(x, reduced_mid, is_mid), reduced_big, is_big);
+    __m256d offset = _mm256_or_pd(_mm256_and_pd(is_big, _mm256_set1_pd(pio2_hi)),
+                                  _mm256_and_pd(is_mid, _mm256_set1_pd(M_PI_4)));
+    __m256d offset_lo = _mm256_or_pd(_mm256_and_pd(is_big, _mm256_set1_pd(pio2_lo)),
+                                     _mm256_and_pd(is_mid, _mm256_set1_pd(0.5 * pio2_lo)));
+
+    __m256d z = _mm256_mul_pd(x, x);
+    __m256d ratio = _mm256_div_pd(avx2_poly(z, atan_p_coeffs, FUTILE_N_COEFFS(atan_p_coeffs)),
+                                  avx2_poly(z, atan_q_coeffs, FUTILE_N_COEFFS(atan_q_coeffs)));
+    __m256d y = _mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(x, z), ratio), x);
+    y = _mm256_add_pd(offset, _mm256_add_pd(y, offset_lo));
+    return _mm256_xor_pd(y, sign);
+}
+
+// exp(x) for |x| <= 700, see avx2_exp_terms
+FUTILE_TARGET_SSE4
+static inline __m128d sse4_exp_terms(__m128d x, int n_terms) {
+    __m128d k = _mm_round_pd(_mm_mul_pd(x, _mm_set1_pd(M_LOG2E)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m128d r = _mm_sub_pd(x, _mm_mul_pd(k, _mm_set1_pd(ln2_hi)));
+    r = _mm_sub_pd(r, _mm_mul_pd(k, _mm_set1_pd(ln2_lo)));
+    __m128d p = sse4_poly(r, exp_coeffs, n_terms);
+    __m128i k_bits = _mm_castpd_si128(_mm_add_pd(k, _mm_set1_pd(two_pow_52 + 1023)));
+    __m128d scale = _mm_castsi128_pd(_mm_slli_epi64(k_bits, 52));
+    return _mm_mul_pd(p, scale);
+}
+
+FUTILE_TARGET_SSE4
+static inline __m128d sse4_exp(__m128d x) {
+    return sse4_exp_terms(x, FUTILE_N_COEFFS(exp_coeffs));
+}
+
+// see avx2_atan
+FUTILE_TARGET_SSE4
+static inline __m128d sse4_atan(__m128d x) {
+    __m128d one = _mm_set1_pd(1.0);
+    __m128d sign_mask = _mm_set1_pd(-0.0);
+    __m128d sign = _mm_and_pd(x, sign_mask);
+    x = _mm_andnot_pd(sign_mask, x);
+
+    __m128d is_big = _mm_cmpgt_pd(x, _mm_set1_pd(atan_t3p8));
+    __m128d is_mid = _mm_andnot_pd(is_big, _mm_cmpgt_pd(x, _mm_set1_pd(0.66)));
+    __m128d reduced_big = _mm_div_pd(_mm_set1_pd(-1.0), x);
+    __m128d reduced_mid = _mm_div_pd(_mm_sub_pd(x, one), _mm_add_pd(x, one));
+    x = _mm_blendv_pd(_mm_blendv_pd(x, reduced_mid, is_mid), reduced_big, is_big);
+    __m128d offset = _mm_or_pd(_mm_and_pd(is_big, _mm_set1_pd(pio2_hi)),
+                               _mm_and_pd(is_mid, _mm_set1_pd(M_PI_4)));
+    __m128d offset_lo = _mm_or_pd(_mm_and_pd(is_big, _mm_set1_pd(pio2_lo)),
+                                  _mm_and_pd(is_mid, _mm_set1_pd(0.5 * pio2_lo)));
+
+    __m128d z = _mm_mul_pd(x, x);
+    __m128d ratio = _mm_div_pd(sse4_poly(z, atan_p_coeffs, FUTILE_N_COEFFS(atan_p_coeffs)),
+                               sse4_poly(z, atan_q_coeffs, FUTILE_N_COEFFS(atan_q_coeffs)));
+    __m128d y = _mm_add_pd(_mm_mul_pd(_mm_mul_pd(x, z), ratio), x);
+    y = _mm_add_pd(offset, _mm_add_pd(y, offset_lo));
+    return _mm_xor_pd(y, sign);
+}
+
+#endif
+
+FUTILE_DEF void futile_explode_bounds(futile_bounds_s *bounds, double *out_minx, double *out_miny, double *out_maxx, double *out_maxy) {
+    *out_minx = bounds->minx;
+    *out_miny = bounds->miny;
+    *out_maxx = bounds->maxx;
+    *out_maxy = bounds->maxy;
+}
+
+// http://wiki.openstreetmap.org/wiki/Slippy_map_tilenames
+FUTILE_DEF void futile_coord_to_lnglat(futile_coord_s *coord, futile_point_s *out) {
+    double n = pow(2, coord->z);
+    double lng_deg = coord->x / n * 360.0 - 180.0;
+    double lat_rad = atan(sinh(M_PI * (1 - 2 * coord->y / n)));
+    double lat_deg = radians_to_degrees(lat_rad);
+    out->x = lng_deg;
+    out->y = lat_deg;
+}
+
+// http://wiki.openstreetmap.org/wiki/Slippy_map_tilenames
+// make input point
+FUTILE_DEF void futile_lnglat_to_coord(futile_point_s *lnglat, int zoom, futile_coord_s *out) {
+    double lng_deg = lnglat->x;
+    double lat_deg = lnglat->y;
+
+    double lat_rad = degrees_to_radians(lat_deg);
+    double n = pow(2.0, zoom);
+    out->x = (lng_deg + 180.0) / 360.0 * n;
+    out->y = (1.0 - log(tan(lat_rad) + (1 / cos(lat_rad))) / M_PI) / 2.0 * n;
+    out->z = zoom;
+}
+
+typedef void (*lnglat_to_coord_kernel_fn)(const double *lngs, const double *lats, size_t n, double n_tiles, uint32_t *out_x, uint32_t *out_y);
+
+static void lnglat_to_coord_scalar(const double *lngs, const double *lats, size_t n, double n_tiles, uint32_t *out_x, uint32_t *out_y) {
+    for (size_t i = 0; i < n; i++) {
+        double lat_deg = max(-max_projected_latitude, min(max_projected_latitude, lats[i]));
+        double lat_rad = degrees_to_radians(lat_deg);
+        double x = (lngs[i] + 180.0) / 360.0 * n_tiles;
+        double y = (1.0 - log(tan(lat_rad) + (1 / cos(lat_rad))) / M_PI) / 2.0 * n_tiles;
+        out_x[i] = clamp_tile_index(x, n_tiles);
+        out_y[i] = clamp_tile_index(y, n_tiles);
+    }
+}
+
+#ifdef FUTILE_X86_SIMD
+
+// The vectorized kernels compute log(tan(lat) + sec(lat)) as
+// log((1 + sin(|lat|)) / cos(|lat|)) with the sign of lat, where cos
+// is evaluated as sin(pi/2 - |lat|) to stay accurate near the poles.
+
+FUTILE_TARGET_AVX2
+static void avx2_lnglat_to_coord4(const double *lngs, const double *lats, __m256d n_tiles, uint32_t *out_x, uint32_t *out_y) {
+    __m256d one = _mm256_set1_pd(1.0);
+    __m256d sign_mask = _mm256_set1_pd(-0.0);
+    __m256d lng = _mm256_loadu_pd(lngs);
+    __m256d lat = _mm256_loadu_pd(lats);
+
+    __m256d x = _mm256_mul_pd(_mm256_div_pd(_mm256_add_pd(lng, _mm256_set1_pd(180.0)), _mm256_set1_pd(360.0)), n_tiles);
+
+    lat = _mm256_max_pd(lat, _mm256_set1_pd(-max_projected_latitude));
+    lat = _mm256_min_pd(lat, _mm256_set1_pd(max_projected_latitude));
+    __m256d lat_rad = _mm256_mul_pd(lat, _mm256_set1_pd(M_PI / 180.0));
+    __m256d sign = _mm256_and_pd(lat_rad, sign_mask);
+    __m256d a = _mm256_andnot_pd(sign_mask, lat_rad);
+    __m256d s = avx2_sin(a);
+    __m256d c = avx2_sin(_mm256_add_pd(_mm256_sub_pd(_mm256_set1_pd(pio2_hi), a), _mm256_set1_pd(pio2_lo)));
+    __m256d merc = _mm256_xor_pd(avx2_log(_mm256_div_pd(_mm256_add_pd(one, s), c)), sign);
+    __m256d y = _mm256_sub_pd(_mm256_set1_pd(0.5), _mm256_mul_pd(merc, _mm256_set1_pd(0.5 / M_PI)));
+    y = _mm256_mul_pd(y, n_tiles);
+
+    avx2_store_tile_indexes(x, n_tiles, out_x);
+    avx2_store_tile_indexes(y, n_tiles, out_y);
+}
+
+FUTILE_TARGET_AVX2
+static void lnglat_to_coord_avx2(const double *lngs, const double *lats, size_t n, double n_tiles, uint32_t *out_x, uint32_t *out_y) {
+    __m256d tiles = _mm256_set1_pd(n_tiles);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        avx2_lnglat_to_coord4(lngs + i, lats + i, tiles, out_x + i, out_y + i);
+    }
+    if (i < n) {
+        double lng_tail[4] = {0}, lat_tail[4] = {0};
+        uint32_t x_tail[4], y_tail[4];
+        for (size_t j = 0; i + j < n; j++) {
+            lng_tail[j] = lngs[i + j];
+            lat_tail[j] = lats[i + j];
+        }
+        avx2_lnglat_to_coord4(lng_tail, lat_tail, tiles, x_tail, y_tail);
+        for (size_t j = 0; i + j < n; j++) {
+            out_x[i + j] = x_tail[j];
+            out_y[i + j] = y_tail[j];
+        }
+    }
+}
+
+FUTILE_TARGET_SSE4
+static void sse4_lnglat_to_coord2(const double *lngs, const double *lats, __m128d n_tiles, uint32_t *out_x, uint32_t *out_y) {
+    __m128d one = _mm_set1_pd(1.0);
+    __m128d sign_mask = _mm_set1_pd(-0.0);
+    __m128d lng = _mm_loadu_pd(lngs);
+    __m128d lat = _mm_loadu_pd(lats);
+
+    __m128d x = _mm_mul_pd(_mm_div_pd(_mm_add_pd(lng, _mm_set1_pd(180.0)), _mm_set1_pd(360.0)), n_tiles);
+
+    lat = _mm_max_pd(lat, _mm_set1_pd(-max_projected_latitude));
+    lat = _mm_min_pd(lat, _mm_set1_pd(max_projected_latitude));
+    __m128d lat_rad = _mm_mul_pd(lat, _mm_set1_pd(M_PI / 180.0));
+    __m128d sign = _mm_and_pd(lat_rad, sign_mask);
+    __m128d a = _mm_andnot_pd(sign_mask, lat_rad);
+    __m128d s = sse4_sin(a);
+    __m128d c = sse4_sin(_mm_add_pd(_mm_sub_pd(_mm_set1_pd(pio2_hi), a), _mm_set1_pd(pio2_lo)));
+    __m128d merc = _mm_xor_pd(sse4_log(_mm_div_pd(_mm_add_pd(one, s), c)), sign);
+    __m128d y = _mm_sub_pd(_mm_set1_pd(0.5), _mm_mul_pd(merc, _mm_set1_pd(0.5 / M_PI)));
+    y = _mm_mul_pd(y, n_tiles);
+
+    sse4_store_tile_indexes(x, n_tiles, out_x);
+    sse4_store_tile_indexes(y, n_tiles, out_y);
+}
+
+FUTILE_TARGET_SSE4
+static void lnglat_to_coord_sse4(const double *lngs, const double *lats, size_t n, double n_tiles, uint32_t *out_x, uint32_t *out_y) {
+    __m128d tiles = _mm_set1_pd(n_tiles);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        sse4_lnglat_to_coord2(lngs + i, lats + i, tiles, out_x + i, out_y + i);
+    }
+    if (i < n) {
+        double lng_tail[2] = {lngs[i], 0}, lat_tail[2] = {lats[i], 0};
+        uint32_t x_tail[2], y_tail[2];
+        sse4_lnglat_to_coord2(lng_tail, lat_tail, tiles, x_tail, y_tail);
+        out_x[i] = x_tail[0];
+        out_y[i] = y_tail[0];
+    }
+}
+
+#endif
+
+static lnglat_to_coord_kernel_fn lnglat_to_coord_kernel(void) {
+    switch (futile_simd_level()) {
+#ifdef FUTILE_X86_SIMD
+    case FUTILE_SIMD_AVX2:
+        return lnglat_to_coord_avx2;
+    case FUTILE_SIMD_SSE4:
+        return lnglat_to_coord_sse4;
+#endif
+    default:
+        return lnglat_to_coord_scalar;
+    }
+}
+
+FUTILE_DEF void futile_lnglat_to_coord_batch(futile_point_s *lnglats, size_t n, int zoom, futile_coord_s *out_coords) {
+    lnglat_to_coord_kernel_fn kernel = lnglat_to_coord_kernel();
+    double n_tiles = ldexp(1.0, zoom);
+    double lngs[FUTILE_BATCH_BLOCK], lats[FUTILE_BATCH_BLOCK];
+    uint32_t xs[FUTILE_BATCH_BLOCK], ys[FUTILE_BATCH_BLOCK];
+    for (size_t start = 0; start < n; start += FUTILE_BATCH_BLOCK) {
+        size_t n_block = min_size(n - start, FUTILE_BATCH_BLOCK);
+        for (size_t i = 0; i < n_block; i++) {
+            lngs[i] = lnglats[start + i].x;
+            lats[i] = lnglats[start + i].y;
+        }
+        kernel(lngs, lats, n_block, n_tiles, xs, ys);
+        for (size_t i = 0; i < n_block; i++) {
+            futile_coord_s *coord = &out_coords[start + i];
+            coord->x = xs[i];
+            coord->y = ys[i];
+            coord->z = zoom;
+        }
+    }
+}
+
+FUTILE_DEF void futile_lnglat_to_coord_batch_soa(double *lngs, double *lats, size_t n, int zoom, uint32_t *out_x, uint32_t *out_y) {
+    lnglat_to_coord_kernel()(lngs, lats, n, ldexp(1.0, zoom), out_x, out_y);
+}
+
+FUTILE_DEF void futile_coord_to_bounds(futile_coord_s *coord, futile_bounds_s *out) {
+    futile_point_s topleft, bottomright;
+    futile_coord_s coord_bottomright = {
+        .x=coord->x + 1,
+        .y=coord->y + 1,
+        .z=coord->z
+    };
+    futile_coord_to_lnglat(coord, &topleft);
+    futile_coord_to_lnglat(&coord_bottomright, &bottomright);
+    double minx = topleft.x;
+    double miny = bottomright.y;
+    double maxx = bottomright.x;
+    double maxy = topleft.y;
+
+    // coord_to_bounds is used to calculate boxes that could be off the grid
+    // clamp the max values in that scenario
+    maxx = min(180, maxx);
+    maxy = min(90, maxy);
+
+    *out = (futile_bounds_s){minx, miny, maxx, maxy};
+}
+
+typedef void (*row_to_lat_kernel_fn)(const double *ys, size_t n, double n_tiles, double *out_lats);
+
+static double row_to_lat(double y, double n_tiles) {
+    return radians_to_degrees(atan(sinh(M_PI * (1 - 2 * y / n_tiles))));
+}
+
+static void row_to_lat_scalar(const double *ys, size_t n, double n_tiles, double *out_lats) {
+    for (size_t i = 0; i < n; i++) {
+        out_lats[i] = row_to_lat(ys[i], n_tiles);
+    }
+}
+
+// Beyond this sinh(t) is so large that atan returns pi/2 exactly, and
+// clamping keeps the vectorized exp in range for rows far off the grid.
+static const double max_mercator_t = 40.0;
+
+#ifdef FUTILE_X86_SIMD
+
+FUTILE_TARGET_AVX2
+static void avx2_row_to_lat4(const double *ys, __m256d n_tiles, double *out_lats) {
+    __m256d one = _mm256_set1_pd(1.0);
+    __m256d y = _mm256_loadu_pd(ys);
+    __m256d t = _mm256_sub_pd(one, _mm256_div_pd(_mm256_add_pd(y, y), n_tiles));
+    t = _mm256_mul_pd(_mm256_set1_pd(M_PI), t);
+    t = _mm256_max_pd(t, _mm256_set1_pd(-max_mercator_t));
+    t = _mm256_min_pd(t, _mm256_set1_pd(max_mercator_t));
+    __m256d e = avx2_exp(t);
+    __m256d sinh_t = _mm256_mul_pd(_mm256_sub_pd(e, _mm256_div_pd(one, e)), _mm256_set1_pd(0.5));
+    __m256d lat = _mm256_div_pd(_mm256_mul_pd(avx2_atan(sinh_t), _mm256_set1_pd(180.0)), _mm256_set1_pd(M_PI));
+    _mm256_storeu_pd(out_lats, lat);
+}
+
+FUTILE_TARGET_AVX2
+static void row_to_lat_avx2(const double *ys, size_t n, double n_tiles, double *out_lats) {
+    __m256d tiles = _mm256_set1_pd(n_tiles);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        avx2_row_to_lat4(ys + i, tiles, out_lats + i);
+    }
+    if (i < n) {
+        double y_tail[4] = {0}, lat_tail[4];
+        for (size_t j = 0; i + j < n; j++) {
+            y_tail[j] = ys[i + j];
+        }
+        avx2_row_to_lat4(y_tail, tiles, lat_tail);
+        for (size_t j = 0; i + j < n; j++) {
+            out_lats[i + j] = lat_tail[j];
+        }
+    }
+}
+
+FUTILE_TARGET_SSE4
+static void sse4_row_to_lat2(const double *ys, __m128d n_tiles, double *out_lats) {
+    __m128d one = _mm_set1_pd(1.0);
+    __m128d y = _mm_loadu_pd(ys);
+    __m128d t = _mm_sub_pd(one, _mm_div_pd(_mm_add_pd(y, y), n_tiles));
+    t = _mm_mul_pd(_mm_set1_pd(M_PI), t);
+    t = _mm_max_pd(t, _mm_set1_pd(-max_mercator_t));
+    t = _mm_min_pd(t, _mm_set1_pd(max_mercator_t));
+    __m128d e = sse4_exp(t);
+    __m128d sinh_t = _mm_mul_pd(_mm_sub_pd(e, _mm_div_pd(one, e)), _mm_set1_pd(0.5));
+    __m128d lat = _mm_div_pd(_mm_mul_pd(sse4_atan(sinh_t), _mm_set1_pd(180.0)), _mm_set1_pd(M_PI));
+    _mm_storeu_pd(out_lats, lat);
+}
+
+FUTILE_TARGET_SSE4
+static void row_to_lat_sse4(const double *ys, size_t n, double n_tiles, double *out_lats) {
+    __m128d tiles = _mm_set1_pd(n_tiles);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        sse4_row_to_lat2(ys + i, tiles, out_lats + i);
+    }
+    if (i < n) {
+        double y_tail[2] = {ys[i], 0}, lat_tail[2];
+        sse4_row_to_lat2(y_tail, tiles, lat_tail);
+        out_lats[i] = lat_tail[0];
+    }
+}
+
+#endif
+
+static row_to_lat_kernel_fn row_to_lat_kernel(void) {
+    switch (futile_simd_level()) {
+#ifdef FUTILE_X86_SIMD
+    case FUTILE_SIMD_AVX2:
+        return row_to_lat_avx2;
+    case FUTILE_SIMD_SSE4:
+        return row_to_lat_sse4;
+#endif
+    default:
+        return row_to_lat_scalar;
+    }
+}
+
+static bool lat_table_has_row(futile_lat_table_s *table, uint32_t z, uint64_t y) {
+    return table && table->zoom == z && y <= ((uint64_t)1 << z);
+}
+
+FUTILE_DEF size_t futile_lat_table_size(unsigned int zoom) {
+    return ((size_t)1 << zoom) + 1;
+}
+
+FUTILE_DEF void futile_lat_table_init(futile_lat_table_s *table, unsigned int zoom, double *lats) {
+    double n_tiles = ldexp(1.0, zoom);
+    size_t n = futile_lat_table_size(zoom);
+    for (size_t y = 0; y < n; y++) {
+        lats[y] = row_to_lat(y, n_tiles);
+    }
+    table->zoom = zoom;
+    table->lats = lats;
+}
+
+FUTILE_DEF void futile_coord_to_lnglat_batch(futile_coord_s *coords, size_t n, futile_lat_table_s *table, futile_point_s *out) {
+    row_to_lat_kernel_fn kernel = row_to_lat_kernel();
+    double ys[FUTILE_BATCH_BLOCK], lats[FUTILE_BATCH_BLOCK];
+    for (size_t start = 0; start < n; start += FUTILE_BATCH_BLOCK) {
+        size_t n_block = min_size(n - start, FUTILE_BATCH_BLOCK);
+        futile_coord_s *block = coords + start;
+        // rows from the table are filled in directly, the rest go
+        // through the kernel, which works per zoom level
+        size_t i = 0;
+        while (i < n_block) {
+            uint32_t z = block[i].z;
+            size_t n_pending = 0;
+            size_t j = i;
+            for (; j < n_block && block[j].z == z; j++) {
+                if (!lat_table_has_row(table, z, block[j].y)) {
+                    ys[n_pending++] = block[j].y;
+                }
+            }
+            double n_tiles = ldexp(1.0, z);
+            kernel(ys, n_pending, n_tiles, lats);
+            size_t pending = 0;
+            for (size_t k = i; k < j; k++) {
+                futile_point_s *point = &out[start + k];
+                point->x = block[k].x / n_tiles * 360.0 - 180.0;
+                if (lat_table_has_row(table, z, block[k].y)) {
+                    point->y = table->lats[block[k].y];
+                } else {
+                    point->y = lats[pending++];
+                }
+            }
+            i = j;
+        }
+    }
+}
+
+FUTILE_DEF void futile_coord_to_bounds_batch(futile_coord_s *coords, size_t n, futile_lat_table_s *table, futile_bounds_s *out) {
+    row_to_lat_kernel_fn kernel = row_to_lat_kernel();
+    // each coordinate needs its top and bottom edge
+    double ys[2 * FUTILE_BATCH_BLOCK], lats[2 * FUTILE_BATCH_BLOCK];
+    for (size_t start = 0; start < n; start += FUTILE_BATCH_BLOCK) {
+        size_t n_block = min_size(n - start, FUTILE_BATCH_BLOCK);
+        futile_coord_s *block = coords + start;
+        size_t i = 0;
+        while (i < n_block) {
+            uint32_t z = block[i].z;
+            size_t n_pending = 0;
+            size_t j = i;
+            for (; j < n_block && block[j].z == z; j++) {
+                if (!lat_table_has_row(table, z, (uint64_t)block[j].y + 1)) {
+                    ys[n_pending++] = block[j].y;
+                    ys[n_pending++] = (double)block[j].y + 1;
+                }
+            }
+            double n_tiles = ldexp(1.0, z);
+            kernel(ys, n_pending, n_tiles, lats);
+            size_t pending = 0;
+            for (size_t k = i; k < j; k++) {
+                futile_coord_s *coord = &block[k];
+                double maxy, miny;
+                if (lat_table_has_row(table, z, (uint64_t)coord->y + 1)) {
+                    maxy = table->lats[coord->y];
+                    miny = table->lats[coord->y + 1];
+                } else {
+                    maxy = lats[pending++];
+                    miny = lats[pending++];
+                }
+                // clamp off the grid boxes, as futile_coord_to_bounds does
+                out[start + k] = (futile_bounds_s){
+                    coord->x / n_tiles * 360.0 - 180.0,
+                    miny,
+                    min(180, ((double)coord->x + 1) / n_tiles * 360.0 - 180.0),
+                    min(90, maxy)
+                };
+            }
+            i = j;
+        }
+    }
+}
+
+FUTILE_DEF size_t futile_coord_range_to_bounds(unsigned int zoom, unsigned int start_x, unsigned int start_y, unsigned int end_x, unsigned int end_y, futile_lat_table_s *table, futile_bounds_s *out) {
+    if (start_x > end_x || start_y > end_y) {
+        return 0;
+    }
+    row_to_lat_kernel_fn kernel = row_to_lat_kernel();
+    double n_tiles = ldexp(1.0, zoom);
+    size_t n_cols = (size_t)end_x - start_x + 1;
+    double ys[FUTILE_BATCH_BLOCK + 1], lats[FUTILE_BATCH_BLOCK + 1];
+    size_t n_out = 0;
+    for (uint64_t block_y = start_y; block_y <= end_y; block_y += FUTILE_BATCH_BLOCK) {
+        size_t n_rows = min_size(end_y - block_y + 1, FUTILE_BATCH_BLOCK);
+        double *edges;
+        if (lat_table_has_row(table, zoom, block_y + n_rows)) {
+            edges = table->lats + block_y;
+        } else {
+            for (size_t i = 0; i <= n_rows; i++) {
+                ys[i] = block_y + i;
+            }
+            kernel(ys, n_rows + 1, n_tiles, lats);
+            edges = lats;
+        }
+        for (size_t row = 0; row < n_rows; row++) {
+            double maxy = min(90, edges[row]);
+            double miny = edges[row + 1];
+            if (n_out == 0) {
+                double minx = start_x / n_tiles * 360.0 - 180.0;
+                for (size_t col = 0; col < n_cols; col++) {
+                    double maxx = ((double)start_x + col + 1) / n_tiles * 360.0 - 180.0;
+                    out[n_out++] = (futile_bounds_s){minx, miny, min(180, maxx), maxy};
+                    minx = maxx;
+                }
+                continue;
+            }
+            // the first row holds the column edges
+            for (size_t col = 0; col < n_cols; col++) {
+                out[n_out++] = (futile_bounds_s){out[col].minx, miny, out[col].maxx, maxy};
+            }
+        }
+    }
+    return n_out;
+}
+
+FUTILE_DEF unsigned int futile_bounds_to_coords(futile_bounds_s *bounds, int zoom, futile_coord_s out_coords[]) {
+    futile_point_s topleft, bottomright;
+    futile_explode_bounds(bounds, &topleft.x, &bottomright.y, &bottomright.x, &topleft.y);
+
+    futile_coord_s topleft_coord, bottomright_coord;
+    futile_lnglat_to_coord(&topleft, zoom, &topleft_coord);
+    futile_lnglat_to_coord(&bottomright, zoom, &bottomright_coord);
+
+    // clamp max values
+    int maxval = pow(2, zoom) - 1;
+    bottomright_coord.x = min(maxval, bottomright_coord.x);
+    bottomright_coord.y = min(maxval, bottomright_coord.y);
+
+    out_coords[0] = topleft_coord;
+    // check if one coordinate subsumes the whole bounds at this zoom
+    if (topleft_coord.x == bottomright_coord.x &&
+        topleft_coord.y == bottomright_coord.y) {
+        return 1;
+    } else {
+        // we have two inclusive coordinates representing the range
+        out_coords[1] = bottomright_coord;
+        return 2;
+    }
+}
+
+// radius of earth in meters is 6378137
+// static double circumference_meters = 40075016.685578487813;
+static double half_circumference_meters = 20037508.342789243907;
+
+FUTILE_DEF void futile_mercator_to_lnglat(futile_point_s *in, futile_point_s *out) {
+    double x = in->x, y = in->y;
+
+    x /= half_circumference_meters;
+    y /= half_circumference_meters;
+
+    y = (2 * atan(exp(y * M_PI)) - (M_PI / 2)) / M_PI;
+
+    x *= 180;
+    y *= 180;
+
+    out->x = x;
+    out->y = y;
+}
+
+FUTILE_DEF void futile_lnglat_to_mercator(futile_point_s *in, futile_point_s *out) {
+    double x = in->x, y = in->y;
+
+    // Latitude
+    y = log(tan(y * M_PI / 360 + M_PI / 4)) / M_PI;
+    y *= half_circumference_meters;
+
+    // Longitude
+    x *= half_circumference_meters / 180;
+
+    out->x = x;
+    out->y = y;
+}
+
+// log(circumference_meters) / log(2)
+static double zoom_with_mercator_meters = 25.256199785270;
+
+FUTILE_DEF void futile_coord_to_mercator(futile_coord_s *in, futile_point_s *out) {
+    // update the source x, y values to their corresponding values at
+    // the zoom where mercator units are in meters
+    double x = in->x * pow(2, zoom_with_mercator_meters - in->z);
+    double y = in->y * pow(2, zoom_with_mercator_meters - in->z);
+
+    // adjust for coordinate system
+    out->x = x - half_circumference_meters;
+    // y grid starts from 0 at top and goes down
+    out->y = half_circumference_meters - y;
+}
+
+FUTILE_DEF void futile_mercator_to_coord(futile_point_s *in, int zoom, futile_coord_s *out) {
+    // adjust for coordinate system
+    double x = in->x + half_circumference_meters;
+    // y grid starts from 0 at top and goes down
+    double y = half_circumference_meters - in->y;
+
+    out->x = x * pow(2, zoom - zoom_with_mercator_meters);
+    out->y = y * pow(2, zoom - zoom_with_mercator_meters);
+    out->z = zoom;
+}
+
+FUTILE_DEF void futile_coord_to_mercator_bounds(futile_coord_s *in, futile_bounds_s *out) {
+    futile_coord_s coord_bottom_right = {.x=in->x + 1, .y=in->y + 1, in->z};
+    futile_point_s merc_topleft, merc_bottomright;
+    futile_coord_to_mercator(in, &merc_topleft);
+    futile_coord_to_mercator(&coord_bottom_right, &merc_bottomright);
+    out->minx = min(merc_topleft.x, merc_bottomright.x);
+    out->miny = min(merc_topleft.y, merc_bottomright.y);
+    out->maxx = max(merc_topleft.x, merc_bottomright.x);
+    out->maxy = max(merc_topleft.y, merc_bottomright.y);
+}
+
+FUTILE_DEF int futile_mercator_bounds_to_coords(futile_bounds_s *bounds, int zoom, futile_coord_s *out) {
+    double topleft_x, topleft_y, bottomright_x, bottomright_y;
+    futile_explode_bounds(bounds, &topleft_x, &bottomright_y, &bottomright_x, &topleft_y);
+    futile_point_s topleft_point = {topleft_x, topleft_y};
+    futile_point_s bottomright_point = {bottomright_x, bottomright_y};
+    futile_coord_s topleft_coord, bottomright_coord;
+    futile_mercator_to_coord(&topleft_point, zoom, &topleft_coord);
+    futile_mercator_to_coord(&bottomright_point, zoom, &bottomright_coord);
+    out[0] = topleft_coord;
+    if (topleft_coord.x == bottomright_coord.x &&
+        topleft_coord.y == bottomright_coord.y) {
+        return 1;
+    } else {
+        out[1] = bottomright_coord;
+        return 2;
+    }
+}
+
+// Series lengths for the vectorized projections
+typedef struct mercator_terms_s {
+    int n_sin, n_atanh, n_exp;
+} mercator_terms_s;
+
+// Every term of sin_coeffs, atanh_coeffs and exp_coeffs, for
+// vectorized callers that need the projection to double precision
+static const mercator_terms_s mercator_terms_full = {
+    FUTILE_N_COEFFS(sin_coeffs), FUTILE_N_COEFFS(atanh_coeffs), FUTILE_N_COEFFS(exp_coeffs)
+};
+
+// Enough terms for the bound of each approximate mode, see
+// futile_accuracy_e. The exact mode uses libm and has no entry.
+static const mercator_terms_s mercator_terms[] = {
+    [FUTILE_ACCURACY_1E9] = {8, 7, 11},
+    [FUTILE_ACCURACY_1E6] = {7, 5, 9},
+};
+
+typedef void (*mercator_kernel_fn)(const double *xs, const double *ys, size_t n, const mercator_terms_s *terms, double *out_x, double *out_y);
+
+static void lnglat_to_mercator_scalar(const double *xs, const double *ys, size_t n, const mercator_terms_s *terms, double *out_x, double *out_y) {
+    (void)terms;
+    for (size_t i = 0; i < n; i++) {
+        futile_point_s point = {.x=xs[i], .y=ys[i]};
+        futile_lnglat_to_mercator(&point, &point);
+        out_x[i] = point.x;
+        out_y[i] = point.y;
+    }
+}
+
+static void mercator_to_lnglat_scalar(const double *xs, const double *ys, size_t n, const mercator_terms_s *terms, double *out_x, double *out_y) {
+    (void)terms;
+    for (size_t i = 0; i < n; i++) {
+        futile_point_s point = {.x=xs[i], .y=ys[i]};
+        futile_mercator_to_lnglat(&point, &point);
+        out_x[i] = point.x;
+        out_y[i] = point.y;
+    }
+}
+
+#ifdef FUTILE_X86_SIMD
+
+// Projects lng/lat to mercator meters, see avx2_lnglat_to_coord4
+FUTILE_TARGET_AVX2
+static inline void avx2_lnglat_to_mercator(__m256d *x, __m256d *y, const mercator_terms_s *terms) {
+    __m256d sign_mask = _mm256_set1_pd(-0.0);
+    __m256d lat = _mm256_max_pd(*y, _mm256_set1_pd(-max_projected_latitude));
+    lat = _mm256_min_pd(lat, _mm256_set1_pd(max_projected_latitude));
+    __m256d lat_rad = _mm256_mul_pd(lat, _mm256_set1_pd(M_PI / 180.0));
+    __m256d sign = _mm256_and_pd(lat_rad, sign_mask);
+    __m256d a = _mm256_andnot_pd(sign_mask, lat_rad);
+    __m256d s = avx2_sin_terms(a, terms->n_sin);
+    __m256d c = avx2_sin_terms(_mm256_add_pd(_mm256_sub_pd(_mm256_set1_pd(pio2_hi), a), _mm256_set1_pd(pio2_lo)), terms->n_sin);
+    __m256d merc = _mm256_xor_pd(avx2_log_terms(_mm256_div_pd(_mm256_add_pd(_mm256_set1_pd(1.0), s), c), terms->n_atanh), sign);
+    *x = _mm256_mul_pd(*x, _mm256_set1_pd(half_circumference_meters / 180));
+    *y = _mm256_mul_pd(merc, _mm256_set1_pd(half_circumference_meters / M_PI));
+}
+
+// lat = 2 atan(exp(t)) - pi/2, which needs no division for sinh(t)
+FUTILE_TARGET_AVX2
+static inline void avx2_mercator_to_lnglat(__m256d *x, __m256d *y, const mercator_terms_s *terms) {
+    __m256d t = _mm256_mul_pd(_mm256_div_pd(*y, _mm256_set1_pd(half_circumference_meters)), _mm256_set1_pd(M_PI));
+    t = _mm256_max_pd(t, _mm256_set1_pd(-max_mercator_t));
+    t = _mm256_min_pd(t, _mm256_set1_pd(max_mercator_t));
+    __m256d a = avx2_atan(avx2_exp_terms(t, terms->n_exp));
+    __m256d lat = _mm256_sub_pd(_mm256_add_pd(a, a), _mm256_set1_pd(pio2_hi));
+    *x = _mm256_mul_pd(_mm256_div_pd(*x, _mm256_set1_pd(half_circumference_meters)), _mm256_set1_pd(180.0));
+    *y = _mm256_mul_pd(lat, _mm256_set1_pd(180.0 / M_PI));
+}
+
+FUTILE_TARGET_AVX2
+static void lnglat_to_mercator_avx2(const double *xs, const double *ys, size_t n, const mercator_terms_s *terms, double *out_x, double *out_y) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(xs + i);
+        __m256d y = _mm256_loadu_pd(ys + i);
+        avx2_lnglat_to_mercator(&x, &y, terms);
+        _mm256_storeu_pd(out_x + i, x);
+        _mm256_storeu_pd(out_y + i, y);
+    }
+    lnglat_to_mercator_scalar(xs + i, ys + i, n - i, terms, out_x + i, out_y + i);
+}
+
+FUTILE_TARGET_AVX2
+static void mercator_to_lnglat_avx2(const double *xs, const double *ys, size_t n, const mercator_terms_s *terms, double *out_x, double *out_y) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(xs + i);
+        __m256d y = _mm256_loadu_pd(ys + i);
+        avx2_mercator_to_lnglat(&x, &y, terms);
+        _mm256_storeu_pd(out_x + i, x);
+        _mm256_storeu_pd(out_y + i, y);
+    }
+    mercator_to_lnglat_scalar(xs + i, ys + i, n - i, terms, out_x + i, out_y + i);
+}
+
+// see avx2_lnglat_to_mercator
+FUTILE_TARGET_SSE4
+static inline void sse4_lnglat_to_mercator(__m128d *x, __m128d *y, const mercator_terms_s *terms) {
+    __m128d sign_mask = _mm_set1_pd(-0.0);
+    __m128d lat = _mm_max_pd(*y, _mm_set1_pd(-max_projected_latitude));
+    lat = _mm_min_pd(lat, _mm_set1_pd(max_projected_latitude));
+    __m128d lat_rad = _mm_mul_pd(lat, _mm_set1_pd(M_PI / 180.0));
+    __m128d sign = _mm_and_pd(lat_rad, sign_mask);
+    __m128d a = _mm_andnot_pd(sign_mask, lat_rad);
+    __m128d s = sse4_sin_terms(a, terms->n_sin);
+    __m128d c = sse4_sin_terms(_mm_add_pd(_mm_sub_pd(_mm_set1_pd(pio2_hi), a), _mm_set1_pd(pio2_lo)), terms->n_sin);
+    __m128d merc = _mm_xor_pd(sse4_log_terms(_mm_div_pd(_mm_add_pd(_mm_set1_pd(1.0), s), c), terms->n_atanh), sign);
+    *x = _mm_mul_pd(*x, _mm_set1_pd(half_circumference_meters / 180));
+    *y = _mm_mul_pd(merc, _mm_set1_pd(half_circumference_meters / M_PI));
+}
+
+// see avx2_mercator_to_lnglat
+FUTILE_TARGET_SSE4
+static inline void sse4_mercator_to_lnglat(__m128d *x, __m128d *y, const mercator_terms_s *terms) {
+    __m128d t = _mm_mul_pd(_mm_div_pd(*y, _mm_set1_pd(half_circumference_meters)), _mm_set1_pd(M_PI));
+    t = _mm_max_pd(t, _mm_set1_pd(-max_mercator_t));
+    t = _mm_min_pd(t, _mm_set1_pd(max_mercator_t));
+    __m128d a = sse4_atan(sse4_exp_terms(t, terms->n_exp));
+    __m128d lat = _mm_sub_pd(_mm_add_pd(a, a), _mm_set1_pd(pio2_hi));
+    *x = _mm_mul_pd(_mm_div_pd(*x, _mm_set1_pd(half_circumference_meters)), _mm_set1_pd(180.0));
+    *y = _mm_mul_pd(lat, _mm_set1_pd(180.0 / M_PI));
+}
+
+FUTILE_TARGET_SSE4
+static void lnglat_to_mercator_sse4(const double *xs, const double *ys, size_t n, const mercator_terms_s *terms, double *out_x, double *out_y) {
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d x = _mm_loadu_pd(xs + i);
+        __m128d y = _mm_loadu_pd(ys + i);
+        sse4_lnglat_to_mercator(&x, &y, terms);
+        _mm_storeu_pd(out_x + i, x);
+        _mm_storeu_pd(out_y + i, y);
+    }
+    lnglat_to_mercator_scalar(xs + i, ys + i, n - i, terms, out_x + i, out_y + i);
+}
+
+FUTILE_TARGET_SSE4
+static void mercator_to_lnglat_sse4(const double *xs, const double *ys, size_t n, const mercator_terms_s *terms, double *out_x, double *out_y) {
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d x = _mm_loadu_pd(xs + i);
+        __m128d y = _mm_loadu_pd(ys + i);
+        sse4_mercator_to_lnglat(&x, &y, terms);
+        _mm_storeu_pd(out_x + i, x);
+        _mm_storeu_pd(out_y + i, y);
+    }
+    mercator_to_lnglat_scalar(xs + i, ys + i, n - i, terms, out_x + i, out_y + i);
+}
+
+#endif
+
+static mercator_kernel_fn mercator_kernel(futile_accuracy_e accuracy, bool is_forward) {
+    if (accuracy != FUTILE_ACCURACY_EXACT) {
+        switch (futile_simd_level()) {
+#ifdef FUTILE_X86_SIMD
+        case FUTILE_SIMD_AVX2:
+            return is_forward ? lnglat_to_mercator_avx2 : mercator_to_lnglat_avx2;
+        case FUTILE_SIMD_SSE4:
+            return is_forward ? lnglat_to_mercator_sse4 : mercator_to_lnglat_sse4;
+#endif
+        default:
+            break;
+        }
+    }
+    return is_forward ? lnglat_to_mercator_scalar : mercator_to_lnglat_scalar;
+}
+
+static void mercator_batch(futile_point_s *in, size_t n, futile_accuracy_e accuracy, bool is_forward, futile_point_s *out) {
+    // anything that is not an approximate mode is exact
+    if (accuracy != FUTILE_ACCURACY_1E9 && accuracy != FUTILE_ACCURACY_1E6) {
+        accuracy = FUTILE_ACCURACY_EXACT;
+    }
+    mercator_kernel_fn kernel = mercator_kernel(accuracy, is_forward);
+    const mercator_terms_s *terms = accuracy == FUTILE_ACCURACY_EXACT ? NULL : &mercator_terms[accuracy];
+    double xs[FUTILE_BATCH_BLOCK], ys[FUTILE_BATCH_BLOCK];
+    for (size_t start = 0; start < n; start += FUTILE_BATCH_BLOCK) {
+        size_t n_block = min_size(n - start, FUTILE_BATCH_BLOCK);
+        for (size_t i = 0; i < n_block; i++) {
+            xs[i] = in[start + i].x;
+            ys[i] = in[start + i].y;
+        }
+        // the kernels allow in place updates
+        kernel(xs, ys, n_block, terms, xs, ys);
+        for (size_t i = 0; i < n_block; i++) {
+            out[start + i] = (futile_point_s){.x=xs[i], .y=ys[i]};
+        }
+    }
+}
+
+FUTILE_DEF void futile_lnglat_to_mercator_batch(futile_point_s *in, size_t n, futile_accuracy_e accuracy, futile_point_s *out) {
+    mercator_batch(in, n, accuracy, true, out);
+}
+
+FUTILE_DEF void futile_mercator_to_lnglat_batch(futile_point_s *in, size_t n, futile_accuracy_e accuracy, futile_point_s *out) {
+    mercator_batch(in, n, accuracy, false, out);
+}
+
+// Maps mercator meters onto the grid of one tile, see
+// futile_mercator_to_tile_batch
+typedef struct tile_transform_s {
+    double minx, maxy, scale;
+    double lo, hi;
+} tile_transform_s;
+
+typedef void (*tile_quantize_kernel_fn)(const double *xs, const double *ys, size_t n, bool is_lnglat, const tile_transform_s *t, int32_t *out_x, int32_t *out_y);
+
+// written so that NaN also ends up at lo, like the max_pd in the
+// vectorized kernels
+static int32_t quantize_tile_value(double v, const tile_transform_s *t) {
+    v = floor(v + 0.5);
+    if (!(v >= t->lo)) {
+        return t->lo;
+    }
+    if (v > t->hi) {
+        return t->hi;
+    }
+    return v;
+}
+
+static void tile_quantize_scalar(const double *xs, const double *ys, size_t n, bool is_lnglat, const tile_transform_s *t, int32_t *out_x, int32_t *out_y) {
+    for (size_t i = 0; i < n; i++) {
+        double x = xs[i], y = ys[i];
+        if (is_lnglat) {
+            double lat_rad = degrees_to_radians(max(-max_projected_latitude, min(max_projected_latitude, y)));
+            x = x * (half_circumference_meters / 180);
+            y = log(tan(lat_rad) + (1 / cos(lat_rad))) * (half_circumference_meters / M_PI);
+        }
+        out_x[i] = quantize_tile_value((x - t->minx) * t->scale, t);
+        out_y[i] = quantize_tile_value((t->maxy - y) * t->scale, t);
+    }
+}
+
+#ifdef FUTILE_X86_SIMD
+
+// Rounds and clamps 4 grid positions, storing them as int32
+FUTILE_TARGET_AVX2
+static inline void avx2_store_tile_values(__m256d v, __m256d lo, __m256d hi, int32_t *out) {
+    v = _mm256_floor_pd(_mm256_add_pd(v, _mm256_set1_pd(0.5)));
+    // max picks its second argument for NaN
+    v = _mm256_max_pd(v, lo);
+    v = _mm256_min_pd(v, hi);
+    _mm_storeu_si128((__m128i *)out, _mm256_cvtpd_epi32(v));
+}
+
+FUTILE_TARGET_AVX2
+static void tile_quantize_avx2(const double *xs, const double *ys, size_t n, bool is_lnglat, const tile_transform_s *t, int32_t *out_x, int32_t *out_y) {
+    __m256d minx = _mm256_set1_pd(t->minx), maxy = _mm256_set1_pd(t->maxy);
+    __m256d scale = _mm256_set1_pd(t->scale);
+    __m256d lo = _mm256_set1_pd(t->lo), hi = _mm256_set1_pd(t->hi);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(xs + i);
+        __m256d y = _mm256_loadu_pd(ys + i);
+        if (is_lnglat) {
+            avx2_lnglat_to_mercator(&x, &y, &mercator_terms_full);
+        }
+        avx2_store_tile_values(_mm256_mul_pd(_mm256_sub_pd(x, minx), scale), lo, hi, out_x + i);
+        avx2_store_tile_values(_mm256_mul_pd(_mm256_sub_pd(maxy, y), scale), lo, hi, out_y + i);
+    }
+    tile_quantize_scalar(xs + i, ys + i, n - i, is_lnglat, t, out_x + i, out_y + i);
+}
+
+// see avx2_store_tile_values
+FUTILE_TARGET_SSE4
+static inline void sse4_store_tile_values(__m128d v, __m128d lo, __m128d hi, int32_t *out) {
+    v = _mm_floor_pd(_mm_add_pd(v, _mm_set1_pd(0.5)));
+    v = _mm_max_pd(v, lo);
+    v = _mm_min_pd(v, hi);
+    _mm_storel_epi64((__m128i *)out, _mm_cvtpd_epi32(v));
+}
+
+FUTILE_TARGET_SSE4
+static void tile_quantize_sse4(const double *xs, const double *ys, size_t n, bool is_lnglat, const tile_transform_s *t, int32_t *out_x, int32_t *out_y) {
+    __m128d minx = _mm_set1_pd(t->minx), maxy = _mm_set1_pd(t->maxy);
+    __m128d scale = _mm_set1_pd(t->scale);
+    __m128d lo = _mm_set1_pd(t->lo), hi = _mm_set1_pd(t->hi);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d x = _mm_loadu_pd(xs + i);
+        __m128d y = _mm_loadu_pd(ys + i);
+        if (is_lnglat) {
+            sse4_lnglat_to_mercator(&x, &y, &mercator_terms_full);
+        }
+        sse4_store_tile_values(_mm_mul_pd(_mm_sub_pd(x, minx), scale), lo, hi, out_x + i);
+        sse4_store_tile_values(_mm_mul_pd(_mm_sub_pd(maxy, y), scale), lo, hi, out_y + i);
+    }
+    tile_quantize_scalar(xs + i, ys + i, n - i, is_lnglat, t, out_x + i, out_y + i);
+}
+
+#endif
+
+static tile_quantize_kernel_fn tile_quantize_kernel(void) {
+    switch (futile_simd_level()) {
+#ifdef FUTILE_X86_SIMD
+    case FUTILE_SIMD_AVX2:
+        return tile_quantize_avx2;
+    case FUTILE_SIMD_SSE4:
+        return tile_quantize_sse4;
+#endif
+    default:
+        return tile_quantize_scalar;
+    }
+}
+
+static size_t tile_batch(futile_coord_s *coord, uint32_t extent, uint32_t buffer, futile_point_s *in, size_t n, bool is_lnglat, bool drop_duplicates, futile_tile_point_s *out) {
+    tile_quantize_kernel_fn kernel = tile_quantize_kernel();
+    double n_tiles = ldexp(1.0, coord->z);
+    double tile_size = 2 * half_circumference_meters / n_tiles;
+    tile_transform_s t = {
+        .minx=coord->x * tile_size - half_circumference_meters,
+        .maxy=half_circumference_meters - coord->y * tile_size,
+        .scale=extent / tile_size,
+        .lo=max(-(double)buffer, INT32_MIN),
+        .hi=min((double)extent + buffer, INT32_MAX),
+    };
+    double xs[FUTILE_BATCH_BLOCK], ys[FUTILE_BATCH_BLOCK];
+    int32_t out_x[FUTILE_BATCH_BLOCK], out_y[FUTILE_BATCH_BLOCK];
+    size_t n_out = 0;
+    for (size_t start = 0; start < n; start += FUTILE_BATCH_BLOCK) {
+        size_t n_block = min_size(n - start, FUTILE_BATCH_BLOCK);
+        for (size_t i = 0; i < n_block; i++) {
+            xs[i] = in[start + i].x;
+            ys[i] = in[start + i].y;
+        }
+        kernel(xs, ys, n_block, is_lnglat, &t, out_x, out_y);
+        for (size_t i = 0; i < n_block; i++) {
+            if (drop_duplicates && n_out > 0 &&
+                out[n_out - 1].x == out_x[i] && out[n_out - 1].y == out_y[i]) {
+                continue;
+            }
+            out[n_out++] = (futile_tile_point_s){.x=out_x[i], .y=out_y[i]};
+        }
+    }
+    return n_out;
+}
+
+FUTILE_DEF size_t futile_mercator_to_tile_batch(futile_coord_s *coord, uint32_t extent, uint32_t buffer, futile_point_s *in, size_t n, bool drop_duplicates, futile_tile_point_s *out) {
+    return tile_batch(coord, extent, buffer, in, n, false, drop_duplicates, out);
+}
+
+FUTILE_DEF size_t futile_lnglat_to_tile_batch(futile_coord_s *coord, uint32_t extent, uint32_t buffer, futile_point_s *in, size_t n, bool drop_duplicates, futile_tile_point_s *out) {
+    return tile_batch(coord, extent, buffer, in, n, true, drop_duplicates, out);
+}
+
+// 2^FUTILE_WORLD_BITS, world coordinates are fractions of the mercator
+// square scaled by this
+static const double world_size = 4294967296.0;
+
+// written so that NaN also ends up at 0
+static uint32_t clamp_world_value(double v) {
+    if (!(v >= 0)) {
+        return 0;
+    }
+    if (v >= world_size) {
+        return UINT32_MAX;
+    }
+    return v;
+}
+
+// fraction of the mercator square from the top, matching
+// futile_lnglat_to_coord for latitudes within the mercator limit
+static double lat_to_world_fraction(double lat_deg) {
+    double lat_rad = degrees_to_radians(max(-max_projected_latitude, min(max_projected_latitude, lat_deg)));
+    return (1.0 - log(tan(lat_rad) + (1 / cos(lat_rad))) / M_PI) / 2.0;
+}
+
+FUTILE_DEF void futile_mercator_to_world(futile_point_s *in, futile_world_point_s *out) {
+    double scale = world_size / (2 * half_circumference_meters);
+    out->x = clamp_world_value((in->x + half_circumference_meters) * scale);
+    out->y = clamp_world_value((half_circumference_meters - in->y) * scale);
+}
+
+FUTILE_DEF void futile_world_to_mercator(futile_world_point_s *in, futile_point_s *out) {
+    double unit = 2 * half_circumference_meters / world_size;
+    out->x = (in->x + 0.5) * unit - half_circumference_meters;
+    out->y = half_circumference_meters - (in->y + 0.5) * unit;
+}
+
+FUTILE_DEF void futile_lnglat_to_world(futile_point_s *in, futile_world_point_s *out) {
+    out->x = clamp_world_value((in->x + 180.0) / 360.0 * world_size);
+    out->y = clamp_world_value(lat_to_world_fraction(in->y) * world_size);
+}
+
+FUTILE_DEF void futile_world_to_lnglat(futile_world_point_s *in, futile_point_s *out) {
+    futile_point_s merc;
+    futile_world_to_mercator(in, &merc);
+    futile_mercator_to_lnglat(&merc, out);
+}
+
+FUTILE_DEF void futile_world_to_coord(futile_world_point_s *in, unsigned int zoom, futile_coord_s *out) {
+    // through 64 bits, as a shift by 32 is undefined on uint32_t
+    unsigned int shift = FUTILE_WORLD_BITS - zoom;
+    out->x = (uint64_t)in->x >> shift;
+    out->y = (uint64_t)in->y >> shift;
+    out->z = zoom;
+}
+
+FUTILE_DEF void futile_coord_to_world_bounds(futile_coord_s *coord, futile_world_bounds_s *out) {
+    unsigned int shift = FUTILE_WORLD_BITS - coord->z;
+    uint64_t mask = ((uint64_t)1 << shift) - 1;
+    out->minx = (uint64_t)coord->x << shift;
+    out->miny = (uint64_t)coord->y << shift;
+    out->maxx = out->minx | mask;
+    out->maxy = out->miny | mask;
+}
+
+FUTILE_DEF void futile_bounds_to_world_bounds(futile_bounds_s *bounds, futile_world_bounds_s *out) {
+    futile_point_s topleft = {.x=bounds->minx, .y=bounds->maxy};
+    futile_point_s bottomright = {.x=bounds->maxx, .y=bounds->miny};
+    futile_world_point_s world_topleft, world_bottomright;
+    futile_lnglat_to_world(&topleft, &world_topleft);
+    futile_lnglat_to_world(&bottomright, &world_bottomright);
+    *out = (futile_world_bounds_s){
+        .minx=world_topleft.x,
+        .miny=world_topleft.y,
+        .maxx=world_bottomright.x,
+        .maxy=world_bottomright.y,
+    };
+}
+
+FUTILE_DEF unsigned int futile_world_bounds_to_coords(futile_world_bounds_s *bounds, unsigned int zoom, futile_coord_s *out_coords) {
+    futile_world_point_s topleft = {.x=bounds->minx, .y=bounds->miny};
+    futile_world_point_s bottomright = {.x=bounds->maxx, .y=bounds->maxy};
+    futile_world_to_coord(&topleft, zoom, &out_coords[0]);
+    futile_world_to_coord(&bottomright, zoom, &out_coords[1]);
+    return 1 + !futile_coord_equal(&out_coords[0], &out_coords[1]);
+}
+
+// Quadkey digits are the base 4 digits of the Morton code, top first
+static void morton_to_quadkey(uint64_t code, uint32_t zoom, char *out) {
+    for (uint32_t i = 0; i < zoom; i++) {
+        out[i] = '0' + ((code >> (2 * (zoom - 1 - i))) & 3);
+    }
+}
+
+// Accumulates quadkey digits into a Morton code, returning false on
+// any character other than 0-3
+static bool quadkey_to_morton(const char *quadkey, size_t n, uint64_t *out_code) {
+    uint64_t code = 0;
+    unsigned int invalid = 0;
+    for (size_t i = 0; i < n; i++) {
+        unsigned int digit = (unsigned char)quadkey[i] - '0';
+        invalid |= digit > 3;
+        code = (code << 2) | (digit & 3);
+    }
+    *out_code = code;
+    return !invalid;
+}
+
+FUTILE_DEF void futile_coord_to_quadkey(futile_coord_s *coord, char *quadkey) {
+    morton_to_quadkey(futile_morton_encode(coord->x, coord->y), coord->z, quadkey);
+    quadkey[coord->z] = '\0';
+}
+
+FUTILE_DEF bool futile_quadkey_to_coord(char *quadkey, size_t n_quadkey, futile_coord_s *coord) {
+    uint64_t code;
+    if (n_quadkey > FUTILE_QUADKEY_MAX || !quadkey_to_morton(quadkey, n_quadkey, &code)) {
+        return false;
+    }
+    futile_morton_decode(code, &coord->x, &coord->y);
+    coord->z = n_quadkey;
+    return true;
+}
+
+FUTILE_DEF bool futile_coord_to_quadkey_n(futile_coord_s *coord, char *out, size_t n_out) {
+    if (coord->z > FUTILE_QUADKEY_MAX || coord->z > n_out) {
+        return false;
+    }
+    morton_to_quadkey(futile_morton_encode(coord->x, coord->y), coord->z, out);
+    return true;
+}
+
+FUTILE_DEF size_t futile_coord_to_quadkey_lines(futile_coord_s *coords, size_t n, char *out, size_t n_out, size_t *out_n_formatted) {
+    uint64_t codes[FUTILE_BATCH_BLOCK];
+    size_t offset = 0;
+    size_t i = 0;
+    for (size_t start = 0; start < n; start += FUTILE_BATCH_BLOCK) {
+        size_t n_block = min_size(n - start, FUTILE_BATCH_BLOCK);
+        futile_morton_encode_batch(coords + start, n_block, codes);
+        for (size_t j = 0; j < n_block; j++, i++) {
+            uint32_t zoom = coords[i].z;
+            if (zoom == 0 || zoom > FUTILE_QUADKEY_MAX) {
+                errno = EINVAL;
+                goto done;
+            }
+            if (n_out - offset < zoom + 1) {
+                errno = ENOSPC;
+                goto done;
+            }
+            morton_to_quadkey(codes[j], zoom, out + offset);
+            offset += zoom;
+            out[offset++] = '\n';
+        }
+    }
+done:
+    if (out_n_formatted) {
+        *out_n_formatted = i;
+    }
+    return offset;
+}
+
+static bool parse_quadkey_line(const char *line, size_t n_line, futile_coord_s *out_coord) {
+    return n_line > 0 && futile_quadkey_to_coord((char *)line, n_line, out_coord);
+}
+
+FUTILE_DEF size_t futile_quadkey_parse_lines(const char *buf, size_t n_buf, futile_coord_group_s *group, futile_parse_error_fn on_error, void *userdata) {
+    return parse_lines(buf, n_buf, parse_quadkey_line, group, on_error, userdata);
+}
+
+FUTILE_DEF void futile_for_zoom_range(unsigned int zoom_start, unsigned int zoom_until, futile_coord_fn for_coord, void *userdata) {
+    for (unsigned int z = zoom_start; z <= zoom_until; z++) {
+        int limit = pow(2, z);
+        for (int x = 0; x < limit; x++) {
+            for (int y = 0; y < limit; y++) {
+                futile_coord_s coord = {.x = x, .y = y, .z = z};
+                for_coord(&coord, userdata);
+            }
+        }
+    }
+}
+
+FUTILE_DEF bool futile_for_zoom_range_array(futile_coord_cursor_s *cursor, futile_coord_group_s *group) {
+    unsigned int coord_index = 0;
+    unsigned int x = cursor->x;
+    unsigned int y = cursor->y;
+    unsigned int z = cursor->z;
+    bool is_group_complete = true;
+    for (; is_group_complete && z <= cursor->zoom_until; z++) {
+        unsigned int limit = pow(2, z);
+        for (; is_group_complete && x < limit; x++) {
+            for (; is_group_complete && y < limit; y++) {
+                if (coord_index >= group->n) {
+                    is_group_complete = false;
+                    cursor->x = x;
+                    cursor->y = y;
+                    cursor->z = z;
+                    break;
+                }
+                futile_coord_s coord = {.x = x, .y = y, .z = z};
+                group->coords[coord_index++] = coord;
+            }
+            y = 0;
+        }
+        x = 0;
+    }
+    group->n = coord_index;
+    return is_group_complete;
+}
+
+static const uint64_t default_parallel_block_size = 1 << 16;
+
+// Progress and cancellation shared by the workers of a parallel visit
+typedef struct {
+    futile_parallel_options_s *options;
+    uint64_t n_total;
+    uint64_t n_done;
+    bool cancelled;
+    pthread_mutex_t lock;
+} parallel_progress_s;
+
+static void parallel_progress_add(parallel_progress_s *progress, uint64_t n) {
+    futile_parallel_options_s *options = progress->options;
+    uint64_t n_done = __atomic_add_fetch(&progress->n_done, n, __ATOMIC_RELAXED);
+    // no more reports once the visit is cancelled
+    if (options->on_progress && !__atomic_load_n(&progress->cancelled, __ATOMIC_RELAXED)) {
+        pthread_mutex_lock(&progress->lock);
+        if (!options->on_progress(n_done, progress->n_total, options->progress_userdata)) {
+            __atomic_store_n(&progress->cancelled, true, __ATOMIC_RELAXED);
+        }
+        pthread_mutex_unlock(&progress->lock);
+    }
+}
+
+static bool parallel_progress_cancelled(parallel_progress_s *progress) {
+    bool *cancel = progress->options->cancel;
+    if (cancel && __atomic_load_n(cancel, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&progress->cancelled, true, __ATOMIC_RELAXED);
+    }
+    return __atomic_load_n(&progress->cancelled, __ATOMIC_RELAXED);
+}
+
+typedef void (*parallel_worker_fn)(void *pool, unsigned int index, void *userdata);
+
+typedef struct {
+    parallel_worker_fn run;
+    void *pool;
+    unsigned int index;
+    void *userdata;
+} parallel_worker_s;
+
+static void *parallel_worker_main(void *arg) {
+    parallel_worker_s *worker = arg;
+    worker->run(worker->pool, worker->index, worker->userdata);
+    return NULL;
+}
+
+// Batons are per thread, so the caller has to choose the number of
+// threads to size them, rather than leave it to default_n_threads
+static bool parallel_options_valid(futile_parallel_options_s *options) {
+    if (options->thread_userdata && options->n_threads == 0) {
+        errno = EINVAL;
+        return false;
+    }
+    return true;
+}
+
+// Run a worker per thread, each with its baton from the options. As
+// with the tile list reader, the calling thread is worker 0, and if
+// starting more threads fails, the workers that run have to pick up
+// the rest of the work.
+static void parallel_run_workers(futile_parallel_options_s *options, unsigned int n_threads, parallel_worker_fn run, void *pool) {
+    parallel_worker_s *workers = calloc(n_threads, sizeof(parallel_worker_s));
+    pthread_t *threads = calloc(n_threads, sizeof(pthread_t));
+    if (!workers || !threads) {
+        free(workers);
+        free(threads);
+        run(pool, 0, options->thread_userdata ? options->thread_userdata[0] : options->userdata);
+        return;
+    }
+    for (unsigned int i = 0; i < n_threads; i++) {
+        workers[i] = (parallel_worker_s){
+            .run = run,
+            .pool = pool,
+            .index = i,
+            .userdata = options->thread_userdata ? options->thread_userdata[i] : options->userdata,
+        };
+    }
+    unsigned int n_started = 1;
+    for (; n_started < n_threads; n_started++) {
+        if (pthread_create(&threads[n_started], NULL, parallel_worker_main, &workers[n_started]) != 0) {
+            break;
+        }
+    }
+    parallel_worker_main(&workers[0]);
+    for (unsigned int i = 1; i < n_started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(workers);
+    free(threads);
+}
+
+typedef struct {
+    parallel_progress_s progress;
+    futile_coord_fn for_coord;
+    unsigned int zoom_start;
+    unsigned int zoom_until;
+    // log2 of the block size
+    unsigned int block_bits;
+    // index of the first block of each zoom, and the total after the last
+    uint64_t first_block[FUTILE_ZORDER_MAX_ZOOM + 2];
+    uint64_t next_block;
+} zoom_range_pool_s;
+
+// Blocks hold whole zooms up to the block size, then runs of whole
+// columns, and past that parts of a single column
+static uint64_t zoom_range_n_blocks(unsigned int z, unsigned int block_bits) {
+    return 2 * z <= block_bits ? 1 : (uint64_t)1 << (2 * z - block_bits);
+}
+
+static void zoom_range_visit_block(zoom_range_pool_s *pool, void *userdata, unsigned int z, uint64_t block) {
+    uint64_t n = (uint64_t)1 << z;
+    uint64_t x0 = 0, x1 = n, y0 = 0, y1 = n;
+    unsigned int block_bits = pool->block_bits;
+    if (2 * z <= block_bits) {
+        // the whole zoom
+    } else if (z <= block_bits) {
+        x0 = block << (block_bits - z);
+        x1 = x0 + ((uint64_t)1 << (block_bits - z));
+    } else {
+        x0 = block >> (z - block_bits);
+        x1 = x0 + 1;
+        y0 = (block & (((uint64_t)1 << (z - block_bits)) - 1)) << block_bits;
+        y1 = y0 + ((uint64_t)1 << block_bits);
+    }
+    for (uint64_t x = x0; x < x1; x++) {
+        for (uint64_t y = y0; y < y1; y++) {
+            futile_coord_s coord = {.x = x, .y = y, .z = z};
+            pool->for_coord(&coord, userdata);
+        }
+    }
+    parallel_progress_add(&pool->progress, (x1 - x0) * (y1 - y0));
+}
+
+static void zoom_range_worker(void *pool_, __attribute__((unused)) unsigned int index, void *userdata) {
+    zoom_range_pool_s *pool = pool_;
+    uint64_t n_blocks = pool->first_block[pool->zoom_until + 1];
+    unsigned int z = pool->zoom_start;
+    while (!parallel_progress_cancelled(&pool->progress)) {
+        uint64_t block = __atomic_fetch_add(&pool->next_block, 1, __ATOMIC_RELAXED);
+        if (block >= n_blocks) {
+            break;
+        }
+        // blocks are claimed in increasing order, so the zoom only grows
+        while (block >= pool->first_block[z + 1]) {
+            z++;
+        }
+        zoom_range_visit_block(pool, userdata, z, block - pool->first_block[z]);
+    }
+}
+
+FUTILE_DEF bool futile_for_zoom_range_parallel(unsigned int zoom_start, unsigned int zoom_until, futile_coord_fn for_coord, futile_parallel_options_s *options) {
+    futile_parallel_options_s default_options = {0};
+    options = options ? options : &default_options;
+    if (zoom_until > FUTILE_ZORDER_MAX_ZOOM || !parallel_options_valid(options)) {
+        return false;
+    }
+    if (zoom_start > zoom_until) {
+        return true;
+    }
+
+    zoom_range_pool_s pool = {
+        .progress = {.options = options},
+        .for_coord = for_coord,
+        .zoom_start = zoom_start,
+        .zoom_until = zoom_until,
+    };
+    uint64_t block_size = options->block_size ? options->block_size : default_parallel_block_size;
+    while (pool.block_bits < 63 && ((uint64_t)2 << pool.block_bits) <= block_size) {
+        pool.block_bits++;
+    }
+    for (unsigned int z = zoom_start; z <= zoom_until; z++) {
+        pool.first_block[z + 1] = pool.first_block[z] + zoom_range_n_blocks(z, pool.block_bits);
+        pool.progress.n_total += (uint64_t)1 << (2 * z);
+    }
+    pthread_mutex_init(&pool.progress.lock, NULL);
+    unsigned int n_threads = options->n_threads ? options->n_threads : default_n_threads();
+    parallel_run_workers(options, n_threads, zoom_range_worker, &pool);
+    pthread_mutex_destroy(&pool.progress.lock);
+    return pool.progress.n_done == pool.progress.n_total;
+}
+
+FUTILE_DEF void futile_for_coord_zoom_range(unsigned int start_x, unsigned int start_y, unsigned int end_x, unsigned int end_y, unsigned int start_zoom, unsigned int end_zoom, futile_coord_fn for_coord, void *userdata) {
+    unsigned int zoom_multiplier = 1;
+    // all the "end" parameters are inclusive
+    // bump them all up here to make them exclusive for range
+    end_x += 1;
+    end_y += 1;
+    end_zoom += 1;
+    for (unsigned int zoom_index = start_zoom; zoom_index < end_zoom; zoom_index++) {
+        for (unsigned int x_index = start_x * zoom_multiplier;
+             x_index < end_x * zoom_multiplier;
+             x_index++) {
+            for (unsigned int y_index = start_y * zoom_multiplier;
+                 y_index < end_y * zoom_multiplier;
+                 y_index++) {
+                futile_coord_s coord = {.x = x_index, .y = y_index, .z = zoom_index};
+                for_coord(&coord, userdata);
+            }
+        }
+        zoom_multiplier *= 2;
+    }
+}
+
+
+FUTILE_DEF void futile_for_coord_parents(futile_coord_s *start, unsigned int zoom_until, futile_coord_fn for_coord, void *userdata) {
+    futile_coord_s coord = *start;
+    while (coord.z >= zoom_until) {
+        for_coord(&coord, userdata);
+        futile_coord_zoom(-1, &coord);
+    }
+}
+
+FUTILE_DEF long futile_n_for_zoom(unsigned int zoom) {
+    if (zoom > FUTILE_ZORDER_MAX_ZOOM) {
+        return -1;
+    }
+    // geometric series, each zoom containing 4 times more tiles, which
+    // is where the ids of the next zoom start
+    return zoom_base_id(zoom + 1);
+}
+
+FUTILE_DEF void futile_for_bounds(futile_bounds_s *bounds, unsigned int zoom_start, unsigned int zoom_until, futile_coord_fn for_coord, void *userdata) {
+    unsigned int start_x, until_x, start_y, until_y, n_coords;
+    futile_coord_s coords[2];
+
+    for (unsigned int z = zoom_start; z <= zoom_until; z++) {
+        n_coords = futile_bounds_to_coords(bounds, z, coords);;
+        if (n_coords == 2) {
+            start_x = coords[0].x;
+            start_y = coords[0].y;
+            until_x = coords[1].x;
+            until_y = coords[1].y;
+        } else {
+            start_x = until_x = coords[0].x;
+            start_y = until_y = coords[0].y;
+        }
+
+        coords->z = z;
+        for (unsigned int y = start_y; y <= until_y; y++) {
+            coords->y = y;
+            for (unsigned int x = start_x; x <= until_x; x++) {
+                coords->x = x;
+                for_coord(coords, userdata);
+            }
+        }
+    }
+}
+
+typedef struct {
+    unsigned int zoom;
+    unsigned int start_x, start_y, until_x, until_y;
+    // when set, only positions along the curve from first_d to last_d
+    bool limit_d;
+    uint64_t first_d, last_d;
+    futile_coord_fn for_coord;
+    void *userdata;
+} hilbert_walk_s;
+
+// orientation has bit 0 set when the curve is transposed and bit 1 set
+// when it is mirrored, relative to the root curve, which visits the
+// quadrants (0, 0), (0, 1), (1, 1), (1, 0)
+static void hilbert_child(unsigned int x, unsigned int y, unsigned int orientation, unsigned int d, unsigned int *out_x, unsigned int *out_y, unsigned int *out_orientation) {
+    static const unsigned int quadrant_x[4] = {0, 0, 1, 1};
+    static const unsigned int quadrant_y[4] = {0, 1, 1, 0};
+    static const unsigned int child_orientation[4] = {1, 0, 0, 3};
+    unsigned int flip = (orientation >> 1) & 1;
+    unsigned int rx = quadrant_x[d], ry = quadrant_y[d];
+    if (orientation & 1) {
+        unsigned int t = rx;
+        rx = ry;
+        ry = t;
+    }
+    *out_x = 2 * x + (rx ^ flip);
+    *out_y = 2 * y + (ry ^ flip);
+    *out_orientation = orientation ^ child_orientation[d];
+}
+
+// Depth first walk of the quadtree in Hilbert order, d is the position
+// of x, y along the curve at zoom z
+static void hilbert_walk(hilbert_walk_s *walk, unsigned int x, unsigned int y, unsigned int z, unsigned int orientation, uint64_t d) {
+    unsigned int shift = walk->zoom - z;
+    if ((x << shift) > walk->until_x || (((x + 1) << shift) - 1) < walk->start_x ||
+        (y << shift) > walk->until_y || (((y + 1) << shift) - 1) < walk->start_y) {
+        return;
+    }
+    if (walk->limit_d && ((d << 2 * shift) > walk->last_d || (((d + 1) << 2 * shift) - 1) < walk->first_d)) {
+        return;
+    }
+    if (shift == 0) {
+        futile_coord_s coord = {.x = x, .y = y, .z = z};
+        walk->for_coord(&coord, walk->userdata);
+        return;
+    }
+    for (unsigned int i = 0; i < 4; i++) {
+        unsigned int child_x, child_y, child_orientation;
+        hilbert_child(x, y, orientation, i, &child_x, &child_y, &child_orientation);
+        hilbert_walk(walk, child_x, child_y, z + 1, child_orientation, 4 * d + i);
+    }
+}
+
+FUTILE_DEF void futile_for_zoom_range_hilbert(unsigned int zoom_start, unsigned int zoom_until, futile_coord_fn for_coord, void *userdata) {
+    for (unsigned int z = zoom_start; z <= zoom_until; z++) {
+        hilbert_walk_s walk = {
+            .zoom = z,
+            .start_x = 0, .start_y = 0,
+            .until_x = (unsigned int)(((uint64_t)1 << z) - 1),
+            .until_y = (unsigned int)(((uint64_t)1 << z) - 1),
+            .for_coord = for_coord, .userdata = userdata,
+        };
+        hilbert_walk(&walk, 0, 0, 0, 0, 0);
+    }
+}
+
+FUTILE_DEF void futile_for_bounds_hilbert(futile_bounds_s *bounds, unsigned int zoom_start, unsigned int zoom_until, futile_coord_fn for_coord, void *userdata) {
+    futile_coord_s coords[2];
+    for (unsigned int z = zoom_start; z <= zoom_until; z++) {
+        hilbert_walk_s walk = {.zoom = z, .for_coord = for_coord, .userdata = userdata};
+        if (futile_bounds_to_coords(bounds, z, coords) == 2) {
+            walk.start_x = coords[0].x;
+            walk.start_y = coords[0].y;
+            walk.until_x = coords[1].x;
+            walk.until_y = coords[1].y;
+        } else {
+            walk.start_x = walk.until_x = coords[0].x;
+            walk.start_y = walk.until_y = coords[0].y;
+        }
+        hilbert_walk(&walk, 0, 0, 0, 0, 0);
+    }
+}
+
+// Each worker runs subtrees depth first from the bottom of its queue,
+// while thieves take from the top. A subtree queues at most three
+// siblings per level, so the queue never outgrows the ring.
+#define STEAL_DEQUE_SIZE 256
+
+typedef struct {
+    pthread_mutex_t lock;
+    uint64_t top;
+    uint64_t bottom;
+    futile_coord_s coords[STEAL_DEQUE_SIZE];
+} steal_deque_s;
+
+static void steal_deque_push(steal_deque_s *deque, futile_coord_s *coord) {
+    pthread_mutex_lock(&deque->lock);
+    deque->coords[deque->bottom++ % STEAL_DEQUE_SIZE] = *coord;
+    pthread_mutex_unlock(&deque->lock);
+}
+
+static bool steal_deque_pop(steal_deque_s *deque, futile_coord_s *out_coord) {
+    pthread_mutex_lock(&deque->lock);
+    bool found = deque->bottom > deque->top;
+    if (found) {
+        *out_coord = deque->coords[--deque->bottom % STEAL_DEQUE_SIZE];
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+static bool steal_deque_steal(steal_deque_s *deque, futile_coord_s *out_coord) {
+    pthread_mutex_lock(&deque->lock);
+    bool found = deque->bottom > deque->top;
+    if (found) {
+        *out_coord = deque->coords[deque->top++ % STEAL_DEQUE_SIZE];
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+typedef struct {
+    unsigned int start_x, start_y, until_x, until_y;
+} tile_range_s;
+
+static void bounds_tile_range(futile_bounds_s *bounds, unsigned int z, tile_range_s *out_range) {
+    futile_coord_s coords[2];
+    if (futile_bounds_to_coords(bounds, z, coords) == 2) {
+        *out_range = (tile_range_s){coords[0].x, coords[0].y, coords[1].x, coords[1].y};
+    } else {
+        *out_range = (tile_range_s){coords[0].x, coords[0].y, coords[0].x, coords[0].y};
+    }
+}
+
+static uint64_t tile_range_area(tile_range_s *range) {
+    return (uint64_t)(range->until_x - range->start_x + 1) * (range->until_y - range->start_y + 1);
+}
+
+typedef struct {
+    parallel_progress_s progress;
+    futile_coord_fn for_coord;
+    unsigned int zoom_start;
+    unsigned int zoom_until;
+    uint64_t block_size;
+    tile_range_s ranges[FUTILE_ZORDER_MAX_ZOOM + 1];
+    // subtrees queued or running, the visit is over at zero
+    uint64_t n_pending;
+    unsigned int n_workers;
+    steal_deque_s *deques;
+    futile_worker_stats_s *stats;
+} bounds_pool_s;
+
+typedef struct {
+    bounds_pool_s *pool;
+    unsigned int index;
+    void *userdata;
+    // coordinates visited since the last progress report
+    uint64_t n_unreported;
+} bounds_worker_s;
+
+static void bounds_worker_visit(bounds_worker_s *worker, futile_coord_s *coord) {
+    bounds_pool_s *pool = worker->pool;
+    pool->for_coord(coord, worker->userdata);
+    pool->stats[worker->index].n_coords++;
+    if (++worker->n_unreported >= pool->block_size) {
+        parallel_progress_add(&pool->progress, worker->n_unreported);
+        worker->n_unreported = 0;
+    }
+}
+
+static bool tile_range_contains(tile_range_s *range, unsigned int x, unsigned int y) {
+    return x >= range->start_x && x <= range->until_x && y >= range->start_y && y <= range->until_y;
+}
+
+static void bounds_worker_run(bounds_worker_s *worker, futile_coord_s *coord) {
+    bounds_pool_s *pool = worker->pool;
+    if (coord->z >= pool->zoom_start) {
+        bounds_worker_visit(worker, coord);
+    }
+    if (coord->z < pool->zoom_until) {
+        unsigned int z = coord->z + 1;
+        tile_range_s *range = &pool->ranges[z];
+        futile_coord_s children[4];
+        unsigned int n_children = 0;
+        for (unsigned int i = 0; i < 4; i++) {
+            futile_coord_s child = {.x = coord->x * 2 + (i & 1), .y = coord->y * 2 + (i >> 1), .z = z};
+            if (tile_range_contains(range, child.x, child.y)) {
+                children[n_children++] = child;
+            }
+        }
+        if (z == pool->zoom_until) {
+            // leaves are not worth queueing
+            for (unsigned int i = 0; i < n_children; i++) {
+                bounds_worker_visit(worker, &children[i]);
+            }
+        } else {
+            __atomic_add_fetch(&pool->n_pending, n_children, __ATOMIC_RELAXED);
+            // pushed in reverse so that the first child runs next
+            for (unsigned int i = n_children; i > 0; i--) {
+                steal_deque_push(&pool->deques[worker->index], &children[i - 1]);
+            }
+        }
+    }
+    pool->stats[worker->index].n_subtrees++;
+    __atomic_sub_fetch(&pool->n_pending, 1, __ATOMIC_RELEASE);
+}
+
+static bool bounds_worker_steal(bounds_worker_s *worker, futile_coord_s *out_coord) {
+    bounds_pool_s *pool = worker->pool;
+    futile_worker_stats_s *stats = &pool->stats[worker->index];
+    // start from a different victim each round to spread the thefts
+    unsigned int first = worker->index + 1 + (unsigned int)(stats->n_steals + stats->n_failed_steals);
+    for (unsigned int i = 0; i < pool->n_workers; i++) {
+        unsigned int victim = (first + i) % pool->n_workers;
+        if (victim != worker->index && steal_deque_steal(&pool->deques[victim], out_coord)) {
+            stats->n_steals++;
+            return true;
+        }
+    }
+    stats->n_failed_steals++;
+    return false;
+}
+
+static void bounds_worker(void *pool_, unsigned int index, void *userdata) {
+    bounds_worker_s worker = {.pool = pool_, .index = index, .userdata = userdata};
+    bounds_pool_s *pool = worker.pool;
+    futile_coord_s coord;
+    while (!parallel_progress_cancelled(&pool->progress)) {
+        if (steal_deque_pop(&pool->deques[index], &coord) ||
+            (pool->n_workers > 1 && bounds_worker_steal(&worker, &coord))) {
+            bounds_worker_run(&worker, &coord);
+        } else if (__atomic_load_n(&pool->n_pending, __ATOMIC_ACQUIRE) == 0) {
+            break;
+        } else {
+            sched_yield();
+        }
+    }
+    if (worker.n_unreported > 0) {
+        parallel_progress_add(&pool->progress, worker.n_unreported);
+    }
+}
+
+FUTILE_DEF bool futile_for_bounds_parallel(futile_bounds_s *bounds, unsigned int zoom_start, unsigned int zoom_until, futile_coord_fn for_coord, futile_parallel_options_s *options, futile_worker_stats_s *out_stats) {
+    futile_parallel_options_s default_options = {0};
+    options = options ? options : &default_options;
+    if (zoom_until > FUTILE_ZORDER_MAX_ZOOM || !parallel_options_valid(options)) {
+        return false;
+    }
+    // as with thread batons, the caller sizes the stats
+    if (out_stats && options->n_threads == 0) {
+        errno = EINVAL;
+        return false;
+    }
+    if (zoom_start > zoom_until) {
+        return true;
+    }
+
+    bounds_pool_s pool = {
+        .progress = {.options = options},
+        .for_coord = for_coord,
+        .zoom_start = zoom_start,
+        .zoom_until = zoom_until,
+        .block_size = options->block_size ? options->block_size : default_parallel_block_size,
+        .n_pending = 1,
+        .n_workers = options->n_threads ? options->n_threads : default_n_threads(),
+    };
+    for (unsigned int z = 0; z <= zoom_until; z++) {
+        bounds_tile_range(bounds, z, &pool.ranges[z]);
+        if (z >= zoom_start) {
+            pool.progress.n_total += tile_range_area(&pool.ranges[z]);
+        }
+    }
+
+    pool.deques = calloc(pool.n_workers, sizeof(steal_deque_s));
+    pool.stats = calloc(pool.n_workers, sizeof(futile_worker_stats_s));
+    if (!pool.deques || !pool.stats) {
+        free(pool.deques);
+        free(pool.stats);
+        return false;
+    }
+    for (unsigned int i = 0; i < pool.n_workers; i++) {
+        pthread_mutex_init(&pool.deques[i].lock, NULL);
+    }
+    futile_coord_s root = {0};
+    steal_deque_push(&pool.deques[0], &root);
+
+    pthread_mutex_init(&pool.progress.lock, NULL);
+    parallel_run_workers(options, pool.n_workers, bounds_worker, &pool);
+    pthread_mutex_destroy(&pool.progress.lock);
+
+    for (unsigned int i = 0; i < pool.n_workers; i++) {
+        pthread_mutex_destroy(&pool.deques[i].lock);
+    }
+    if (out_stats) {
+        memcpy(out_stats, pool.stats, pool.n_workers * sizeof(futile_worker_stats_s));
+    }
+    free(pool.deques);
+    free(pool.stats);
+    return pool.progress.n_done == pool.progress.n_total;
+}
+
+// Fills group with the coordinates from *position until end, counting
+// through the ranges of each zoom, rows first, or columns first.
+static bool tile_ranges_fill(tile_range_s *ranges, unsigned int zoom_start, unsigned int zoom_until, bool columns_first, uint64_t *position, uint64_t end, futile_coord_group_s *group) {
+    uint64_t offset = *position;
+    unsigned int z = zoom_start;
+    while (z <= zoom_until && offset >= tile_range_area(&ranges[z])) {
+        offset -= tile_range_area(&ranges[z]);
+        z++;
+    }
+    uint64_t n_left = end - *position;
+    size_t n_max = group->n < n_left ? group->n : n_left;
+    size_t n = 0;
+    for (; n < n_max; z++, offset = 0) {
+        tile_range_s *range = &ranges[z];
+        uint64_t area = tile_range_area(range);
+        uint64_t n_inner = columns_first ? range->until_y - range->start_y + 1 : range->until_x - range->start_x + 1;
+        uint64_t outer = offset / n_inner, inner = offset % n_inner;
+        for (; n < n_max && offset < area; offset++) {
+            futile_coord_s *coord = &group->coords[n++];
+            coord->z = z;
+            if (columns_first) {
+                coord->x = range->start_x + outer;
+                coord->y = range->start_y + inner;
+            } else {
+                coord->x = range->start_x + inner;
+                coord->y = range->start_y + outer;
+            }
+            if (++inner == n_inner) {
+                inner = 0;
+                outer++;
+            }
+        }
+    }
+    *position += n;
+    group->n = n;
+    return *position == end;
+}
+
+// Splits the positions from position until end into k parts, the
+// first of them one larger when they do not divide evenly.
+static void cursor_split_positions(uint64_t position, uint64_t end, size_t k, size_t i, uint64_t *out_position, uint64_t *out_end) {
+    uint64_t n_each = (end - position) / k, n_extra = (end - position) % k;
+    *out_position = position + i * n_each + (i < n_extra ? i : n_extra);
+    *out_end = *out_position + n_each + (i < n_extra);
+}
+
+static void bounds_cursor_ranges(futile_bounds_cursor_s *cursor, tile_range_s *out_ranges) {
+    for (unsigned int z = cursor->zoom_start; z <= cursor->zoom_until; z++) {
+        bounds_tile_range(&cursor->bounds, z, &out_ranges[z]);
+    }
+}
+
+static uint64_t tile_ranges_total(tile_range_s *ranges, unsigned int zoom_start, unsigned int zoom_until) {
+    uint64_t total = 0;
+    for (unsigned int z = zoom_start; z <= zoom_until; z++) {
+        total += tile_range_area(&ranges[z]);
+    }
+    return total;
+}
+
+FUTILE_DEF bool futile_bounds_cursor_init(futile_bounds_cursor_s *cursor, futile_bounds_s *bounds, unsigned int zoom_start, unsigned int zoom_until) {
+    if (zoom_until > FUTILE_ZORDER_MAX_ZOOM) {
+        return false;
+    }
+    *cursor = (futile_bounds_cursor_s){.bounds = *bounds, .zoom_start = zoom_start, .zoom_until = zoom_until};
+    tile_range_s ranges[FUTILE_ZORDER_MAX_ZOOM + 1];
+    bounds_cursor_ranges(cursor, ranges);
+    cursor->end = tile_ranges_total(ranges, zoom_start, zoom_until);
+    return true;
+}
+
+FUTILE_DEF bool futile_for_bounds_array(futile_bounds_cursor_s *cursor, futile_coord_group_s *group) {
+    tile_range_s ranges[FUTILE_ZORDER_MAX_ZOOM + 1];
+    bounds_cursor_ranges(cursor, ranges);
+    return tile_ranges_fill(ranges, cursor->zoom_start, cursor->zoom_until, false, &cursor->position, cursor->end, group);
+}
+
+FUTILE_DEF uint64_t futile_bounds_cursor_remaining(futile_bounds_cursor_s *cursor) {
+    return cursor->end - cursor->position;
+}
+
+FUTILE_DEF void futile_bounds_cursor_split(futile_bounds_cursor_s *cursor, size_t k, futile_bounds_cursor_s *out_cursors) {
+    futile_bounds_cursor_s whole = *cursor;
+    for (size_t i = 0; i < k; i++) {
+        out_cursors[i] = whole;
+        cursor_split_positions(whole.position, whole.end, k, i, &out_cursors[i].position, &out_cursors[i].end);
+    }
+}
+
+FUTILE_DEF bool futile_bounds_cursor_serialize(futile_bounds_cursor_s *cursor, size_t n_out, char *out) {
+    int n = snprintf(out, n_out, "bounds %u %u %llu %llu %.17g %.17g %.17g %.17g",
+                     cursor->zoom_start, cursor->zoom_until,
+                     (unsigned long long)cursor->position, (unsigned long long)cursor->end,
+                     cursor->bounds.minx, cursor->bounds.miny, cursor->bounds.maxx, cursor->bounds.maxy);
+    return n >= 0 && (size_t)n < n_out;
+}
+
+FUTILE_DEF bool futile_bounds_cursor_deserialize(const char *str, futile_bounds_cursor_s *out_cursor) {
+    futile_bounds_s bounds;
+    unsigned int zoom_start, zoom_until;
+    unsigned long long position, end;
+    int n = 0;
+    if (sscanf(str, "bounds %u %u %llu %llu %lg %lg %lg %lg %n",
+               &zoom_start, &zoom_until, &position, &end,
+               &bounds.minx, &bounds.miny, &bounds.maxx, &bounds.maxy, &n) != 8 || str[n] != '\0') {
+        return false;
+    }
+    futile_bounds_cursor_s cursor;
+    if (!futile_bounds_cursor_init(&cursor, &bounds, zoom_start, zoom_until) ||
+        position > end || end > cursor.end) {
+        return false;
+    }
+    cursor.position = position;
+    cursor.end = end;
+    *out_cursor = cursor;
+    return true;
+}
+
+static void coord_range_cursor_ranges(futile_coord_range_cursor_s *cursor, tile_range_s *out_ranges) {
+    for (unsigned int z = cursor->zoom_start; z <= cursor->zoom_until; z++) {
+        unsigned int shift = z - cursor->zoom_start;
+        out_ranges[z] = (tile_range_s){
+            .start_x = cursor->start_x << shift,
+            .start_y = cursor->start_y << shift,
+            .until_x = ((cursor->end_x + 1) << shift) - 1,
+            .until_y = ((cursor->end_y + 1) << shift) - 1,
+        };
+    }
+}
+
+FUTILE_DEF bool futile_coord_range_cursor_init(futile_coord_range_cursor_s *cursor, unsigned int start_x, unsigned int start_y, unsigned int end_x, unsigned int end_y, unsigned int start_zoom, unsigned int end_zoom) {
+    if (end_zoom > FUTILE_ZORDER_MAX_ZOOM || start_zoom > FUTILE_ZORDER_MAX_ZOOM ||
+        start_x > end_x || start_y > end_y ||
+        end_x >= (1U << start_zoom) || end_y >= (1U << start_zoom)) {
+        return false;
+    }
+    *cursor = (futile_coord_range_cursor_s){
+        .start_x = start_x, .start_y = start_y, .end_x = end_x, .end_y = end_y,
+        .zoom_start = start_zoom, .zoom_until = end_zoom,
+    };
+    tile_range_s ranges[FUTILE_ZORDER_MAX_ZOOM + 1];
+    coord_range_cursor_ranges(cursor, ranges);
+    cursor->end = tile_ranges_total(ranges, start_zoom, end_zoom);
+    return true;
+}
+
+FUTILE_DEF bool futile_for_coord_zoom_range_array(futile_coord_range_cursor_s *cursor, futile_coord_group_s *group) {
+    tile_range_s ranges[FUTILE_ZORDER_MAX_ZOOM + 1];
+    coord_range_cursor_ranges(cursor, ranges);
+    return tile_ranges_fill(ranges, cursor->zoom_start, cursor->zoom_until, true, &cursor->position, cursor->end, group);
+}
+
+FUTILE_DEF uint64_t futile_coord_range_cursor_remaining(futile_coord_range_cursor_s *cursor) {
+    return cursor->end - cursor->position;
+}
+
+FUTILE_DEF void futile_coord_range_cursor_split(futile_coord_range_cursor_s *cursor, size_t k, futile_coord_range_cursor_s *out_cursors) {
+    futile_coord_range_cursor_s whole = *cursor;
+    for (size_t i = 0; i < k; i++) {
+        out_cursors[i] = whole;
+        cursor_split_positions(whole.position, whole.end, k, i, &out_cursors[i].position, &out_cursors[i].end);
+    }
+}
+
+FUTILE_DEF bool futile_coord_range_cursor_serialize(futile_coord_range_cursor_s *cursor, size_t n_out, char *out) {
+    int n = snprintf(out, n_out, "coord-range %u %u %llu %llu %u %u %u %u",
+                     cursor->zoom_start, cursor->zoom_until,
+                     (unsigned long long)cursor->position, (unsigned long long)cursor->end,
+                     cursor->start_x, cursor->start_y, cursor->end_x, cursor->end_y);
+    return n >= 0 && (size_t)n < n_out;
+}
+
+FUTILE_DEF bool futile_coord_range_cursor_deserialize(const char *str, futile_coord_range_cursor_s *out_cursor) {
+    unsigned int zoom_start, zoom_until, start_x, start_y, end_x, end_y;
+    unsigned long long position, end;
+    int n = 0;
+    if (sscanf(str, "coord-range %u %u %llu %llu %u %u %u %u %n",
+               &zoom_start, &zoom_until, &position, &end,
+               &start_x, &start_y, &end_x, &end_y, &n) != 8 || str[n] != '\0') {
+        return false;
+    }
+    futile_coord_range_cursor_s cursor;
+    if (!futile_coord_range_cursor_init(&cursor, start_x, start_y, end_x, end_y, zoom_start, zoom_until) ||
+        position > end || end > cursor.end) {
+        return false;
+    }
+    cursor.position = position;
+    cursor.end = end;
+    *out_cursor = cursor;
+    return true;
+}
+
+FUTILE_DEF uint64_t futile_n_for_bounds(futile_bounds_s *bounds, unsigned int zoom_start, unsigned int zoom_until) {
+    uint64_t n = 0;
+    for (unsigned int z = zoom_start; z <= zoom_until && z <= FUTILE_ZORDER_MAX_ZOOM; z++) {
+        tile_range_s range;
+        bounds_tile_range(bounds, z, &range);
+        n += tile_range_area(&range);
+    }
+    return n;
+}
+
+static bool is_metatile_size(uint32_t size) {
+    return size != 0 && (size & (size - 1)) == 0;
+}
+
+// tiles across the metatile that exist at its zoom
+static uint64_t metatile_side(futile_metatile_s *metatile) {
+    uint64_t n_tiles = (uint64_t)1 << metatile->z;
+    return metatile->size < n_tiles ? metatile->size : n_tiles;
+}
+
+FUTILE_DEF bool futile_coord_to_metatile(futile_coord_s *coord, uint32_t size, futile_metatile_s *out) {
+    if (!is_metatile_size(size)) {
+        errno = EINVAL;
+        return false;
+    }
+    *out = (futile_metatile_s){.x=coord->x / size, .y=coord->y / size, .z=coord->z, .size=size};
+    return true;
+}
+
+FUTILE_DEF size_t futile_metatile_n_coords(futile_metatile_s *metatile) {
+    uint64_t side = metatile_side(metatile);
+    return side * side;
+}
+
+FUTILE_DEF size_t futile_metatile_to_coords(futile_metatile_s *metatile, futile_coord_s *out) {
+    uint64_t side = metatile_side(metatile);
+    uint64_t start_x = (uint64_t)metatile->x * metatile->size;
+    uint64_t start_y = (uint64_t)metatile->y * metatile->size;
+    size_t n = 0;
+    for (uint64_t y = start_y; y < start_y + side; y++) {
+        for (uint64_t x = start_x; x < start_x + side; x++) {
+            out[n++] = (futile_coord_s){.x=x, .y=y, .z=metatile->z};
+        }
+    }
+    return n;
+}
+
+FUTILE_DEF void futile_metatile_to_mercator_bounds(futile_metatile_s *metatile, double buffer, futile_bounds_s *out) {
+    double n_tiles = ldexp(1.0, metatile->z);
+    double tile_meters = 2 * half_circumference_meters / n_tiles;
+    double side = metatile_side(metatile);
+    double start_x = (double)metatile->x * metatile->size;
+    double start_y = (double)metatile->y * metatile->size;
+    double minx = max(0, start_x - buffer), maxx = min(n_tiles, start_x + side + buffer);
+    double miny = max(0, start_y - buffer), maxy = min(n_tiles, start_y + side + buffer);
+    // tile rows grow down, mercator y grows up
+    *out = (futile_bounds_s){
+        .minx=minx * tile_meters - half_circumference_meters,
+        .miny=half_circumference_meters - maxy * tile_meters,
+        .maxx=maxx * tile_meters - half_circumference_meters,
+        .maxy=half_circumference_meters - miny * tile_meters,
+    };
+}
+
+FUTILE_DEF bool futile_for_zoom_range_metatile(unsigned int zoom_start, unsigned int zoom_until, uint32_t size, futile_metatile_fn for_metatile, void *userdata) {
+    if (!is_metatile_size(size) || zoom_until > FUTILE_ZORDER_MAX_ZOOM) {
+        errno = EINVAL;
+        return false;
+    }
+    for (unsigned int z = zoom_start; z <= zoom_until; z++) {
+        uint64_t n_tiles = (uint64_t)1 << z;
+        uint64_t limit = n_tiles > size ? n_tiles / size : 1;
+        for (uint64_t x = 0; x < limit; x++) {
+            for (uint64_t y = 0; y < limit; y++) {
+                futile_metatile_s metatile = {.x=x, .y=y, .z=z, .size=size};
+                for_metatile(&metatile, userdata);
+            }
+        }
+    }
+    return true;
+}
+
+FUTILE_DEF bool futile_for_bounds_metatile(futile_bounds_s *bounds, unsigned int zoom_start, unsigned int zoom_until, uint32_t size, futile_metatile_fn for_metatile, void *userdata) {
+    if (!is_metatile_size(size) || zoom_until > FUTILE_ZORDER_MAX_ZOOM) {
+        errno = EINVAL;
+        return false;
+    }
+    for (unsigned int z = zoom_start; z <= zoom_until; z++) {
+        tile_range_s range;
+        bounds_tile_range(bounds, z, &range);
+        futile_metatile_s metatile = {.z=z, .size=size};
+        for (uint32_t y = range.start_y / size; y <= range.until_y / size; y++) {
+            metatile.y = y;
+            for (uint32_t x = range.start_x / size; x <= range.until_x / size; x++) {
+                metatile.x = x;
+                for_metatile(&metatile, userdata);
+            }
+        }
+    }
+    return true;
+}
+
+typedef struct {
+    uint64_t n;
+    double weight;
+} shard_cost_s;
+
+typedef struct {
+    futile_shard_options_s *options;
+    unsigned int zoom_start;
+    unsigned int zoom_until;
+    tile_range_s ranges[FUTILE_ZORDER_MAX_ZOOM + 1];
+    shard_cost_s zoom_costs[FUTILE_ZORDER_MAX_ZOOM + 1];
+    bool by_count;
+} shard_plan_s;
+
+// Number of coordinates at zoom within both the node and the range
+static uint64_t node_range_count(tile_range_s *range, unsigned int x, unsigned int y, unsigned int z, unsigned int zoom) {
+    unsigned int shift = zoom - z;
+    uint64_t start_x = (uint64_t)x << shift, until_x = (((uint64_t)x + 1) << shift) - 1;
+    uint64_t start_y = (uint64_t)y << shift, until_y = (((uint64_t)y + 1) << shift) - 1;
+    start_x = start_x > range->start_x ? start_x : range->start_x;
+    start_y = start_y > range->start_y ? start_y : range->start_y;
+    until_x = until_x < range->until_x ? until_x : range->until_x;
+    until_y = until_y < range->until_y ? until_y : range->until_y;
+    if (start_x > until_x || start_y > until_y) {
+        return 0;
+    }
+    return (until_x - start_x + 1) * (until_y - start_y + 1);
+}
+
+static shard_cost_s node_cost(shard_plan_s *plan, unsigned int x, unsigned int y, unsigned int z, unsigned int zoom) {
+    shard_cost_s cost = {.n = node_range_count(&plan->ranges[zoom], x, y, z, zoom)};
+    futile_shard_options_s *options = plan->options;
+    if (cost.n == 0 || plan->by_count) {
+        cost.weight = cost.n;
+        return cost;
+    }
+    unsigned int region_zoom = options->weight_zoom < zoom ? options->weight_zoom : zoom;
+    if (z >= region_zoom) {
+        futile_coord_s region = {.x = x >> (z - region_zoom), .y = y >> (z - region_zoom), .z = region_zoom};
+        cost.weight = cost.n * options->weight(&region, zoom, options->userdata);
+        return cost;
+    }
+    // the weight varies within the node, so add up its children
+    for (unsigned int i = 0; i < 4; i++) {
+        cost.weight += node_cost(plan, 2 * x + (i & 1), 2 * y + (i >> 1), z + 1, zoom).weight;
+    }
+    return cost;
+}
+
+static bool shard_cost_reached(shard_plan_s *plan, shard_cost_s *cost, shard_cost_s *target) {
+    return plan->by_count ? cost->n >= target->n : cost->weight >= target->weight;
+}
+
+static void shard_cost_add(shard_cost_s *cost, shard_cost_s *add) {
+    cost->n += add->n;
+    cost->weight += add->weight;
+}
+
+// Finds the first coordinate, in Hilbert id order, at which the cost
+// of the coordinates up to and including it reaches target. Returns
+// its id, and the cost up to it in out_cost.
+static uint64_t shard_plan_find(shard_plan_s *plan, shard_cost_s *target, shard_cost_s *out_cost) {
+    shard_cost_s cost = {0};
+    for (unsigned int zoom = plan->zoom_start; zoom <= plan->zoom_until; zoom++) {
+        shard_cost_s reached = cost;
+        shard_cost_add(&reached, &plan->zoom_costs[zoom]);
+        if (!shard_cost_reached(plan, &reached, target)) {
+            cost = reached;
+            continue;
+        }
+        unsigned int x = 0, y = 0, orientation = 0;
+        uint64_t d = 0;
+        for (unsigned int z = 0; z < zoom; z++) {
+            unsigned int child_x[4], child_y[4], child_orientation[4];
+            shard_cost_s child_cost[4];
+            unsigned int found = 4, last_nonempty = 0;
+            for (unsigned int i = 0; i < 4; i++) {
+                hilbert_child(x, y, orientation, i, &child_x[i], &child_y[i], &child_orientation[i]);
+                child_cost[i] = node_cost(plan, child_x[i], child_y[i], z + 1, zoom);
+                if (child_cost[i].n > 0) {
+                    last_nonempty = i;
+                }
+            }
+            for (unsigned int i = 0; i < 4 && found == 4; i++) {
+                reached = cost;
+                shard_cost_add(&reached, &child_cost[i]);
+                if (child_cost[i].n > 0 && shard_cost_reached(plan, &reached, target)) {
+                    found = i;
+                } else {
+                    cost = reached;
+                }
+            }
+            if (found == 4) {
+                // rounding left the target just past the children
+                found = last_nonempty;
+                cost.n -= child_cost[found].n;
+                cost.weight -= child_cost[found].weight;
+            }
+            x = child_x[found];
+            y = child_y[found];
+            orientation = child_orientation[found];
+            d = 4 * d + found;
+        }
+        shard_cost_s leaf_cost = node_cost(plan, x, y, zoom, zoom);
+        shard_cost_add(&cost, &leaf_cost);
+        *out_cost = cost;
+        return zoom_base_id(zoom) + d;
+    }
+    *out_cost = cost;
+    return zoom_base_id(plan->zoom_until + 1) - 1;
+}
+
+FUTILE_DEF size_t futile_bounds_shard(futile_bounds_s *bounds, unsigned int zoom_start, unsigned int zoom_until, size_t n_shards, futile_shard_options_s *options, futile_shard_s *out_shards) {
+    futile_shard_options_s default_options = {0};
+    options = options ? options : &default_options;
+    if (n_shards == 0 || zoom_start > zoom_until || zoom_until > FUTILE_ZORDER_MAX_ZOOM) {
+        return 0;
+    }
+    shard_plan_s plan = {
+        .options = options,
+        .zoom_start = zoom_start,
+        .zoom_until = zoom_until,
+        .by_count = options->weight == NULL,
+    };
+    shard_cost_s total = {0};
+    for (unsigned int z = zoom_start; z <= zoom_until; z++) {
+        bounds_tile_range(bounds, z, &plan.ranges[z]);
+    }
+    for (unsigned int z = zoom_start; z <= zoom_until; z++) {
+        plan.zoom_costs[z] = node_cost(&plan, 0, 0, 0, z);
+        shard_cost_add(&total, &plan.zoom_costs[z]);
+    }
+    if (!plan.by_count && !(total.weight > 0)) {
+        // nothing to balance by, fall back to counts
+        plan.by_count = true;
+        total.weight = total.n;
+        for (unsigned int z = zoom_start; z <= zoom_until; z++) {
+            plan.zoom_costs[z].weight = plan.zoom_costs[z].n;
+        }
+    }
+    if (total.n < n_shards) {
+        n_shards = total.n;
+    }
+
+    size_t n_written = 0;
+    uint64_t first_id = zoom_base_id(zoom_start);
+    shard_cost_s done = {0};
+    for (size_t k = 1; k <= n_shards; k++) {
+        uint64_t last_id = zoom_base_id(zoom_until + 1) - 1;
+        shard_cost_s cost = total;
+        if (k < n_shards) {
+            // the first k shards hold k / n_shards of the total
+            shard_cost_s target = {
+                .n = total.n / n_shards * k + total.n % n_shards * k / n_shards,
+                .weight = total.weight * k / n_shards,
+            };
+            last_id = shard_plan_find(&plan, &target, &cost);
+        }
+        if (cost.n == done.n) {
+            // a heavy coordinate filled more than its share
+            continue;
+        }
+        out_shards[n_written++] = (futile_shard_s){
+            .first_id = first_id,
+            .last_id = last_id,
+            .n_coords = cost.n - done.n,
+            .weight = cost.weight - done.weight,
+        };
+        first_id = last_id + 1;
+        done = cost;
+    }
+    return n_written;
+}
+
+FUTILE_DEF void futile_for_shard(futile_bounds_s *bounds, futile_shard_s *shard, futile_coord_fn for_coord, void *userdata) {
+    unsigned int zoom_first = zoom_of_id(shard->first_id), zoom_last = zoom_of_id(shard->last_id);
+    for (unsigned int z = zoom_first; z <= zoom_last; z++) {
+        tile_range_s range;
+        bounds_tile_range(bounds, z, &range);
+        hilbert_walk_s walk = {
+            .zoom = z,
+            .start_x = range.start_x, .start_y = range.start_y,
+            .until_x = range.until_x, .until_y = range.until_y,
+            .limit_d = true,
+            .first_d = z == zoom_first ? shard->first_id - zoom_base_id(z) : 0,
+            .last_d = z == zoom_last ? shard->last_id - zoom_base_id(z) : ((uint64_t)1 << 2 * z) - 1,
+            .for_coord = for_coord, .userdata = userdata,
+        };
+        hilbert_walk(&walk, 0, 0, 0, 0, 0);
+    }
+}
+
+// Coordinates found by a cover, as row << 32 | column, so that sorting
+// them orders by row then column
+typedef struct {
+    uint64_t *keys;
+    size_t n;
+    size_t capacity;
+} cover_keys_s;
+
+static bool cover_keys_push(cover_keys_s *keys, uint32_t x, uint32_t y) {
+    if (keys->n == keys->capacity) {
+        size_t capacity = keys->capacity ? keys->capacity * 2 : 256;
+        uint64_t *grown = realloc(keys->keys, capacity * sizeof(uint64_t));
+        if (!grown) {
+            return false;
+        }
+        keys->keys = grown;
+        keys->capacity = capacity;
+    }
+    keys->keys[keys->n++] = (uint64_t)y << 32 | x;
+    return true;
+}
+
+static void cover_keys_sort(cover_keys_s *keys) {
+    futile_sort_ids(keys->keys, keys->n, 1);
+    keys->n = futile_unique_ids(keys->keys, keys->n);
+}
+
+// Joins the column ranges of one row into runs
+typedef struct {
+    futile_coord_run_s run;
+    bool is_open;
+    futile_coord_run_fn for_run;
+    void *userdata;
+} run_builder_s;
+
+static void run_builder_flush(run_builder_s *builder) {
+    if (builder->is_open) {
+        builder->for_run(&builder->run, builder->userdata);
+        builder->is_open = false;
+    }
+}
+
+// ranges have to be added in increasing start_x order within a row
+static void run_builder_add(run_builder_s *builder, uint32_t z, uint32_t y, uint32_t start_x, uint32_t until_x) {
+    futile_coord_run_s *run = &builder->run;
+    if (builder->is_open && run->z == z && run->y == y && start_x <= (uint64_t)run->until_x + 1) {
+        run->until_x = until_x > run->until_x ? until_x : run->until_x;
+        return;
+    }
+    run_builder_flush(builder);
+    *run = (futile_coord_run_s){.z = z, .y = y, .start_x = start_x, .until_x = until_x};
+    builder->is_open = true;
+}
+
+// Projects to fractional tile positions at zoom, which stay within
+// the tiles when scaled down to lower zooms
+static futile_point_s *cover_project(futile_point_s *lnglats, size_t n, unsigned int zoom) {
+    futile_point_s *points = malloc((n ? n : 1) * sizeof(futile_point_s));
+    if (!points) {
+        return NULL;
+    }
+    double n_tiles = (double)((uint64_t)1 << zoom);
+    double last = nextafter(n_tiles, 0);
+    for (size_t i = 0; i < n; i++) {
+        double lat_deg = max(-max_projected_latitude, min(max_projected_latitude, lnglats[i].y));
+        double lat_rad = degrees_to_radians(lat_deg);
+        double x = (lnglats[i].x + 180.0) / 360.0 * n_tiles;
+        double y = (1.0 - log(tan(lat_rad) + (1 / cos(lat_rad))) / M_PI) / 2.0 * n_tiles;
+        points[i].x = !(x >= 0) ? 0 : min(x, last);
+        points[i].y = !(y >= 0) ? 0 : min(y, last);
+    }
+    return points;
+}
+
+// Walks the tiles that the segment from a to b passes through, one
+// step across a tile edge at a time. Where the segment goes through a
+// corner, it steps across one of the two edges first, so only one of
+// the tiles beside the corner is counted.
+static bool cover_segment(cover_keys_s *keys, futile_point_s *a, futile_point_s *b) {
+    uint32_t x = a->x, y = a->y;
+    uint32_t end_x = b->x, end_y = b->y;
+    double dx = b->x - a->x, dy = b->y - a->y;
+    int step_x = dx > 0 ? 1 : -1, step_y = dy > 0 ? 1 : -1;
+    double t_max_x = dx != 0 ? ((dx > 0 ? x + 1.0 : x) - a->x) / dx : INFINITY;
+    double t_max_y = dy != 0 ? ((dy > 0 ? y + 1.0 : y) - a->y) / dy : INFINITY;
+    double t_delta_x = dx != 0 ? fabs(1 / dx) : INFINITY;
+    double t_delta_y = dy != 0 ? fabs(1 / dy) : INFINITY;
+    if (!cover_keys_push(keys, x, y)) {
+        return false;
+    }
+    // each step moves one tile closer to the end, which keeps rounding
+    // from walking past it
+    uint64_t n_steps = (uint64_t)(x > end_x ? x - end_x : end_x - x) + (y > end_y ? y - end_y : end_y - y);
+    for (uint64_t i = 0; i < n_steps; i++) {
+        if (x != end_x && (y == end_y || t_max_x < t_max_y)) {
+            x += step_x;
+            t_max_x += t_delta_x;
+        } else {
+            y += step_y;
+            t_max_y += t_delta_y;
+        }
+        if (!cover_keys_push(keys, x, y)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void cover_scale(futile_point_s *points, size_t n, double scale, futile_point_s *out_points) {
+    for (size_t i = 0; i < n; i++) {
+        out_points[i].x = points[i].x * scale;
+        out_points[i].y = points[i].y * scale;
+    }
+}
+
+static void cover_emit_keys(cover_keys_s *keys, uint32_t z, run_builder_s *builder) {
+    for (size_t i = 0; i < keys->n; i++) {
+        uint32_t x = keys->keys[i], y = keys->keys[i] >> 32;
+        run_builder_add(builder, z, y, x, x);
+    }
+    run_builder_flush(builder);
+}
+
+typedef enum {
+    COVER_POINTS,
+    COVER_LINESTRING,
+} cover_kind_e;
+
+static bool cover_points_or_line(futile_point_s *lnglats, size_t n, unsigned int zoom_start, unsigned int zoom_until, cover_kind_e kind, futile_coord_run_fn for_run, void *userdata) {
+    if (zoom_until > FUTILE_ZORDER_MAX_ZOOM) {
+        return false;
+    }
+    futile_point_s *projected = cover_project(lnglats, n, zoom_until);
+    futile_point_s *points = malloc((n ? n : 1) * sizeof(futile_point_s));
+    cover_keys_s keys = {0};
+    bool ok = projected && points;
+    run_builder_s builder = {.for_run = for_run, .userdata = userdata};
+    for (unsigned int z = zoom_start; ok && z <= zoom_until; z++) {
+        cover_scale(projected, n, ldexp(1, -(int)(zoom_until - z)), points);
+        keys.n = 0;
+        for (size_t i = 0; ok && i < n; i++) {
+            if (kind == COVER_POINTS || n == 1) {
+                ok = cover_keys_push(&keys, points[i].x, points[i].y);
+            } else if (i + 1 < n) {
+                ok = cover_segment(&keys, &points[i], &points[i + 1]);
+            }
+        }
+        if (ok) {
+            cover_keys_sort(&keys);
+            cover_emit_keys(&keys, z, &builder);
+        }
+    }
+    free(keys.keys);
+    free(points);
+    free(projected);
+    return ok;
+}
+
+FUTILE_DEF bool futile_cover_points(futile_point_s *lnglats, size_t n, unsigned int zoom_start, unsigned int zoom_until, futile_coord_run_fn for_run, void *userdata) {
+    return cover_points_or_line(lnglats, n, zoom_start, zoom_until, COVER_POINTS, for_run, userdata);
+}
+
+FUTILE_DEF bool futile_cover_linestring(futile_point_s *lnglats, size_t n, unsigned int zoom_start, unsigned int zoom_until, futile_coord_run_fn for_run, void *userdata) {
+    return cover_points_or_line(lnglats, n, zoom_start, zoom_until, COVER_LINESTRING, for_run, userdata);
+}
+
+// A polygon edge that is not horizontal, from its top to its bottom
+typedef struct {
+    double y_min;
+    double y_max;
+    double x_at_y_min;
+    double dx_dy;
+} cover_edge_s;
+
+static int cover_edge_cmp(const void *lhs, const void *rhs) {
+    const cover_edge_s *a = lhs, *b = rhs;
+    return a->y_min < b->y_min ? -1 : a->y_min > b->y_min;
+}
+
+static int double_cmp(const void *lhs, const void *rhs) {
+    double a = *(const double *)lhs, b = *(const double *)rhs;
+    return a < b ? -1 : a > b;
+}
+
+typedef struct {
+    cover_edge_s *edges;
+    size_t n_edges;
+    // edges that may cross the current row, as indexes into edges
+    size_t *active;
+    size_t n_active;
+    size_t next_edge;
+    double *crossings;
+} cover_scanline_s;
+
+// Fills the even-odd spans where the rings cross the middle of row y,
+// joined with the tiles of the row that the rings pass through. Rows
+// have to be visited in increasing order.
+static void cover_scanline_row(cover_scanline_s *scan, uint32_t z, uint32_t y, uint32_t max_x, run_builder_s *builder, uint32_t *boundary_xs, size_t n_boundary) {
+    double y_mid = y + 0.5;
+    while (scan->next_edge < scan->n_edges && scan->edges[scan->next_edge].y_min <= y_mid) {
+        scan->active[scan->n_active++] = scan->next_edge++;
+    }
+    size_t n_active = 0, n_crossings = 0;
+    for (size_t i = 0; i < scan->n_active; i++) {
+        cover_edge_s *edge = &scan->edges[scan->active[i]];
+        if (edge->y_max <= y_mid) {
+            continue;
+        }
+        scan->active[n_active++] = scan->active[i];
+        scan->crossings[n_crossings++] = edge->x_at_y_min + (y_mid - edge->y_min) * edge->dx_dy;
+    }
+    scan->n_active = n_active;
+    qsort(scan->crossings, n_crossings, sizeof(double), double_cmp);
+
+    // merge the spans with the tiles the rings pass through
+    size_t b = 0;
+    for (size_t i = 0; i + 1 < n_crossings; i += 2) {
+        uint32_t start_x = min(scan->crossings[i], max_x), until_x = min(scan->crossings[i + 1], max_x);
+        for (; b < n_boundary && boundary_xs[b] < start_x; b++) {
+            run_builder_add(builder, z, y, boundary_xs[b], boundary_xs[b]);
+        }
+        run_builder_add(builder, z, y, start_x, until_x);
+    }
+    for (; b < n_boundary; b++) {
+        run_builder_add(builder, z, y, boundary_xs[b], boundary_xs[b]);
+    }
+}
+
+FUTILE_DEF bool futile_cover_polygon(futile_point_s *lnglats, size_t *ring_ends, size_t n_rings, unsigned int zoom_start, unsigned int zoom_until, futile_coord_run_fn for_run, void *userdata) {
+    if (zoom_until > FUTILE_ZORDER_MAX_ZOOM) {
+        return false;
+    }
+    size_t n = n_rings > 0 ? ring_ends[n_rings - 1] : 0;
+    futile_point_s *projected = cover_project(lnglats, n, zoom_until);
+    futile_point_s *points = malloc((n ? n : 1) * sizeof(futile_point_s));
+    cover_scanline_s scan = {
+        .edges = malloc((n ? n : 1) * sizeof(cover_edge_s)),
+        .active = malloc((n ? n : 1) * sizeof(size_t)),
+        .crossings = malloc((n ? n : 1) * sizeof(double)),
+    };
+    uint32_t *boundary_xs = NULL;
+    cover_keys_s keys = {0};
+    bool ok = projected && points && scan.edges && scan.active && scan.crossings;
+    run_builder_s builder = {.for_run = for_run, .userdata = userdata};
+    for (unsigned int z = zoom_start; ok && z <= zoom_until; z++) {
+        cover_scale(projected, n, ldexp(1, -(int)(zoom_until - z)), points);
+        keys.n = 0;
+        scan.n_edges = 0;
+        size_t first = 0;
+        for (size_t r = 0; ok && r < n_rings; first = ring_ends[r], r++) {
+            for (size_t i = first; ok && i < ring_ends[r]; i++) {
+                futile_point_s *a = &points[i];
+                futile_point_s *b = &points[i + 1 < ring_ends[r] ? i + 1 : first];
+                ok = cover_segment(&keys, a, b);
+                if (a->y != b->y) {
+                    futile_point_s *top = a->y < b->y ? a : b, *bottom = a->y < b->y ? b : a;
+                    scan.edges[scan.n_edges++] = (cover_edge_s){
+                        .y_min = top->y,
+                        .y_max = bottom->y,
+                        .x_at_y_min = top->x,
+                        .dx_dy = (bottom->x - top->x) / (bottom->y - top->y),
+                    };
+                }
+            }
+        }
+        if (!ok) {
+            break;
+        }
+        cover_keys_sort(&keys);
+        qsort(scan.edges, scan.n_edges, sizeof(cover_edge_s), cover_edge_cmp);
+        scan.n_active = 0;
+        scan.next_edge = 0;
+        uint32_t *grown = realloc(boundary_xs, (keys.n ? keys.n : 1) * sizeof(uint32_t));
+        if (!grown) {
+            ok = false;
+            break;
+        }
+        boundary_xs = grown;
+        // every row between the top and bottom of a ring has tiles on
+        // the ring, so walking the rows of the ring tiles finds them all
+        uint32_t max_x = (uint32_t)(((uint64_t)1 << z) - 1);
+        for (size_t i = 0; i < keys.n;) {
+            uint32_t y = keys.keys[i] >> 32;
+            size_t n_boundary = 0;
+            for (; i < keys.n && (uint32_t)(keys.keys[i] >> 32) == y; i++) {
+                boundary_xs[n_boundary++] = keys.keys[i];
+            }
+            cover_scanline_row(&scan, z, y, max_x, &builder, boundary_xs, n_boundary);
+        }
+        run_builder_flush(&builder);
+    }
+    free(keys.keys);
+    free(boundary_xs);
+    free(scan.edges);
+    free(scan.active);
+    free(scan.crossings);
+    free(points);
+    free(projected);
+    return ok;
+}
+
+// Runs in increasing row then column order, that do not overlap
+typedef struct {
+    futile_coord_run_s *runs;
+    size_t n;
+    size_t capacity;
+    bool failed;
+} run_list_s;
+
+static void run_list_push(run_list_s *list, uint32_t z, uint32_t y, uint32_t start_x, uint32_t until_x) {
+    if (list->n == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 64;
+        futile_coord_run_s *grown = realloc(list->runs, capacity * sizeof(futile_coord_run_s));
+        if (!grown) {
+            list->failed = true;
+            return;
+        }
+        list->runs = grown;
+        list->capacity = capacity;
+    }
+    list->runs[list->n++] = (futile_coord_run_s){.z = z, .y = y, .start_x = start_x, .until_x = until_x};
+}
+
+static void run_list_collect(futile_coord_run_s *run, void *userdata) {
+    run_list_push(userdata, run->z, run->y, run->start_x, run->until_x);
+}
+
+static size_t run_list_row_end(run_list_s *list, size_t first) {
+    size_t end = first;
+    while (end < list->n && list->runs[end].y == list->runs[first].y) {
+        end++;
+    }
+    return end;
+}
+
+// Pushes the n runs of one row, less the sorted column ranges in taken
+static void run_list_push_difference(run_list_s *out, futile_coord_run_s *runs, size_t n, futile_coord_run_s *taken, size_t n_taken) {
+    size_t t = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint64_t start_x = runs[i].start_x;
+        while (t < n_taken && taken[t].until_x < start_x) {
+            t++;
+        }
+        for (size_t u = t; u < n_taken && taken[u].start_x <= runs[i].until_x; u++) {
+            if (taken[u].start_x > start_x) {
+                run_list_push(out, runs[i].z, runs[i].y, start_x, taken[u].start_x - 1);
+            }
+            start_x = (uint64_t)taken[u].until_x + 1;
+        }
+        if (start_x <= runs[i].until_x) {
+            run_list_push(out, runs[i].z, runs[i].y, start_x, runs[i].until_x);
+        }
+    }
+}
+
+// Replaces each group of four tiles in level with their parent, in
+// parents, and pushes the tiles left over to out
+static void run_list_merge_level(run_list_s *level, run_list_s *parents, run_list_s *out, run_list_s *taken) {
+    for (size_t first = 0; first < level->n;) {
+        size_t end = run_list_row_end(level, first);
+        futile_coord_run_s *top = &level->runs[first];
+        if (top->y % 2 != 0 || end == level->n || level->runs[end].y != top->y + 1) {
+            run_list_push_difference(out, top, end - first, NULL, 0);
+            first = end;
+            continue;
+        }
+        size_t bottom_end = run_list_row_end(level, end);
+        futile_coord_run_s *bottom = &level->runs[end];
+        size_t n_top = end - first, n_bottom = bottom_end - end;
+        // the columns in both rows hold whole parents, from even to odd
+        taken->n = 0;
+        for (size_t a = 0, b = 0; a < n_top && b < n_bottom;) {
+            uint32_t start_x = top[a].start_x > bottom[b].start_x ? top[a].start_x : bottom[b].start_x;
+            uint32_t until_x = top[a].until_x < bottom[b].until_x ? top[a].until_x : bottom[b].until_x;
+            uint32_t parent_start = (start_x + 1) / 2;
+            if (start_x <= until_x && until_x > 0 && parent_start <= (until_x - 1) / 2) {
+                uint32_t parent_until = (until_x - 1) / 2;
+                run_list_push(parents, top->z - 1, top->y / 2, parent_start, parent_until);
+                run_list_push(taken, top->z, top->y, 2 * parent_start, 2 * parent_until + 1);
+            }
+            if (top[a].until_x < bottom[b].until_x) {
+                a++;
+            } else {
+                b++;
+            }
+        }
+        run_list_push_difference(out, top, n_top, taken->runs, taken->n);
+        run_list_push_difference(out, bottom, n_bottom, taken->runs, taken->n);
+        first = bottom_end;
+    }
+}
+
+// Replaces level with the parents of its tiles
+static void run_list_coarsen(run_list_s *level, run_list_s *out) {
+    for (size_t first = 0; first < level->n;) {
+        size_t end = run_list_row_end(level, first);
+        size_t bottom_end = end;
+        if (level->runs[first].y % 2 == 0 && end < level->n && level->runs[end].y == level->runs[first].y + 1) {
+            bottom_end = run_list_row_end(level, end);
+        }
+        // merge both rows by start column, joining what overlaps
+        size_t a = first, b = end;
+        size_t n_before = out->n;
+        while (a < end || b < bottom_end) {
+            futile_coord_run_s *run = b == bottom_end || (a < end && level->runs[a].start_x <= level->runs[b].start_x) ? &level->runs[a++] : &level->runs[b++];
+            uint32_t start_x = run->start_x / 2, until_x = run->until_x / 2;
+            futile_coord_run_s *last = out->n > n_before ? &out->runs[out->n - 1] : NULL;
+            if (last && start_x <= (uint64_t)last->until_x + 1) {
+                last->until_x = until_x > last->until_x ? until_x : last->until_x;
+            } else {
+                run_list_push(out, run->z - 1, run->y / 2, start_x, until_x);
+            }
+        }
+        first = bottom_end;
+    }
+}
+
+FUTILE_DEF bool futile_cover_polygon_mixed(futile_point_s *lnglats, size_t *ring_ends, size_t n_rings, unsigned int zoom, uint64_t max_coords, futile_coord_fn for_coord, void *userdata) {
+    if (zoom > FUTILE_ZORDER_MAX_ZOOM) {
+        return false;
+    }
+    run_list_s cover = {0};
+    bool ok = futile_cover_polygon(lnglats, ring_ends, n_rings, zoom, zoom, run_list_collect, &cover) && !cover.failed;
+    // the coordinates left at each zoom, once the rest merge into parents
+    run_list_s levels[FUTILE_ZORDER_MAX_ZOOM + 1] = {{0}};
+    run_list_s scratch[2] = {{0}}, taken = {0};
+    for (unsigned int z = zoom; ok; z--) {
+        run_list_s *current = &cover;
+        for (unsigned int l = z; l > 0; l--) {
+            run_list_s *parents = &scratch[l % 2];
+            parents->n = 0;
+            levels[l].n = 0;
+            run_list_merge_level(current, parents, &levels[l], &taken);
+            ok = ok && !parents->failed && !levels[l].failed && !taken.failed;
+            current = parents;
+        }
+        // whatever reaches zoom 0 is the root
+        run_list_s *roots = current;
+        uint64_t n_coords = 0;
+        for (unsigned int l = 0; l <= z; l++) {
+            run_list_s *level = l == 0 ? roots : &levels[l];
+            for (size_t i = 0; i < level->n; i++) {
+                n_coords += level->runs[i].until_x - level->runs[i].start_x + 1;
+            }
+        }
+        if (ok && (max_coords == 0 || n_coords <= max_coords || z == 0)) {
+            for (unsigned int l = 0; l <= z; l++) {
+                run_list_s *level = l == 0 ? roots : &levels[l];
+                for (size_t i = 0; i < level->n; i++) {
+                    futile_coord_run_s *run = &level->runs[i];
+                    for (uint64_t x = run->start_x; x <= run->until_x; x++) {
+                        futile_coord_s coord = {.x = x, .y = run->y, .z = run->z};
+                        for_coord(&coord, userdata);
+                    }
+                }
+            }
+            break;
+        }
+        // too many, try again with the cover a zoom up
+        run_list_s coarser = {0};
+        run_list_coarsen(&cover, &coarser);
+        ok = ok && !coarser.failed;
+        free(cover.runs);
+        cover = coarser;
+    }
+    for (unsigned int l = 0; l <= zoom; l++) {
+        free(levels[l].runs);
+    }
+    free(cover.runs);
+    free(scratch[0].runs);
+    free(scratch[1].runs);
+    free(taken.runs);
+    return ok;
+}
+
+// Shards index with the high bits of the hash and probe with the low
+// bits, so a key's shard says nothing about its slot
+static uint64_t mix_id(uint64_t v) {
+    v ^= v >> 33;
+    v *= 0xff51afd7ed558ccdULL;
+    v ^= v >> 33;
+    v *= 0xc4ceb9fe1a85ec53ULL;
+    v ^= v >> 33;
+    return v;
+}
+
+// Segment tree over the column edges xs, where leaf i is the columns
+// xs[i] to xs[i + 1] - 1 and node i has children 2i and 2i + 1 below
+// the root at 1. A node counts the bounds covering all of its columns
+// and none of its parent's, and is_covered is set when any column
+// below it is covered.
+typedef struct {
+    uint64_t *xs;
+    size_t n_xs;
+    // leaves in the tree, the power of 2 from n_xs - 1
+    size_t n_leaves;
+    uint32_t *counts;
+    bool *is_covered;
+    futile_coord_run_s *runs;
+    size_t n_runs;
+} cover_bounds_tree_s;
 
-FUTILE_DEF void futile_coord_println(futile_coord_s *coord, FILE *out) {
-    futile_coord_print(coord, out);
-    fputc('\n', out);
+static void cover_bounds_refresh(cover_bounds_tree_s *tree, size_t node) {
+    tree->is_covered[node] = tree->counts[node] > 0 ||
+        (node < tree->n_leaves && (tree->is_covered[2 * node] || tree->is_covered[2 * node + 1]));
+}
+
+// Adds delta to the nodes spanning leaves start to until - 1, from the
+// leaves up, then refreshes the nodes above the two ends
+static void cover_bounds_update(cover_bounds_tree_s *tree, size_t start, size_t until, int delta) {
+    size_t lo = start + tree->n_leaves, hi = until + tree->n_leaves;
+    size_t first = lo, last = hi - 1;
+    for (; lo < hi; lo /= 2, hi /= 2) {
+        if (lo & 1) {
+            tree->counts[lo] += delta;
+            cover_bounds_refresh(tree, lo++);
+        }
+        if (hi & 1) {
+            tree->counts[--hi] += delta;
+            cover_bounds_refresh(tree, hi);
+        }
+    }
+    for (size_t node = first / 2; node > 0; node /= 2) {
+        cover_bounds_refresh(tree, node);
+    }
+    for (size_t node = last / 2; node > 0; node /= 2) {
+        cover_bounds_refresh(tree, node);
+    }
+}
+
+// Collects the covered columns in increasing order, joining touching
+// ranges of neighbouring nodes
+static void cover_bounds_collect(cover_bounds_tree_s *tree, size_t node, size_t lo, size_t hi) {
+    if (!tree->is_covered[node]) {
+        return;
+    }
+    if (tree->counts[node] == 0) {
+        size_t mid = lo + (hi - lo) / 2;
+        cover_bounds_collect(tree, 2 * node, lo, mid);
+        cover_bounds_collect(tree, 2 * node + 1, mid, hi);
+        return;
+    }
+    uint32_t start_x = tree->xs[lo], until_x = tree->xs[hi] - 1;
+    futile_coord_run_s *last = tree->n_runs ? &tree->runs[tree->n_runs - 1] : NULL;
+    if (last && (uint64_t)last->until_x + 1 == start_x) {
+        last->until_x = until_x;
+    } else {
+        tree->runs[tree->n_runs++] = (futile_coord_run_s){.start_x=start_x, .until_x=until_x};
+    }
+}
+
+// A bounds that covers the same tiles as an earlier one at a zoom
+// adds nothing to the union there, nor at the zooms below, where the
+// tiles are their parents. Working up from zoom_until over the bounds
+// still distinct finds the first zoom each one is swept from.
+static bool cover_bounds_first_zooms(futile_world_bounds_s *worlds, size_t n, unsigned int zoom_start, unsigned int zoom_until, uint32_t *distinct, uint8_t *out_first_zooms) {
+    size_t n_slots = 16;
+    while (n_slots < 2 * n) {
+        n_slots *= 2;
+    }
+    // the tiles of a bounds as two keys, its topleft then bottomright
+    uint64_t *slots = malloc(2 * n_slots * sizeof(uint64_t));
+    if (!slots) {
+        return false;
+    }
+    size_t n_distinct = n;
+    for (size_t i = 0; i < n; i++) {
+        distinct[i] = i;
+        out_first_zooms[i] = zoom_start;
+    }
+    for (unsigned int z = zoom_until + 1; z-- > zoom_start;) {
+        unsigned int shift = FUTILE_WORLD_BITS - z;
+        while (n_slots > 16 && n_slots / 2 >= 2 * n_distinct) {
+            n_slots /= 2;
+        }
+        memset(slots, 0xff, 2 * n_slots * sizeof(uint64_t));
+        size_t n_left = 0;
+        for (size_t d = 0; d < n_distinct; d++) {
+            futile_world_bounds_s *world = &worlds[distinct[d]];
+            uint64_t topleft = ((uint64_t)world->minx >> shift) << 32 | (uint64_t)world->miny >> shift;
+            uint64_t bottomright = ((uint64_t)world->maxx >> shift) << 32 | (uint64_t)world->maxy >> shift;
+            size_t slot = mix_id(topleft ^ mix_id(bottomright)) & (n_slots - 1);
+            while (slots[2 * slot] != UINT64_MAX && (slots[2 * slot] != topleft || slots[2 * slot + 1] != bottomright)) {
+                slot = (slot + 1) & (n_slots - 1);
+            }
+            if (slots[2 * slot] == UINT64_MAX) {
+                slots[2 * slot] = topleft;
+                slots[2 * slot + 1] = bottomright;
+                distinct[n_left++] = distinct[d];
+            } else {
+                out_first_zooms[distinct[d]] = z + 1;
+            }
+        }
+        n_distinct = n_left;
+    }
+    free(slots);
+    return true;
+}
+
+// The index of the first key from i whose bounds is swept at zoom z,
+// or n if there is none
+static size_t cover_bounds_skip(uint64_t *keys, size_t i, size_t n, uint8_t *first_zooms, unsigned int z) {
+    while (i < n && first_zooms[(uint32_t)keys[i]] > z) {
+        i++;
+    }
+    return i;
+}
+
+// Merges the column edges of the bounds swept at zoom z into the
+// tree's sorted, unique xs, noting the leaf where each starts and the
+// one past where it stops. The edges come sorted in world units, as
+// edge << 32 | bounds, and a shift keeps them sorted at every zoom.
+static void cover_bounds_edges(cover_bounds_tree_s *tree, uint64_t *starts, uint64_t *stops, size_t n, uint8_t *first_zooms, unsigned int z, uint32_t *out_start_leaves, uint32_t *out_stop_leaves) {
+    unsigned int shift = FUTILE_WORLD_BITS - z;
+    tree->n_xs = 0;
+    size_t s = cover_bounds_skip(starts, 0, n, first_zooms, z);
+    size_t e = cover_bounds_skip(stops, 0, n, first_zooms, z);
+    while (s < n || e < n) {
+        uint64_t start_x = s < n ? (starts[s] >> 32) >> shift : UINT64_MAX;
+        uint64_t stop_x = e < n ? ((stops[e] >> 32) >> shift) + 1 : UINT64_MAX;
+        uint64_t x = start_x < stop_x ? start_x : stop_x;
+        if (tree->n_xs == 0 || tree->xs[tree->n_xs - 1] != x) {
+            tree->xs[tree->n_xs++] = x;
+        }
+        if (start_x == x) {
+            out_start_leaves[(uint32_t)starts[s]] = tree->n_xs - 1;
+            s = cover_bounds_skip(starts, s + 1, n, first_zooms, z);
+        } else {
+            out_stop_leaves[(uint32_t)stops[e]] = tree->n_xs - 1;
+            e = cover_bounds_skip(stops, e + 1, n, first_zooms, z);
+        }
+    }
+}
+
+// The first row at a zoom where the next bounds starts or stops covering
+static uint64_t cover_bounds_next_row(uint64_t *starts, size_t s, uint64_t *stops, size_t e, size_t n, unsigned int shift) {
+    uint64_t row = ((stops[e] >> 32) >> shift) + 1;
+    if (s < n && (starts[s] >> 32) >> shift < row) {
+        row = (starts[s] >> 32) >> shift;
+    }
+    return row;
+}
+
+FUTILE_DEF bool futile_cover_bounds(futile_bounds_s *bounds, size_t n, unsigned int zoom_start, unsigned int zoom_until, futile_coord_run_fn for_run, void *userdata) {
+    if (zoom_until > FUTILE_ZORDER_MAX_ZOOM || n > UINT32_MAX) {
+        return false;
+    }
+    size_t n_alloc = n ? n : 1;
+    // each world edge of each bounds as edge << 32 | bounds, projected
+    // and sorted once, so that a zoom only has to shift them
+    uint64_t *edges = malloc(4 * n_alloc * sizeof(uint64_t));
+    uint32_t *leaves = malloc(2 * n_alloc * sizeof(uint32_t));
+    uint8_t *first_zooms = malloc(n_alloc * sizeof(uint8_t));
+    // 2n edges make at most 2n - 1 leaves, rounded up to under 4n, in
+    // under 8n nodes
+    cover_bounds_tree_s tree = {
+        .xs=malloc(2 * n_alloc * sizeof(uint64_t)),
+        .counts=malloc(8 * n_alloc * sizeof(uint32_t)),
+        .is_covered=malloc(8 * n_alloc * sizeof(bool)),
+        .runs=malloc(n_alloc * sizeof(futile_coord_run_s)),
+    };
+    bool ok = edges && leaves && first_zooms && tree.xs && tree.counts && tree.is_covered && tree.runs;
+    uint64_t *start_xs = edges, *stop_xs = edges + n, *start_ys = edges + 2 * n, *stop_ys = edges + 3 * n;
+    uint32_t *start_leaves = leaves, *stop_leaves = leaves + n;
+
+    // bounds are numbered by their top row, so that the sweep finds
+    // them mostly in order rather than all over memory
+    futile_world_bounds_s *worlds = ok ? malloc(2 * n_alloc * sizeof(futile_world_bounds_s)) : NULL;
+    ok = worlds != NULL;
+    futile_world_bounds_s *projected = worlds ? worlds + n_alloc : NULL;
+    size_t n_valid = 0;
+    for (size_t i = 0; ok && i < n; i++) {
+        futile_world_bounds_s *world = &projected[n_valid];
+        futile_bounds_to_world_bounds(&bounds[i], world);
+        if (world->minx > world->maxx || world->miny > world->maxy) {
+            continue;
+        }
+        start_ys[n_valid] = (uint64_t)world->miny << 32 | n_valid;
+        n_valid++;
+    }
+    ok = ok && futile_sort_ids(start_ys, n_valid, 1);
+    for (size_t i = 0; ok && i < n_valid; i++) {
+        futile_world_bounds_s *world = &worlds[i];
+        *world = projected[(uint32_t)start_ys[i]];
+        start_xs[i] = (uint64_t)world->minx << 32 | i;
+        stop_xs[i] = (uint64_t)world->maxx << 32 | i;
+        start_ys[i] = (uint64_t)world->miny << 32 | i;
+        stop_ys[i] = (uint64_t)world->maxy << 32 | i;
+    }
+    ok = ok && futile_sort_ids(start_xs, n_valid, 1) && futile_sort_ids(stop_xs, n_valid, 1) && futile_sort_ids(stop_ys, n_valid, 1) &&
+        cover_bounds_first_zooms(worlds, n_valid, zoom_start, zoom_until, leaves, first_zooms);
+    free(worlds);
+
+    for (unsigned int z = zoom_start; ok && n_valid > 0 && z <= zoom_until; z++) {
+        unsigned int shift = FUTILE_WORLD_BITS - z;
+        cover_bounds_edges(&tree, start_xs, stop_xs, n_valid, first_zooms, z, start_leaves, stop_leaves);
+        tree.n_leaves = 1;
+        while (tree.n_leaves < tree.n_xs - 1) {
+            tree.n_leaves *= 2;
+        }
+        memset(tree.counts, 0, 2 * tree.n_leaves * sizeof(uint32_t));
+        memset(tree.is_covered, 0, 2 * tree.n_leaves * sizeof(bool));
+
+        // the covered columns only change on rows where a bounds starts
+        // or stops, so the runs found there repeat down to the next one
+        size_t s = cover_bounds_skip(start_ys, 0, n_valid, first_zooms, z);
+        size_t e = cover_bounds_skip(stop_ys, 0, n_valid, first_zooms, z);
+        while (e < n_valid) {
+            uint64_t y = cover_bounds_next_row(start_ys, s, stop_ys, e, n_valid, shift);
+            for (; e < n_valid && ((stop_ys[e] >> 32) >> shift) + 1 == y; e = cover_bounds_skip(stop_ys, e + 1, n_valid, first_zooms, z)) {
+                uint32_t i = (uint32_t)stop_ys[e];
+                cover_bounds_update(&tree, start_leaves[i], stop_leaves[i], -1);
+            }
+            for (; s < n_valid && (start_ys[s] >> 32) >> shift == y; s = cover_bounds_skip(start_ys, s + 1, n_valid, first_zooms, z)) {
+                uint32_t i = (uint32_t)start_ys[s];
+                cover_bounds_update(&tree, start_leaves[i], stop_leaves[i], 1);
+            }
+            if (e == n_valid) {
+                break;
+            }
+            uint64_t next_y = cover_bounds_next_row(start_ys, s, stop_ys, e, n_valid, shift);
+            tree.n_runs = 0;
+            cover_bounds_collect(&tree, 1, 0, tree.n_leaves);
+            for (uint64_t row = y; row < next_y; row++) {
+                for (size_t r = 0; r < tree.n_runs; r++) {
+                    futile_coord_run_s run = tree.runs[r];
+                    run.z = z;
+                    run.y = row;
+                    for_run(&run, userdata);
+                }
+            }
+        }
+    }
+    free(tree.runs);
+    free(tree.is_covered);
+    free(tree.counts);
+    free(tree.xs);
+    free(first_zooms);
+    free(leaves);
+    free(edges);
+    return ok;
+}
+
+enum {
+    TILE_CONTAINER_ARRAY,
+    TILE_CONTAINER_BITMAP,
+    TILE_CONTAINER_RUN,
+};
+
+enum {
+    TILE_SET_UNION,
+    TILE_SET_INTERSECT,
+    TILE_SET_DIFFERENCE,
+};
+
+#define TILE_CONTAINER_SIZE 65536
+#define TILE_BITMAP_WORDS (TILE_CONTAINER_SIZE / 64)
+#define TILE_BITMAP_BYTES (TILE_BITMAP_WORDS * 8)
+// past these sizes, arrays and runs take more room than a bitmap
+#define TILE_ARRAY_MAX (TILE_BITMAP_BYTES / 2)
+#define TILE_RUN_MAX (TILE_BITMAP_BYTES / 4)
+
+// runs are stored as pairs of first and last positions
+typedef struct {
+    uint16_t first;
+    uint16_t last;
+} tile_run_s;
+
+static size_t tile_container_item_size(uint32_t type) {
+    switch (type) {
+    case TILE_CONTAINER_ARRAY:
+        return sizeof(uint16_t);
+    case TILE_CONTAINER_RUN:
+        return sizeof(tile_run_s);
+    default:
+        return sizeof(uint64_t);
+    }
+}
+
+static bool tile_container_alloc(futile_tile_container_s *container, uint32_t type, uint32_t capacity) {
+    void *data = malloc(tile_container_item_size(type) * capacity);
+    if (!data) {
+        return false;
+    }
+    free(container->data);
+    container->type = type;
+    container->capacity = capacity;
+    container->data = data;
+    return true;
+}
+
+static uint32_t bitmap_count_runs(const uint64_t *words) {
+    uint32_t n_runs = 0;
+    uint64_t prev = 0;
+    for (size_t i = 0; i < TILE_BITMAP_WORDS; i++) {
+        uint64_t word = words[i];
+        n_runs += __builtin_popcountll(word & ~(word << 1 | prev >> 63));
+        prev = word;
+    }
+    return n_runs;
+}
+
+static void bitmap_set_range(uint64_t *words, uint32_t first, uint32_t last) {
+    uint32_t first_word = first / 64, last_word = last / 64;
+    uint64_t first_mask = ~(uint64_t)0 << (first % 64);
+    uint64_t last_mask = ~(uint64_t)0 >> (63 - last % 64);
+    if (first_word == last_word) {
+        words[first_word] |= first_mask & last_mask;
+        return;
+    }
+    words[first_word] |= first_mask;
+    for (uint32_t i = first_word + 1; i < last_word; i++) {
+        words[i] = ~(uint64_t)0;
+    }
+    words[last_word] |= last_mask;
+}
+
+static void tile_container_to_bitmap(futile_tile_container_s *container, uint64_t *words) {
+    if (container->type == TILE_CONTAINER_BITMAP) {
+        memcpy(words, container->data, TILE_BITMAP_BYTES);
+        return;
+    }
+    memset(words, 0, TILE_BITMAP_BYTES);
+    if (container->type == TILE_CONTAINER_ARRAY) {
+        uint16_t *values = container->data;
+        for (uint32_t i = 0; i < container->n; i++) {
+            words[values[i] / 64] |= (uint64_t)1 << (values[i] % 64);
+        }
+    } else {
+        tile_run_s *runs = container->data;
+        for (uint32_t i = 0; i < container->n; i++) {
+            bitmap_set_range(words, runs[i].first, runs[i].last);
+        }
+    }
+}
+
+// Pick the smallest representation for a container with the given
+// number of positions and runs
+static uint32_t tile_container_best_type(uint32_t cardinality, uint32_t n_runs) {
+    size_t run_bytes = n_runs * sizeof(tile_run_s);
+    size_t array_bytes = cardinality <= TILE_ARRAY_MAX ? cardinality * sizeof(uint16_t) : SIZE_MAX;
+    if (run_bytes < array_bytes && run_bytes < TILE_BITMAP_BYTES) {
+        return TILE_CONTAINER_RUN;
+    }
+    return cardinality <= TILE_ARRAY_MAX ? TILE_CONTAINER_ARRAY : TILE_CONTAINER_BITMAP;
+}
+
+// Fill a container from a bitmap, in its smallest representation
+static bool tile_container_from_bitmap(futile_tile_container_s *container, const uint64_t *words, uint32_t cardinality) {
+    uint32_t n_runs = bitmap_count_runs(words);
+    uint32_t type = tile_container_best_type(cardinality, n_runs);
+    uint32_t n = type == TILE_CONTAINER_RUN ? n_runs : type == TILE_CONTAINER_ARRAY ? cardinality : TILE_BITMAP_WORDS;
+    if (!tile_container_alloc(container, type, n)) {
+        return false;
+    }
+    container->cardinality = cardinality;
+    container->n = type == TILE_CONTAINER_BITMAP ? 0 : n;
+    if (type == TILE_CONTAINER_BITMAP) {
+        memcpy(container->data, words, TILE_BITMAP_BYTES);
+    } else if (type == TILE_CONTAINER_ARRAY) {
+        uint16_t *values = container->data;
+        uint32_t n_values = 0;
+        for (uint32_t i = 0; i < TILE_BITMAP_WORDS; i++) {
+            for (uint64_t word = words[i]; word; word &= word - 1) {
+                values[n_values++] = i * 64 + __builtin_ctzll(word);
+            }
+        }
+    } else {
+        tile_run_s *runs = container->data;
+        uint32_t n_out = 0;
+        bool in_run = false;
+        for (uint32_t i = 0; i < TILE_BITMAP_WORDS; i++) {
+            uint64_t word = words[i];
+            uint32_t pos = 0;
+            while (pos < 64) {
+                // look for the next set bit to start a run, or the
+                // next clear bit to end one
+                uint64_t rest = (in_run ? ~word : word) >> pos;
+                if (!rest) {
+                    break;
+                }
+                pos += __builtin_ctzll(rest);
+                if (in_run) {
+                    runs[n_out++].last = i * 64 + pos - 1;
+                } else {
+                    runs[n_out].first = i * 64 + pos;
+                }
+                in_run = !in_run;
+            }
+        }
+        if (in_run) {
+            runs[n_out++].last = TILE_CONTAINER_SIZE - 1;
+        }
+    }
+    return true;
+}
+
+// Fill a container from sorted unique positions, in its smallest
+// representation
+static bool tile_container_from_values(futile_tile_container_s *container, const uint16_t *values, uint32_t n_values) {
+    uint32_t n_runs = 0;
+    for (uint32_t i = 0; i < n_values; i++) {
+        n_runs += i == 0 || values[i] != values[i - 1] + 1;
+    }
+    uint32_t type = tile_container_best_type(n_values, n_runs);
+    if (type == TILE_CONTAINER_BITMAP) {
+        uint64_t words[TILE_BITMAP_WORDS] = {0};
+        for (uint32_t i = 0; i < n_values; i++) {
+            words[values[i] / 64] |= (uint64_t)1 << (values[i] % 64);
+        }
+        return tile_container_from_bitmap(container, words, n_values);
+    }
+    uint32_t n = type == TILE_CONTAINER_RUN ? n_runs : n_values;
+    if (!tile_container_alloc(container, type, n)) {
+        return false;
+    }
+    container->cardinality = n_values;
+    container->n = n;
+    if (type == TILE_CONTAINER_ARRAY) {
+        memcpy(container->data, values, n_values * sizeof(uint16_t));
+    } else {
+        tile_run_s *runs = container->data;
+        uint32_t n_out = 0;
+        for (uint32_t i = 0; i < n_values; i++) {
+            if (i == 0 || values[i] != values[i - 1] + 1) {
+                runs[n_out++].first = values[i];
+            }
+            runs[n_out - 1].last = values[i];
+        }
+    }
+    return true;
+}
+
+static bool tile_container_copy(futile_tile_container_s *src, futile_tile_container_s *dst) {
+    *dst = *src;
+    size_t n_bytes = src->type == TILE_CONTAINER_BITMAP ? TILE_BITMAP_BYTES : src->n * tile_container_item_size(src->type);
+    dst->capacity = src->type == TILE_CONTAINER_BITMAP ? TILE_BITMAP_WORDS : src->n;
+    dst->data = malloc(n_bytes);
+    if (!dst->data) {
+        return false;
+    }
+    memcpy(dst->data, src->data, n_bytes);
+    return true;
+}
+
+// Index of the last run starting at or before value, or -1
+static int64_t tile_run_find(tile_run_s *runs, uint32_t n, uint16_t value) {
+    uint32_t lo = 0, hi = n;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (runs[mid].first <= value) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return (int64_t)lo - 1;
+}
+
+// Index of the first array value at or after value
+static uint32_t tile_array_find(uint16_t *values, uint32_t n, uint16_t value) {
+    uint32_t lo = 0, hi = n;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (values[mid] < value) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static bool tile_container_contains(futile_tile_container_s *container, uint16_t value) {
+    switch (container->type) {
+    case TILE_CONTAINER_ARRAY: {
+        uint16_t *values = container->data;
+        uint32_t i = tile_array_find(values, container->n, value);
+        return i < container->n && values[i] == value;
+    }
+    case TILE_CONTAINER_BITMAP: {
+        uint64_t *words = container->data;
+        return (words[value / 64] >> (value % 64)) & 1;
+    }
+    default: {
+        tile_run_s *runs = container->data;
+        int64_t i = tile_run_find(runs, container->n, value);
+        return i >= 0 && value <= runs[i].last;
+    }
+    }
+}
+
+static bool tile_container_grow(futile_tile_container_s *container) {
+    uint32_t max = container->type == TILE_CONTAINER_ARRAY ? TILE_ARRAY_MAX : TILE_RUN_MAX;
+    if (container->n < container->capacity) {
+        return true;
+    }
+    uint32_t capacity = container->capacity < 4 ? 4 : container->capacity * 2;
+    capacity = capacity > max ? max : capacity;
+    void *data = realloc(container->data, capacity * tile_container_item_size(container->type));
+    if (!data) {
+        return false;
+    }
+    container->data = data;
+    container->capacity = capacity;
+    return true;
+}
+
+static bool tile_container_to_bitmap_container(futile_tile_container_s *container) {
+    uint64_t *words = malloc(TILE_BITMAP_BYTES);
+    if (!words) {
+        return false;
+    }
+    tile_container_to_bitmap(container, words);
+    free(container->data);
+    container->type = TILE_CONTAINER_BITMAP;
+    container->n = 0;
+    container->capacity = TILE_BITMAP_WORDS;
+    container->data = words;
+    return true;
+}
+
+static bool tile_container_add(futile_tile_container_s *container, uint16_t value) {
+    if (container->type == TILE_CONTAINER_ARRAY) {
+        uint16_t *values = container->data;
+        uint32_t i = tile_array_find(values, container->n, value);
+        if (i < container->n && values[i] == value) {
+            return true;
+        }
+        if (container->n == TILE_ARRAY_MAX) {
+            if (!tile_container_to_bitmap_container(container)) {
+                return false;
+            }
+            return tile_container_add(container, value);
+        }
+        if (!tile_container_grow(container)) {
+            return false;
+        }
+        values = container->data;
+        memmove(&values[i + 1], &values[i], (container->n - i) * sizeof(uint16_t));
+        values[i] = value;
+        container->n++;
+    } else if (container->type == TILE_CONTAINER_BITMAP) {
+        uint64_t *words = container->data;
+        uint64_t bit = (uint64_t)1 << (value % 64);
+        if (words[value / 64] & bit) {
+            return true;
+        }
+        words[value / 64] |= bit;
+    } else {
+        tile_run_s *runs = container->data;
+        int64_t i = tile_run_find(runs, container->n, value);
+        if (i >= 0 && value <= runs[i].last) {
+            return true;
+        }
+        bool extends_prev = i >= 0 && runs[i].last + 1 == value;
+        bool extends_next = i + 1 < container->n && runs[i + 1].first == value + 1;
+        if (extends_prev && extends_next) {
+            runs[i].last = runs[i + 1].last;
+            memmove(&runs[i + 1], &runs[i + 2], (container->n - i - 2) * sizeof(tile_run_s));
+            container->n--;
+        } else if (extends_prev) {
+            runs[i].last = value;
+        } else if (extends_next) {
+            runs[i + 1].first = value;
+        } else {
+            if (container->n == TILE_RUN_MAX) {
+                if (!tile_container_to_bitmap_container(container)) {
+                    return false;
+                }
+                return tile_container_add(container, value);
+            }
+            if (!tile_container_grow(container)) {
+                return false;
+            }
+            runs = container->data;
+            memmove(&runs[i + 2], &runs[i + 1], (container->n - i - 1) * sizeof(tile_run_s));
+            runs[i + 1] = (tile_run_s){value, value};
+            container->n++;
+        }
+    }
+    container->cardinality++;
+    return true;
+}
+
+typedef uint32_t (*bitmap_op_kernel_fn)(const uint64_t *lhs, const uint64_t *rhs, uint64_t *out, int op);
+
+static uint32_t bitmap_op_scalar(const uint64_t *lhs, const uint64_t *rhs, uint64_t *out, int op) {
+    uint32_t cardinality = 0;
+    for (size_t i = 0; i < TILE_BITMAP_WORDS; i++) {
+        uint64_t word = op == TILE_SET_UNION ? lhs[i] | rhs[i] : op == TILE_SET_INTERSECT ? lhs[i] & rhs[i] : lhs[i] & ~rhs[i];
+        out[i] = word;
+        cardinality += __builtin_popcountll(word);
+    }
+    return cardinality;
+}
+
+#ifdef FUTILE_X86_SIMD
+
+// Population counts use a nibble lookup table through byte shuffles,
+// summed into 64 bit lanes with sad
+
+FUTILE_TARGET_AVX2
+static inline __m256i avx2_popcount_epi64(__m256i v) {
+    const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_mask = _mm256_set1_epi8(0x0f);
+    __m256i lo = _mm256_and_si256(v, low_mask);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+    __m256i counts = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo), _mm256_shuffle_epi8(lookup, hi));
+    return _mm256_sad_epu8(counts, _mm256_setzero_si256());
+}
+
+FUTILE_TARGET_AVX2
+static uint32_t bitmap_op_avx2(const uint64_t *lhs, const uint64_t *rhs, uint64_t *out, int op) {
+    __m256i total = _mm256_setzero_si256();
+    for (size_t i = 0; i < TILE_BITMAP_WORDS; i += 4) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)&lhs[i]);
+        __m256i b = _mm256_loadu_si256((const __m256i *)&rhs[i]);
+        __m256i word = op == TILE_SET_UNION ? _mm256_or_si256(a, b) :
+            op == TILE_SET_INTERSECT ? _mm256_and_si256(a, b) : _mm256_andnot_si256(b, a);
+        _mm256_storeu_si256((__m256i *)&out[i], word);
+        total = _mm256_add_epi64(total, avx2_popcount_epi64(word));
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, total);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+FUTILE_TARGET_SSE4
+static inline __m128i sse4_popcount_epi64(__m128i v) {
+    const __m128i lookup = _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m128i low_mask = _mm_set1_epi8(0x0f);
+    __m128i lo = _mm_and_si128(v, low_mask);
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), low_mask);
+    __m128i counts = _mm_add_epi8(_mm_shuffle_epi8(lookup, lo), _mm_shuffle_epi8(lookup, hi));
+    return _mm_sad_epu8(counts, _mm_setzero_si128());
+}
+
+FUTILE_TARGET_SSE4
+static uint32_t bitmap_op_sse4(const uint64_t *lhs, const uint64_t *rhs, uint64_t *out, int op) {
+    __m128i total = _mm_setzero_si128();
+    for (size_t i = 0; i < TILE_BITMAP_WORDS; i += 2) {
+        __m128i a = _mm_loadu_si128((const __m128i *)&lhs[i]);
+        __m128i b = _mm_loadu_si128((const __m128i *)&rhs[i]);
+        __m128i word = op == TILE_SET_UNION ? _mm_or_si128(a, b) :
+            op == TILE_SET_INTERSECT ? _mm_and_si128(a, b) : _mm_andnot_si128(b, a);
+        _mm_storeu_si128((__m128i *)&out[i], word);
+        total = _mm_add_epi64(total, sse4_popcount_epi64(word));
+    }
+    // each lane sums at most 32768 bits, so the low halves are enough
+    return _mm_cvtsi128_si32(total) + _mm_extract_epi32(total, 2);
+}
+
+#endif
+
+static bitmap_op_kernel_fn bitmap_op_kernel(void) {
+    switch (futile_simd_level()) {
+#ifdef FUTILE_X86_SIMD
+    case FUTILE_SIMD_AVX2:
+        return bitmap_op_avx2;
+    case FUTILE_SIMD_SSE4:
+        return bitmap_op_sse4;
+#endif
+    default:
+        return bitmap_op_scalar;
+    }
+}
+
+// Combine two containers with the same key. An empty result leaves
+// out without data.
+static bool tile_container_op(futile_tile_container_s *lhs, futile_tile_container_s *rhs, futile_tile_container_s *out, int op) {
+    uint16_t values[2 * TILE_ARRAY_MAX];
+    uint32_t n_values = 0;
+    *out = (futile_tile_container_s){.key = lhs->key};
+    if (lhs->type == TILE_CONTAINER_ARRAY && rhs->type == TILE_CONTAINER_ARRAY) {
+        uint16_t *a = lhs->data, *b = rhs->data;
+        uint32_t i = 0, j = 0;
+        while (i < lhs->n || j < rhs->n) {
+            if (j == rhs->n || (i < lhs->n && a[i] < b[j])) {
+                if (op != TILE_SET_INTERSECT) {
+                    values[n_values++] = a[i];
+                }
+                i++;
+            } else if (i == lhs->n || b[j] < a[i]) {
+                if (op == TILE_SET_UNION) {
+                    values[n_values++] = b[j];
+                }
+                j++;
+            } else {
+                if (op != TILE_SET_DIFFERENCE) {
+                    values[n_values++] = a[i];
+                }
+                i++;
+                j++;
+            }
+        }
+    } else if (lhs->type == TILE_CONTAINER_ARRAY && op != TILE_SET_UNION) {
+        uint16_t *a = lhs->data;
+        bool keep = op == TILE_SET_INTERSECT;
+        for (uint32_t i = 0; i < lhs->n; i++) {
+            if (tile_container_contains(rhs, a[i]) == keep) {
+                values[n_values++] = a[i];
+            }
+        }
+    } else if (rhs->type == TILE_CONTAINER_ARRAY && op == TILE_SET_INTERSECT) {
+        uint16_t *b = rhs->data;
+        for (uint32_t j = 0; j < rhs->n; j++) {
+            if (tile_container_contains(lhs, b[j])) {
+                values[n_values++] = b[j];
+            }
+        }
+    } else {
+        uint64_t lhs_words[TILE_BITMAP_WORDS], rhs_words[TILE_BITMAP_WORDS], out_words[TILE_BITMAP_WORDS];
+        uint64_t *a = lhs->data, *b = rhs->data;
+        if (lhs->type != TILE_CONTAINER_BITMAP) {
+            tile_container_to_bitmap(lhs, lhs_words);
+            a = lhs_words;
+        }
+        if (rhs->type != TILE_CONTAINER_BITMAP) {
+            tile_container_to_bitmap(rhs, rhs_words);
+            b = rhs_words;
+        }
+        uint32_t cardinality = bitmap_op_kernel()(a, b, out_words, op);
+        return cardinality == 0 || tile_container_from_bitmap(out, out_words, cardinality);
+    }
+    return n_values == 0 || tile_container_from_values(out, values, n_values);
+}
+
+static bool tile_zoom_set_reserve(futile_tile_zoom_set_s *zoom_set, size_t n) {
+    if (n <= zoom_set->capacity) {
+        return true;
+    }
+    size_t capacity = zoom_set->capacity < 4 ? 4 : zoom_set->capacity * 2;
+    capacity = capacity < n ? n : capacity;
+    futile_tile_container_s *containers = realloc(zoom_set->containers, capacity * sizeof(futile_tile_container_s));
+    if (!containers) {
+        return false;
+    }
+    zoom_set->containers = containers;
+    zoom_set->capacity = capacity;
+    return true;
+}
+
+static void tile_zoom_set_free(futile_tile_zoom_set_s *zoom_set) {
+    for (size_t i = 0; i < zoom_set->n; i++) {
+        free(zoom_set->containers[i].data);
+    }
+    free(zoom_set->containers);
+    *zoom_set = (futile_tile_zoom_set_s){0};
+}
+
+// Index of the container with key, or where it would be inserted
+static bool tile_zoom_set_find(futile_tile_zoom_set_s *zoom_set, uint64_t key, size_t *out_index) {
+    size_t lo = 0, hi = zoom_set->n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (zoom_set->containers[mid].key < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *out_index = lo;
+    return lo < zoom_set->n && zoom_set->containers[lo].key == key;
+}
+
+static bool tile_zoom_set_op(futile_tile_zoom_set_s *lhs, futile_tile_zoom_set_s *rhs, futile_tile_zoom_set_s *out, int op) {
+    size_t i = 0, j = 0;
+    while (i < lhs->n || j < rhs->n) {
+        futile_tile_container_s *a = i < lhs->n ? &lhs->containers[i] : NULL;
+        futile_tile_container_s *b = j < rhs->n ? &rhs->containers[j] : NULL;
+        futile_tile_container_s result = {0};
+        if (!b || (a && a->key < b->key)) {
+            i++;
+            if (op == TILE_SET_INTERSECT) {
+                continue;
+            }
+            if (!tile_container_copy(a, &result)) {
+                return false;
+            }
+        } else if (!a || b->key < a->key) {
+            j++;
+            if (op != TILE_SET_UNION) {
+                continue;
+            }
+            if (!tile_container_copy(b, &result)) {
+                return false;
+            }
+        } else {
+            i++;
+            j++;
+            if (!tile_container_op(a, b, &result, op)) {
+                free(result.data);
+                return false;
+            }
+            if (result.cardinality == 0) {
+                continue;
+            }
+        }
+        if (!tile_zoom_set_reserve(out, out->n + 1)) {
+            free(result.data);
+            return false;
+        }
+        out->containers[out->n++] = result;
+    }
+    return true;
+}
+
+static bool tile_set_op(futile_tile_set_s *lhs, futile_tile_set_s *rhs, futile_tile_set_s *out_set, int op) {
+    futile_tile_set_init(out_set);
+    for (int z = 0; z <= FUTILE_ZORDER_MAX_ZOOM; z++) {
+        if (!tile_zoom_set_op(&lhs->zooms[z], &rhs->zooms[z], &out_set->zooms[z], op)) {
+            futile_tile_set_free(out_set);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool tile_set_coord_code(futile_coord_s *coord, uint64_t *out_code) {
+    if (coord->z > FUTILE_ZORDER_MAX_ZOOM || coord->x >> coord->z || coord->y >> coord->z) {
+        return false;
+    }
+    *out_code = futile_morton_encode(coord->x, coord->y);
+    return true;
+}
+
+FUTILE_DEF void futile_tile_set_init(futile_tile_set_s *set) {
+    memset(set, 0, sizeof(*set));
+}
+
+FUTILE_DEF void futile_tile_set_free(futile_tile_set_s *set) {
+    for (int z = 0; z <= FUTILE_ZORDER_MAX_ZOOM; z++) {
+        tile_zoom_set_free(&set->zooms[z]);
+    }
+}
+
+FUTILE_DEF bool futile_tile_set_add(futile_tile_set_s *set, futile_coord_s *coord) {
+    uint64_t code;
+    if (!tile_set_coord_code(coord, &code)) {
+        return false;
+    }
+    futile_tile_zoom_set_s *zoom_set = &set->zooms[coord->z];
+    size_t index;
+    if (tile_zoom_set_find(zoom_set, code >> 16, &index)) {
+        return tile_container_add(&zoom_set->containers[index], code & 0xffff);
+    }
+    // filled before it is inserted, so a failure leaves no empty
+    // container behind
+    futile_tile_container_s container = {.key = code >> 16, .type = TILE_CONTAINER_ARRAY};
+    if (!tile_container_add(&container, code & 0xffff) ||
+        !tile_zoom_set_reserve(zoom_set, zoom_set->n + 1)) {
+        free(container.data);
+        return false;
+    }
+    memmove(&zoom_set->containers[index + 1], &zoom_set->containers[index],
+            (zoom_set->n - index) * sizeof(futile_tile_container_s));
+    zoom_set->containers[index] = container;
+    zoom_set->n++;
+    return true;
+}
+
+FUTILE_DEF bool futile_tile_set_contains(futile_tile_set_s *set, futile_coord_s *coord) {
+    uint64_t code;
+    size_t index;
+    if (!tile_set_coord_code(coord, &code)) {
+        return false;
+    }
+    futile_tile_zoom_set_s *zoom_set = &set->zooms[coord->z];
+    return tile_zoom_set_find(zoom_set, code >> 16, &index) &&
+        tile_container_contains(&zoom_set->containers[index], code & 0xffff);
 }
 
-FUTILE_DEF int futile_coord_cmp(futile_coord_s *lhs, futile_coord_s *rhs) {
-    if (lhs->z < rhs->z) return -1;
-    if (lhs->z > rhs->z) return 1;
-    if (lhs->x < rhs->x) return -1;
-    if (lhs->x > rhs->x) return 1;
-    if (lhs->y < rhs->y) return -1;
-    if (lhs->y > rhs->y) return 1;
-    return 0;
+FUTILE_DEF uint64_t futile_tile_set_cardinality(futile_tile_set_s *set) {
+    uint64_t cardinality = 0;
+    for (int z = 0; z <= FUTILE_ZORDER_MAX_ZOOM; z++) {
+        for (size_t i = 0; i < set->zooms[z].n; i++) {
+            cardinality += set->zooms[z].containers[i].cardinality;
+        }
+    }
+    return cardinality;
 }
 
-FUTILE_DEF bool futile_coord_equal(futile_coord_s *lhs, futile_coord_s *rhs) {
-    return futile_coord_cmp(lhs, rhs) == 0;
+FUTILE_DEF bool futile_tile_set_union(futile_tile_set_s *lhs, futile_tile_set_s *rhs, futile_tile_set_s *out_set) {
+    return tile_set_op(lhs, rhs, out_set, TILE_SET_UNION);
 }
 
-// This is how the data is encoded into a 64 bit integer:
-// 1 bit unused | 29 bits column | 29 bits row | 5 bits zoom
+FUTILE_DEF bool futile_tile_set_intersect(futile_tile_set_s *lhs, futile_tile_set_s *rhs, futile_tile_set_s *out_set) {
+    return tile_set_op(lhs, rhs, out_set, TILE_SET_INTERSECT);
+}
 
-static const unsigned int zoom_mask = 31;       // 2^5 - 1
-static const unsigned int row_mask = 536870911; // 2^29 - 1
-static const unsigned int col_mask = 536870911; // 2^29 - 1
-static const unsigned int row_offset = 5;       // zoom bits
-static const unsigned int col_offset = 5 + 29;  // zoom bits + row bits
+FUTILE_DEF bool futile_tile_set_difference(futile_tile_set_s *lhs, futile_tile_set_s *rhs, futile_tile_set_s *out_set) {
+    return tile_set_op(lhs, rhs, out_set, TILE_SET_DIFFERENCE);
+}
 
-// the high row mask is all 1 bits except for the highest row bit
-static const uint64_t high_row_mask = 18446744065119617023ULL;
-// all 1 bits except for all zoom bits
-static const uint64_t all_but_zoom_mask = 18446744073709551584ULL;
+FUTILE_DEF bool futile_tile_set_optimize(futile_tile_set_s *set) {
+    uint64_t words[TILE_BITMAP_WORDS];
+    for (int z = 0; z <= FUTILE_ZORDER_MAX_ZOOM; z++) {
+        futile_tile_zoom_set_s *zoom_set = &set->zooms[z];
+        for (size_t i = 0; i < zoom_set->n; i++) {
+            futile_tile_container_s *container = &zoom_set->containers[i];
+            futile_tile_container_s compact = {.key = container->key};
+            tile_container_to_bitmap(container, words);
+            if (!tile_container_from_bitmap(&compact, words, container->cardinality)) {
+                return false;
+            }
+            free(container->data);
+            *container = compact;
+        }
+    }
+    return true;
+}
 
-FUTILE_DEF uint64_t futile_coord_marshall_int(futile_coord_s *coord) {
-    uint64_t x = coord->x;
-    uint64_t y = coord->y;
-    uint64_t z = coord->z;
-    return z | (y << row_offset) | (x << col_offset);
+FUTILE_DEF size_t futile_tile_set_size_bytes(futile_tile_set_s *set) {
+    size_t n_bytes = sizeof(*set);
+    for (int z = 0; z <= FUTILE_ZORDER_MAX_ZOOM; z++) {
+        futile_tile_zoom_set_s *zoom_set = &set->zooms[z];
+        n_bytes += zoom_set->capacity * sizeof(futile_tile_container_s);
+        for (size_t i = 0; i < zoom_set->n; i++) {
+            futile_tile_container_s *container = &zoom_set->containers[i];
+            n_bytes += container->capacity * tile_container_item_size(container->type);
+        }
+    }
+    return n_bytes;
 }
 
-FUTILE_DEF void futile_coord_unmarshall_int(uint64_t val, futile_coord_s *out_coord) {
-    out_coord->z = zoom_mask & val;
-    out_coord->y = row_mask  & (val >> row_offset);
-    out_coord->x = col_mask  & (val >> col_offset);
+FUTILE_DEF void futile_tile_set_for_each(futile_tile_set_s *set, futile_coord_fn for_coord, void *userdata) {
+    futile_coord_s coord;
+    for (int z = 0; z <= FUTILE_ZORDER_MAX_ZOOM; z++) {
+        futile_tile_zoom_set_s *zoom_set = &set->zooms[z];
+        coord.z = z;
+        for (size_t i = 0; i < zoom_set->n; i++) {
+            futile_tile_container_s *container = &zoom_set->containers[i];
+            uint64_t base = container->key << 16;
+            if (container->type == TILE_CONTAINER_ARRAY) {
+                uint16_t *values = container->data;
+                for (uint32_t j = 0; j < container->n; j++) {
+                    futile_morton_decode(base | values[j], &coord.x, &coord.y);
+                    for_coord(&coord, userdata);
+                }
+            } else if (container->type == TILE_CONTAINER_BITMAP) {
+                uint64_t *words = container->data;
+                for (uint32_t j = 0; j < TILE_BITMAP_WORDS; j++) {
+                    for (uint64_t word = words[j]; word; word &= word - 1) {
+                        futile_morton_decode(base | (j * 64 + __builtin_ctzll(word)), &coord.x, &coord.y);
+                        for_coord(&coord, userdata);
+                    }
+                }
+            } else {
+                tile_run_s *runs = container->data;
+                for (uint32_t j = 0; j < container->n; j++) {
+                    for (uint32_t value = runs[j].first; value <= runs[j].last; value++) {
+                        futile_morton_decode(base | value, &coord.x, &coord.y);
+                        for_coord(&coord, userdata);
+                    }
+                }
+            }
+        }
+    }
 }
 
-FUTILE_DEF uint64_t futile_coord_int_zoom_up(uint64_t val) {
-    // First we'll update the row/col values both simultaneously by
-    // shifting all bits to the right in an attempt to divide both by
-    // 2. This is *almost* correct; we just need to account for the
-    // fact that the lowest bit of the column value can "leak" into the
-    // high bit of the row, which we do by zero'ing out just that bit
-    // via the high_row_mask.
-    uint64_t coord_int_shifted = (val >> 1) & high_row_mask;
+#define ROLLUP_ZOOMS (FUTILE_MARSHALL_MAX_ZOOM + 1)
+// chunks smaller than this are not worth a thread
+#define ROLLUP_MIN_CHUNK 4096
 
-    int zoom = zoom_mask & val;
-    // Given that the row/col bits are now set correctly, all that
-    // remains is to update the zoom bits. This is done by applying a
-    // mask to zero out all the zoom bits, and then or'ing the new
-    // parent zoom bits into place
-    uint64_t parent_coord_int = (coord_int_shifted & all_but_zoom_mask) | (zoom - 1);
-    return parent_coord_int;
+typedef struct {
+    uint64_t *ids;
+    size_t n;
+    bool owned;
+} rollup_level_s;
+
+typedef struct {
+    uint64_t *leaves;
+    size_t n_leaves;
+    unsigned int zoom_until;
+    unsigned int max_zoom;
+    size_t n_chunks;
+    // per chunk leaves bucketed by zoom, and n_chunks * ROLLUP_ZOOMS levels
+    uint64_t **buckets;
+    rollup_level_s *levels;
+    futile_rollup_s *out;
+    bool failed;
+} rollup_s;
+
+static size_t merge_unique(uint64_t *lhs, size_t n_lhs, uint64_t *rhs, size_t n_rhs, uint64_t *out) {
+    size_t i = 0, j = 0, n_out = 0;
+    while (i < n_lhs || j < n_rhs) {
+        uint64_t id;
+        if (j == n_rhs || (i < n_lhs && lhs[i] <= rhs[j])) {
+            id = lhs[i++];
+        } else {
+            id = rhs[j++];
+        }
+        if (n_out == 0 || out[n_out - 1] != id) {
+            out[n_out++] = id;
+        }
+    }
+    return n_out;
 }
 
-static double min(double a, double b) {
-    return a < b ? a : b;
+// Parents of a sorted unique level, sorted and unique. Ids sort by
+// column first, so the children of a parent column are two adjacent
+// runs that each map to sorted parents, and merging them is enough.
+static size_t rollup_parents(uint64_t *ids, size_t n, uint64_t *out) {
+    size_t i = 0, n_out = 0;
+    while (i < n) {
+        uint64_t parent_col = ids[i] >> col_offset >> 1;
+        size_t j = i;
+        while (j < n && ids[j] >> col_offset == parent_col << 1) {
+            j++;
+        }
+        size_t k = j;
+        while (k < n && ids[k] >> col_offset >> 1 == parent_col) {
+            k++;
+        }
+        size_t a = i, b = j;
+        while (a < j || b < k) {
+            uint64_t id;
+            if (b == k || (a < j && futile_coord_int_zoom_up(ids[a]) <= futile_coord_int_zoom_up(ids[b]))) {
+                id = futile_coord_int_zoom_up(ids[a++]);
+            } else {
+                id = futile_coord_int_zoom_up(ids[b++]);
+            }
+            if (n_out == 0 || out[n_out - 1] != id) {
+                out[n_out++] = id;
+            }
+        }
+        i = k;
+    }
+    return n_out;
 }
 
-static double max(double a, double b) {
-    return a > b ? a : b;
+static void rollup_chunk(size_t index, void *userdata) {
+    rollup_s *rollup = userdata;
+    size_t start = rollup->n_leaves * index / rollup->n_chunks;
+    size_t end = rollup->n_leaves * (index + 1) / rollup->n_chunks;
+    rollup_level_s *levels = &rollup->levels[index * ROLLUP_ZOOMS];
+
+    uint64_t *bucket = malloc(sizeof(uint64_t) * (end - start + 1));
+    if (!bucket) {
+        __atomic_store_n(&rollup->failed, true, __ATOMIC_RELAXED);
+        return;
+    }
+    rollup->buckets[index] = bucket;
+
+    // counting sort the leaves by zoom, then collapse each zoom
+    size_t counts[ROLLUP_ZOOMS] = {0}, offsets[ROLLUP_ZOOMS];
+    for (size_t i = start; i < end; i++) {
+        counts[rollup->leaves[i] & zoom_mask]++;
+    }
+    for (size_t z = 0, offset = 0; z < ROLLUP_ZOOMS; z++) {
+        offsets[z] = offset;
+        offset += counts[z];
+    }
+    for (size_t i = start; i < end; i++) {
+        unsigned int z = rollup->leaves[i] & zoom_mask;
+        bucket[offsets[z]++] = rollup->leaves[i];
+    }
+    for (int z = rollup->max_zoom; z >= (int)rollup->zoom_until; z--) {
+        uint64_t *leaves = bucket + offsets[z] - counts[z];
+        // chunks already run in parallel, so each sort sticks to its thread
+        if (!futile_sort_ids(leaves, counts[z], 1)) {
+            __atomic_store_n(&rollup->failed, true, __ATOMIC_RELAXED);
+            return;
+        }
+        size_t n_leaves = futile_unique_ids(leaves, counts[z]);
+        rollup_level_s *child = z < (int)rollup->max_zoom ? &levels[z + 1] : NULL;
+        if (!child || child->n == 0) {
+            levels[z] = (rollup_level_s){.ids=leaves, .n=n_leaves};
+            continue;
+        }
+        uint64_t *ids = malloc(sizeof(uint64_t) * (child->n + n_leaves));
+        if (!ids) {
+            __atomic_store_n(&rollup->failed, true, __ATOMIC_RELAXED);
+            return;
+        }
+        size_t n = rollup_parents(child->ids, child->n, ids);
+        if (n_leaves > 0) {
+            // merge from the back half so the parents are not overwritten
+            memmove(ids + n_leaves, ids, sizeof(uint64_t) * n);
+            n = merge_unique(ids + n_leaves, n, leaves, n_leaves, ids);
+        }
+        levels[z] = (rollup_level_s){.ids=ids, .n=n, .owned=true};
+    }
 }
 
-static double radians_to_degrees(double radians) {
-    return radians * 180 / M_PI;
+// Merge the chunk levels of one zoom, using a binary heap of chunk
+// indexes ordered by their next id
+static void rollup_merge_zoom(size_t index, void *userdata) {
+    rollup_s *rollup = userdata;
+    unsigned int z = rollup->zoom_until + index;
+    size_t total = 0;
+    for (size_t c = 0; c < rollup->n_chunks; c++) {
+        total += rollup->levels[c * ROLLUP_ZOOMS + z].n;
+    }
+    if (total == 0) {
+        return;
+    }
+    uint64_t *out = malloc(sizeof(uint64_t) * total);
+    size_t *heap = malloc(sizeof(size_t) * rollup->n_chunks);
+    size_t *positions = calloc(rollup->n_chunks, sizeof(size_t));
+    if (!out || !heap || !positions) {
+        free(out);
+        free(heap);
+        free(positions);
+        __atomic_store_n(&rollup->failed, true, __ATOMIC_RELAXED);
+        return;
+    }
+    rollup_level_s *levels = rollup->levels;
+#define ROLLUP_HEAD(c) levels[(c) * ROLLUP_ZOOMS + z].ids[positions[c]]
+    size_t n_heap = 0;
+    for (size_t c = 0; c < rollup->n_chunks; c++) {
+        if (levels[c * ROLLUP_ZOOMS + z].n == 0) {
+            continue;
+        }
+        size_t i = n_heap++;
+        while (i > 0 && ROLLUP_HEAD(heap[(i - 1) / 2]) > ROLLUP_HEAD(c)) {
+            heap[i] = heap[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+        heap[i] = c;
+    }
+    size_t n_out = 0;
+    while (n_heap > 0) {
+        size_t c = heap[0];
+        uint64_t id = ROLLUP_HEAD(c);
+        if (n_out == 0 || out[n_out - 1] != id) {
+            out[n_out++] = id;
+        }
+        if (++positions[c] == levels[c * ROLLUP_ZOOMS + z].n) {
+            c = heap[--n_heap];
+        }
+        // sift c down from the root
+        size_t i = 0;
+        while (n_heap > 0) {
+            size_t child = 2 * i + 1;
+            if (child >= n_heap) {
+                break;
+            }
+            if (child + 1 < n_heap && ROLLUP_HEAD(heap[child + 1]) < ROLLUP_HEAD(heap[child])) {
+                child++;
+            }
+            if (ROLLUP_HEAD(heap[child]) >= ROLLUP_HEAD(c)) {
+                break;
+            }
+            heap[i] = heap[child];
+            i = child;
+        }
+        if (n_heap > 0) {
+            heap[i] = c;
+        }
+    }
+#undef ROLLUP_HEAD
+    free(heap);
+    free(positions);
+    rollup->out->n[z] = n_out;
+    rollup->out->ids[z] = out;
 }
 
-static double degrees_to_radians(double degrees) {
-    return degrees * M_PI / 180;
+FUTILE_DEF bool futile_rollup_ints(uint64_t *ids, size_t n, unsigned int zoom_until, unsigned int n_threads, futile_rollup_s *out_rollup) {
+    memset(out_rollup, 0, sizeof(*out_rollup));
+    rollup_s rollup = {.leaves=ids, .n_leaves=n, .zoom_until=zoom_until, .out=out_rollup};
+    for (size_t i = 0; i < n; i++) {
+        unsigned int z = ids[i] & zoom_mask;
+        if (z > FUTILE_MARSHALL_MAX_ZOOM) {
+            errno = EINVAL;
+            return false;
+        }
+        rollup.max_zoom = z > rollup.max_zoom ? z : rollup.max_zoom;
+    }
+    if (n == 0 || zoom_until > rollup.max_zoom) {
+        return true;
+    }
+
+    n_threads = n_threads ? n_threads : default_n_threads();
+    size_t max_chunks = n / ROLLUP_MIN_CHUNK;
+    rollup.n_chunks = max_chunks < 1 ? 1 : max_chunks < n_threads ? max_chunks : n_threads;
+    rollup.buckets = calloc(rollup.n_chunks, sizeof(uint64_t *));
+    rollup.levels = calloc(rollup.n_chunks * ROLLUP_ZOOMS, sizeof(rollup_level_s));
+    if (!rollup.buckets || !rollup.levels) {
+        rollup.failed = true;
+    } else {
+        parallel_for(n_threads, rollup.n_chunks, rollup_chunk, &rollup);
+    }
+    if (!rollup.failed) {
+        parallel_for(n_threads, rollup.max_zoom - zoom_until + 1, rollup_merge_zoom, &rollup);
+    }
+
+    for (size_t c = 0; rollup.levels && c < rollup.n_chunks; c++) {
+        for (int z = 0; z < ROLLUP_ZOOMS; z++) {
+            if (rollup.levels[c * ROLLUP_ZOOMS + z].owned) {
+                free(rollup.levels[c * ROLLUP_ZOOMS + z].ids);
+            }
+        }
+        free(rollup.buckets[c]);
+    }
+    free(rollup.levels);
+    free(rollup.buckets);
+    if (rollup.failed) {
+        futile_rollup_free(out_rollup);
+        errno = ENOMEM;
+        return false;
+    }
+    return true;
 }
 
-FUTILE_DEF void futile_explode_bounds(futile_bounds_s *bounds, double *out_minx, double *out_miny, double *out_maxx, double *out_maxy) {
-    *out_minx = bounds->minx;
-    *out_miny = bounds->miny;
-    *out_maxx = bounds->maxx;
-    *out_maxy = bounds->maxy;
+FUTILE_DEF bool futile_rollup_coords(futile_coord_s *coords, size_t n, unsigned int zoom_until, unsigned int n_threads, futile_rollup_s *out_rollup) {
+    uint64_t *ids = malloc(sizeof(uint64_t) * (n + 1));
+    if (!ids) {
+        memset(out_rollup, 0, sizeof(*out_rollup));
+        errno = ENOMEM;
+        return false;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (coords[i].z > FUTILE_MARSHALL_MAX_ZOOM) {
+            free(ids);
+            memset(out_rollup, 0, sizeof(*out_rollup));
+            errno = EINVAL;
+            return false;
+        }
+        ids[i] = futile_coord_marshall_int(&coords[i]);
+    }
+    bool result = futile_rollup_ints(ids, n, zoom_until, n_threads, out_rollup);
+    free(ids);
+    return result;
 }
 
-// http://wiki.openstreetmap.org/wiki/Slippy_map_tilenames
-FUTILE_DEF void futile_coord_to_lnglat(futile_coord_s *coord, futile_point_s *out) {
-    double n = pow(2, coord->z);
-    double lng_deg = coord->x / n * 360.0 - 180.0;
-    double lat_rad = atan(sinh(M_PI * (1 - 2 * coord->y / n)));
-    double lat_deg = radians_to_degrees(lat_rad);
-    out->x = lng_deg;
-    out->y = lat_deg;
+FUTILE_DEF void futile_rollup_free(futile_rollup_s *rollup) {
+    for (int z = 0; z < ROLLUP_ZOOMS; z++) {
+        free(rollup->ids[z]);
+    }
+    memset(rollup, 0, sizeof(*rollup));
 }
 
-// http://wiki.openstreetmap.org/wiki/Slippy_map_tilenames
-// make input point
-FUTILE_DEF void futile_lnglat_to_coord(futile_point_s *lnglat, int zoom, futile_coord_s *out) {
-    double lng_deg = lnglat->x;
-    double lat_deg = lnglat->y;
+// points projected, or looked up, per task
+#define BUCKET_CHUNK (1 << 16)
 
-    double lat_rad = degrees_to_radians(lat_deg);
-    double n = pow(2.0, zoom);
-    out->x = (lng_deg + 180.0) / 360.0 * n;
-    out->y = (1.0 - log(tan(lat_rad) + (1 / cos(lat_rad))) / M_PI) / 2.0 * n;
-    out->z = zoom;
-}
+typedef struct {
+    futile_point_s *lnglats;
+    size_t n;
+    unsigned int zoom;
+    // when the morton code and the point index fit in 64 bits, keys
+    // pack both, so that sorting them also orders the points
+    bool packed;
+    unsigned int index_bits;
+    // keys of the points, and when not packed later their tile indexes
+    uint64_t *keys;
+    futile_bucket_zoom_s *out;
+} bucket_s;
 
-FUTILE_DEF void futile_coord_to_bounds(futile_coord_s *coord, futile_bounds_s *out) {
-    futile_point_s topleft, bottomright;
-    futile_coord_s coord_bottomright = {
-        .x=coord->x + 1,
-        .y=coord->y + 1,
-        .z=coord->z
-    };
-    futile_coord_to_lnglat(coord, &topleft);
-    futile_coord_to_lnglat(&coord_bottomright, &bottomright);
-    double minx = topleft.x;
-    double miny = bottomright.y;
-    double maxx = bottomright.x;
-    double maxy = topleft.y;
+static uint64_t bucket_key_id(bucket_s *bucket, uint64_t key) {
+    return bucket->packed ? zoom_base_id(bucket->zoom) + (key >> bucket->index_bits) : key;
+}
 
-    // coord_to_bounds is used to calculate boxes that could be off the grid
-    // clamp the max values in that scenario
-    maxx = min(180, maxx);
-    maxy = min(90, maxy);
+static void bucket_project_chunk(size_t index, void *userdata) {
+    bucket_s *bucket = userdata;
+    size_t start = index * BUCKET_CHUNK, end = min_size(bucket->n, start + BUCKET_CHUNK);
+    futile_coord_s coords[FUTILE_BATCH_BLOCK];
+    for (size_t i = start; i < end; i += FUTILE_BATCH_BLOCK) {
+        size_t n_block = min_size(end - i, FUTILE_BATCH_BLOCK);
+        futile_lnglat_to_coord_batch(&bucket->lnglats[i], n_block, bucket->zoom, coords);
+        for (size_t j = 0; j < n_block; j++) {
+            if (bucket->packed) {
+                bucket->keys[i + j] = futile_morton_encode(coords[j].x, coords[j].y) << bucket->index_bits | (i + j);
+            } else {
+                bucket->keys[i + j] = futile_coord_to_zorder(&coords[j]);
+            }
+        }
+    }
+}
 
-    *out = (futile_bounds_s){minx, miny, maxx, maxy};
+static void bucket_index_chunk(size_t index, void *userdata) {
+    bucket_s *bucket = userdata;
+    size_t start = index * BUCKET_CHUNK, end = min_size(bucket->n, start + BUCKET_CHUNK);
+    uint64_t *ids = bucket->out->ids;
+    for (size_t i = start; i < end; i++) {
+        size_t lo = 0, hi = bucket->out->n - 1;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (ids[mid] < bucket->keys[i]) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        bucket->keys[i] = lo;
+    }
 }
 
-FUTILE_DEF unsigned int futile_bounds_to_coords(futile_bounds_s *bounds, int zoom, futile_coord_s out_coords[]) {
-    futile_point_s topleft, bottomright;
-    futile_explode_bounds(bounds, &topleft.x, &bottomright.y, &bottomright.x, &topleft.y);
+FUTILE_DEF bool futile_bucket_points(futile_point_s *lnglats, size_t n, unsigned int zoom, unsigned int n_threads, size_t *out_order, futile_bucket_zoom_s *out_bucket) {
+    memset(out_bucket, 0, sizeof(*out_bucket));
+    out_bucket->zoom = zoom;
+    if (zoom > FUTILE_ZORDER_MAX_ZOOM) {
+        errno = EINVAL;
+        return false;
+    }
+    if (n == 0) {
+        if (out_order) {
+            out_bucket->offsets = calloc(1, sizeof(size_t));
+            return out_bucket->offsets != NULL;
+        }
+        return true;
+    }
+    n_threads = n_threads ? n_threads : default_n_threads();
+    size_t n_chunks = (n + BUCKET_CHUNK - 1) / BUCKET_CHUNK;
+    bucket_s bucket = {.lnglats = lnglats, .n = n, .zoom = zoom, .out = out_bucket};
+    while (bucket.index_bits < 64 && ((uint64_t)(n - 1) >> bucket.index_bits) != 0) {
+        bucket.index_bits++;
+    }
+    bucket.packed = out_order && 2 * zoom + bucket.index_bits <= 64;
+    bucket.keys = malloc(n * sizeof(uint64_t));
+    // unpacked keys are needed again to place the points, so sort a copy
+    uint64_t *sorted = out_order && !bucket.packed ? malloc(n * sizeof(uint64_t)) : bucket.keys;
+    bool ok = bucket.keys && sorted;
+    if (ok) {
+        parallel_for(n_threads, n_chunks, bucket_project_chunk, &bucket);
+        if (sorted != bucket.keys) {
+            memcpy(sorted, bucket.keys, n * sizeof(uint64_t));
+        }
+        ok = futile_sort_ids(sorted, n, n_threads);
+    }
 
-    futile_coord_s topleft_coord, bottomright_coord;
-    futile_lnglat_to_coord(&topleft, zoom, &topleft_coord);
-    futile_lnglat_to_coord(&bottomright, zoom, &bottomright_coord);
+    size_t n_tiles = 0;
+    for (size_t i = 0; ok && i < n; i++) {
+        n_tiles += i == 0 || bucket_key_id(&bucket, sorted[i]) != bucket_key_id(&bucket, sorted[i - 1]);
+    }
+    if (ok) {
+        out_bucket->ids = malloc(n_tiles * sizeof(uint64_t));
+        out_bucket->counts = malloc(n_tiles * sizeof(uint64_t));
+        ok = out_bucket->ids && out_bucket->counts;
+    }
+    if (ok) {
+        for (size_t i = 0; i < n; i++) {
+            uint64_t id = bucket_key_id(&bucket, sorted[i]);
+            if (out_bucket->n == 0 || out_bucket->ids[out_bucket->n - 1] != id) {
+                out_bucket->ids[out_bucket->n] = id;
+                out_bucket->counts[out_bucket->n++] = 0;
+            }
+            out_bucket->counts[out_bucket->n - 1]++;
+        }
+    }
 
-    // clamp max values
-    int maxval = pow(2, zoom) - 1;
-    bottomright_coord.x = min(maxval, bottomright_coord.x);
-    bottomright_coord.y = min(maxval, bottomright_coord.y);
+    if (ok && out_order) {
+        out_bucket->offsets = malloc((n_tiles + 1) * sizeof(size_t));
+        ok = out_bucket->offsets != NULL;
+    }
+    if (ok && out_order) {
+        out_bucket->offsets[0] = 0;
+        for (size_t t = 0; t < n_tiles; t++) {
+            out_bucket->offsets[t + 1] = out_bucket->offsets[t] + out_bucket->counts[t];
+        }
+        if (bucket.packed) {
+            uint64_t index_mask = bucket.index_bits == 64 ? ~(uint64_t)0 : ((uint64_t)1 << bucket.index_bits) - 1;
+            for (size_t i = 0; i < n; i++) {
+                out_order[i] = sorted[i] & index_mask;
+            }
+        } else {
+            // counting sort of the point indexes, by tile
+            parallel_for(n_threads, n_chunks, bucket_index_chunk, &bucket);
+            size_t *next = malloc(n_tiles * sizeof(size_t));
+            ok = next != NULL;
+            if (ok) {
+                memcpy(next, out_bucket->offsets, n_tiles * sizeof(size_t));
+                for (size_t i = 0; i < n; i++) {
+                    out_order[next[bucket.keys[i]]++] = i;
+                }
+            }
+            free(next);
+        }
+    }
 
-    out_coords[0] = topleft_coord;
-    // check if one coordinate subsumes the whole bounds at this zoom
-    if (topleft_coord.x == bottomright_coord.x &&
-        topleft_coord.y == bottomright_coord.y) {
-        return 1;
-    } else {
-        // we have two inclusive coordinates representing the range
-        out_coords[1] = bottomright_coord;
-        return 2;
+    if (sorted != bucket.keys) {
+        free(sorted);
     }
+    free(bucket.keys);
+    if (!ok) {
+        futile_bucket_free(out_bucket);
+        errno = ENOMEM;
+    }
+    return ok;
 }
 
-// radius of earth in meters is 6378137
-// static double circumference_meters = 40075016.685578487813;
-static double half_circumference_meters = 20037508.342789243907;
+FUTILE_DEF bool futile_bucket_coarsen(futile_bucket_zoom_s *bucket, unsigned int zoom, futile_bucket_zoom_s *out_bucket) {
+    memset(out_bucket, 0, sizeof(*out_bucket));
+    out_bucket->zoom = zoom;
+    if (zoom > bucket->zoom) {
+        errno = EINVAL;
+        return false;
+    }
+    unsigned int shift = 2 * (bucket->zoom - zoom);
+    uint64_t fine_base = zoom_base_id(bucket->zoom), base = zoom_base_id(zoom);
+    size_t n_tiles = 0;
+    uint64_t last = 0;
+    for (size_t i = 0; i < bucket->n; i++) {
+        uint64_t id = base + ((bucket->ids[i] - fine_base) >> shift);
+        n_tiles += i == 0 || id != last;
+        last = id;
+    }
+    out_bucket->ids = malloc((n_tiles ? n_tiles : 1) * sizeof(uint64_t));
+    out_bucket->counts = malloc((n_tiles ? n_tiles : 1) * sizeof(uint64_t));
+    if (bucket->offsets) {
+        out_bucket->offsets = malloc((n_tiles + 1) * sizeof(size_t));
+    }
+    if (!out_bucket->ids || !out_bucket->counts || (bucket->offsets && !out_bucket->offsets)) {
+        futile_bucket_free(out_bucket);
+        errno = ENOMEM;
+        return false;
+    }
+    for (size_t i = 0; i < bucket->n; i++) {
+        uint64_t id = base + ((bucket->ids[i] - fine_base) >> shift);
+        if (out_bucket->n == 0 || out_bucket->ids[out_bucket->n - 1] != id) {
+            if (out_bucket->offsets) {
+                out_bucket->offsets[out_bucket->n] = bucket->offsets[i];
+            }
+            out_bucket->ids[out_bucket->n] = id;
+            out_bucket->counts[out_bucket->n++] = 0;
+        }
+        out_bucket->counts[out_bucket->n - 1] += bucket->counts[i];
+    }
+    if (out_bucket->offsets) {
+        out_bucket->offsets[out_bucket->n] = bucket->offsets[bucket->n];
+    }
+    return true;
+}
 
-FUTILE_DEF void futile_mercator_to_lnglat(futile_point_s *in, futile_point_s *out) {
-    double x = in->x, y = in->y;
+FUTILE_DEF void futile_bucket_free(futile_bucket_zoom_s *bucket) {
+    free(bucket->ids);
+    free(bucket->counts);
+    free(bucket->offsets);
+    memset(bucket, 0, sizeof(*bucket));
+}
 
-    x /= half_circumference_meters;
-    y /= half_circumference_meters;
+#define TILE_CACHE_MIN_CAPACITY 16
 
-    y = (2 * atan(exp(y * M_PI)) - (M_PI / 2)) / M_PI;
+typedef struct tile_cache_table_s {
+    size_t mask;
+    struct tile_cache_table_s *next_retired;
+    futile_tile_cache_value_s *slots[];
+} tile_cache_table_s;
 
-    x *= 180;
-    y *= 180;
+// Marks a removed slot, so that probes for keys further along the
+// chain keep going
+static futile_tile_cache_value_s tile_cache_tombstone;
 
-    out->x = x;
-    out->y = y;
-}
+// Readers register in n_readers[epoch & 1] for the duration of a
+// lookup. Values and tables unlinked during an epoch go on that
+// epoch's retired lists. Once the epoch has moved on and the count of
+// the previous epoch drains to 0, nothing unlinked back then can be
+// reached any more, so that epoch's lists are freed and the epoch
+// advances again, reusing the drained counter.
+struct futile_tile_cache_shard_s {
+    pthread_mutex_t lock;
+    tile_cache_table_s *table;
+    size_t n_live;
+    size_t n_tombstones;
+    size_t hand;
+    size_t n_bytes;
+    uint64_t n_evictions;
+    uint64_t epoch;
+    futile_tile_cache_value_s *retired_values[2];
+    tile_cache_table_s *retired_tables[2];
+    // on their own cache line, as every lookup writes to them
+    uint64_t n_readers[2] __attribute__((aligned(64)));
+} __attribute__((aligned(64)));
 
-FUTILE_DEF void futile_lnglat_to_mercator(futile_point_s *in, futile_point_s *out) {
-    double x = in->x, y = in->y;
+typedef struct futile_tile_cache_shard_s tile_cache_shard_s;
+
+static size_t tile_cache_cost(futile_tile_cache_value_s *value) {
+    return sizeof(futile_tile_cache_value_s) + value->size;
+}
 
-    // Latitude
-    y = log(tan(y * M_PI / 360 + M_PI / 4)) / M_PI;
-    y *= half_circumference_meters;
+static tile_cache_shard_s *tile_cache_shard(futile_tile_cache_s *cache, uint64_t hash) {
+    return &cache->shards[(hash >> 32) & (cache->n_shards - 1)];
+}
 
-    // Longitude
-    x *= half_circumference_meters / 180;
+static uint64_t tile_cache_enter(tile_cache_shard_s *shard) {
+    for (;;) {
+        uint64_t epoch = __atomic_load_n(&shard->epoch, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&shard->n_readers[epoch & 1], 1, __ATOMIC_SEQ_CST);
+        // a reader that registered with an epoch that has already
+        // moved on could otherwise hold up or miss its reclamation
+        if (__atomic_load_n(&shard->epoch, __ATOMIC_SEQ_CST) == epoch) {
+            return epoch;
+        }
+        __atomic_sub_fetch(&shard->n_readers[epoch & 1], 1, __ATOMIC_RELEASE);
+    }
+}
 
-    out->x = x;
-    out->y = y;
+static void tile_cache_leave(tile_cache_shard_s *shard, uint64_t epoch) {
+    __atomic_sub_fetch(&shard->n_readers[epoch & 1], 1, __ATOMIC_RELEASE);
 }
 
-// log(circumference_meters) / log(2)
-static double zoom_with_mercator_meters = 25.256199785270;
+static tile_cache_table_s *tile_cache_table_new(size_t capacity) {
+    tile_cache_table_s *table = calloc(1, sizeof(tile_cache_table_s) + capacity * sizeof(futile_tile_cache_value_s *));
+    if (table) {
+        table->mask = capacity - 1;
+    }
+    return table;
+}
 
-FUTILE_DEF void futile_coord_to_mercator(futile_coord_s *in, futile_point_s *out) {
-    // update the source x, y values to their corresponding values at
-    // the zoom where mercator units are in meters
-    double x = in->x * pow(2, zoom_with_mercator_meters - in->z);
-    double y = in->y * pow(2, zoom_with_mercator_meters - in->z);
+// Returns the slot holding key, or the slot to insert it at: the first
+// tombstone on its chain if there is one, else the empty slot ending it
+static size_t tile_cache_find(tile_cache_table_s *table, uint64_t hash, uint64_t key, bool *out_found) {
+    size_t insert_at = SIZE_MAX;
+    for (size_t i = hash & table->mask;; i = (i + 1) & table->mask) {
+        futile_tile_cache_value_s *value = table->slots[i];
+        if (!value) {
+            *out_found = false;
+            return insert_at != SIZE_MAX ? insert_at : i;
+        }
+        if (value == &tile_cache_tombstone) {
+            if (insert_at == SIZE_MAX) {
+                insert_at = i;
+            }
+        } else if (value->key == key) {
+            *out_found = true;
+            return i;
+        }
+    }
+}
 
-    // adjust for coordinate system
-    out->x = x - half_circumference_meters;
-    // y grid starts from 0 at top and goes down
-    out->y = half_circumference_meters - y;
+static void tile_cache_unref(futile_tile_cache_value_s *value) {
+    if (__atomic_sub_fetch(&value->n_refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(value);
+    }
 }
 
-FUTILE_DEF void futile_mercator_to_coord(futile_point_s *in, int zoom, futile_coord_s *out) {
-    // adjust for coordinate system
-    double x = in->x + half_circumference_meters;
-    // y grid starts from 0 at top and goes down
-    double y = half_circumference_meters - in->y;
+// Called with the shard locked
+static void tile_cache_retire(tile_cache_shard_s *shard, futile_tile_cache_value_s *value) {
+    value->next_retired = shard->retired_values[shard->epoch & 1];
+    shard->retired_values[shard->epoch & 1] = value;
+    shard->n_bytes -= tile_cache_cost(value);
+}
 
-    out->x = x * pow(2, zoom - zoom_with_mercator_meters);
-    out->y = y * pow(2, zoom - zoom_with_mercator_meters);
-    out->z = zoom;
+static void tile_cache_free_retired(tile_cache_shard_s *shard, int index) {
+    futile_tile_cache_value_s *value = shard->retired_values[index];
+    while (value) {
+        futile_tile_cache_value_s *next = value->next_retired;
+        tile_cache_unref(value);
+        value = next;
+    }
+    tile_cache_table_s *table = shard->retired_tables[index];
+    while (table) {
+        tile_cache_table_s *next = table->next_retired;
+        free(table);
+        table = next;
+    }
+    shard->retired_values[index] = NULL;
+    shard->retired_tables[index] = NULL;
 }
 
-FUTILE_DEF void futile_coord_to_mercator_bounds(futile_coord_s *in, futile_bounds_s *out) {
-    futile_coord_s coord_bottom_right = {.x=in->x + 1, .y=in->y + 1, in->z};
-    futile_point_s merc_topleft, merc_bottomright;
-    futile_coord_to_mercator(in, &merc_topleft);
-    futile_coord_to_mercator(&coord_bottom_right, &merc_bottomright);
-    out->minx = min(merc_topleft.x, merc_bottomright.x);
-    out->miny = min(merc_topleft.y, merc_bottomright.y);
-    out->maxx = max(merc_topleft.x, merc_bottomright.x);
-    out->maxy = max(merc_topleft.y, merc_bottomright.y);
+// Called with the shard locked, see futile_tile_cache_shard_s
+static void tile_cache_reclaim(tile_cache_shard_s *shard) {
+    uint64_t epoch = shard->epoch;
+    int previous = (epoch + 1) & 1;
+    if (!shard->retired_values[0] && !shard->retired_values[1] &&
+        !shard->retired_tables[0] && !shard->retired_tables[1]) {
+        return;
+    }
+    if (__atomic_load_n(&shard->n_readers[previous], __ATOMIC_SEQ_CST) != 0) {
+        return;
+    }
+    tile_cache_free_retired(shard, previous);
+    __atomic_store_n(&shard->epoch, epoch + 1, __ATOMIC_SEQ_CST);
 }
 
-FUTILE_DEF int futile_mercator_bounds_to_coords(futile_bounds_s *bounds, int zoom, futile_coord_s *out) {
-    double topleft_x, topleft_y, bottomright_x, bottomright_y;
-    futile_explode_bounds(bounds, &topleft_x, &bottomright_y, &bottomright_x, &topleft_y);
-    futile_point_s topleft_point = {topleft_x, topleft_y};
-    futile_point_s bottomright_point = {bottomright_x, bottomright_y};
-    futile_coord_s topleft_coord, bottomright_coord;
-    futile_mercator_to_coord(&topleft_point, zoom, &topleft_coord);
-    futile_mercator_to_coord(&bottomright_point, zoom, &bottomright_coord);
-    out[0] = topleft_coord;
-    if (topleft_coord.x == bottomright_coord.x &&
-        topleft_coord.y == bottomright_coord.y) {
-        return 1;
-    } else {
-        out[1] = bottomright_coord;
-        return 2;
+// Rehashes into a table at most half full, dropping tombstones
+static bool tile_cache_rebuild(tile_cache_shard_s *shard) {
+    tile_cache_table_s *old = shard->table;
+    size_t capacity = TILE_CACHE_MIN_CAPACITY;
+    while (capacity < 2 * (shard->n_live + 1)) {
+        capacity *= 2;
+    }
+    tile_cache_table_s *table = tile_cache_table_new(capacity);
+    if (!table) {
+        return false;
+    }
+    for (size_t i = 0; i <= old->mask; i++) {
+        futile_tile_cache_value_s *value = old->slots[i];
+        if (value && value != &tile_cache_tombstone) {
+            bool found;
+            table->slots[tile_cache_find(table, mix_id(value->key), value->key, &found)] = value;
+        }
     }
+    __atomic_store_n(&shard->table, table, __ATOMIC_RELEASE);
+    old->next_retired = shard->retired_tables[shard->epoch & 1];
+    shard->retired_tables[shard->epoch & 1] = old;
+    shard->n_tombstones = 0;
+    shard->hand = 0;
+    return true;
 }
 
-FUTILE_DEF void futile_coord_to_quadkey(futile_coord_s *coord, char *quadkey) {
-    int n = 0;
-    int x = coord->x;
-    int y = coord->y;
-    for (int i = coord->z; i > 0; i--) {
-        char digit = '0';
-        int mask = 1 << (i - 1);
-        if ((x & mask) != 0) {
-            digit++;
+// CLOCK: referenced values get their bit cleared and a second chance,
+// the first unreferenced one is evicted. keep is never evicted.
+static void tile_cache_evict_one(tile_cache_shard_s *shard, futile_tile_cache_value_s *keep) {
+    tile_cache_table_s *table = shard->table;
+    for (;;) {
+        size_t i = shard->hand;
+        shard->hand = (i + 1) & table->mask;
+        futile_tile_cache_value_s *value = table->slots[i];
+        if (!value || value == &tile_cache_tombstone || value == keep) {
+            continue;
         }
-        if ((y & mask) != 0) {
-            digit += 2;
+        if (__atomic_load_n(&value->is_referenced, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&value->is_referenced, false, __ATOMIC_RELAXED);
+            continue;
         }
-        quadkey[n++] = digit;
+        __atomic_store_n(&table->slots[i], &tile_cache_tombstone, __ATOMIC_RELEASE);
+        shard->n_live--;
+        shard->n_tombstones++;
+        shard->n_evictions++;
+        tile_cache_retire(shard, value);
+        return;
     }
-    quadkey[n] = '\0';
 }
 
-FUTILE_DEF bool futile_quadkey_to_coord(char *quadkey, size_t n_quadkey, futile_coord_s *coord) {
-    int x = 0, y = 0;
-    int z = n_quadkey;
-    for (int i = z; i > 0; i--) {
-        int mask = 1 << (i - 1);
-        switch (quadkey[z - i]) {
-        case '0':
-            break;
-        case '1':
-            x |= mask;
-            break;
-        case '2':
-            y |= mask;
-            break;
-        case '3':
-            x |= mask;
-            y |= mask;
-            break;
-        default:
+FUTILE_DEF bool futile_tile_cache_init(futile_tile_cache_s *cache, size_t max_bytes, unsigned int n_shards) {
+    if (max_bytes == 0) {
+        errno = EINVAL;
+        return false;
+    }
+    unsigned int wanted = n_shards ? n_shards : 4 * default_n_threads();
+    n_shards = 1;
+    while (n_shards < wanted) {
+        n_shards *= 2;
+    }
+    tile_cache_shard_s *shards = NULL;
+    if (posix_memalign((void **)&shards, 64, n_shards * sizeof(tile_cache_shard_s)) != 0) {
+        errno = ENOMEM;
+        return false;
+    }
+    memset(shards, 0, n_shards * sizeof(tile_cache_shard_s));
+    for (unsigned int i = 0; i < n_shards; i++) {
+        shards[i].table = tile_cache_table_new(TILE_CACHE_MIN_CAPACITY);
+        if (!shards[i].table) {
+            for (unsigned int j = 0; j < i; j++) {
+                free(shards[j].table);
+                pthread_mutex_destroy(&shards[j].lock);
+            }
+            free(shards);
+            errno = ENOMEM;
             return false;
         }
+        pthread_mutex_init(&shards[i].lock, NULL);
     }
-    coord->x = x;
-    coord->y = y;
-    coord->z = z;
+    *cache = (futile_tile_cache_s){
+        .shards=shards,
+        .n_shards=n_shards,
+        .shard_max_bytes=max_bytes / n_shards,
+    };
     return true;
 }
 
-FUTILE_DEF void futile_for_zoom_range(unsigned int zoom_start, unsigned int zoom_until, futile_coord_fn for_coord, void *userdata) {
-    for (unsigned int z = zoom_start; z <= zoom_until; z++) {
-        int limit = pow(2, z);
-        for (int x = 0; x < limit; x++) {
-            for (int y = 0; y < limit; y++) {
-                futile_coord_s coord = {.x = x, .y = y, .z = z};
-                for_coord(&coord, userdata);
+FUTILE_DEF void futile_tile_cache_free(futile_tile_cache_s *cache) {
+    for (unsigned int i = 0; i < cache->n_shards; i++) {
+        tile_cache_shard_s *shard = &cache->shards[i];
+        tile_cache_free_retired(shard, 0);
+        tile_cache_free_retired(shard, 1);
+        tile_cache_table_s *table = shard->table;
+        for (size_t j = 0; j <= table->mask; j++) {
+            if (table->slots[j] && table->slots[j] != &tile_cache_tombstone) {
+                tile_cache_unref(table->slots[j]);
             }
         }
+        free(table);
+        pthread_mutex_destroy(&shard->lock);
     }
+    free(cache->shards);
+    *cache = (futile_tile_cache_s){0};
 }
 
-FUTILE_DEF bool futile_for_zoom_range_array(futile_coord_cursor_s *cursor, futile_coord_group_s *group) {
-    unsigned int coord_index = 0;
-    unsigned int x = cursor->x;
-    unsigned int y = cursor->y;
-    unsigned int z = cursor->z;
-    bool is_group_complete = true;
-    for (; is_group_complete && z <= cursor->zoom_until; z++) {
-        unsigned int limit = pow(2, z);
-        for (; is_group_complete && x < limit; x++) {
-            for (; is_group_complete && y < limit; y++) {
-                if (coord_index >= group->n) {
-                    is_group_complete = false;
-                    cursor->x = x;
-                    cursor->y = y;
-                    cursor->z = z;
-                    break;
-                }
-                futile_coord_s coord = {.x = x, .y = y, .z = z};
-                group->coords[coord_index++] = coord;
-            }
-            y = 0;
+FUTILE_DEF bool futile_tile_cache_put(futile_tile_cache_s *cache, uint64_t key, const void *data, size_t size) {
+    if (size > cache->shard_max_bytes - min_size(cache->shard_max_bytes, sizeof(futile_tile_cache_value_s))) {
+        errno = EINVAL;
+        return false;
+    }
+    futile_tile_cache_value_s *value = malloc(sizeof(futile_tile_cache_value_s) + size);
+    if (!value) {
+        errno = ENOMEM;
+        return false;
+    }
+    memcpy(value + 1, data, size);
+    *value = (futile_tile_cache_value_s){.key=key, .size=size, .data=value + 1, .n_refs=1};
+
+    uint64_t hash = mix_id(key);
+    tile_cache_shard_s *shard = tile_cache_shard(cache, hash);
+    pthread_mutex_lock(&shard->lock);
+    // keep the table at most three quarters used, so probes always
+    // reach an empty slot
+    size_t capacity = shard->table->mask + 1;
+    if (4 * (shard->n_live + shard->n_tombstones + 1) > 3 * capacity && !tile_cache_rebuild(shard)) {
+        pthread_mutex_unlock(&shard->lock);
+        free(value);
+        errno = ENOMEM;
+        return false;
+    }
+    tile_cache_table_s *table = shard->table;
+    bool found;
+    size_t i = tile_cache_find(table, hash, key, &found);
+    futile_tile_cache_value_s *old = table->slots[i];
+    __atomic_store_n(&table->slots[i], value, __ATOMIC_RELEASE);
+    if (found) {
+        tile_cache_retire(shard, old);
+    } else {
+        shard->n_live++;
+        if (old == &tile_cache_tombstone) {
+            shard->n_tombstones--;
         }
-        x = 0;
     }
-    group->n = coord_index;
-    return is_group_complete;
+    shard->n_bytes += tile_cache_cost(value);
+    while (shard->n_bytes > cache->shard_max_bytes) {
+        tile_cache_evict_one(shard, value);
+    }
+    tile_cache_reclaim(shard);
+    pthread_mutex_unlock(&shard->lock);
+    return true;
 }
 
-FUTILE_DEF void futile_for_coord_zoom_range(unsigned int start_x, unsigned int start_y, unsigned int end_x, unsigned int end_y, unsigned int start_zoom, unsigned int end_zoom, futile_coord_fn for_coord, void *userdata) {
-    unsigned int zoom_multiplier = 1;
-    // all the "end" parameters are inclusive
-    // bump them all up here to make them exclusive for range
-    end_x += 1;
-    end_y += 1;
-    end_zoom += 1;
-    for (unsigned int zoom_index = start_zoom; zoom_index < end_zoom; zoom_index++) {
-        for (unsigned int x_index = start_x * zoom_multiplier;
-             x_index < end_x * zoom_multiplier;
-             x_index++) {
-            for (unsigned int y_index = start_y * zoom_multiplier;
-                 y_index < end_y * zoom_multiplier;
-                 y_index++) {
-                futile_coord_s coord = {.x = x_index, .y = y_index, .z = zoom_index};
-                for_coord(&coord, userdata);
+FUTILE_DEF futile_tile_cache_value_s *futile_tile_cache_get(futile_tile_cache_s *cache, uint64_t key) {
+    uint64_t hash = mix_id(key);
+    tile_cache_shard_s *shard = tile_cache_shard(cache, hash);
+    uint64_t epoch = tile_cache_enter(shard);
+    tile_cache_table_s *table = __atomic_load_n(&shard->table, __ATOMIC_ACQUIRE);
+    futile_tile_cache_value_s *result = NULL;
+    for (size_t i = hash & table->mask;; i = (i + 1) & table->mask) {
+        futile_tile_cache_value_s *value = __atomic_load_n(&table->slots[i], __ATOMIC_ACQUIRE);
+        if (!value) {
+            break;
+        }
+        if (value != &tile_cache_tombstone && value->key == key) {
+            __atomic_add_fetch(&value->n_refs, 1, __ATOMIC_RELAXED);
+            // only write when needed, to keep the line shared
+            if (!__atomic_load_n(&value->is_referenced, __ATOMIC_RELAXED)) {
+                __atomic_store_n(&value->is_referenced, true, __ATOMIC_RELAXED);
             }
+            result = value;
+            break;
         }
-        zoom_multiplier *= 2;
     }
+    tile_cache_leave(shard, epoch);
+    return result;
 }
 
+FUTILE_DEF void futile_tile_cache_release(futile_tile_cache_value_s *value) {
+    tile_cache_unref(value);
+}
 
-FUTILE_DEF void futile_for_coord_parents(futile_coord_s *start, unsigned int zoom_until, futile_coord_fn for_coord, void *userdata) {
-    futile_coord_s coord = *start;
-    while (coord.z >= zoom_until) {
-        for_coord(&coord, userdata);
-        futile_coord_zoom(-1, &coord);
+FUTILE_DEF bool futile_tile_cache_remove(futile_tile_cache_s *cache, uint64_t key) {
+    uint64_t hash = mix_id(key);
+    tile_cache_shard_s *shard = tile_cache_shard(cache, hash);
+    pthread_mutex_lock(&shard->lock);
+    bool found;
+    size_t i = tile_cache_find(shard->table, hash, key, &found);
+    if (found) {
+        futile_tile_cache_value_s *value = shard->table->slots[i];
+        __atomic_store_n(&shard->table->slots[i], &tile_cache_tombstone, __ATOMIC_RELEASE);
+        shard->n_live--;
+        shard->n_tombstones++;
+        tile_cache_retire(shard, value);
     }
+    tile_cache_reclaim(shard);
+    pthread_mutex_unlock(&shard->lock);
+    return found;
 }
 
-FUTILE_DEF long futile_n_for_zoom(unsigned int zoom) {
-    // geometric series, each zoom containing 4 times more tiles
-    return (1 - pow(4, zoom + 1)) / -3;
+FUTILE_DEF void futile_tile_cache_stats(futile_tile_cache_s *cache, futile_tile_cache_stats_s *out_stats) {
+    *out_stats = (futile_tile_cache_stats_s){0};
+    for (unsigned int i = 0; i < cache->n_shards; i++) {
+        tile_cache_shard_s *shard = &cache->shards[i];
+        pthread_mutex_lock(&shard->lock);
+        out_stats->n_values += shard->n_live;
+        out_stats->n_bytes += shard->n_bytes;
+        out_stats->n_evictions += shard->n_evictions;
+        pthread_mutex_unlock(&shard->lock);
+    }
 }
 
-FUTILE_DEF void futile_for_bounds(futile_bounds_s *bounds, unsigned int zoom_start, unsigned int zoom_until, futile_coord_fn for_coord, void *userdata) {
-    unsigned int start_x, until_x, start_y, until_y, n_coords;
-    futile_coord_s coords[2];
+#define DEDUP_N_STRIPES 64
+// Probe runs this long only happen once an epoch is far past its
+// capacity
+#define DEDUP_MAX_PROBES 256
 
-    for (unsigned int z = zoom_start; z <= zoom_until; z++) {
-        n_coords = futile_bounds_to_coords(bounds, z, coords);;
-        if (n_coords == 2) {
-            start_x = coords[0].x;
-            start_y = coords[0].y;
-            until_x = coords[1].x;
-            until_y = coords[1].y;
-        } else {
-            start_x = until_x = coords[0].x;
-            start_y = until_y = coords[0].y;
+// Producers register in n_active[epoch & 1] of their stripe while they
+// add. A drain advances the epoch and waits for the old parity to
+// drain in every stripe, after which nothing writes to the old table.
+struct futile_dedup_stripe_s {
+    uint64_t n_active[2];
+} __attribute__((aligned(64)));
+
+typedef struct futile_dedup_stripe_s dedup_stripe_s;
+
+// Threads are spread over the stripes round robin, on first use
+static unsigned int dedup_next_stripe;
+static __thread int dedup_stripe_index = -1;
+
+static dedup_stripe_s *dedup_stripe(futile_dedup_set_s *set) {
+    if (dedup_stripe_index < 0) {
+        dedup_stripe_index = __atomic_fetch_add(&dedup_next_stripe, 1, __ATOMIC_RELAXED) % DEDUP_N_STRIPES;
+    }
+    return &set->stripes[dedup_stripe_index];
+}
+
+static uint64_t dedup_enter(futile_dedup_set_s *set, dedup_stripe_s *stripe) {
+    for (;;) {
+        uint64_t epoch = __atomic_load_n(&set->epoch, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&stripe->n_active[epoch & 1], 1, __ATOMIC_SEQ_CST);
+        // a drain may have moved on between the load and registering
+        if (__atomic_load_n(&set->epoch, __ATOMIC_SEQ_CST) == epoch) {
+            return epoch;
         }
+        __atomic_sub_fetch(&stripe->n_active[epoch & 1], 1, __ATOMIC_RELEASE);
+    }
+}
 
-        coords->z = z;
-        for (unsigned int y = start_y; y <= until_y; y++) {
-            coords->y = y;
-            for (unsigned int x = start_x; x <= until_x; x++) {
-                coords->x = x;
-                for_coord(coords, userdata);
-            }
+static void dedup_leave(dedup_stripe_s *stripe, uint64_t epoch) {
+    __atomic_sub_fetch(&stripe->n_active[epoch & 1], 1, __ATOMIC_RELEASE);
+}
+
+// With n_ids set, a new id first reserves one of limit places in it,
+// so the table never holds more than limit ids. A reservation that
+// loses its slot to another producer is handed back.
+static bool dedup_insert(uint64_t *table, size_t mask, uint64_t id, uint64_t *n_ids, size_t limit) {
+    // slots hold id + 1, so UINT64_MAX would look like an empty one
+    if (id == UINT64_MAX) {
+        errno = EINVAL;
+        return false;
+    }
+    uint64_t value = id + 1;
+    size_t n_probes = min_size(mask + 1, DEDUP_MAX_PROBES);
+    size_t i = mix_id(id) & mask;
+    for (size_t probe = 0; probe < n_probes; probe++, i = (i + 1) & mask) {
+        uint64_t current = __atomic_load_n(&table[i], __ATOMIC_RELAXED);
+        if (current == value) {
+            return true;
+        }
+        if (current != 0) {
+            continue;
+        }
+        if (n_ids && __atomic_add_fetch(n_ids, 1, __ATOMIC_RELAXED) > limit) {
+            __atomic_sub_fetch(n_ids, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        // the drain publishes the table, so slots need no ordering
+        if (__atomic_compare_exchange_n(&table[i], &current, value, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            return true;
+        }
+        if (n_ids) {
+            __atomic_sub_fetch(n_ids, 1, __ATOMIC_RELAXED);
+        }
+        if (current == value) {
+            return true;
+        }
+    }
+    errno = ENOSPC;
+    return false;
+}
+
+FUTILE_DEF bool futile_dedup_set_init(futile_dedup_set_s *set, size_t capacity) {
+    size_t n_slots = 16;
+    while (n_slots < 2 * capacity) {
+        n_slots *= 2;
+    }
+    *set = (futile_dedup_set_s){.mask=n_slots - 1};
+    set->tables[0] = calloc(n_slots, sizeof(uint64_t));
+    set->tables[1] = calloc(n_slots, sizeof(uint64_t));
+    if (posix_memalign((void **)&set->stripes, 64, DEDUP_N_STRIPES * sizeof(dedup_stripe_s)) != 0) {
+        set->stripes = NULL;
+    }
+    if (!set->tables[0] || !set->tables[1] || !set->stripes) {
+        futile_dedup_set_free(set);
+        errno = ENOMEM;
+        return false;
+    }
+    memset(set->stripes, 0, DEDUP_N_STRIPES * sizeof(dedup_stripe_s));
+    return true;
+}
+
+FUTILE_DEF void futile_dedup_set_free(futile_dedup_set_s *set) {
+    free(set->tables[0]);
+    free(set->tables[1]);
+    free(set->stripes);
+    *set = (futile_dedup_set_s){0};
+}
+
+FUTILE_DEF size_t futile_dedup_set_slots(futile_dedup_set_s *set) {
+    return set->mask + 1;
+}
+
+FUTILE_DEF bool futile_dedup_set_add(futile_dedup_set_s *set, uint64_t id) {
+    return futile_dedup_set_add_many(set, &id, 1) == 1;
+}
+
+// futile_dedup_set_add_many that stops once the epoch holds limit ids.
+// Counting costs an atomic add on a shared counter per new id, so
+// only limited adds count, and SIZE_MAX turns it off.
+static size_t dedup_add_many_limited(futile_dedup_set_s *set, uint64_t *ids, size_t n, size_t limit) {
+    dedup_stripe_s *stripe = dedup_stripe(set);
+    uint64_t epoch = dedup_enter(set, stripe);
+    uint64_t *table = set->tables[epoch & 1];
+    uint64_t *n_ids = limit == SIZE_MAX ? NULL : &set->n_limited[epoch & 1];
+    size_t i = 0;
+    while (i < n && dedup_insert(table, set->mask, ids[i], n_ids, limit)) {
+        i++;
+    }
+    dedup_leave(stripe, epoch);
+    return i;
+}
+
+FUTILE_DEF size_t futile_dedup_set_add_many(futile_dedup_set_s *set, uint64_t *ids, size_t n) {
+    return dedup_add_many_limited(set, ids, n, SIZE_MAX);
+}
+
+FUTILE_DEF size_t futile_dedup_set_drain(futile_dedup_set_s *set, uint64_t *out_ids) {
+    uint64_t epoch = set->epoch;
+    __atomic_store_n(&set->epoch, epoch + 1, __ATOMIC_SEQ_CST);
+    for (size_t i = 0; i < DEDUP_N_STRIPES; i++) {
+        while (__atomic_load_n(&set->stripes[i].n_active[epoch & 1], __ATOMIC_ACQUIRE) != 0) {
+            sched_yield();
+        }
+    }
+    // the table of the old epoch is ours until the drain after next,
+    // and is left cleared for it
+    uint64_t *table = set->tables[epoch & 1];
+    size_t n = 0;
+    for (size_t i = 0; i <= set->mask; i++) {
+        if (table[i]) {
+            out_ids[n++] = table[i] - 1;
+            table[i] = 0;
+        }
+    }
+    set->n_limited[epoch & 1] = 0;
+    return n;
+}
+
+static const uint64_t expiry_window_closed = UINT64_MAX;
+
+FUTILE_DEF bool futile_expiry_pipeline_init(futile_expiry_pipeline_s *pipeline, futile_expiry_options_s *options) {
+    if (options->max_pending == 0 || options->zoom_until > FUTILE_MARSHALL_MAX_ZOOM) {
+        errno = EINVAL;
+        return false;
+    }
+    *pipeline = (futile_expiry_pipeline_s){
+        .window_start_ns=expiry_window_closed,
+        .options=*options,
+    };
+    if (pipeline->options.max_batches == 0) {
+        pipeline->options.max_batches = 1;
+    }
+    if (!futile_dedup_set_init(&pipeline->pending, options->max_pending)) {
+        return false;
+    }
+    pipeline->drained = malloc(sizeof(uint64_t) * futile_dedup_set_slots(&pipeline->pending));
+    if (!pipeline->drained) {
+        futile_dedup_set_free(&pipeline->pending);
+        errno = ENOMEM;
+        return false;
+    }
+    return true;
+}
+
+FUTILE_DEF void futile_expiry_pipeline_free(futile_expiry_pipeline_s *pipeline) {
+    futile_dedup_set_free(&pipeline->pending);
+    free(pipeline->drained);
+    *pipeline = (futile_expiry_pipeline_s){0};
+}
+
+FUTILE_DEF size_t futile_expiry_ingest(futile_expiry_pipeline_s *pipeline, uint64_t *ids, size_t n, uint64_t now_ns) {
+    size_t n_valid = 0;
+    while (n_valid < n && (ids[n_valid] & zoom_mask) <= FUTILE_MARSHALL_MAX_ZOOM) {
+        n_valid++;
+    }
+    size_t n_added = dedup_add_many_limited(&pipeline->pending, ids, n_valid, pipeline->options.max_pending);
+    if (n_added > 0) {
+        // opened after adding, and closed before draining, so an id
+        // that misses a drain always finds an open window
+        uint64_t closed = expiry_window_closed;
+        __atomic_compare_exchange_n(&pipeline->window_start_ns, &closed, now_ns, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    }
+    if (n_added < n_valid) {
+        errno = EAGAIN;
+    } else if (n_valid < n) {
+        errno = EINVAL;
+    }
+    return n_added;
+}
+
+static bool expiry_emit(futile_expiry_pipeline_s *pipeline, uint64_t now_ns, bool is_forced, futile_expiry_batch_s **out_batch) {
+    *out_batch = NULL;
+    if (__atomic_load_n(&pipeline->n_batches, __ATOMIC_ACQUIRE) >= pipeline->options.max_batches) {
+        return true;
+    }
+    // leaves left over from a failed rollup go first
+    if (pipeline->n_drained == 0) {
+        uint64_t start = __atomic_load_n(&pipeline->window_start_ns, __ATOMIC_SEQ_CST);
+        // a clock read before the window opened has not seen it elapse
+        if (start == expiry_window_closed || (!is_forced && (now_ns < start || now_ns - start < pipeline->options.window_ns))) {
+            return true;
         }
+        __atomic_store_n(&pipeline->window_start_ns, expiry_window_closed, __ATOMIC_SEQ_CST);
+        pipeline->n_drained = futile_dedup_set_drain(&pipeline->pending, pipeline->drained);
+        pipeline->drained_start_ns = start;
+        if (pipeline->n_drained == 0) {
+            return true;
+        }
+    }
+    futile_expiry_batch_s *batch = malloc(sizeof(futile_expiry_batch_s));
+    if (!batch) {
+        errno = ENOMEM;
+        return false;
+    }
+    if (!futile_rollup_ints(pipeline->drained, pipeline->n_drained, pipeline->options.zoom_until, pipeline->options.n_threads, &batch->tiles)) {
+        free(batch);
+        return false;
     }
+    batch->n_leaves = pipeline->n_drained;
+    batch->window_start_ns = pipeline->drained_start_ns;
+    batch->emitted_ns = now_ns;
+    pipeline->n_drained = 0;
+    __atomic_add_fetch(&pipeline->n_batches, 1, __ATOMIC_RELAXED);
+    *out_batch = batch;
+    return true;
+}
+
+FUTILE_DEF bool futile_expiry_poll(futile_expiry_pipeline_s *pipeline, uint64_t now_ns, futile_expiry_batch_s **out_batch) {
+    return expiry_emit(pipeline, now_ns, false, out_batch);
+}
+
+FUTILE_DEF bool futile_expiry_flush(futile_expiry_pipeline_s *pipeline, uint64_t now_ns, futile_expiry_batch_s **out_batch) {
+    return expiry_emit(pipeline, now_ns, true, out_batch);
+}
+
+FUTILE_DEF void futile_expiry_batch_release(futile_expiry_pipeline_s *pipeline, futile_expiry_batch_s *batch) {
+    futile_rollup_free(&batch->tiles);
+    free(batch);
+    __atomic_sub_fetch(&pipeline->n_batches, 1, __ATOMIC_RELEASE);
 }
 
 #endif
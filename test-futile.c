@@ -2,6 +2,10 @@
 #include <stdlib.h>
 #include <glib.h>
 #include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <inttypes.h>
 #define FUTILE_IMPLEMENTATION 1
 #define FUTILE_STATIC 1
 #include "futile.h"
@@ -152,6 +156,228 @@ void test_coord_print() {
     g_assert_cmpstr("3/1/2", ==, str);
 }
 
+void test_coord_format() {
+    futile_coord_s c = {.x=1002463, .y=312816, .z=20};
+    char str[FUTILE_COORD_STR_MAX];
+    size_t n = futile_coord_format(&c, str, sizeof(str));
+    g_assert_cmpint(17, ==, n);
+    g_assert(memcmp("20/1002463/312816", str, n) == 0);
+    g_assert_cmpint(0, ==, futile_coord_format(&c, str, 16));
+    futile_coord_s max = {.x=UINT32_MAX, .y=UINT32_MAX, .z=UINT32_MAX};
+    g_assert_cmpint(FUTILE_COORD_STR_MAX, ==, futile_coord_format(&max, str, sizeof(str)));
+}
+
+void test_coord_parse() {
+    // no \0, and trailing characters are left alone
+    const char buf[] = {'5', '/', '1', '/', '2', '3', 'x'};
+    futile_coord_s c;
+    g_assert_cmpint(6, ==, futile_coord_parse(buf, sizeof(buf), &c));
+    g_assert_cmpint(5, ==, c.z);
+    g_assert_cmpint(1, ==, c.x);
+    g_assert_cmpint(23, ==, c.y);
+    g_assert_cmpint(5, ==, futile_coord_parse(buf, 5, &c));
+    g_assert_cmpint(2, ==, c.y);
+    g_assert_cmpint(0, ==, futile_coord_parse(buf, 4, &c));
+    g_assert_cmpint(0, ==, futile_coord_parse("31/4294967295/0", 15, &c));
+    g_assert_cmpint(0, ==, futile_coord_parse("1/2/2", 5, &c));
+}
+
+// futile_coord_deserialize as it was implemented with sscanf
+static bool sscanf_deserialize(char *coord_str, futile_coord_s *out) {
+    int x, y, z;
+    if (sscanf(coord_str, "%10d/%10d/%10d", &z, &x, &y) == 3) {
+        if (z >= 0 && x >= 0 && y >= 0) {
+            out->z = z;
+            out->x = x;
+            out->y = y;
+            return futile_coord_is_valid(out);
+        }
+    }
+    return false;
+}
+
+void test_coord_parse_matches_sscanf() {
+    const char *tokens[] = {"", " ", "\t", "+", "-", "0", "1", "7", "12", "/", "/", "/", "x", "\n"};
+    size_t n_tokens = sizeof(tokens) / sizeof(tokens[0]);
+    srand(42);
+    for (int i = 0; i < 100000; i++) {
+        char str[64] = "";
+        int n_parts = 1 + rand() % 10;
+        for (int j = 0; j < n_parts; j++) {
+            strcat(str, tokens[rand() % n_tokens]);
+        }
+        // overflowing an int is undefined for sscanf
+        size_t digit_run = 0, longest_digit_run = 0;
+        for (char *p = str; *p; p++) {
+            digit_run = (*p >= '0' && *p <= '9') ? digit_run + 1 : 0;
+            if (digit_run > longest_digit_run) {
+                longest_digit_run = digit_run;
+            }
+        }
+        if (longest_digit_run > 9) {
+            continue;
+        }
+        futile_coord_s expected = {}, actual = {};
+        bool expected_ok = sscanf_deserialize(str, &expected);
+        g_assert(expected_ok == futile_coord_deserialize(str, &actual));
+        if (expected_ok) {
+            g_assert(futile_coord_equal(&expected, &actual));
+        }
+    }
+}
+
+struct _parse_errors {
+    size_t n;
+    size_t offsets[8];
+};
+
+void _on_parse_error(size_t offset, void *userdata) {
+    struct _parse_errors *errors = userdata;
+    errors->offsets[errors->n++] = offset;
+}
+
+void test_coord_parse_lines() {
+    const char *buf = "0/0/0\n3/1/2\nbogus\n1/2/2\n\n16/19295/24641";
+    futile_coord_s coords[8];
+    futile_coord_group_s group = {.coords=coords, .n=8};
+    struct _parse_errors errors = {};
+    size_t n = futile_coord_parse_lines(buf, strlen(buf), &group, _on_parse_error, &errors);
+    g_assert_cmpint(strlen(buf), ==, n);
+    g_assert_cmpint(3, ==, group.n);
+    g_assert_cmpint(3, ==, coords[1].z);
+    g_assert_cmpint(1, ==, coords[1].x);
+    g_assert_cmpint(2, ==, coords[1].y);
+    g_assert_cmpint(24641, ==, coords[2].y);
+    g_assert_cmpint(3, ==, errors.n);
+    g_assert_cmpint(12, ==, errors.offsets[0]);
+    g_assert_cmpint(18, ==, errors.offsets[1]);
+    g_assert_cmpint(24, ==, errors.offsets[2]);
+}
+
+void test_coord_parse_lines_resume() {
+    const char *buf = "1/0/0\n1/0/1\n1/1/0\n1/1/1\n";
+    size_t n_buf = strlen(buf);
+    futile_coord_s coords[3];
+    futile_coord_group_s group = {.coords=coords, .n=3};
+    size_t n = futile_coord_parse_lines(buf, n_buf, &group, NULL, NULL);
+    g_assert_cmpint(18, ==, n);
+    g_assert_cmpint(3, ==, group.n);
+    group.n = 3;
+    n += futile_coord_parse_lines(buf + n, n_buf - n, &group, NULL, NULL);
+    g_assert_cmpint(n_buf, ==, n);
+    g_assert_cmpint(1, ==, group.n);
+    g_assert_cmpint(1, ==, coords[0].x);
+    g_assert_cmpint(1, ==, coords[0].y);
+}
+
+void test_coord_format_lines() {
+    futile_coord_s coords[] = {
+        {.x=1, .y=2, .z=3},
+        {.x=19295, .y=24641, .z=16},
+        {.x=0, .y=0, .z=0}
+    };
+    char buf[32];
+    size_t n_formatted;
+    size_t n = futile_coord_format_lines(coords, 3, buf, sizeof(buf), &n_formatted);
+    g_assert_cmpint(3, ==, n_formatted);
+    g_assert_cmpint(27, ==, n);
+    g_assert(memcmp("3/1/2\n16/19295/24641\n0/0/0\n", buf, n) == 0);
+    n = futile_coord_format_lines(coords, 3, buf, 21, &n_formatted);
+    g_assert_cmpint(2, ==, n_formatted);
+    g_assert_cmpint(21, ==, n);
+}
+
+typedef struct {
+    pthread_mutex_t lock;
+    size_t n_coords;
+    uint64_t sum;
+    size_t n_last;
+    size_t n_errors;
+    size_t error_offsets[16];
+} _tile_list_userdata;
+
+void _on_tile_list_chunk(futile_tile_list_chunk_s *chunk, void *userdata_) {
+    _tile_list_userdata *userdata = userdata_;
+    uint64_t sum = 0;
+    for (size_t i = 0; i < chunk->n; i++) {
+        sum += chunk->ids ? chunk->ids[i] : futile_coord_marshall_int(&chunk->coords[i]);
+    }
+    pthread_mutex_lock(&userdata->lock);
+    userdata->n_coords += chunk->n;
+    userdata->sum += sum;
+    userdata->n_last += chunk->last;
+    pthread_mutex_unlock(&userdata->lock);
+}
+
+void _on_tile_list_error(size_t offset, void *userdata_) {
+    _tile_list_userdata *userdata = userdata_;
+    pthread_mutex_lock(&userdata->lock);
+    userdata->error_offsets[userdata->n_errors++] = offset;
+    pthread_mutex_unlock(&userdata->lock);
+}
+
+static char *write_tile_list(const char *contents) {
+    char *path = strdup("/tmp/futile-test-XXXXXX");
+    int fd = mkstemp(path);
+    g_assert(fd >= 0);
+    g_assert(write(fd, contents, strlen(contents)) == (ssize_t)strlen(contents));
+    close(fd);
+    return path;
+}
+
+void test_read_tile_list() {
+    char contents[4096] = "";
+    uint64_t expected_sum = 0;
+    size_t n_expected = 0;
+    for (unsigned int z = 0; z <= 4; z++) {
+        for (unsigned int x = 0; x < (1U << z); x++) {
+            futile_coord_s coord = {.x=x, .y=(x * 7) % (1U << z), .z=z};
+            char line[FUTILE_COORD_STR_MAX + 1];
+            size_t n = futile_coord_format(&coord, line, sizeof(line));
+            line[n] = '\0';
+            strcat(contents, line);
+            strcat(contents, "\n");
+            expected_sum += futile_coord_marshall_int(&coord);
+            n_expected++;
+        }
+    }
+    size_t bad_offset = strlen(contents);
+    strcat(contents, "bogus\n2/4/0\n1/1/1");
+    expected_sum += futile_coord_marshall_int(&(futile_coord_s){.x=1, .y=1, .z=1});
+    n_expected++;
+    char *path = write_tile_list(contents);
+
+    bool marshall_options[] = {false, true};
+    for (unsigned int i = 0; i < 2; i++) {
+        _tile_list_userdata userdata = {.lock=PTHREAD_MUTEX_INITIALIZER};
+        futile_tile_list_options_s options = {
+            .n_threads=4,
+            .chunk_size=16,
+            .batch_size=3,
+            .marshall=marshall_options[i],
+            .on_chunk=_on_tile_list_chunk,
+            .on_error=_on_tile_list_error,
+            .userdata=&userdata
+        };
+        g_assert(futile_read_tile_list(path, &options));
+        g_assert_cmpint(n_expected, ==, userdata.n_coords);
+        g_assert(expected_sum == userdata.sum);
+        g_assert_cmpint((strlen(contents) + 15) / 16, ==, userdata.n_last);
+        g_assert_cmpint(2, ==, userdata.n_errors);
+        size_t first = min_size(userdata.error_offsets[0], userdata.error_offsets[1]);
+        size_t second = userdata.error_offsets[0] ^ userdata.error_offsets[1] ^ first;
+        g_assert_cmpint(bad_offset, ==, first);
+        g_assert_cmpint(bad_offset + 6, ==, second);
+    }
+    unlink(path);
+    free(path);
+}
+
+void test_read_tile_list_missing() {
+    futile_tile_list_options_s options = {.on_chunk=_on_tile_list_chunk};
+    g_assert(!futile_read_tile_list("/nonexistent/futile", &options));
+}
+
 void test_coord_cmp() {
     futile_coord_s coord = {.x=2, .y=2, .z=2};
     futile_coord_s less[] = {
@@ -253,6 +479,172 @@ void test_coord_int_zoom_up_small_range() {
     }
 }
 
+void test_coord_morton_examples() {
+    g_assert(0 == futile_morton_encode(0, 0));
+    g_assert(1 == futile_morton_encode(1, 0));
+    g_assert(2 == futile_morton_encode(0, 1));
+    g_assert(0x5555555555555555ULL == futile_morton_encode(UINT32_MAX, 0));
+    g_assert(0xAAAAAAAAAAAAAAAAULL == futile_morton_encode(0, UINT32_MAX));
+    // x=101, y=011 interleave to 01 10 11, which is quadkey 123
+    g_assert(27 == futile_morton_encode(5, 3));
+}
+
+void test_coord_morton_roundtrip() {
+    const size_t n = 1000;
+    futile_coord_s coords[n], decoded[n];
+    uint64_t codes[n];
+    srand(42);
+    for (size_t i = 0; i < n; i++) {
+        coords[i] = (futile_coord_s){.x=(uint32_t)rand() << 1 ^ rand(), .y=(uint32_t)rand() << 1 ^ rand(), .z=32};
+    }
+    for (int level = 0; level <= futile_simd_detect(); level++) {
+        futile_simd_set_level(level);
+        futile_morton_encode_batch(coords, n, codes);
+        futile_morton_decode_batch(codes, n, 32, decoded);
+        for (size_t i = 0; i < n; i++) {
+            g_assert(codes[i] == futile_morton_encode(coords[i].x, coords[i].y));
+            uint32_t x, y;
+            futile_morton_decode(codes[i], &x, &y);
+            g_assert_cmpuint(coords[i].x, ==, x);
+            g_assert_cmpuint(coords[i].y, ==, y);
+            g_assert(futile_coord_equal(&coords[i], &decoded[i]));
+        }
+    }
+    futile_simd_set_level(futile_simd_detect());
+}
+
+void test_coord_zorder_examples() {
+    futile_coord_s coord;
+    coord = (futile_coord_s){0, 0, 0};
+    g_assert(0 == futile_coord_to_zorder(&coord));
+    coord = (futile_coord_s){0, 0, 1};
+    g_assert(1 == futile_coord_to_zorder(&coord));
+    coord = (futile_coord_s){1, 1, 1};
+    g_assert(4 == futile_coord_to_zorder(&coord));
+    coord = (futile_coord_s){0, 0, 2};
+    g_assert(5 == futile_coord_to_zorder(&coord));
+    coord = (futile_coord_s){UINT32_MAX >> 1, UINT32_MAX >> 1, 31};
+    uint64_t last = futile_coord_to_zorder(&coord);
+    g_assert(0x5555555555555555ULL - 1 == last);
+    g_assert_cmpuint(31, ==, futile_zorder_zoom(last));
+
+    uint64_t parent;
+    g_assert(!futile_zorder_parent(0, &parent));
+    g_assert(futile_zorder_parent(4, &parent));
+    g_assert(0 == parent);
+
+    uint64_t first_id, last_id;
+    g_assert(futile_zorder_descendants(0, 0, &first_id, &last_id));
+    g_assert(0 == first_id && 0 == last_id);
+    g_assert(futile_zorder_descendants(0, 2, &first_id, &last_id));
+    g_assert(5 == first_id && 20 == last_id);
+    g_assert(futile_zorder_descendants(0, 31, &first_id, &last_id));
+    g_assert(0x5555555555555555ULL - 1 == last_id);
+    g_assert(!futile_zorder_descendants(4, 0, &first_id, &last_id));
+    g_assert(!futile_zorder_descendants(0, 32, &first_id, &last_id));
+}
+
+void test_coord_zorder_relatives() {
+    srand(42);
+    for (int i = 0; i < 1000; i++) {
+        uint32_t zoom = 1 + rand() % 30;
+        uint32_t mask = (1U << zoom) - 1;
+        futile_coord_s coord = {((uint32_t)rand() << 1 ^ rand()) & mask, ((uint32_t)rand() << 1 ^ rand()) & mask, zoom};
+        uint64_t id = futile_coord_to_zorder(&coord);
+        g_assert_cmpuint(zoom, ==, futile_zorder_zoom(id));
+
+        futile_coord_s decoded;
+        futile_zorder_to_coord(id, &decoded);
+        g_assert(futile_coord_equal(&coord, &decoded));
+
+        futile_coord_s parent_coord;
+        uint64_t parent;
+        g_assert(futile_coord_parent(&coord, &parent_coord));
+        g_assert(futile_zorder_parent(id, &parent));
+        g_assert(futile_coord_to_zorder(&parent_coord) == parent);
+
+        futile_coord_s child_coords[4];
+        uint64_t children[4];
+        futile_coord_children(&coord, child_coords);
+        futile_zorder_children(id, children);
+        for (int j = 0; j < 4; j++) {
+            g_assert(futile_coord_to_zorder(&child_coords[j]) == children[j]);
+        }
+
+        // every descendant falls in the range, and the tiles just
+        // outside it are not descendants
+        uint32_t desc_zoom = zoom + rand() % (FUTILE_ZORDER_MAX_ZOOM - zoom + 1);
+        uint64_t first_id, last_id;
+        g_assert(futile_zorder_descendants(id, desc_zoom, &first_id, &last_id));
+        g_assert(last_id - first_id + 1 == (uint64_t)1 << (2 * (desc_zoom - zoom)));
+        uint32_t shift = desc_zoom - zoom;
+        uint64_t desc_mask = ((uint64_t)1 << shift) - 1;
+        futile_coord_s desc = {(coord.x << shift) + (((uint32_t)rand() << 1 ^ rand()) & desc_mask),
+                               (coord.y << shift) + (((uint32_t)rand() << 1 ^ rand()) & desc_mask),
+                               desc_zoom};
+        uint64_t desc_id = futile_coord_to_zorder(&desc);
+        g_assert(first_id <= desc_id && desc_id <= last_id);
+        futile_coord_s outside;
+        if (first_id > 0 && futile_zorder_zoom(first_id - 1) == desc_zoom) {
+            futile_zorder_to_coord(first_id - 1, &outside);
+            outside = (futile_coord_s){outside.x >> shift, outside.y >> shift, zoom};
+            g_assert(!futile_coord_equal(&coord, &outside));
+        }
+        if (futile_zorder_zoom(last_id + 1) == desc_zoom) {
+            futile_zorder_to_coord(last_id + 1, &outside);
+            outside = (futile_coord_s){outside.x >> shift, outside.y >> shift, zoom};
+            g_assert(!futile_coord_equal(&coord, &outside));
+        }
+    }
+}
+
+void test_coord_hilbert_examples() {
+    // tile ids from the PMTiles specification
+    futile_coord_s coord;
+    coord = (futile_coord_s){0, 0, 0};
+    g_assert(0 == futile_coord_to_hilbert(&coord));
+    coord = (futile_coord_s){0, 0, 1};
+    g_assert(1 == futile_coord_to_hilbert(&coord));
+    coord = (futile_coord_s){0, 1, 1};
+    g_assert(2 == futile_coord_to_hilbert(&coord));
+    coord = (futile_coord_s){1, 1, 1};
+    g_assert(3 == futile_coord_to_hilbert(&coord));
+    coord = (futile_coord_s){1, 0, 1};
+    g_assert(4 == futile_coord_to_hilbert(&coord));
+    coord = (futile_coord_s){0, 0, 2};
+    g_assert(5 == futile_coord_to_hilbert(&coord));
+    coord = (futile_coord_s){3423, 1763, 12};
+    g_assert(19078479 == futile_coord_to_hilbert(&coord));
+
+    futile_hilbert_to_coord(19078479, &coord);
+    g_assert_cmpuint(3423, ==, coord.x);
+    g_assert_cmpuint(1763, ==, coord.y);
+    g_assert_cmpuint(12, ==, coord.z);
+}
+
+void test_coord_hilbert_roundtrip() {
+    srand(42);
+    for (int i = 0; i < 1000; i++) {
+        uint32_t zoom = rand() % (FUTILE_ZORDER_MAX_ZOOM + 1);
+        uint32_t mask = (uint32_t)(((uint64_t)1 << zoom) - 1);
+        futile_coord_s coord = {((uint32_t)rand() << 1 ^ rand()) & mask, ((uint32_t)rand() << 1 ^ rand()) & mask, zoom};
+        uint64_t id = futile_coord_to_hilbert(&coord);
+        g_assert_cmpuint(zoom, ==, futile_zorder_zoom(id));
+        futile_coord_s decoded;
+        futile_hilbert_to_coord(id, &decoded);
+        g_assert(futile_coord_equal(&coord, &decoded));
+
+        // consecutive ids in a zoom are neighbouring tiles
+        futile_coord_s next;
+        futile_hilbert_to_coord(id + 1, &next);
+        if (next.z == zoom) {
+            uint32_t dx = next.x > coord.x ? next.x - coord.x : coord.x - next.x;
+            uint32_t dy = next.y > coord.y ? next.y - coord.y : coord.y - next.y;
+            g_assert_cmpuint(1, ==, dx + dy);
+        }
+    }
+}
+
 void test_explode_bounds() {
     futile_bounds_s bounds = {1, 2, 3, 4};
     double a, b, c, d;
@@ -285,6 +677,219 @@ void test_lnglat_to_coord() {
     g_assert_cmpint(24641, ==, c.y);
 }
 
+static double random_range(double lo, double hi) {
+    return lo + (hi - lo) * (rand() / (RAND_MAX + 1.0));
+}
+
+void test_lnglat_to_coord_batch() {
+    futile_point_s lnglats[] = {
+        {.x=-74.0093994140625, .y=40.709792012434946},
+        {.x=-73.96708488464355, .y=40.781906259287},
+        {.x=151.2093, .y=-33.8688},
+        {.x=0, .y=0},
+        {.x=-180, .y=85.05}
+    };
+    size_t n = sizeof(lnglats) / sizeof(lnglats[0]);
+    for (int level = 0; level <= futile_simd_detect(); level++) {
+        futile_simd_set_level(level);
+        for (int zoom = 0; zoom <= 20; zoom += 4) {
+            futile_coord_s coords[n];
+            futile_lnglat_to_coord_batch(lnglats, n, zoom, coords);
+            for (size_t i = 0; i < n; i++) {
+                futile_coord_s expected;
+                futile_lnglat_to_coord(&lnglats[i], zoom, &expected);
+                g_assert(futile_coord_equal(&expected, &coords[i]));
+            }
+        }
+    }
+    futile_simd_set_level(futile_simd_detect());
+}
+
+void test_lnglat_to_coord_batch_random() {
+    const size_t n = 10000;
+    futile_point_s *lnglats = malloc(sizeof(futile_point_s) * n);
+    futile_coord_s *coords = malloc(sizeof(futile_coord_s) * n);
+    srand(42);
+    for (size_t i = 0; i < n; i++) {
+        lnglats[i].x = random_range(-180, 180);
+        lnglats[i].y = random_range(-85.0511, 85.0511);
+    }
+    for (int level = 0; level <= futile_simd_detect(); level++) {
+        futile_simd_set_level(level);
+        for (int zoom = 0; zoom <= 30; zoom += 3) {
+            futile_lnglat_to_coord_batch(lnglats, n, zoom, coords);
+            double n_tiles = pow(2, zoom);
+            for (size_t i = 0; i < n; i++) {
+                futile_coord_s expected;
+                futile_lnglat_to_coord(&lnglats[i], zoom, &expected);
+                g_assert_cmpint(expected.z, ==, coords[i].z);
+                g_assert_cmpint(expected.x, ==, coords[i].x);
+                if (expected.y != coords[i].y) {
+                    // only allowed right next to a tile edge
+                    double lat_rad = lnglats[i].y * M_PI / 180;
+                    double y = (1.0 - log(tan(lat_rad) + (1 / cos(lat_rad))) / M_PI) / 2.0 * n_tiles;
+                    double to_edge = fabs(y - round(y)) / n_tiles;
+                    g_assert_cmpfloat(to_edge, <, 1e-14);
+                }
+            }
+        }
+    }
+    futile_simd_set_level(futile_simd_detect());
+    free(coords);
+    free(lnglats);
+}
+
+void test_lnglat_to_coord_batch_clamp() {
+    futile_point_s lnglats[] = {
+        {.x=180, .y=-90},
+        {.x=-200, .y=90},
+        {.x=200, .y=-89}
+    };
+    size_t n = sizeof(lnglats) / sizeof(lnglats[0]);
+    for (int level = 0; level <= futile_simd_detect(); level++) {
+        futile_simd_set_level(level);
+        futile_coord_s coords[n];
+        futile_lnglat_to_coord_batch(lnglats, n, 3, coords);
+        g_assert_cmpint(7, ==, coords[0].x);
+        g_assert_cmpint(7, ==, coords[0].y);
+        g_assert_cmpint(0, ==, coords[1].x);
+        g_assert_cmpint(0, ==, coords[1].y);
+        g_assert_cmpint(7, ==, coords[2].x);
+        g_assert_cmpint(7, ==, coords[2].y);
+    }
+    futile_simd_set_level(futile_simd_detect());
+}
+
+void test_lnglat_to_coord_batch_soa() {
+    double lngs[] = {-74.0093994140625, 2.3522, 139.6917};
+    double lats[] = {40.709792012434946, 48.8566, 35.6895};
+    size_t n = sizeof(lngs) / sizeof(lngs[0]);
+    uint32_t xs[n], ys[n];
+    futile_lnglat_to_coord_batch_soa(lngs, lats, n, 16, xs, ys);
+    for (size_t i = 0; i < n; i++) {
+        futile_point_s lnglat = {.x=lngs[i], .y=lats[i]};
+        futile_coord_s expected;
+        futile_lnglat_to_coord(&lnglat, 16, &expected);
+        g_assert_cmpint(expected.x, ==, xs[i]);
+        g_assert_cmpint(expected.y, ==, ys[i]);
+    }
+}
+
+void test_mercator_to_tile_batch() {
+    const uint32_t extent = 4096, buffer = 64;
+    futile_coord_s coord = {.x=4823, .y=6160, .z=14};
+    futile_bounds_s bounds;
+    futile_coord_to_mercator_bounds(&coord, &bounds);
+    double w = bounds.maxx - bounds.minx;
+    futile_point_s points[] = {
+        {.x=bounds.minx, .y=bounds.maxy},
+        {.x=bounds.maxx, .y=bounds.miny},
+        {.x=bounds.minx + w / 2, .y=bounds.maxy - w / 4},
+        {.x=bounds.minx + w * 1.6 / extent, .y=bounds.maxy - w * 0.49 / extent},
+        {.x=bounds.minx - w, .y=bounds.miny - w},
+        {.x=bounds.minx - w * 10 / extent, .y=bounds.maxy + w * 10 / extent},
+        {.x=NAN, .y=bounds.maxy}
+    };
+    futile_tile_point_s expected[] = {
+        {0, 0}, {4096, 4096}, {2048, 1024}, {2, 0},
+        {-64, 4160}, {-10, -10}, {-64, 0}
+    };
+    size_t n = sizeof(points) / sizeof(points[0]);
+    for (int level = 0; level <= futile_simd_detect(); level++) {
+        futile_simd_set_level(level);
+        futile_tile_point_s out[n];
+        g_assert_cmpint(n, ==, futile_mercator_to_tile_batch(&coord, extent, buffer, points, n, false, out));
+        for (size_t i = 0; i < n; i++) {
+            g_assert_cmpint(expected[i].x, ==, out[i].x);
+            g_assert_cmpint(expected[i].y, ==, out[i].y);
+        }
+    }
+
+    // every level agrees exactly on mercator input
+    const size_t n_random = 1000;
+    futile_point_s *random_points = malloc(sizeof(futile_point_s) * n_random);
+    futile_tile_point_s *scalar = malloc(sizeof(futile_tile_point_s) * n_random);
+    futile_tile_point_s *out = malloc(sizeof(futile_tile_point_s) * n_random);
+    srand(42);
+    for (size_t i = 0; i < n_random; i++) {
+        random_points[i].x = random_range(bounds.minx - w / 8, bounds.maxx + w / 8);
+        random_points[i].y = random_range(bounds.miny - w / 8, bounds.maxy + w / 8);
+    }
+    futile_simd_set_level(0);
+    futile_mercator_to_tile_batch(&coord, extent, buffer, random_points, n_random, false, scalar);
+    for (int level = 1; level <= futile_simd_detect(); level++) {
+        futile_simd_set_level(level);
+        futile_mercator_to_tile_batch(&coord, extent, buffer, random_points, n_random, false, out);
+        g_assert(memcmp(scalar, out, sizeof(futile_tile_point_s) * n_random) == 0);
+    }
+    futile_simd_set_level(futile_simd_detect());
+    free(out);
+    free(scalar);
+    free(random_points);
+}
+
+void test_lnglat_to_tile_batch() {
+    const uint32_t extent = 4096, buffer = 256;
+    const size_t n = 1000;
+    futile_point_s *lnglats = malloc(sizeof(futile_point_s) * n);
+    futile_point_s *mercs = malloc(sizeof(futile_point_s) * n);
+    futile_tile_point_s *expected = malloc(sizeof(futile_tile_point_s) * n);
+    futile_tile_point_s *out = malloc(sizeof(futile_tile_point_s) * n);
+    srand(42);
+    for (int zoom = 0; zoom <= 20; zoom += 5) {
+        futile_point_s center = {.x=random_range(-170, 170), .y=random_range(-80, 80)};
+        futile_coord_s coord;
+        futile_lnglat_to_coord(&center, zoom, &coord);
+        double span = 360.0 / pow(2, zoom);
+        for (size_t i = 0; i < n; i++) {
+            lnglats[i].x = center.x + random_range(-span, span);
+            lnglats[i].y = fmax(-85, fmin(85, center.y + random_range(-span, span) / 2));
+            futile_lnglat_to_mercator(&lnglats[i], &mercs[i]);
+        }
+        futile_simd_set_level(0);
+        futile_mercator_to_tile_batch(&coord, extent, buffer, mercs, n, false, expected);
+        for (int level = 0; level <= futile_simd_detect(); level++) {
+            futile_simd_set_level(level);
+            g_assert_cmpint(n, ==, futile_lnglat_to_tile_batch(&coord, extent, buffer, lnglats, n, false, out));
+            for (size_t i = 0; i < n; i++) {
+                // the projections differ in the last bits only
+                g_assert_cmpint(abs(expected[i].x - out[i].x), <=, 1);
+                g_assert_cmpint(abs(expected[i].y - out[i].y), <=, 1);
+            }
+        }
+    }
+    futile_simd_set_level(futile_simd_detect());
+    free(out);
+    free(expected);
+    free(mercs);
+    free(lnglats);
+}
+
+void test_tile_batch_drop_duplicates() {
+    futile_coord_s coord = {.x=0, .y=0, .z=0};
+    double unit = 2 * 20037508.342789243907 / 256;
+    futile_point_s points[600];
+    size_t n = sizeof(points) / sizeof(points[0]);
+    // runs of three points share a grid position, also across the
+    // block boundaries inside the batch
+    for (size_t i = 0; i < n; i++) {
+        double v = (i / 3) * unit;
+        points[i] = (futile_point_s){.x=v - 20037508.342789243907 + unit * 0.1 * (i % 3), .y=20037508.342789243907 - v};
+    }
+    for (int level = 0; level <= futile_simd_detect(); level++) {
+        futile_simd_set_level(level);
+        futile_tile_point_s out[n];
+        g_assert_cmpint(n, ==, futile_mercator_to_tile_batch(&coord, 256, 0, points, n, false, out));
+        size_t n_out = futile_mercator_to_tile_batch(&coord, 256, 0, points, n, true, out);
+        g_assert_cmpint(200, ==, n_out);
+        for (size_t i = 0; i < n_out; i++) {
+            g_assert_cmpint(i, ==, out[i].x);
+            g_assert_cmpint(i, ==, out[i].y);
+        }
+    }
+    futile_simd_set_level(futile_simd_detect());
+}
+
 void test_coord_to_bounds() {
     futile_coord_s c = {.x=19295, .y=24641, .z=16};
     futile_bounds_s b;
@@ -295,6 +900,102 @@ void test_coord_to_bounds() {
     g_assert(float_cmp(40.709792012435, b.maxy, 0.01));
 }
 
+void test_coord_to_lnglat_batch() {
+    futile_coord_s coords[] = {
+        {.x=19295, .y=24641, .z=16},
+        {.x=0, .y=0, .z=0},
+        {.x=1, .y=1, .z=1},
+        {.x=5, .y=3, .z=3},
+        {.x=19296, .y=24642, .z=16},
+        {.x=1002463, .y=312816, .z=20}
+    };
+    size_t n = sizeof(coords) / sizeof(coords[0]);
+    double table_lats[futile_lat_table_size(16)];
+    futile_lat_table_s table;
+    futile_lat_table_init(&table, 16, table_lats);
+    for (int level = 0; level <= futile_simd_detect(); level++) {
+        futile_simd_set_level(level);
+        futile_point_s points[n];
+        futile_point_s table_points[n];
+        futile_coord_to_lnglat_batch(coords, n, NULL, points);
+        futile_coord_to_lnglat_batch(coords, n, &table, table_points);
+        for (size_t i = 0; i < n; i++) {
+            futile_point_s expected;
+            futile_coord_to_lnglat(&coords[i], &expected);
+            g_assert_cmpfloat(expected.x, ==, points[i].x);
+            g_assert(float_cmp(expected.y, points[i].y, 1e-13));
+            g_assert_cmpfloat(expected.x, ==, table_points[i].x);
+            if (coords[i].z == 16) {
+                g_assert_cmpfloat(expected.y, ==, table_points[i].y);
+            }
+        }
+    }
+    futile_simd_set_level(futile_simd_detect());
+}
+
+void test_coord_to_bounds_batch() {
+    futile_coord_s coords[] = {
+        {.x=19295, .y=24641, .z=16},
+        {.x=0, .y=0, .z=0},
+        {.x=3, .y=0, .z=2},
+        {.x=65535, .y=65535, .z=16},
+        {.x=4, .y=4, .z=2}
+    };
+    size_t n = sizeof(coords) / sizeof(coords[0]);
+    double table_lats[futile_lat_table_size(16)];
+    futile_lat_table_s table;
+    futile_lat_table_init(&table, 16, table_lats);
+    for (int level = 0; level <= futile_simd_detect(); level++) {
+        futile_simd_set_level(level);
+        futile_bounds_s bounds[n];
+        futile_bounds_s table_bounds[n];
+        futile_coord_to_bounds_batch(coords, n, NULL, bounds);
+        futile_coord_to_bounds_batch(coords, n, &table, table_bounds);
+        for (size_t i = 0; i < n; i++) {
+            futile_bounds_s expected;
+            futile_coord_to_bounds(&coords[i], &expected);
+            g_assert_cmpfloat(expected.minx, ==, bounds[i].minx);
+            g_assert_cmpfloat(expected.maxx, ==, bounds[i].maxx);
+            g_assert(float_cmp(expected.miny, bounds[i].miny, 1e-13));
+            g_assert(float_cmp(expected.maxy, bounds[i].maxy, 1e-13));
+            if (coords[i].z == 16) {
+                g_assert(memcmp(&expected, &table_bounds[i], sizeof(expected)) == 0);
+            }
+        }
+    }
+    futile_simd_set_level(futile_simd_detect());
+}
+
+void test_coord_range_to_bounds() {
+    futile_bounds_s bounds[300 * 3];
+    double table_lats[futile_lat_table_size(10)];
+    futile_lat_table_s table;
+    futile_lat_table_init(&table, 10, table_lats);
+    futile_lat_table_s *tables[] = {NULL, &table};
+    for (unsigned int i = 0; i < 2; i++) {
+        size_t n = futile_coord_range_to_bounds(10, 500, 200, 502, 499, tables[i], bounds);
+        g_assert_cmpint(900, ==, n);
+        // same order as futile_for_bounds, rows then columns
+        futile_bounds_s *actual = bounds;
+        for (unsigned int y = 200; y <= 499; y++) {
+            for (unsigned int x = 500; x <= 502; x++) {
+                futile_coord_s coord = {.x=x, .y=y, .z=10};
+                futile_bounds_s expected;
+                futile_coord_to_bounds(&coord, &expected);
+                g_assert_cmpfloat(expected.minx, ==, actual->minx);
+                g_assert_cmpfloat(expected.maxx, ==, actual->maxx);
+                g_assert(float_cmp(expected.miny, actual->miny, 1e-13));
+                g_assert(float_cmp(expected.maxy, actual->maxy, 1e-13));
+                actual++;
+            }
+        }
+    }
+
+    // reversed ranges have nothing in them
+    g_assert_cmpint(0, ==, futile_coord_range_to_bounds(10, 502, 200, 500, 499, NULL, bounds));
+    g_assert_cmpint(0, ==, futile_coord_range_to_bounds(10, 500, 499, 502, 200, NULL, bounds));
+}
+
 void test_bounds_to_multiple_coords() {
     double minx = -74.009399414062;
     double miny = 40.705627938206;
@@ -342,6 +1043,162 @@ void test_wgs84_to_mercator() {
     g_assert(float_cmp(4980225.91, merc.y, 0.01));
 }
 
+void test_mercator_batch() {
+    const size_t n = 10000;
+    const double half_circumference = 20037508.342789243907;
+    const double max_error[] = {0, 1e-9, 1e-6};
+    futile_point_s *lnglats = malloc(sizeof(futile_point_s) * n);
+    futile_point_s *mercs = malloc(sizeof(futile_point_s) * n);
+    futile_point_s *out = malloc(sizeof(futile_point_s) * n);
+    srand(42);
+    for (size_t i = 0; i < n; i++) {
+        lnglats[i].x = random_range(-180, 180);
+        lnglats[i].y = random_range(-85.0511, 85.0511);
+        futile_lnglat_to_mercator(&lnglats[i], &mercs[i]);
+    }
+    for (int level = 0; level <= futile_simd_detect(); level++) {
+        futile_simd_set_level(level);
+        for (int accuracy = FUTILE_ACCURACY_EXACT; accuracy <= FUTILE_ACCURACY_1E6; accuracy++) {
+            futile_lnglat_to_mercator_batch(lnglats, n, accuracy, out);
+            for (size_t i = 0; i < n; i++) {
+                // mercator error as degrees on the ground
+                double scale = cos(lnglats[i].y * M_PI / 180) * 180 / half_circumference;
+                g_assert_cmpfloat(fabs(out[i].x - mercs[i].x) * scale, <=, max_error[accuracy]);
+                g_assert_cmpfloat(fabs(out[i].y - mercs[i].y) * scale, <=, max_error[accuracy]);
+            }
+
+            futile_mercator_to_lnglat_batch(mercs, n, accuracy, out);
+            for (size_t i = 0; i < n; i++) {
+                futile_point_s expected;
+                futile_mercator_to_lnglat(&mercs[i], &expected);
+                g_assert_cmpfloat(fabs(out[i].x - expected.x), <=, max_error[accuracy]);
+                g_assert_cmpfloat(fabs(out[i].y - expected.y), <=, max_error[accuracy]);
+            }
+        }
+    }
+
+    // in place, and with a tail shorter than a vector
+    memcpy(out, lnglats, sizeof(futile_point_s) * 7);
+    futile_lnglat_to_mercator_batch(out, 7, FUTILE_ACCURACY_1E9, out);
+    futile_mercator_to_lnglat_batch(out, 7, FUTILE_ACCURACY_1E9, out);
+    for (size_t i = 0; i < 7; i++) {
+        g_assert_cmpfloat(fabs(out[i].x - lnglats[i].x), <=, 1e-9);
+        g_assert_cmpfloat(fabs(out[i].y - lnglats[i].y), <=, 2e-9);
+    }
+
+    // an unknown mode is exact
+    futile_lnglat_to_mercator_batch(lnglats, 7, (futile_accuracy_e)7, out);
+    for (size_t i = 0; i < 7; i++) {
+        g_assert_cmpfloat(out[i].x, ==, mercs[i].x);
+        g_assert_cmpfloat(out[i].y, ==, mercs[i].y);
+    }
+    futile_simd_set_level(futile_simd_detect());
+    free(out);
+    free(mercs);
+    free(lnglats);
+}
+
+void test_world_lnglat() {
+    srand(42);
+    for (int i = 0; i < 1000; i++) {
+        futile_point_s lnglat = {.x=random_range(-180, 180), .y=random_range(-85.0511, 85.0511)};
+        futile_world_point_s world;
+        futile_lnglat_to_world(&lnglat, &world);
+        for (unsigned int zoom = 0; zoom <= 31; zoom++) {
+            futile_coord_s expected, coord;
+            futile_lnglat_to_coord(&lnglat, zoom, &expected);
+            futile_world_to_coord(&world, zoom, &coord);
+            g_assert(futile_coord_equal(&expected, &coord));
+        }
+        futile_point_s back;
+        futile_world_to_lnglat(&world, &back);
+        // within one world unit, 360 / 2^32 degrees
+        g_assert_cmpfloat(fabs(back.x - lnglat.x), <, 1e-7);
+        g_assert_cmpfloat(fabs(back.y - lnglat.y), <, 1e-7);
+    }
+
+    futile_point_s corners[] = {{.x=-180, .y=90}, {.x=180, .y=-90}, {.x=NAN, .y=NAN}};
+    futile_world_point_s expected[] = {{0, 0}, {UINT32_MAX, UINT32_MAX}, {0, 0}};
+    for (size_t i = 0; i < sizeof(corners) / sizeof(corners[0]); i++) {
+        futile_world_point_s world;
+        futile_lnglat_to_world(&corners[i], &world);
+        g_assert_cmpuint(expected[i].x, ==, world.x);
+        g_assert_cmpuint(expected[i].y, ==, world.y);
+    }
+}
+
+void test_world_mercator() {
+    futile_world_point_s points[] = {{0, 0}, {UINT32_MAX, UINT32_MAX}, {1u << 31, 1u << 31}, {12345, 4000000000u}};
+    for (size_t i = 0; i < sizeof(points) / sizeof(points[0]); i++) {
+        futile_point_s merc;
+        futile_world_point_s back;
+        futile_world_to_mercator(&points[i], &merc);
+        futile_mercator_to_world(&merc, &back);
+        g_assert_cmpuint(points[i].x, ==, back.x);
+        g_assert_cmpuint(points[i].y, ==, back.y);
+    }
+    srand(42);
+    for (int i = 0; i < 10000; i++) {
+        futile_world_point_s world = {.x=rand() * 2u + (rand() & 1), .y=rand() * 2u + (rand() & 1)};
+        futile_point_s merc;
+        futile_world_point_s back;
+        futile_world_to_mercator(&world, &merc);
+        futile_mercator_to_world(&merc, &back);
+        g_assert_cmpuint(world.x, ==, back.x);
+        g_assert_cmpuint(world.y, ==, back.y);
+    }
+
+    futile_point_s outside = {.x=-3e7, .y=-3e7};
+    futile_world_point_s world;
+    futile_mercator_to_world(&outside, &world);
+    g_assert_cmpuint(0, ==, world.x);
+    g_assert_cmpuint(UINT32_MAX, ==, world.y);
+}
+
+void test_world_bounds() {
+    futile_coord_s world_coord = {.x=0, .y=0, .z=0};
+    futile_world_bounds_s bounds;
+    futile_coord_to_world_bounds(&world_coord, &bounds);
+    g_assert_cmpuint(0, ==, bounds.minx);
+    g_assert_cmpuint(0, ==, bounds.miny);
+    g_assert_cmpuint(UINT32_MAX, ==, bounds.maxx);
+    g_assert_cmpuint(UINT32_MAX, ==, bounds.maxy);
+
+    futile_coord_s unit = {.x=7, .y=UINT32_MAX, .z=32};
+    futile_coord_to_world_bounds(&unit, &bounds);
+    g_assert_cmpuint(7, ==, bounds.minx);
+    g_assert_cmpuint(7, ==, bounds.maxx);
+    g_assert_cmpuint(UINT32_MAX, ==, bounds.miny);
+    g_assert_cmpuint(UINT32_MAX, ==, bounds.maxy);
+
+    // a tile covers itself, and its 4 children one zoom deeper
+    futile_coord_s coord = {.x=19295, .y=24641, .z=16};
+    futile_coord_s coords[2];
+    futile_coord_to_world_bounds(&coord, &bounds);
+    g_assert_cmpint(1, ==, futile_world_bounds_to_coords(&bounds, 16, coords));
+    g_assert(futile_coord_equal(&coord, &coords[0]));
+    g_assert_cmpint(2, ==, futile_world_bounds_to_coords(&bounds, 17, coords));
+    g_assert_cmpint(2 * coord.x, ==, coords[0].x);
+    g_assert_cmpint(2 * coord.y, ==, coords[0].y);
+    g_assert_cmpint(2 * coord.x + 1, ==, coords[1].x);
+    g_assert_cmpint(2 * coord.y + 1, ==, coords[1].y);
+
+    srand(42);
+    for (int i = 0; i < 1000; i++) {
+        double x = random_range(-180, 179), y = random_range(-85, 84);
+        futile_bounds_s lnglat_bounds = {x, y, x + random_range(0, 1), y + random_range(0, 1)};
+        futile_bounds_to_world_bounds(&lnglat_bounds, &bounds);
+        for (unsigned int zoom = 0; zoom <= 20; zoom++) {
+            futile_coord_s expected[2];
+            unsigned int n = futile_bounds_to_coords(&lnglat_bounds, zoom, expected);
+            g_assert_cmpint(n, ==, futile_world_bounds_to_coords(&bounds, zoom, coords));
+            for (unsigned int j = 0; j < n; j++) {
+                g_assert(futile_coord_equal(&expected[j], &coords[j]));
+            }
+        }
+    }
+}
+
 void test_coord_to_mercator() {
     futile_coord_s coord = {.x=19302, .y=24623, .z=16};
     futile_point_s merc;
@@ -436,6 +1293,87 @@ void test_quadkey_to_coord() {
     }
 }
 
+void test_coord_to_quadkey_n() {
+    futile_coord_s coord = {.x=5, .y=0, .z=3};
+    char quadkey[3];
+    g_assert(futile_coord_to_quadkey_n(&coord, quadkey, sizeof(quadkey)));
+    g_assert(memcmp("101", quadkey, 3) == 0);
+    g_assert(!futile_coord_to_quadkey_n(&coord, quadkey, 2));
+    futile_coord_s too_deep = {.x=0, .y=0, .z=FUTILE_QUADKEY_MAX + 1};
+    char long_quadkey[64];
+    g_assert(!futile_coord_to_quadkey_n(&too_deep, long_quadkey, sizeof(long_quadkey)));
+}
+
+void test_quadkey_to_coord_invalid() {
+    futile_coord_s coord;
+    g_assert(!futile_quadkey_to_coord("014", 3, &coord));
+    g_assert(!futile_quadkey_to_coord("0a", 2, &coord));
+    char too_long[FUTILE_QUADKEY_MAX + 1];
+    memset(too_long, '3', sizeof(too_long));
+    g_assert(!futile_quadkey_to_coord(too_long, sizeof(too_long), &coord));
+    g_assert(futile_quadkey_to_coord(too_long, FUTILE_QUADKEY_MAX, &coord));
+    g_assert_cmpuint(UINT32_MAX, ==, coord.x);
+    g_assert_cmpuint(UINT32_MAX, ==, coord.y);
+}
+
+void test_quadkey_lines_roundtrip() {
+    const size_t n = 500;
+    futile_coord_s coords[n], parsed[n];
+    srand(42);
+    for (size_t i = 0; i < n; i++) {
+        uint32_t z = 1 + rand() % FUTILE_QUADKEY_MAX;
+        uint64_t mask = ((uint64_t)1 << z) - 1;
+        coords[i] = (futile_coord_s){.x=((uint32_t)rand() << 1 ^ rand()) & mask, .y=((uint32_t)rand() << 1 ^ rand()) & mask, .z=z};
+    }
+    char buf[n * (FUTILE_QUADKEY_MAX + 1)];
+    for (int level = 0; level <= futile_simd_detect(); level++) {
+        futile_simd_set_level(level);
+        size_t n_formatted;
+        size_t n_buf = futile_coord_to_quadkey_lines(coords, n, buf, sizeof(buf), &n_formatted);
+        g_assert_cmpint(n, ==, n_formatted);
+        futile_coord_group_s group = {.coords=parsed, .n=n};
+        g_assert_cmpint(n_buf, ==, futile_quadkey_parse_lines(buf, n_buf, &group, NULL, NULL));
+        g_assert_cmpint(n, ==, group.n);
+        for (size_t i = 0; i < n; i++) {
+            g_assert(futile_coord_equal(&coords[i], &parsed[i]));
+            char quadkey[FUTILE_QUADKEY_MAX + 1];
+            futile_coord_to_quadkey(&coords[i], quadkey);
+            futile_coord_s single;
+            g_assert(futile_quadkey_to_coord(quadkey, strlen(quadkey), &single));
+            g_assert(futile_coord_equal(&coords[i], &single));
+        }
+    }
+    futile_simd_set_level(futile_simd_detect());
+
+    // zoom 0 would be an empty line, so formatting stops there, which
+    // errno tells apart from running out of space
+    size_t n_formatted;
+    size_t n_first = coords[0].z + 1;
+    g_assert_cmpint(n_first, ==, futile_coord_to_quadkey_lines(coords, n, buf, n_first + coords[1].z, &n_formatted));
+    g_assert_cmpint(1, ==, n_formatted);
+    g_assert_cmpint(ENOSPC, ==, errno);
+    coords[3] = (futile_coord_s){0, 0, 0};
+    futile_coord_to_quadkey_lines(coords, n, buf, sizeof(buf), &n_formatted);
+    g_assert_cmpint(3, ==, n_formatted);
+    g_assert_cmpint(EINVAL, ==, errno);
+}
+
+void test_quadkey_parse_lines_errors() {
+    const char *buf = "030\n\n012x\n3";
+    futile_coord_s coords[4];
+    futile_coord_group_s group = {.coords=coords, .n=4};
+    struct _parse_errors errors = {};
+    g_assert_cmpint(strlen(buf), ==, futile_quadkey_parse_lines(buf, strlen(buf), &group, _on_parse_error, &errors));
+    g_assert_cmpint(2, ==, group.n);
+    g_assert_cmpint(3, ==, coords[0].z);
+    g_assert_cmpint(1, ==, coords[1].x);
+    g_assert_cmpint(1, ==, coords[1].y);
+    // an empty line is malformed, as for futile_coord_parse_lines
+    g_assert_cmpint(2, ==, errors.n);
+    g_assert_cmpint(4, ==, errors.offsets[0]);
+    g_assert_cmpint(5, ==, errors.offsets[1]);
+}
+
 void _for_zoom_range(__attribute__((unused)) futile_coord_s *c, void *userdata) {
     int *n = userdata;
     *n = *n + 1;
@@ -512,6 +1450,95 @@ static futile_coord_s parent_coords[] = {
     {.z = 1, .x = 1, .y = 1}
 };
 
+struct _parallel_visits {
+    uint8_t *visits;
+    uint64_t n_visited;
+};
+
+void _for_zoom_range_parallel(futile_coord_s *coord, void *userdata) {
+    struct _parallel_visits *data = userdata;
+    __atomic_add_fetch(&data->visits[futile_coord_to_zorder(coord)], 1, __ATOMIC_RELAXED);
+    // per thread batons need no synchronization
+    data->n_visited++;
+}
+
+void _count_coords(__attribute__((unused)) futile_coord_s *coord, void *userdata) {
+    // also used as the callback of parallel walks
+    __atomic_add_fetch((uint64_t *)userdata, 1, __ATOMIC_RELAXED);
+}
+
+bool _cancel_after_first_block(uint64_t n_done, uint64_t n_total, void *userdata) {
+    g_assert_cmpuint(n_done, <=, n_total);
+    int *n_calls = userdata;
+    return ++*n_calls < 2;
+}
+
+void test_tile_for_zoom_range_parallel() {
+    const unsigned int zoom_until = 8;
+    size_t n_ids = futile_n_for_zoom(zoom_until);
+    uint8_t *visits = calloc(n_ids, 1);
+    struct _parallel_visits batons[4];
+    void *thread_userdata[4];
+    for (int i = 0; i < 4; i++) {
+        batons[i] = (struct _parallel_visits){.visits = visits};
+        thread_userdata[i] = &batons[i];
+    }
+
+    // small blocks split zooms into columns and columns into rows
+    uint64_t block_sizes[] = {0, 100, 1};
+    for (size_t b = 0; b < sizeof(block_sizes) / sizeof(block_sizes[0]); b++) {
+        memset(visits, 0, n_ids);
+        futile_parallel_options_s options = {.n_threads = 4, .block_size = block_sizes[b], .thread_userdata = thread_userdata};
+        g_assert(futile_for_zoom_range_parallel(2, zoom_until, _for_zoom_range_parallel, &options));
+        for (size_t id = 0; id < n_ids; id++) {
+            g_assert_cmpuint(id < 5 ? 0 : 1, ==, visits[id]);
+        }
+    }
+    uint64_t n_visited = 0;
+    for (int i = 0; i < 4; i++) {
+        n_visited += batons[i].n_visited;
+    }
+    g_assert_cmpuint(3 * (n_ids - 5), ==, n_visited);
+
+    // batons can not be sized for a thread count chosen by the library
+    futile_parallel_options_s blind = {.thread_userdata = thread_userdata};
+    g_assert(!futile_for_zoom_range_parallel(2, zoom_until, _for_zoom_range_parallel, &blind));
+    g_assert_cmpint(EINVAL, ==, errno);
+
+    // without thread batons every thread shares userdata
+    struct _parallel_visits shared = {.visits = calloc(n_ids, 1)};
+    futile_parallel_options_s options = {.n_threads = 1, .userdata = &shared};
+    g_assert(futile_for_zoom_range_parallel(0, 3, _for_zoom_range_parallel, &options));
+    g_assert_cmpuint(futile_n_for_zoom(3), ==, shared.n_visited);
+    free(shared.visits);
+
+    free(visits);
+}
+
+void test_tile_for_zoom_range_parallel_cancel() {
+    const unsigned int zoom_until = 8;
+    size_t n_ids = futile_n_for_zoom(zoom_until);
+    struct _parallel_visits baton = {.visits = calloc(n_ids, 1)};
+
+    int n_calls = 0;
+    futile_parallel_options_s options = {
+        .n_threads = 1, .block_size = 16, .userdata = &baton,
+        .on_progress = _cancel_after_first_block, .progress_userdata = &n_calls,
+    };
+    g_assert(!futile_for_zoom_range_parallel(0, zoom_until, _for_zoom_range_parallel, &options));
+    g_assert_cmpint(2, ==, n_calls);
+    g_assert_cmpuint(baton.n_visited, <, n_ids);
+
+    bool cancel = true;
+    baton.n_visited = 0;
+    options = (futile_parallel_options_s){.n_threads = 2, .userdata = &baton, .cancel = &cancel};
+    g_assert(!futile_for_zoom_range_parallel(0, zoom_until, _for_zoom_range_parallel, &options));
+    g_assert_cmpuint(0, ==, baton.n_visited);
+
+    g_assert(!futile_for_zoom_range_parallel(0, FUTILE_ZORDER_MAX_ZOOM + 1, _for_zoom_range_parallel, &options));
+    free(baton.visits);
+}
+
 void _for_coord_parents(futile_coord_s *coord, void *userdata) {
     int *n = userdata;
     futile_coord_s *exp = &parent_coords[*n];
@@ -564,45 +1591,2440 @@ void test_tile_for_bounds_low_zooms() {
     g_assert_cmpint(11, ==, userdata.n);
 }
 
-void noop(futile_coord_s *coord, void *ignored) {
+struct _hilbert_order_userdata {
+    size_t n;
+    uint64_t last_id;
+    futile_coord_s coords[4096];
+};
+
+void _for_hilbert_order(futile_coord_s *coord, void *userdata) {
+    struct _hilbert_order_userdata *data = userdata;
+    uint64_t id = futile_coord_to_hilbert(coord);
+    g_assert(data->n == 0 || data->last_id < id);
+    g_assert(data->n < sizeof(data->coords) / sizeof(data->coords[0]));
+    data->last_id = id;
+    data->coords[data->n++] = *coord;
 }
 
-unsigned int now() {
-    return time(NULL);
+void test_tile_for_zoom_range_hilbert() {
+    struct _hilbert_order_userdata *userdata = g_new0(struct _hilbert_order_userdata, 1);
+    futile_for_zoom_range_hilbert(0, 5, _for_hilbert_order, userdata);
+    g_assert_cmpint(futile_n_for_zoom(5), ==, userdata->n);
+    for (size_t i = 0; i < userdata->n; i++) {
+        g_assert(futile_coord_to_hilbert(&userdata->coords[i]) == i);
+    }
+    g_free(userdata);
 }
 
-void test_timing_for_zoom_range_array() {
-    unsigned int start, took, zoom_start, zoom_until;
-    zoom_start = 0;
-    zoom_until = 16;
+void _collect_coords(futile_coord_s *coord, void *userdata) {
+    struct _hilbert_order_userdata *data = userdata;
+    g_assert(data->n < sizeof(data->coords) / sizeof(data->coords[0]));
+    data->coords[data->n++] = *coord;
+}
 
-    start = now();
-    futile_for_zoom_range(zoom_start, zoom_until, noop, NULL);
-    took = now() - start;
-    printf("\nfor zoom range: %u\n", took);
+void test_tile_for_bounds_hilbert() {
+    futile_bounds_s bounds = {-1.115, 50.941, 0.895, 51.984};
+    struct _hilbert_order_userdata *expected = g_new0(struct _hilbert_order_userdata, 1);
+    struct _hilbert_order_userdata *actual = g_new0(struct _hilbert_order_userdata, 1);
+    futile_for_bounds(&bounds, 0, 11, _collect_coords, expected);
+    futile_for_bounds_hilbert(&bounds, 0, 11, _for_hilbert_order, actual);
+    g_assert_cmpint(expected->n, ==, actual->n);
+    qsort(expected->coords, expected->n, sizeof(futile_coord_s), (int (*)(const void *, const void *))futile_coord_cmp);
+    qsort(actual->coords, actual->n, sizeof(futile_coord_s), (int (*)(const void *, const void *))futile_coord_cmp);
+    for (size_t i = 0; i < expected->n; i++) {
+        g_assert(futile_coord_equal(&expected->coords[i], &actual->coords[i]));
+    }
+    g_free(actual);
+    g_free(expected);
+}
 
-    futile_coord_cursor_s cursor = {};
-    // cursor.zoom_start = zoom_start;
-    cursor.zoom_until = zoom_until;
-    size_t n = 100;
-    futile_coord_s *coords = malloc(sizeof(futile_coord_s) * n);
-    futile_coord_group_s group = {.coords=coords, .n=n};
+void test_tile_for_bounds_parallel() {
+    futile_bounds_s bounds = {-1.115, 50.941, 0.895, 51.984};
+    const unsigned int zoom_until = 11;
+    size_t n_ids = futile_n_for_zoom(zoom_until);
+    struct _parallel_visits expected = {.visits = calloc(n_ids, 1)};
+    futile_for_bounds(&bounds, 3, zoom_until, _for_zoom_range_parallel, &expected);
 
-    start = now();
-    while (1) {
-        if (futile_for_zoom_range_array(&cursor, &group)) {
-            break;
-        }
+    uint8_t *visits = calloc(n_ids, 1);
+    struct _parallel_visits batons[4];
+    void *thread_userdata[4];
+    for (int i = 0; i < 4; i++) {
+        batons[i] = (struct _parallel_visits){.visits = visits};
+        thread_userdata[i] = &batons[i];
     }
-    free(coords);
-    took = now() - start;
-    printf("array: %u\n", took);
-}
+    futile_worker_stats_s stats[4];
+    futile_parallel_options_s options = {.n_threads = 4, .block_size = 7, .thread_userdata = thread_userdata};
+    g_assert(futile_for_bounds_parallel(&bounds, 3, zoom_until, _for_zoom_range_parallel, &options, stats));
+    g_assert(memcmp(expected.visits, visits, n_ids) == 0);
+    uint64_t n_visited = 0, n_stats = 0;
+    for (int i = 0; i < 4; i++) {
+        g_assert_cmpuint(batons[i].n_visited, ==, stats[i].n_coords);
+        n_visited += batons[i].n_visited;
+        n_stats += stats[i].n_coords;
+    }
+    g_assert_cmpuint(expected.n_visited, ==, n_visited);
+    g_assert_cmpuint(expected.n_visited, ==, n_stats);
 
-int main(int argc, char *argv[]) {
-    g_test_init(&argc, &argv, NULL);
+    // stats can not be sized for a thread count chosen by the library
+    options = (futile_parallel_options_s){.userdata = &batons[0]};
+    g_assert(!futile_for_bounds_parallel(&bounds, 3, zoom_until, _for_zoom_range_parallel, &options, stats));
+    g_assert_cmpint(EINVAL, ==, errno);
 
-    g_test_add_func("/coord/zoom/down-one", test_coord_zoom_down_one);
+    // the whole world is the zoom range, and a single zoom is all leaves
+    futile_bounds_s world = {-180, -85, 180, 85};
+    uint64_t n_coords = 0;
+    options = (futile_parallel_options_s){.n_threads = 2, .userdata = &n_coords};
+    g_assert(futile_for_bounds_parallel(&world, 0, 6, _count_coords, &options, NULL));
+    g_assert_cmpuint(futile_n_for_zoom(6), ==, n_coords);
+    n_coords = 0;
+    g_assert(futile_for_bounds_parallel(&world, 0, 0, _count_coords, &options, NULL));
+    g_assert_cmpuint(1, ==, n_coords);
+    n_coords = 0;
+    g_assert(futile_for_bounds_parallel(&world, 5, 5, _count_coords, &options, NULL));
+    g_assert_cmpuint(1 << 10, ==, n_coords);
+
+    free(visits);
+    free(expected.visits);
+}
+
+void test_tile_for_bounds_parallel_cancel() {
+    futile_bounds_s world = {-180, -85, 180, 85};
+    const unsigned int zoom_until = 8;
+    size_t n_ids = futile_n_for_zoom(zoom_until);
+    struct _parallel_visits baton = {.visits = calloc(n_ids, 1)};
+
+    int n_calls = 0;
+    futile_parallel_options_s options = {
+        .n_threads = 1, .block_size = 16, .userdata = &baton,
+        .on_progress = _cancel_after_first_block, .progress_userdata = &n_calls,
+    };
+    g_assert(!futile_for_bounds_parallel(&world, 0, zoom_until, _for_zoom_range_parallel, &options, NULL));
+    g_assert_cmpint(2, ==, n_calls);
+    g_assert_cmpuint(baton.n_visited, <, n_ids);
+
+    bool cancel = true;
+    baton.n_visited = 0;
+    options = (futile_parallel_options_s){.n_threads = 2, .userdata = &baton, .cancel = &cancel};
+    g_assert(!futile_for_bounds_parallel(&world, 0, zoom_until, _for_zoom_range_parallel, &options, NULL));
+    g_assert_cmpuint(0, ==, baton.n_visited);
+
+    g_assert(!futile_for_bounds_parallel(&world, 0, FUTILE_ZORDER_MAX_ZOOM + 1, _for_zoom_range_parallel, &options, NULL));
+    free(baton.visits);
+}
+
+// checks that a batch continues the expected sequence from *offset
+void _assert_next_coords(struct _hilbert_order_userdata *expected, size_t *offset, futile_coord_group_s *group) {
+    g_assert_cmpuint(*offset + group->n, <=, expected->n);
+    for (size_t i = 0; i < group->n; i++) {
+        g_assert(futile_coord_equal(&expected->coords[*offset + i], &group->coords[i]));
+    }
+    *offset += group->n;
+}
+
+void test_tile_bounds_cursor() {
+    futile_bounds_s bounds = {-1.115, 50.941, 0.895, 51.984};
+    struct _hilbert_order_userdata *expected = g_new0(struct _hilbert_order_userdata, 1);
+    futile_for_bounds(&bounds, 2, 10, _collect_coords, expected);
+
+    futile_bounds_cursor_s cursor;
+    g_assert(futile_bounds_cursor_init(&cursor, &bounds, 2, 10));
+    g_assert_cmpuint(expected->n, ==, futile_bounds_cursor_remaining(&cursor));
+    futile_coord_s coords[37];
+    futile_coord_group_s group = {.n = 37, .coords = coords};
+    size_t offset = 0;
+    g_assert(!futile_for_bounds_array(&cursor, &group));
+    _assert_next_coords(expected, &offset, &group);
+
+    // resume from a saved cursor
+    char str[FUTILE_CURSOR_STR_MAX];
+    g_assert(futile_bounds_cursor_serialize(&cursor, sizeof(str), str));
+    // no room for the \0
+    char short_str[FUTILE_CURSOR_STR_MAX];
+    g_assert(!futile_bounds_cursor_serialize(&cursor, strlen(str), short_str));
+    futile_bounds_cursor_s resumed;
+    g_assert(futile_bounds_cursor_deserialize(str, &resumed));
+    g_assert(memcmp(&cursor.bounds, &resumed.bounds, sizeof(futile_bounds_s)) == 0);
+    g_assert_cmpuint(cursor.position, ==, resumed.position);
+
+    // shards cover the rest in order, with sizes at most one apart
+    futile_bounds_cursor_s shards[5];
+    futile_bounds_cursor_split(&resumed, 5, shards);
+    for (int i = 0; i < 5; i++) {
+        uint64_t n_remaining = futile_bounds_cursor_remaining(&shards[i]);
+        g_assert_cmpuint(n_remaining, >=, (expected->n - 37) / 5);
+        g_assert_cmpuint(n_remaining, <=, (expected->n - 37 + 4) / 5);
+        bool is_done = false;
+        while (!is_done) {
+            group.n = 37;
+            is_done = futile_for_bounds_array(&shards[i], &group);
+            _assert_next_coords(expected, &offset, &group);
+        }
+        g_assert_cmpuint(0, ==, futile_bounds_cursor_remaining(&shards[i]));
+    }
+    g_assert_cmpuint(expected->n, ==, offset);
+    group.n = 37;
+    g_assert(futile_for_bounds_array(&shards[4], &group));
+    g_assert_cmpuint(0, ==, group.n);
+
+    g_assert(!futile_bounds_cursor_init(&cursor, &bounds, 0, FUTILE_ZORDER_MAX_ZOOM + 1));
+    g_assert(!futile_bounds_cursor_deserialize("", &resumed));
+    g_assert(!futile_bounds_cursor_deserialize("bounds 2 10 0 1", &resumed));
+    g_assert(!futile_bounds_cursor_deserialize("bounds 2 10 5 4 0 0 1 1", &resumed));
+    g_assert(!futile_bounds_cursor_deserialize("bounds 2 10 0 1000000 0 0 1 1", &resumed));
+    g_assert(!futile_bounds_cursor_deserialize("bounds 2 10 0 1 0 0 1 1 extra", &resumed));
+    g_free(expected);
+}
+
+void test_tile_coord_range_cursor() {
+    struct _hilbert_order_userdata *expected = g_new0(struct _hilbert_order_userdata, 1);
+    futile_for_coord_zoom_range(1, 0, 2, 2, 2, 6, _collect_coords, expected);
+
+    futile_coord_range_cursor_s cursor;
+    g_assert(futile_coord_range_cursor_init(&cursor, 1, 0, 2, 2, 2, 6));
+    g_assert_cmpuint(expected->n, ==, futile_coord_range_cursor_remaining(&cursor));
+    futile_coord_s coords[100];
+    futile_coord_group_s group = {.n = 100, .coords = coords};
+    size_t offset = 0;
+    g_assert(!futile_for_coord_zoom_range_array(&cursor, &group));
+    _assert_next_coords(expected, &offset, &group);
+
+    char str[FUTILE_CURSOR_STR_MAX];
+    g_assert(futile_coord_range_cursor_serialize(&cursor, sizeof(str), str));
+    futile_coord_range_cursor_s resumed;
+    g_assert(futile_coord_range_cursor_deserialize(str, &resumed));
+    g_assert(memcmp(&cursor, &resumed, sizeof(cursor)) == 0);
+
+    // more shards than coordinates leaves some empty
+    size_t n_shards = expected->n;
+    futile_coord_range_cursor_s *shards = calloc(n_shards, sizeof(futile_coord_range_cursor_s));
+    futile_coord_range_cursor_split(&resumed, n_shards, shards);
+    for (size_t i = 0; i < n_shards; i++) {
+        group.n = 100;
+        g_assert(futile_for_coord_zoom_range_array(&shards[i], &group));
+        g_assert_cmpuint(i < expected->n - 100 ? 1 : 0, ==, group.n);
+        _assert_next_coords(expected, &offset, &group);
+    }
+    g_assert_cmpuint(expected->n, ==, offset);
+    free(shards);
+
+    g_assert(!futile_coord_range_cursor_init(&cursor, 2, 0, 1, 0, 2, 6));
+    g_assert(!futile_coord_range_cursor_init(&cursor, 0, 0, 4, 0, 2, 6));
+    g_assert(!futile_coord_range_cursor_init(&cursor, 0, 0, 1, 1, 2, FUTILE_ZORDER_MAX_ZOOM + 1));
+    g_assert(!futile_coord_range_cursor_deserialize("bounds 2 10 0 1 0 0 1 1", &resumed));
+    g_assert(!futile_coord_range_cursor_deserialize("coord-range 2 6 0 1 4 0 1 0", &resumed));
+    g_free(expected);
+}
+
+void test_tile_n_for_bounds() {
+    futile_bounds_s bounds = {-1.115, 50.941, 0.895, 51.984};
+    uint64_t n_visited = 0;
+    futile_for_bounds(&bounds, 3, 14, _count_coords, &n_visited);
+    g_assert_cmpuint(n_visited, ==, futile_n_for_bounds(&bounds, 3, 14));
+
+    futile_bounds_s world = {-180, -85.05112877, 180, 85.05112877};
+    g_assert_cmpuint(futile_n_for_zoom(FUTILE_ZORDER_MAX_ZOOM), ==, futile_n_for_bounds(&world, 0, FUTILE_ZORDER_MAX_ZOOM));
+    g_assert_cmpuint(0x5555555555555555ULL, ==, futile_n_for_zoom(FUTILE_ZORDER_MAX_ZOOM));
+    g_assert_cmpint(-1, ==, futile_n_for_zoom(FUTILE_ZORDER_MAX_ZOOM + 1));
+}
+
+void test_tile_metatile() {
+    futile_coord_s coord = {.x=1234, .y=567, .z=12};
+    futile_metatile_s meta;
+    g_assert(futile_coord_to_metatile(&coord, 8, &meta));
+    g_assert_cmpuint(154, ==, meta.x);
+    g_assert_cmpuint(70, ==, meta.y);
+    g_assert_cmpuint(12, ==, meta.z);
+    g_assert(!futile_coord_to_metatile(&coord, 6, &meta));
+    g_assert_cmpint(EINVAL, ==, errno);
+    g_assert(!futile_coord_to_metatile(&coord, 0, &meta));
+
+    g_assert(futile_coord_to_metatile(&coord, 8, &meta));
+    futile_coord_s members[64];
+    g_assert_cmpuint(64, ==, futile_metatile_n_coords(&meta));
+    g_assert_cmpuint(64, ==, futile_metatile_to_coords(&meta, members));
+    g_assert_cmpuint(1232, ==, members[0].x);
+    g_assert_cmpuint(560, ==, members[0].y);
+    g_assert_cmpuint(1233, ==, members[1].x);
+    g_assert_cmpuint(1239, ==, members[63].x);
+    g_assert_cmpuint(567, ==, members[63].y);
+    for (int i = 0; i < 64; i++) {
+        futile_metatile_s back;
+        g_assert(futile_coord_to_metatile(&members[i], 8, &back));
+        g_assert(memcmp(&meta, &back, sizeof(meta)) == 0);
+    }
+
+    // the bounds without a buffer are those of the corner tiles
+    futile_bounds_s bounds, topleft, bottomright;
+    futile_metatile_to_mercator_bounds(&meta, 0, &bounds);
+    futile_coord_to_mercator_bounds(&members[0], &topleft);
+    futile_coord_to_mercator_bounds(&members[63], &bottomright);
+    g_assert_cmpfloat(fabs(bounds.minx - topleft.minx), <, 1e-6);
+    g_assert_cmpfloat(fabs(bounds.maxy - topleft.maxy), <, 1e-6);
+    g_assert_cmpfloat(fabs(bounds.maxx - bottomright.maxx), <, 1e-6);
+    g_assert_cmpfloat(fabs(bounds.miny - bottomright.miny), <, 1e-6);
+    futile_bounds_s buffered;
+    futile_metatile_to_mercator_bounds(&meta, 0.5, &buffered);
+    double half_tile = (topleft.maxx - topleft.minx) / 2;
+    g_assert_cmpfloat(fabs(buffered.minx - (bounds.minx - half_tile)), <, 1e-6);
+    g_assert_cmpfloat(fabs(buffered.maxy - (bounds.maxy + half_tile)), <, 1e-6);
+
+    // a metatile larger than the world holds the world, and a buffer
+    // stops at its edges
+    coord = (futile_coord_s){.x=1, .y=1, .z=1};
+    g_assert(futile_coord_to_metatile(&coord, 8, &meta));
+    g_assert_cmpuint(0, ==, meta.x);
+    g_assert_cmpuint(0, ==, meta.y);
+    g_assert_cmpuint(4, ==, futile_metatile_n_coords(&meta));
+    g_assert_cmpuint(4, ==, futile_metatile_to_coords(&meta, members));
+    g_assert_cmpuint(1, ==, members[3].x);
+    g_assert_cmpuint(1, ==, members[3].y);
+    futile_coord_s world_coord = {0, 0, 0};
+    futile_bounds_s world;
+    futile_coord_to_mercator_bounds(&world_coord, &world);
+    futile_metatile_to_mercator_bounds(&meta, 0.5, &buffered);
+    g_assert_cmpfloat(fabs(buffered.minx - world.minx), <, 1e-6);
+    g_assert_cmpfloat(fabs(buffered.miny - world.miny), <, 1e-6);
+    g_assert_cmpfloat(fabs(buffered.maxx - world.maxx), <, 1e-6);
+    g_assert_cmpfloat(fabs(buffered.maxy - world.maxy), <, 1e-6);
+}
+
+void _count_metatile_coords(futile_metatile_s *metatile, void *userdata) {
+    *(uint64_t *)userdata += futile_metatile_n_coords(metatile);
+}
+
+typedef struct {
+    futile_metatile_s metatiles[256];
+    size_t n;
+} _metatile_visit_s;
+
+void _collect_metatile(futile_metatile_s *metatile, void *userdata) {
+    _metatile_visit_s *visit = userdata;
+    for (size_t i = 0; i < visit->n; i++) {
+        g_assert(memcmp(&visit->metatiles[i], metatile, sizeof(*metatile)) != 0);
+    }
+    g_assert_cmpuint(visit->n, <, 256);
+    visit->metatiles[visit->n++] = *metatile;
+}
+
+void _assert_in_metatile(futile_coord_s *coord, void *userdata) {
+    _metatile_visit_s *visit = userdata;
+    futile_metatile_s metatile;
+    g_assert(futile_coord_to_metatile(coord, 8, &metatile));
+    bool is_found = false;
+    for (size_t i = 0; i < visit->n; i++) {
+        is_found |= memcmp(&visit->metatiles[i], &metatile, sizeof(metatile)) == 0;
+    }
+    g_assert(is_found);
+}
+
+void test_tile_for_metatile() {
+    // every tile of the pyramid, once
+    uint64_t n_coords = 0;
+    g_assert(futile_for_zoom_range_metatile(0, 9, 8, _count_metatile_coords, &n_coords));
+    g_assert_cmpuint(futile_n_for_zoom(9), ==, n_coords);
+    g_assert(!futile_for_zoom_range_metatile(0, 9, 3, _count_metatile_coords, &n_coords));
+    g_assert_cmpint(EINVAL, ==, errno);
+
+    // a metatile for each tile within the bounds, and no more than
+    // the tiles need
+    futile_bounds_s bounds = {-1.115, 50.941, 0.895, 51.984};
+    _metatile_visit_s visit = {0};
+    g_assert(futile_for_bounds_metatile(&bounds, 0, 12, 8, _collect_metatile, &visit));
+    futile_for_bounds(&bounds, 0, 12, _assert_in_metatile, &visit);
+    g_assert_cmpuint(visit.n, <, futile_n_for_bounds(&bounds, 0, 12));
+    for (size_t i = 0; i < visit.n; i++) {
+        futile_bounds_s meta_bounds;
+        futile_metatile_to_mercator_bounds(&visit.metatiles[i], 0, &meta_bounds);
+        g_assert_cmpfloat(meta_bounds.minx, <, 100000);
+        g_assert_cmpfloat(meta_bounds.maxx, >, -125000);
+    }
+    g_assert(!futile_for_bounds_metatile(&bounds, 0, 32, 8, _collect_metatile, &visit));
+}
+
+struct _shard_visit {
+    futile_shard_s *shard;
+    futile_shard_options_s *options;
+    uint64_t last_id;
+    uint64_t n;
+    double weight;
+};
+
+void _for_shard(futile_coord_s *coord, void *userdata) {
+    struct _shard_visit *data = userdata;
+    uint64_t id = futile_coord_to_hilbert(coord);
+    g_assert_cmpuint(id, >=, data->shard->first_id);
+    g_assert_cmpuint(id, <=, data->shard->last_id);
+    g_assert(data->n == 0 || id > data->last_id);
+    data->last_id = id;
+    data->n++;
+    if (data->options && data->options->weight) {
+        unsigned int region_zoom = coord->z < data->options->weight_zoom ? coord->z : data->options->weight_zoom;
+        futile_coord_s region = {.x = coord->x >> (coord->z - region_zoom), .y = coord->y >> (coord->z - region_zoom), .z = region_zoom};
+        data->weight += data->options->weight(&region, coord->z, data->options->userdata);
+    } else {
+        data->weight += 1;
+    }
+}
+
+// visits every shard, checking that they cover the bounds in order,
+// and returns the largest difference from an even share of weight
+double _assert_shards(futile_bounds_s *bounds, unsigned int zoom_start, unsigned int zoom_until, futile_shard_s *shards, size_t n_shards, futile_shard_options_s *options) {
+    uint64_t n_total = 0;
+    double weight_total = 0;
+    for (size_t i = 0; i < n_shards; i++) {
+        g_assert_cmpuint(shards[i].first_id, ==, i == 0 ? futile_n_for_zoom(zoom_start) - ((uint64_t)1 << 2 * zoom_start) : shards[i - 1].last_id + 1);
+        struct _shard_visit visit = {.shard = &shards[i], .options = options};
+        futile_for_shard(bounds, &shards[i], _for_shard, &visit);
+        g_assert_cmpuint(visit.n, ==, shards[i].n_coords);
+        g_assert_cmpfloat(fabs(visit.weight - shards[i].weight), <, 1e-6 * visit.weight + 1e-9);
+        n_total += visit.n;
+        weight_total += visit.weight;
+    }
+    g_assert_cmpuint(futile_n_for_zoom(zoom_until) - 1, ==, shards[n_shards - 1].last_id);
+    g_assert_cmpuint(futile_n_for_bounds(bounds, zoom_start, zoom_until), ==, n_total);
+    double max_diff = 0;
+    for (size_t i = 0; i < n_shards; i++) {
+        max_diff = fmax(max_diff, fabs(shards[i].weight - weight_total / n_shards));
+    }
+    return max_diff;
+}
+
+double _weight_by_zoom(__attribute__((unused)) futile_coord_s *region, unsigned int zoom, __attribute__((unused)) void *userdata) {
+    return zoom + 1;
+}
+
+double _weight_west(futile_coord_s *region, __attribute__((unused)) unsigned int zoom, __attribute__((unused)) void *userdata) {
+    // tiles over the western quarter of the world cost ten times more
+    return region->z >= 2 && (region->x >> (region->z - 2)) == 0 ? 10 : 1;
+}
+
+void test_tile_bounds_shard() {
+    futile_bounds_s bounds = {-1.115, 50.941, 0.895, 51.984};
+    futile_shard_s shards[7];
+    g_assert_cmpuint(7, ==, futile_bounds_shard(&bounds, 2, 12, 7, NULL, shards));
+    g_assert_cmpfloat(_assert_shards(&bounds, 2, 12, shards, 7, NULL), <=, 1);
+
+    futile_shard_options_s options = {.weight = _weight_by_zoom};
+    g_assert_cmpuint(7, ==, futile_bounds_shard(&bounds, 2, 12, 7, &options, shards));
+    g_assert_cmpfloat(_assert_shards(&bounds, 2, 12, shards, 7, &options), <=, 13);
+
+    futile_bounds_s world = {-180, -85.05112877, 180, 85.05112877};
+    options = (futile_shard_options_s){.weight = _weight_west, .weight_zoom = 4};
+    g_assert_cmpuint(7, ==, futile_bounds_shard(&world, 0, 8, 7, &options, shards));
+    g_assert_cmpfloat(_assert_shards(&world, 0, 8, shards, 7, &options), <=, 10);
+
+    // too few coordinates for every shard
+    g_assert_cmpuint(5, ==, futile_bounds_shard(&world, 0, 1, 7, NULL, shards));
+    _assert_shards(&world, 0, 1, shards, 5, NULL);
+
+    // planning does not depend on the number of coordinates
+    size_t n_shards = 1000;
+    futile_shard_s *many = calloc(n_shards, sizeof(futile_shard_s));
+    g_assert_cmpuint(n_shards, ==, futile_bounds_shard(&world, 0, FUTILE_ZORDER_MAX_ZOOM, n_shards, NULL, many));
+    uint64_t n_total = 0;
+    for (size_t i = 0; i < n_shards; i++) {
+        g_assert_cmpuint(many[i].n_coords, >=, futile_n_for_zoom(FUTILE_ZORDER_MAX_ZOOM) / n_shards);
+        g_assert_cmpuint(many[i].n_coords, <=, futile_n_for_zoom(FUTILE_ZORDER_MAX_ZOOM) / n_shards + 1);
+        n_total += many[i].n_coords;
+    }
+    g_assert_cmpuint(futile_n_for_zoom(FUTILE_ZORDER_MAX_ZOOM), ==, n_total);
+    free(many);
+}
+
+struct _cover_runs {
+    size_t n;
+    futile_coord_s coords[8192];
+    futile_coord_run_s last;
+};
+
+void _collect_cover_runs(futile_coord_run_s *run, void *userdata) {
+    struct _cover_runs *data = userdata;
+    g_assert_cmpuint(run->start_x, <=, run->until_x);
+    if (data->n > 0) {
+        futile_coord_run_s *last = &data->last;
+        g_assert(last->z < run->z || (last->z == run->z && (last->y < run->y ||
+                 (last->y == run->y && (uint64_t)last->until_x + 1 < run->start_x))));
+    }
+    data->last = *run;
+    for (uint32_t x = run->start_x; x <= run->until_x; x++) {
+        g_assert_cmpuint(data->n, <, sizeof(data->coords) / sizeof(data->coords[0]));
+        data->coords[data->n++] = (futile_coord_s){.x = x, .y = run->y, .z = run->z};
+    }
+}
+
+void _project_to_tiles(futile_point_s *lnglats, size_t n, unsigned int zoom, futile_point_s *out) {
+    for (size_t i = 0; i < n; i++) {
+        double lat_rad = lnglats[i].y * M_PI / 180;
+        out[i].x = (lnglats[i].x + 180.0) / 360.0 * (1 << zoom);
+        out[i].y = (1.0 - log(tan(lat_rad) + (1 / cos(lat_rad))) / M_PI) / 2.0 * (1 << zoom);
+    }
+}
+
+// clips the segment to the tile, Liang-Barsky style
+bool _segment_hits_tile(futile_point_s *a, futile_point_s *b, uint32_t x, uint32_t y) {
+    double t0 = 0, t1 = 1;
+    double d[2] = {b->x - a->x, b->y - a->y}, p[2] = {a->x, a->y}, lo[2] = {x, y};
+    for (int axis = 0; axis < 2; axis++) {
+        if (d[axis] == 0) {
+            if (p[axis] < lo[axis] || p[axis] > lo[axis] + 1) {
+                return false;
+            }
+            continue;
+        }
+        double ta = (lo[axis] - p[axis]) / d[axis], tb = (lo[axis] + 1 - p[axis]) / d[axis];
+        t0 = fmax(t0, fmin(ta, tb));
+        t1 = fmin(t1, fmax(ta, tb));
+    }
+    return t0 <= t1;
+}
+
+bool _point_in_rings(futile_point_s *points, size_t *ring_ends, size_t n_rings, double px, double py) {
+    bool inside = false;
+    size_t first = 0;
+    for (size_t r = 0; r < n_rings; r++) {
+        for (size_t i = first, j = ring_ends[r] - 1; i < ring_ends[r]; j = i++) {
+            if ((points[i].y > py) != (points[j].y > py) &&
+                px < (points[j].x - points[i].x) * (py - points[i].y) / (points[j].y - points[i].y) + points[i].x) {
+                inside = !inside;
+            }
+        }
+        first = ring_ends[r];
+    }
+    return inside;
+}
+
+// checks a cover at one zoom against testing every tile of the bbox
+void _assert_cover(struct _cover_runs *cover, futile_point_s *lnglats, size_t *ring_ends, size_t n_rings, bool is_polygon, unsigned int zoom) {
+    size_t n = ring_ends[n_rings - 1];
+    futile_point_s *points = calloc(n, sizeof(futile_point_s));
+    _project_to_tiles(lnglats, n, zoom, points);
+    double min_x = INFINITY, min_y = INFINITY, max_x = -INFINITY, max_y = -INFINITY;
+    for (size_t i = 0; i < n; i++) {
+        min_x = fmin(min_x, points[i].x);
+        min_y = fmin(min_y, points[i].y);
+        max_x = fmax(max_x, points[i].x);
+        max_y = fmax(max_y, points[i].y);
+    }
+    size_t k = 0;
+    for (uint32_t y = min_y; y <= (uint32_t)max_y; y++) {
+        for (uint32_t x = min_x; x <= (uint32_t)max_x; x++) {
+            bool hit = is_polygon && _point_in_rings(points, ring_ends, n_rings, x + 0.5, y + 0.5);
+            size_t first = 0;
+            for (size_t r = 0; !hit && r < n_rings; r++) {
+                for (size_t i = first; !hit && i + 1 < ring_ends[r] + is_polygon; i++) {
+                    size_t j = i + 1 < ring_ends[r] ? i + 1 : first;
+                    hit = _segment_hits_tile(&points[i], &points[j], x, y);
+                }
+                first = ring_ends[r];
+            }
+            while (k < cover->n && cover->coords[k].z < zoom) {
+                k++;
+            }
+            if (hit) {
+                g_assert_cmpuint(k, <, cover->n);
+                g_assert_cmpuint(zoom, ==, cover->coords[k].z);
+                g_assert_cmpuint(y, ==, cover->coords[k].y);
+                g_assert_cmpuint(x, ==, cover->coords[k].x);
+                k++;
+            }
+        }
+    }
+    g_assert(k == cover->n || cover->coords[k].z > zoom);
+    free(points);
+}
+
+void test_tile_cover_points() {
+    futile_point_s lnglats[] = {{-73.99, 40.73}, {-73.98, 40.74}, {-122.42, 37.77}, {-73.99, 40.73}, {-180, 90}};
+    struct _cover_runs *cover = g_new0(struct _cover_runs, 1);
+    g_assert(futile_cover_points(lnglats, 5, 0, 10, _collect_cover_runs, cover));
+    futile_coord_s expected[5];
+    size_t n_expected = 0;
+    for (unsigned int z = 0; z <= 10; z++) {
+        futile_lnglat_to_coord_batch(lnglats, 5, z, expected);
+        qsort(expected, 5, sizeof(futile_coord_s), (int (*)(const void *, const void *))futile_coord_cmp);
+        n_expected += futile_unique_coords(expected, 5);
+    }
+    g_assert_cmpuint(n_expected, ==, cover->n);
+    g_assert_cmpuint(0, ==, cover->coords[0].z);
+    g_assert(!futile_cover_points(lnglats, 5, 0, FUTILE_ZORDER_MAX_ZOOM + 1, _collect_cover_runs, cover));
+    g_free(cover);
+}
+
+void test_tile_cover_linestring() {
+    // a diagonal road across the bay
+    futile_point_s lnglats[] = {{-122.51, 37.71}, {-122.39, 37.81}, {-122.27, 37.79}, {-122.301, 37.702}};
+    size_t ring_ends[] = {4};
+    struct _cover_runs *cover = g_new0(struct _cover_runs, 1);
+    g_assert(futile_cover_linestring(lnglats, 4, 8, 14, _collect_cover_runs, cover));
+    for (unsigned int z = 8; z <= 14; z++) {
+        _assert_cover(cover, lnglats, ring_ends, 1, false, z);
+    }
+    // far fewer tiles than the bbox
+    futile_bounds_s bbox = {-122.51, 37.702, -122.27, 37.81};
+    g_assert_cmpuint(cover->n * 2, <, futile_n_for_bounds(&bbox, 8, 14));
+
+    // diagonals through the corner at the center of the world take one
+    // of the two tiles beside it
+    double lats[] = {10, 30, 60};
+    for (unsigned int i = 0; i < 3; i++) {
+        futile_point_s diagonal[] = {{-45, lats[i]}, {45, -lats[i]}};
+        memset(cover, 0, sizeof(*cover));
+        g_assert(futile_cover_linestring(diagonal, 2, 2, 2, _collect_cover_runs, cover));
+        g_assert_cmpuint(3, ==, cover->n);
+        futile_coord_s topleft = {.x=1, .y=1, .z=2}, bottomright = {.x=2, .y=2, .z=2};
+        g_assert(futile_coord_equal(&topleft, &cover->coords[0]));
+        g_assert(futile_coord_equal(&bottomright, &cover->coords[2]));
+    }
+    g_free(cover);
+}
+
+void test_tile_cover_polygon() {
+    // a triangle with a square hole, and a repeated first point
+    futile_point_s lnglats[] = {
+        {-10.1, -10.2}, {30.3, -8.4}, {5.5, 35.6}, {-10.1, -10.2},
+        {0.3, 0.4}, {0.3, 10.1}, {10.2, 10.1}, {10.2, 0.4},
+    };
+    size_t ring_ends[] = {4, 8};
+    struct _cover_runs *cover = g_new0(struct _cover_runs, 1);
+    g_assert(futile_cover_polygon(lnglats, ring_ends, 2, 2, 7, _collect_cover_runs, cover));
+    for (unsigned int z = 2; z <= 7; z++) {
+        _assert_cover(cover, lnglats, ring_ends, 2, true, z);
+    }
+    // the hole is empty at the deepest zoom
+    futile_coord_s hole = {.z = 7};
+    futile_point_s center = {5, 5};
+    futile_lnglat_to_coord(&center, 7, &hole);
+    for (size_t i = 0; i < cover->n; i++) {
+        g_assert(!futile_coord_equal(&hole, &cover->coords[i]));
+    }
+    g_free(cover);
+}
+
+struct _mixed_cover {
+    size_t n;
+    uint64_t ids[8192];
+};
+
+void _collect_mixed_cover(futile_coord_s *coord, void *userdata) {
+    struct _mixed_cover *data = userdata;
+    g_assert_cmpuint(data->n, <, sizeof(data->ids) / sizeof(data->ids[0]));
+    // zoom, row, then column order
+    futile_coord_s last;
+    if (data->n > 0) {
+        futile_zorder_to_coord(data->ids[data->n - 1], &last);
+        g_assert(last.z < coord->z || (last.z == coord->z && (last.y < coord->y || (last.y == coord->y && last.x < coord->x))));
+    }
+    data->ids[data->n++] = futile_coord_to_zorder(coord);
+}
+
+void _mark_visit(futile_coord_s *coord, void *userdata) {
+    uint8_t *visits = userdata;
+    visits[futile_coord_to_zorder(coord)]++;
+}
+
+// expands a mixed cover down to zoom, marking each coordinate
+void _expand_mixed_cover(struct _mixed_cover *mixed, unsigned int zoom, uint8_t *visits) {
+    for (size_t i = 0; i < mixed->n; i++) {
+        futile_coord_s coord;
+        futile_zorder_to_coord(mixed->ids[i], &coord);
+        futile_for_coord_zoom_range(coord.x, coord.y, coord.x, coord.y, coord.z, zoom, _mark_visit, visits);
+    }
+}
+
+void test_tile_cover_polygon_mixed() {
+    futile_point_s lnglats[] = {
+        {-10.1, -10.2}, {30.3, -8.4}, {5.5, 35.6},
+        {0.3, 0.4}, {0.3, 10.1}, {10.2, 10.1}, {10.2, 0.4},
+    };
+    size_t ring_ends[] = {3, 7};
+    const unsigned int zoom = 9;
+    struct _cover_runs *cover = g_new0(struct _cover_runs, 1);
+    g_assert(futile_cover_polygon(lnglats, ring_ends, 2, zoom, zoom, _collect_cover_runs, cover));
+
+    struct _mixed_cover *mixed = g_new0(struct _mixed_cover, 1);
+    g_assert(futile_cover_polygon_mixed(lnglats, ring_ends, 2, zoom, 0, _collect_mixed_cover, mixed));
+    g_assert_cmpuint(mixed->n * 4, <, cover->n);
+
+    // expanding gives back the cover exactly, with no overlaps
+    size_t n_ids = futile_n_for_zoom(zoom);
+    uint8_t *visits = calloc(n_ids, 1);
+    _expand_mixed_cover(mixed, zoom, visits);
+    size_t n_visited = 0;
+    for (size_t id = futile_n_for_zoom(zoom - 1); id < n_ids; id++) {
+        g_assert_cmpuint(visits[id], <=, 1);
+        n_visited += visits[id];
+    }
+    g_assert_cmpuint(cover->n, ==, n_visited);
+    for (size_t i = 0; i < cover->n; i++) {
+        g_assert_cmpuint(1, ==, visits[futile_coord_to_zorder(&cover->coords[i])]);
+    }
+
+    // no four siblings are left to merge
+    futile_sort_ids(mixed->ids, mixed->n, 1);
+    for (size_t i = 0; i + 3 < mixed->n; i++) {
+        uint64_t parent, next_parent;
+        if (futile_zorder_parent(mixed->ids[i], &parent) && futile_zorder_parent(mixed->ids[i + 3], &next_parent)) {
+            g_assert(parent != next_parent);
+        }
+    }
+
+    // a cap coarsens the cover, which still holds the fine cover
+    size_t n_uncapped = mixed->n;
+    mixed->n = 0;
+    g_assert(futile_cover_polygon_mixed(lnglats, ring_ends, 2, zoom, n_uncapped / 3, _collect_mixed_cover, mixed));
+    g_assert_cmpuint(mixed->n, <=, n_uncapped / 3);
+    memset(visits, 0, n_ids);
+    _expand_mixed_cover(mixed, zoom, visits);
+    for (size_t i = 0; i < cover->n; i++) {
+        g_assert_cmpuint(1, ==, visits[futile_coord_to_zorder(&cover->coords[i])]);
+    }
+    mixed->n = 0;
+    g_assert(futile_cover_polygon_mixed(lnglats, ring_ends, 2, zoom, 1, _collect_mixed_cover, mixed));
+    g_assert_cmpuint(1, ==, mixed->n);
+
+    g_assert(!futile_cover_polygon_mixed(lnglats, ring_ends, 2, FUTILE_ZORDER_MAX_ZOOM + 1, 0, _collect_mixed_cover, mixed));
+    free(visits);
+    g_free(mixed);
+    g_free(cover);
+}
+
+struct _cover_ids {
+    size_t n;
+    uint64_t ids[1 << 16];
+};
+
+void _collect_cover_id(futile_coord_s *coord, void *userdata) {
+    struct _cover_ids *data = userdata;
+    g_assert_cmpuint(data->n, <, sizeof(data->ids) / sizeof(data->ids[0]));
+    data->ids[data->n++] = futile_coord_marshall_int(coord);
+}
+
+void test_tile_cover_bounds() {
+    // overlapping boxes around london, some repeated, one inside
+    // another, and one crossing the others
+    futile_bounds_s bounds[64];
+    srand(42);
+    for (int i = 0; i < 60; i++) {
+        double lng = random_range(-1, 0.8), lat = random_range(51, 51.9);
+        bounds[i] = (futile_bounds_s){lng, lat, lng + random_range(0, 0.3), lat + random_range(0, 0.2)};
+    }
+    bounds[60] = bounds[0];
+    bounds[61] = bounds[1];
+    bounds[62] = (futile_bounds_s){bounds[1].minx + 0.01, bounds[1].miny + 0.01, bounds[1].maxx - 0.01, bounds[1].maxy - 0.01};
+    bounds[63] = (futile_bounds_s){-1.2, 51.4, 1, 51.45};
+
+    struct _cover_runs *runs = g_new0(struct _cover_runs, 1);
+    g_assert(futile_cover_bounds(bounds, 64, 0, 11, _collect_cover_runs, runs));
+    struct _cover_ids *actual = g_new0(struct _cover_ids, 1);
+    for (size_t i = 0; i < runs->n; i++) {
+        actual->ids[actual->n++] = futile_coord_marshall_int(&runs->coords[i]);
+    }
+    struct _cover_ids *expected = g_new0(struct _cover_ids, 1);
+    for (int i = 0; i < 64; i++) {
+        futile_for_bounds(&bounds[i], 0, 11, _collect_cover_id, expected);
+    }
+    g_assert_cmpuint(expected->n, >, 2 * actual->n);
+    g_assert(futile_sort_ids(expected->ids, expected->n, 1));
+    expected->n = futile_unique_ids(expected->ids, expected->n);
+    // runs are reported once each, so only the order can differ
+    g_assert(futile_sort_ids(actual->ids, actual->n, 1));
+    g_assert_cmpuint(expected->n, ==, actual->n);
+    g_assert(memcmp(expected->ids, actual->ids, sizeof(uint64_t) * actual->n) == 0);
+
+    // the world is one run per row
+    futile_bounds_s world[2] = {{-180, -85, 0, 85}, {-10, -85, 180, 85}};
+    memset(runs, 0, sizeof(*runs));
+    g_assert(futile_cover_bounds(world, 2, 3, 3, _collect_cover_runs, runs));
+    g_assert_cmpuint(64, ==, runs->n);
+    g_assert_cmpuint(7, ==, runs->last.y);
+    g_assert_cmpuint(0, ==, runs->last.start_x);
+    g_assert_cmpuint(7, ==, runs->last.until_x);
+
+    memset(runs, 0, sizeof(*runs));
+    g_assert(futile_cover_bounds(NULL, 0, 0, 10, _collect_cover_runs, runs));
+    g_assert_cmpuint(0, ==, runs->n);
+    futile_bounds_s inverted = {bounds[0].maxx, bounds[0].miny, bounds[0].minx, bounds[0].maxy};
+    g_assert(futile_cover_bounds(&inverted, 1, 0, 10, _collect_cover_runs, runs));
+    g_assert_cmpuint(0, ==, runs->n);
+    g_assert(!futile_cover_bounds(bounds, 64, 0, FUTILE_ZORDER_MAX_ZOOM + 1, _collect_cover_runs, runs));
+
+    g_free(expected);
+    g_free(actual);
+    g_free(runs);
+}
+
+static int uint64_cmp(const void *lhs, const void *rhs) {
+    uint64_t a = *(const uint64_t *)lhs, b = *(const uint64_t *)rhs;
+    return a < b ? -1 : a > b;
+}
+
+static size_t sort_unique_ids(uint64_t *ids, size_t n) {
+    size_t n_unique = 0;
+    qsort(ids, n, sizeof(uint64_t), uint64_cmp);
+    for (size_t i = 0; i < n; i++) {
+        if (n_unique == 0 || ids[n_unique - 1] != ids[i]) {
+            ids[n_unique++] = ids[i];
+        }
+    }
+    return n_unique;
+}
+
+struct _tile_set_ids {
+    size_t n;
+    uint64_t *ids;
+};
+
+void _collect_tile_set_ids(futile_coord_s *coord, void *userdata) {
+    struct _tile_set_ids *data = userdata;
+    data->ids[data->n++] = futile_coord_to_zorder(coord);
+}
+
+// Fill a set with a mix of dense rectangles, which end up in bitmap
+// and run containers, and scattered tiles, which end up in arrays
+static size_t fill_tile_set(futile_tile_set_s *set, uint64_t *ids, unsigned int seed) {
+    size_t n = 0;
+    srand(seed);
+    futile_tile_set_init(set);
+    for (int i = 0; i < 4; i++) {
+        uint32_t x0 = 8000 + rand() % 600, y0 = 5000 + rand() % 600;
+        uint32_t width = 1 + rand() % 300, height = 1 + rand() % 300;
+        for (uint32_t y = y0; y < y0 + height; y++) {
+            for (uint32_t x = x0; x < x0 + width; x++) {
+                futile_coord_s coord = {x, y, 14};
+                g_assert(futile_tile_set_add(set, &coord));
+                ids[n++] = futile_coord_to_zorder(&coord);
+            }
+        }
+    }
+    for (int i = 0; i < 20000; i++) {
+        futile_coord_s coord = {8000 + rand() % 2048, 5000 + rand() % 2048, 14};
+        if (i % 10 == 0) {
+            coord = (futile_coord_s){rand() % 256, rand() % 256, 8};
+        }
+        g_assert(futile_tile_set_add(set, &coord));
+        ids[n++] = futile_coord_to_zorder(&coord);
+    }
+    return sort_unique_ids(ids, n);
+}
+
+static size_t reference_set_op(uint64_t *a, size_t n_a, uint64_t *b, size_t n_b, int op, uint64_t *out) {
+    size_t i = 0, j = 0, n = 0;
+    while (i < n_a || j < n_b) {
+        if (j == n_b || (i < n_a && a[i] < b[j])) {
+            if (op != 1) {
+                out[n++] = a[i];
+            }
+            i++;
+        } else if (i == n_a || b[j] < a[i]) {
+            if (op == 0) {
+                out[n++] = b[j];
+            }
+            j++;
+        } else {
+            if (op != 2) {
+                out[n++] = a[i];
+            }
+            i++;
+            j++;
+        }
+    }
+    return n;
+}
+
+static void assert_tile_set_ids(futile_tile_set_s *set, uint64_t *expected, size_t n_expected) {
+    struct _tile_set_ids actual = {.ids = malloc(sizeof(uint64_t) * (n_expected + 1))};
+    g_assert_cmpuint(n_expected, ==, futile_tile_set_cardinality(set));
+    futile_tile_set_for_each(set, _collect_tile_set_ids, &actual);
+    g_assert_cmpuint(n_expected, ==, actual.n);
+    for (size_t i = 0; i < n_expected; i++) {
+        g_assert(expected[i] == actual.ids[i]);
+    }
+    free(actual.ids);
+}
+
+void test_tile_set_basic() {
+    futile_tile_set_s set;
+    futile_tile_set_init(&set);
+    futile_coord_s coord = {1, 2, 3};
+    g_assert(!futile_tile_set_contains(&set, &coord));
+    g_assert(futile_tile_set_add(&set, &coord));
+    g_assert(futile_tile_set_add(&set, &coord));
+    g_assert(futile_tile_set_contains(&set, &coord));
+    g_assert_cmpuint(1, ==, futile_tile_set_cardinality(&set));
+
+    futile_coord_s other = {2, 1, 3};
+    g_assert(!futile_tile_set_contains(&set, &other));
+    other = (futile_coord_s){1, 2, 4};
+    g_assert(!futile_tile_set_contains(&set, &other));
+
+    futile_coord_s invalid = {8, 0, 3};
+    g_assert(!futile_tile_set_add(&set, &invalid));
+    invalid = (futile_coord_s){0, 0, FUTILE_ZORDER_MAX_ZOOM + 1};
+    g_assert(!futile_tile_set_add(&set, &invalid));
+    g_assert(!futile_tile_set_contains(&set, &invalid));
+
+    futile_coord_s last = {UINT32_MAX >> 1, UINT32_MAX >> 1, FUTILE_ZORDER_MAX_ZOOM};
+    g_assert(futile_tile_set_add(&set, &last));
+    g_assert(futile_tile_set_contains(&set, &last));
+    g_assert_cmpuint(2, ==, futile_tile_set_cardinality(&set));
+
+    futile_tile_set_free(&set);
+    g_assert_cmpuint(0, ==, futile_tile_set_cardinality(&set));
+}
+
+void test_tile_set_algebra() {
+    const size_t max_ids = 4 * 300 * 300 + 20000;
+    uint64_t *a = malloc(sizeof(uint64_t) * max_ids);
+    uint64_t *b = malloc(sizeof(uint64_t) * max_ids);
+    uint64_t *expected = malloc(sizeof(uint64_t) * 2 * max_ids);
+    futile_tile_set_s lhs, rhs, out;
+    size_t n_a = fill_tile_set(&lhs, a, 1);
+    size_t n_b = fill_tile_set(&rhs, b, 2);
+    assert_tile_set_ids(&lhs, a, n_a);
+
+    for (int optimize = 0; optimize < 2; optimize++) {
+        for (int level = 0; level <= futile_simd_detect(); level++) {
+            futile_simd_set_level(level);
+            bool (*ops[3])(futile_tile_set_s *, futile_tile_set_s *, futile_tile_set_s *) = {
+                futile_tile_set_union, futile_tile_set_intersect, futile_tile_set_difference,
+            };
+            for (int op = 0; op < 3; op++) {
+                g_assert(ops[op](&lhs, &rhs, &out));
+                assert_tile_set_ids(&out, expected, reference_set_op(a, n_a, b, n_b, op, expected));
+                futile_tile_set_free(&out);
+            }
+        }
+        g_assert(futile_tile_set_optimize(&lhs));
+        g_assert(futile_tile_set_optimize(&rhs));
+        assert_tile_set_ids(&lhs, a, n_a);
+    }
+    futile_simd_set_level(futile_simd_detect());
+
+    for (size_t i = 0; i < n_a; i += 97) {
+        futile_coord_s coord;
+        futile_zorder_to_coord(a[i], &coord);
+        g_assert(futile_tile_set_contains(&lhs, &coord));
+    }
+
+    futile_tile_set_free(&lhs);
+    futile_tile_set_free(&rhs);
+    free(expected);
+    free(b);
+    free(a);
+}
+
+void test_tile_set_add_runs() {
+    // after optimizing, a single row of tiles is a run container that
+    // further adds have to split and join
+    futile_tile_set_s set;
+    futile_tile_set_init(&set);
+    uint64_t ids[1100];
+    size_t n = 0;
+    for (uint32_t x = 0; x < 1024; x += 2) {
+        futile_coord_s coord = {x, 0, 10};
+        g_assert(futile_tile_set_add(&set, &coord));
+        ids[n++] = futile_coord_to_zorder(&coord);
+    }
+    g_assert(futile_tile_set_optimize(&set));
+    srand(3);
+    for (int i = 0; i < 500; i++) {
+        futile_coord_s coord = {rand() % 1024, 0, 10};
+        g_assert(futile_tile_set_add(&set, &coord));
+        ids[n++] = futile_coord_to_zorder(&coord);
+    }
+    n = sort_unique_ids(ids, n);
+    assert_tile_set_ids(&set, ids, n);
+    futile_tile_set_free(&set);
+}
+
+void test_tile_set_size() {
+    // an expiry set for a city sized area at zoom 16
+    futile_tile_set_s set;
+    futile_tile_set_init(&set);
+    for (uint32_t y = 20000; y < 20500; y++) {
+        for (uint32_t x = 30000; x < 30700; x++) {
+            futile_coord_s coord = {x, y, 16};
+            g_assert(futile_tile_set_add(&set, &coord));
+        }
+    }
+    g_assert(futile_tile_set_optimize(&set));
+    g_assert_cmpuint(500 * 700, ==, futile_tile_set_cardinality(&set));
+    g_assert_cmpuint(futile_tile_set_size_bytes(&set), <, 500 * 700 / 4);
+    futile_tile_set_free(&set);
+}
+
+struct _rollup_reference {
+    size_t n;
+    uint64_t *ids;
+};
+
+void _add_rollup_reference(futile_coord_s *coord, void *userdata) {
+    struct _rollup_reference *data = userdata;
+    data->ids[data->n++] = futile_coord_marshall_int(coord);
+}
+
+static void assert_rollup(futile_coord_s *leaves, size_t n, unsigned int zoom_until, futile_rollup_s *rollup) {
+    struct _rollup_reference reference = {.ids = malloc(sizeof(uint64_t) * n * (FUTILE_MARSHALL_MAX_ZOOM + 1))};
+    for (size_t i = 0; i < n; i++) {
+        if (leaves[i].z >= zoom_until) {
+            // futile_for_coord_parents does not stop at zoom 0
+            futile_coord_s root = {0, 0, 0};
+            if (leaves[i].z > 0) {
+                futile_for_coord_parents(&leaves[i], zoom_until > 0 ? zoom_until : 1, _add_rollup_reference, &reference);
+            }
+            if (zoom_until == 0) {
+                _add_rollup_reference(&root, &reference);
+            }
+        }
+    }
+    size_t n_unique = sort_unique_ids(reference.ids, reference.n);
+    size_t n_total = 0;
+    for (unsigned int z = 0; z <= FUTILE_MARSHALL_MAX_ZOOM; z++) {
+        for (size_t i = 0; i < rollup->n[z]; i++) {
+            futile_coord_s coord;
+            futile_coord_unmarshall_int(rollup->ids[z][i], &coord);
+            g_assert_cmpuint(z, ==, coord.z);
+            g_assert(i == 0 || rollup->ids[z][i - 1] < rollup->ids[z][i]);
+            g_assert(bsearch(&rollup->ids[z][i], reference.ids, n_unique, sizeof(uint64_t), uint64_cmp));
+        }
+        n_total += rollup->n[z];
+    }
+    g_assert_cmpuint(n_unique, ==, n_total);
+    free(reference.ids);
+}
+
+void test_tile_rollup() {
+    const size_t n = 50000;
+    futile_coord_s *leaves = malloc(sizeof(futile_coord_s) * n);
+    uint64_t *ids = malloc(sizeof(uint64_t) * n);
+    srand(9);
+    for (size_t i = 0; i < n; i++) {
+        // mostly clustered zoom 16 tiles, with duplicates and a few
+        // leaves at other zooms
+        uint32_t z = i % 20 == 0 ? 5 + rand() % 15 : 16;
+        uint32_t x = 19000 + rand() % 400, y = 24000 + rand() % 300;
+        leaves[i] = (futile_coord_s){x >> (16 - (z < 16 ? z : 16)) << (z > 16 ? z - 16 : 0),
+                                     y >> (16 - (z < 16 ? z : 16)) << (z > 16 ? z - 16 : 0), z};
+        ids[i] = futile_coord_marshall_int(&leaves[i]);
+    }
+
+    unsigned int thread_counts[] = {1, 3, 8};
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+        futile_rollup_s rollup;
+        g_assert(futile_rollup_ints(ids, n, 0, thread_counts[t], &rollup));
+        assert_rollup(leaves, n, 0, &rollup);
+        g_assert_cmpuint(1, ==, rollup.n[0]);
+        futile_rollup_free(&rollup);
+
+        g_assert(futile_rollup_coords(leaves, n, 10, thread_counts[t], &rollup));
+        assert_rollup(leaves, n, 10, &rollup);
+        g_assert_cmpuint(0, ==, rollup.n[9]);
+        g_assert(rollup.ids[9] == NULL);
+        futile_rollup_free(&rollup);
+    }
+
+    free(ids);
+    free(leaves);
+}
+
+void test_tile_rollup_edges() {
+    futile_rollup_s rollup;
+    g_assert(futile_rollup_ints(NULL, 0, 0, 0, &rollup));
+    for (unsigned int z = 0; z <= FUTILE_MARSHALL_MAX_ZOOM; z++) {
+        g_assert_cmpuint(0, ==, rollup.n[z]);
+    }
+
+    futile_coord_s coord = {3, 5, 3};
+    g_assert(futile_rollup_coords(&coord, 1, 0, 0, &rollup));
+    for (unsigned int z = 0; z <= 3; z++) {
+        g_assert_cmpuint(1, ==, rollup.n[z]);
+        futile_coord_s ancestor;
+        futile_coord_unmarshall_int(rollup.ids[z][0], &ancestor);
+        g_assert_cmpuint(3 >> (3 - z), ==, ancestor.x);
+        g_assert_cmpuint(5 >> (3 - z), ==, ancestor.y);
+    }
+    g_assert_cmpuint(0, ==, rollup.n[4]);
+    futile_rollup_free(&rollup);
+
+    coord.z = FUTILE_MARSHALL_MAX_ZOOM + 1;
+    g_assert(!futile_rollup_coords(&coord, 1, 0, 0, &rollup));
+}
+
+// points clustered around a few cities, as events tend to be
+static void fill_event_points(futile_point_s *lnglats, size_t n) {
+    static const futile_point_s cities[] = {{-73.99, 40.73}, {-0.12, 51.5}, {139.69, 35.69}, {-122.42, 37.77}};
+    srand(42);
+    for (size_t i = 0; i < n; i++) {
+        const futile_point_s *city = &cities[rand() % 4];
+        double spread = i % 10 == 0 ? 60 : 0.5;
+        lnglats[i].x = city->x + spread * (rand() / (double)RAND_MAX - 0.5);
+        lnglats[i].y = city->y + spread * (rand() / (double)RAND_MAX - 0.5);
+    }
+}
+
+// checks the buckets against projecting every point at the zoom
+void assert_bucket(futile_point_s *lnglats, size_t n, futile_bucket_zoom_s *bucket, size_t *order, bool is_input_order) {
+    futile_coord_s *coords = calloc(n, sizeof(futile_coord_s));
+    uint64_t *ids = calloc(n, sizeof(uint64_t));
+    futile_lnglat_to_coord_batch(lnglats, n, bucket->zoom, coords);
+    for (size_t i = 0; i < n; i++) {
+        ids[i] = futile_coord_to_zorder(&coords[i]);
+    }
+    uint64_t *sorted = calloc(n, sizeof(uint64_t));
+    memcpy(sorted, ids, n * sizeof(uint64_t));
+    qsort(sorted, n, sizeof(uint64_t), uint64_cmp);
+    size_t t = 0;
+    for (size_t i = 0; i < n; t++) {
+        g_assert_cmpuint(t, <, bucket->n);
+        g_assert_cmpuint(sorted[i], ==, bucket->ids[t]);
+        size_t j = i;
+        while (j < n && sorted[j] == sorted[i]) {
+            j++;
+        }
+        g_assert_cmpuint(j - i, ==, bucket->counts[t]);
+        if (order) {
+            g_assert_cmpuint(i, ==, bucket->offsets[t]);
+            for (size_t k = i; k < j; k++) {
+                g_assert_cmpuint(bucket->ids[t], ==, ids[order[k]]);
+                g_assert(!is_input_order || k == i || order[k - 1] < order[k]);
+            }
+        }
+        i = j;
+    }
+    g_assert_cmpuint(t, ==, bucket->n);
+    if (order) {
+        g_assert_cmpuint(n, ==, bucket->offsets[bucket->n]);
+    }
+    free(sorted);
+    free(ids);
+    free(coords);
+}
+
+void test_tile_bucket_points() {
+    const size_t n = 200000;
+    futile_point_s *lnglats = calloc(n, sizeof(futile_point_s));
+    fill_event_points(lnglats, n);
+
+    futile_bucket_zoom_s bucket;
+    g_assert(futile_bucket_points(lnglats, n, 12, 2, NULL, &bucket));
+    g_assert(bucket.offsets == NULL);
+    assert_bucket(lnglats, n, &bucket, NULL, false);
+    futile_bucket_free(&bucket);
+
+    size_t *order = calloc(n, sizeof(size_t));
+    g_assert(futile_bucket_points(lnglats, n, 12, 2, order, &bucket));
+    assert_bucket(lnglats, n, &bucket, order, true);
+
+    // coarser zooms from sums, chained, match projecting again
+    futile_bucket_zoom_s coarse = bucket, coarser;
+    for (int zoom = 9; zoom >= 0; zoom -= 3) {
+        g_assert(futile_bucket_coarsen(&coarse, zoom, &coarser));
+        assert_bucket(lnglats, n, &coarser, order, false);
+        if (coarse.ids != bucket.ids) {
+            futile_bucket_free(&coarse);
+        }
+        coarse = coarser;
+    }
+    g_assert_cmpuint(1, ==, coarse.n);
+    g_assert_cmpuint(n, ==, coarse.counts[0]);
+    futile_bucket_free(&coarse);
+    g_assert(!futile_bucket_coarsen(&bucket, 13, &coarser));
+    futile_bucket_free(&bucket);
+
+    // too deep to pack the point index with the tile
+    g_assert(futile_bucket_points(lnglats, n, 28, 2, order, &bucket));
+    assert_bucket(lnglats, n, &bucket, order, true);
+    futile_bucket_free(&bucket);
+
+    g_assert(futile_bucket_points(lnglats, 0, 12, 2, order, &bucket));
+    g_assert_cmpuint(0, ==, bucket.n);
+    g_assert_cmpuint(0, ==, bucket.offsets[0]);
+    futile_bucket_free(&bucket);
+    g_assert(!futile_bucket_points(lnglats, n, FUTILE_ZORDER_MAX_ZOOM + 1, 2, NULL, &bucket));
+
+    free(order);
+    free(lnglats);
+}
+
+static uint64_t cache_key(int i) {
+    futile_coord_s coord = {.x=i % 1000, .y=i / 1000, .z=14};
+    return futile_coord_marshall_int(&coord);
+}
+
+// fills data with a pattern derived from key and size, so readers can
+// check that they got the bytes put under that key
+static void fill_cache_value(uint64_t key, unsigned char *data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        data[i] = (unsigned char)(key * 31 + size + i);
+    }
+}
+
+static bool is_cache_value(futile_tile_cache_value_s *value, uint64_t key) {
+    const unsigned char *data = value->data;
+    for (size_t i = 0; i < value->size; i++) {
+        if (data[i] != (unsigned char)(key * 31 + value->size + i)) {
+            return false;
+        }
+    }
+    return value->key == key;
+}
+
+void test_tile_cache_basic() {
+    futile_tile_cache_s cache;
+    g_assert(!futile_tile_cache_init(&cache, 0, 4));
+    g_assert_cmpint(EINVAL, ==, errno);
+    g_assert(futile_tile_cache_init(&cache, 1 << 20, 3));
+    g_assert_cmpuint(4, ==, cache.n_shards);
+
+    unsigned char data[1000];
+    for (int i = 0; i < 100; i++) {
+        fill_cache_value(cache_key(i), data, i * 10);
+        g_assert(futile_tile_cache_put(&cache, cache_key(i), data, i * 10));
+    }
+    for (int i = 0; i < 100; i++) {
+        futile_tile_cache_value_s *value = futile_tile_cache_get(&cache, cache_key(i));
+        g_assert(value);
+        g_assert_cmpuint(i * 10, ==, value->size);
+        g_assert(is_cache_value(value, cache_key(i)));
+        futile_tile_cache_release(value);
+    }
+    g_assert(!futile_tile_cache_get(&cache, cache_key(100)));
+
+    // a value held by a reader outlives its replacement and removal
+    futile_tile_cache_value_s *held = futile_tile_cache_get(&cache, cache_key(7));
+    fill_cache_value(cache_key(7), data, 500);
+    g_assert(futile_tile_cache_put(&cache, cache_key(7), data, 500));
+    futile_tile_cache_value_s *value = futile_tile_cache_get(&cache, cache_key(7));
+    g_assert_cmpuint(500, ==, value->size);
+    g_assert(is_cache_value(value, cache_key(7)));
+    futile_tile_cache_release(value);
+    g_assert(futile_tile_cache_remove(&cache, cache_key(7)));
+    g_assert(!futile_tile_cache_remove(&cache, cache_key(7)));
+    g_assert(!futile_tile_cache_get(&cache, cache_key(7)));
+    for (int i = 0; i < 100; i++) {
+        // writes to the shard let it reclaim
+        futile_tile_cache_put(&cache, cache_key(1000 + i), data, 0);
+    }
+    g_assert_cmpuint(70, ==, held->size);
+    g_assert(is_cache_value(held, cache_key(7)));
+    futile_tile_cache_release(held);
+
+    futile_tile_cache_stats_s stats;
+    futile_tile_cache_stats(&cache, &stats);
+    g_assert_cmpuint(199, ==, stats.n_values);
+    g_assert_cmpuint(0, ==, stats.n_evictions);
+
+    g_assert(!futile_tile_cache_put(&cache, 1, data, cache.shard_max_bytes));
+    g_assert_cmpint(EINVAL, ==, errno);
+    futile_tile_cache_free(&cache);
+}
+
+void test_tile_cache_evict() {
+    const size_t size = 1000;
+    const int n_fit = 10;
+    unsigned char data[1000];
+    futile_tile_cache_s cache;
+    g_assert(futile_tile_cache_init(&cache, n_fit * (sizeof(futile_tile_cache_value_s) + size), 1));
+    for (int i = 0; i < 200; i++) {
+        // the first 5 keys are read before every put, so CLOCK always
+        // finds an unreferenced value to evict first
+        for (int j = 0; j < 5 && j < i; j++) {
+            futile_tile_cache_release(futile_tile_cache_get(&cache, cache_key(j)));
+        }
+        fill_cache_value(cache_key(i), data, size);
+        g_assert(futile_tile_cache_put(&cache, cache_key(i), data, size));
+        futile_tile_cache_stats_s stats;
+        futile_tile_cache_stats(&cache, &stats);
+        g_assert_cmpuint(stats.n_bytes, <=, cache.shard_max_bytes);
+        g_assert_cmpuint(stats.n_values, ==, i < n_fit ? i + 1 : n_fit);
+        g_assert_cmpuint(stats.n_evictions, ==, i < n_fit ? 0 : i + 1 - n_fit);
+    }
+    for (int j = 0; j < 5; j++) {
+        futile_tile_cache_value_s *value = futile_tile_cache_get(&cache, cache_key(j));
+        g_assert(value);
+        g_assert(is_cache_value(value, cache_key(j)));
+        futile_tile_cache_release(value);
+    }
+    futile_tile_cache_value_s *value = futile_tile_cache_get(&cache, cache_key(199));
+    g_assert(value);
+    futile_tile_cache_release(value);
+    futile_tile_cache_free(&cache);
+}
+
+typedef struct {
+    futile_tile_cache_s *cache;
+    unsigned int seed;
+    bool failed;
+} cache_worker_s;
+
+static void *cache_worker(void *userdata) {
+    cache_worker_s *worker = userdata;
+    unsigned char data[4096];
+    for (int i = 0; i < 50000; i++) {
+        int op = rand_r(&worker->seed) % 16;
+        uint64_t key = cache_key(rand_r(&worker->seed) % 512);
+        if (op == 0) {
+            futile_tile_cache_remove(worker->cache, key);
+        } else if (op < 4) {
+            size_t size = rand_r(&worker->seed) % sizeof(data);
+            fill_cache_value(key, data, size);
+            futile_tile_cache_put(worker->cache, key, data, size);
+        } else {
+            futile_tile_cache_value_s *value = futile_tile_cache_get(worker->cache, key);
+            if (value) {
+                worker->failed |= !is_cache_value(value, key);
+                futile_tile_cache_release(value);
+            }
+        }
+    }
+    return NULL;
+}
+
+void test_tile_cache_threads() {
+    futile_tile_cache_s cache;
+    // small enough that most puts evict
+    g_assert(futile_tile_cache_init(&cache, 256 << 10, 4));
+    pthread_t threads[4];
+    cache_worker_s workers[4];
+    for (int i = 0; i < 4; i++) {
+        workers[i] = (cache_worker_s){.cache=&cache, .seed=i + 1};
+        pthread_create(&threads[i], NULL, cache_worker, &workers[i]);
+    }
+    for (int i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+        g_assert(!workers[i].failed);
+    }
+    futile_tile_cache_stats_s stats;
+    futile_tile_cache_stats(&cache, &stats);
+    g_assert_cmpuint(stats.n_bytes, <=, 256 << 10);
+    g_assert_cmpuint(stats.n_evictions, >, 0);
+    futile_tile_cache_free(&cache);
+}
+
+void test_tile_dedup_set_basic() {
+    futile_dedup_set_s set;
+    g_assert(futile_dedup_set_init(&set, 100));
+    size_t n_slots = futile_dedup_set_slots(&set);
+    g_assert_cmpuint(n_slots, >=, 200);
+    uint64_t *out = malloc(sizeof(uint64_t) * n_slots);
+
+    uint64_t ids[300];
+    for (int i = 0; i < 300; i++) {
+        // 0 is the id of 0/0/0
+        ids[i] = i % 100 ? cache_key(i % 100) : 0;
+    }
+    g_assert(futile_dedup_set_add(&set, 0));
+    g_assert_cmpuint(300, ==, futile_dedup_set_add_many(&set, ids, 300));
+    size_t n = futile_dedup_set_drain(&set, out);
+    g_assert_cmpuint(100, ==, n);
+    qsort(out, n, sizeof(uint64_t), uint64_cmp);
+    qsort(ids, 100, sizeof(uint64_t), uint64_cmp);
+    g_assert(memcmp(ids, out, sizeof(uint64_t) * 100) == 0);
+
+    g_assert_cmpuint(0, ==, futile_dedup_set_drain(&set, out));
+    g_assert(futile_dedup_set_add(&set, 42));
+    g_assert(futile_dedup_set_add(&set, 42));
+    g_assert_cmpuint(1, ==, futile_dedup_set_drain(&set, out));
+    g_assert_cmpuint(42, ==, out[0]);
+
+    // UINT64_MAX is the empty slot, so it can never go in
+    uint64_t bad[2] = {42, UINT64_MAX};
+    g_assert(!futile_dedup_set_add(&set, UINT64_MAX));
+    g_assert_cmpint(EINVAL, ==, errno);
+    g_assert_cmpuint(1, ==, futile_dedup_set_add_many(&set, bad, 2));
+    g_assert_cmpint(EINVAL, ==, errno);
+    g_assert_cmpuint(1, ==, futile_dedup_set_drain(&set, out));
+    g_assert_cmpuint(42, ==, out[0]);
+
+    // every slot taken, then the epoch is full
+    for (size_t i = 0; i < n_slots; i++) {
+        g_assert(futile_dedup_set_add(&set, i + 1000));
+    }
+    g_assert(!futile_dedup_set_add(&set, 7));
+    g_assert_cmpint(ENOSPC, ==, errno);
+    g_assert(futile_dedup_set_add(&set, 1000));
+    g_assert_cmpuint(n_slots, ==, futile_dedup_set_drain(&set, out));
+    g_assert(futile_dedup_set_add(&set, 7));
+
+    free(out);
+    futile_dedup_set_free(&set);
+}
+
+typedef struct {
+    futile_dedup_set_s *set;
+    int first;
+    bool use_batches;
+} dedup_producer_s;
+
+static void *dedup_producer(void *userdata) {
+    dedup_producer_s *producer = userdata;
+    uint64_t batch[64];
+    for (int round = 0; round < 20; round++) {
+        for (int i = 0; i < 4096; i += 64) {
+            for (int j = 0; j < 64; j++) {
+                batch[j] = cache_key(producer->first + i + j);
+            }
+            if (producer->use_batches) {
+                futile_dedup_set_add_many(producer->set, batch, 64);
+            } else {
+                for (int j = 0; j < 64; j++) {
+                    futile_dedup_set_add(producer->set, batch[j]);
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+typedef struct {
+    futile_dedup_set_s *set;
+    bool *is_done;
+    bool *seen;
+    bool failed;
+} dedup_consumer_s;
+
+// drains until the producers are done, checking that no drain repeats
+// an id
+static void dedup_drain_into(dedup_consumer_s *consumer, uint64_t *out) {
+    size_t n = futile_dedup_set_drain(consumer->set, out);
+    qsort(out, n, sizeof(uint64_t), uint64_cmp);
+    for (size_t i = 0; i < n; i++) {
+        futile_coord_s coord;
+        futile_coord_unmarshall_int(out[i], &coord);
+        consumer->failed |= i > 0 && out[i - 1] == out[i];
+        consumer->seen[coord.y * 1000 + coord.x] = true;
+    }
+}
+
+static void *dedup_consumer(void *userdata) {
+    dedup_consumer_s *consumer = userdata;
+    uint64_t *out = malloc(sizeof(uint64_t) * futile_dedup_set_slots(consumer->set));
+    while (!__atomic_load_n(consumer->is_done, __ATOMIC_ACQUIRE)) {
+        dedup_drain_into(consumer, out);
+    }
+    dedup_drain_into(consumer, out);
+    free(out);
+    return NULL;
+}
+
+void test_tile_dedup_set_threads() {
+    futile_dedup_set_s set;
+    g_assert(futile_dedup_set_init(&set, 16384));
+    bool is_done = false;
+    bool *seen = calloc(3 * 4096, sizeof(bool));
+    dedup_consumer_s consumer = {.set=&set, .is_done=&is_done, .seen=seen};
+    pthread_t consumer_thread, producer_threads[4];
+    dedup_producer_s producers[4];
+    pthread_create(&consumer_thread, NULL, dedup_consumer, &consumer);
+    for (int i = 0; i < 4; i++) {
+        // neighbouring producers overlap by half
+        producers[i] = (dedup_producer_s){.set=&set, .first=i * 2048, .use_batches=i % 2};
+        pthread_create(&producer_threads[i], NULL, dedup_producer, &producers[i]);
+    }
+    for (int i = 0; i < 4; i++) {
+        pthread_join(producer_threads[i], NULL);
+    }
+    __atomic_store_n(&is_done, true, __ATOMIC_RELEASE);
+    pthread_join(consumer_thread, NULL);
+    g_assert(!consumer.failed);
+    for (int i = 0; i < 5 * 2048; i++) {
+        g_assert(seen[i]);
+    }
+    g_assert(!seen[5 * 2048]);
+    free(seen);
+    futile_dedup_set_free(&set);
+}
+
+void test_tile_expiry_basic() {
+    futile_expiry_pipeline_s pipeline;
+    futile_expiry_options_s options = {.window_ns=1000, .max_pending=100, .max_batches=1, .zoom_until=10};
+    g_assert(futile_expiry_pipeline_init(&pipeline, &options));
+    futile_expiry_batch_s *batch;
+
+    // nothing changed, nothing due
+    g_assert(futile_expiry_poll(&pipeline, 5000, &batch));
+    g_assert(batch == NULL);
+
+    uint64_t ids[300];
+    for (int i = 0; i < 300; i++) {
+        ids[i] = cache_key(i % 100);
+    }
+    g_assert_cmpuint(150, ==, futile_expiry_ingest(&pipeline, ids, 150, 10000));
+    g_assert_cmpuint(150, ==, futile_expiry_ingest(&pipeline, ids + 150, 150, 10500));
+    g_assert(futile_expiry_poll(&pipeline, 10999, &batch));
+    g_assert(batch == NULL);
+    // a clock behind the window start has not seen it elapse
+    g_assert(futile_expiry_poll(&pipeline, 9000, &batch));
+    g_assert(batch == NULL);
+    g_assert(futile_expiry_poll(&pipeline, 11000, &batch));
+    g_assert(batch != NULL);
+    g_assert_cmpuint(100, ==, batch->n_leaves);
+    g_assert_cmpuint(10000, ==, batch->window_start_ns);
+    g_assert_cmpuint(11000, ==, batch->emitted_ns);
+
+    futile_rollup_s expected;
+    g_assert(futile_rollup_ints(ids, 100, 10, 1, &expected));
+    for (int z = 0; z <= FUTILE_MARSHALL_MAX_ZOOM; z++) {
+        g_assert_cmpuint(expected.n[z], ==, batch->tiles.n[z]);
+        g_assert(expected.n[z] == 0 || memcmp(expected.ids[z], batch->tiles.ids[z], sizeof(uint64_t) * expected.n[z]) == 0);
+    }
+    futile_rollup_free(&expected);
+    futile_expiry_batch_s *first = batch;
+
+    // the batch is still out, so the next window waits
+    g_assert_cmpuint(1, ==, futile_expiry_ingest(&pipeline, ids, 1, 20000));
+    g_assert(futile_expiry_poll(&pipeline, 30000, &batch) && batch == NULL);
+    g_assert(futile_expiry_flush(&pipeline, 30000, &batch) && batch == NULL);
+    futile_expiry_batch_release(&pipeline, first);
+    g_assert(futile_expiry_poll(&pipeline, 30000, &batch));
+    g_assert(batch != NULL);
+    g_assert_cmpuint(1, ==, batch->n_leaves);
+    g_assert_cmpuint(20000, ==, batch->window_start_ns);
+    g_assert_cmpuint(1, ==, batch->tiles.n[14]);
+    g_assert_cmpuint(1, ==, batch->tiles.n[10]);
+    g_assert_cmpuint(0, ==, batch->tiles.n[9]);
+    futile_expiry_batch_release(&pipeline, batch);
+
+    // flush skips the wait
+    g_assert_cmpuint(1, ==, futile_expiry_ingest(&pipeline, ids + 1, 1, 40000));
+    g_assert(futile_expiry_flush(&pipeline, 40001, &batch));
+    g_assert(batch != NULL);
+    g_assert_cmpuint(1, ==, batch->n_leaves);
+    futile_expiry_batch_release(&pipeline, batch);
+
+    // a full window pushes back at max_pending unique leaves
+    size_t max_pending = options.max_pending;
+    uint64_t *many = malloc(sizeof(uint64_t) * (max_pending + 1));
+    for (size_t i = 0; i <= max_pending; i++) {
+        many[i] = cache_key(i);
+    }
+    g_assert_cmpuint(max_pending, ==, futile_expiry_ingest(&pipeline, many, max_pending + 1, 50000));
+    g_assert_cmpint(EAGAIN, ==, errno);
+    g_assert_cmpuint(1, ==, futile_expiry_ingest(&pipeline, many, 1, 50000));
+    g_assert(futile_expiry_poll(&pipeline, 51000, &batch));
+    g_assert_cmpuint(max_pending, ==, batch->n_leaves);
+    futile_expiry_batch_release(&pipeline, batch);
+    g_assert_cmpuint(1, ==, futile_expiry_ingest(&pipeline, many + max_pending, 1, 52000));
+    free(many);
+
+    // ids above the max zoom are refused
+    uint64_t bad[2] = {cache_key(0), 31};
+    g_assert_cmpuint(1, ==, futile_expiry_ingest(&pipeline, bad, 2, 53000));
+    g_assert_cmpint(EINVAL, ==, errno);
+    g_assert(futile_expiry_flush(&pipeline, 53000, &batch));
+    g_assert_cmpuint(2, ==, batch->n_leaves);
+    futile_expiry_batch_release(&pipeline, batch);
+
+    futile_expiry_pipeline_free(&pipeline);
+
+    options.zoom_until = FUTILE_MARSHALL_MAX_ZOOM + 1;
+    g_assert(!futile_expiry_pipeline_init(&pipeline, &options));
+    g_assert_cmpint(EINVAL, ==, errno);
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+typedef struct {
+    futile_expiry_pipeline_s *pipeline;
+    int first;
+} expiry_producer_s;
+
+static void *expiry_producer(void *userdata) {
+    expiry_producer_s *producer = userdata;
+    uint64_t batch[64];
+    for (int round = 0; round < 10; round++) {
+        for (int i = 0; i < 4096; i += 64) {
+            for (int j = 0; j < 64; j++) {
+                batch[j] = cache_key(producer->first + i + j);
+            }
+            // retry what was pushed back once the consumer catches up
+            size_t n_done = 0;
+            while (n_done < 64) {
+                n_done += futile_expiry_ingest(producer->pipeline, batch + n_done, 64 - n_done, now_ns());
+                if (n_done < 64) {
+                    sched_yield();
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+typedef struct {
+    futile_expiry_pipeline_s *pipeline;
+    bool *is_done;
+    bool *seen;
+    size_t n_batches;
+    bool failed;
+} expiry_consumer_s;
+
+static void expiry_take(expiry_consumer_s *consumer, futile_expiry_batch_s *batch) {
+    futile_rollup_s *tiles = &batch->tiles;
+    consumer->failed |= tiles->n[14] != batch->n_leaves || tiles->n[8] == 0;
+    for (size_t i = 0; i < tiles->n[14]; i++) {
+        futile_coord_s coord;
+        futile_coord_unmarshall_int(tiles->ids[14][i], &coord);
+        consumer->seen[coord.y * 1000 + coord.x] = true;
+    }
+    consumer->n_batches++;
+    futile_expiry_batch_release(consumer->pipeline, batch);
+}
+
+static void *expiry_consumer(void *userdata) {
+    expiry_consumer_s *consumer = userdata;
+    futile_expiry_batch_s *batch;
+    while (!__atomic_load_n(consumer->is_done, __ATOMIC_ACQUIRE)) {
+        consumer->failed |= !futile_expiry_poll(consumer->pipeline, now_ns(), &batch);
+        if (batch) {
+            expiry_take(consumer, batch);
+        } else {
+            sched_yield();
+        }
+    }
+    consumer->failed |= !futile_expiry_flush(consumer->pipeline, now_ns(), &batch);
+    if (batch) {
+        expiry_take(consumer, batch);
+    }
+    return NULL;
+}
+
+void test_tile_expiry_threads() {
+    futile_expiry_pipeline_s pipeline;
+    futile_expiry_options_s options = {.window_ns=100000, .max_pending=1024, .max_batches=2, .zoom_until=8, .n_threads=2};
+    g_assert(futile_expiry_pipeline_init(&pipeline, &options));
+    bool is_done = false;
+    bool *seen = calloc(3 * 4096, sizeof(bool));
+    expiry_consumer_s consumer = {.pipeline=&pipeline, .is_done=&is_done, .seen=seen};
+    pthread_t consumer_thread, producer_threads[4];
+    expiry_producer_s producers[4];
+    pthread_create(&consumer_thread, NULL, expiry_consumer, &consumer);
+    for (int i = 0; i < 4; i++) {
+        producers[i] = (expiry_producer_s){.pipeline=&pipeline, .first=i * 2048};
+        pthread_create(&producer_threads[i], NULL, expiry_producer, &producers[i]);
+    }
+    for (int i = 0; i < 4; i++) {
+        pthread_join(producer_threads[i], NULL);
+    }
+    __atomic_store_n(&is_done, true, __ATOMIC_RELEASE);
+    pthread_join(consumer_thread, NULL);
+    g_assert(!consumer.failed);
+    g_assert_cmpuint(consumer.n_batches, >, 1);
+    for (int i = 0; i < 5 * 2048; i++) {
+        g_assert(seen[i]);
+    }
+    g_assert(!seen[5 * 2048]);
+    free(seen);
+    futile_expiry_pipeline_free(&pipeline);
+}
+
+static int coord_qsort_cmp(const void *lhs, const void *rhs) {
+    return futile_coord_cmp((futile_coord_s *)lhs, (futile_coord_s *)rhs);
+}
+
+void test_coord_sort_ids() {
+    // a parallel sized array, with marshalled ids in the first half and
+    // arbitrary 64 bit values in the second
+    const size_t n = (1 << 20) + 12345;
+    uint64_t *ids = malloc(sizeof(uint64_t) * n);
+    uint64_t *expected = malloc(sizeof(uint64_t) * n);
+    unsigned int thread_counts[] = {1, 4};
+    size_t sizes[] = {0, 1, 1000, n};
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            srand(10 + s);
+            for (size_t i = 0; i < sizes[s]; i++) {
+                futile_coord_s coord = {rand() % 5000, rand() % 5000, 14 + rand() % 2};
+                uint64_t random = (uint64_t)rand() << 42 ^ (uint64_t)rand() << 21 ^ rand();
+                ids[i] = expected[i] = i < sizes[s] / 2 ? futile_coord_marshall_int(&coord) : random;
+            }
+            qsort(expected, sizes[s], sizeof(uint64_t), uint64_cmp);
+            g_assert(futile_sort_ids(ids, sizes[s], thread_counts[t]));
+            g_assert(memcmp(ids, expected, sizeof(uint64_t) * sizes[s]) == 0);
+        }
+    }
+
+    uint64_t dups[] = {1, 1, 2, 3, 3, 3, 7};
+    g_assert_cmpuint(4, ==, futile_unique_ids(dups, 7));
+    g_assert(dups[0] == 1 && dups[1] == 2 && dups[2] == 3 && dups[3] == 7);
+    g_assert_cmpuint(0, ==, futile_unique_ids(dups, 0));
+
+    free(expected);
+    free(ids);
+}
+
+void test_coord_sort_coords() {
+    const size_t n = (1 << 20) + 777;
+    futile_coord_s *coords = malloc(sizeof(futile_coord_s) * n);
+    futile_coord_s *expected = malloc(sizeof(futile_coord_s) * n);
+    unsigned int thread_counts[] = {1, 4};
+    size_t sizes[] = {1000, n};
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            srand(20 + s);
+            for (size_t i = 0; i < sizes[s]; i++) {
+                // full range columns and rows, so every digit matters
+                coords[i] = expected[i] = (futile_coord_s){
+                    (uint32_t)rand() << 1 ^ rand(), i % 3 == 0 ? rand() % 100 : (uint32_t)rand() << 1 ^ rand(), rand() % 33
+                };
+            }
+            qsort(expected, sizes[s], sizeof(futile_coord_s), coord_qsort_cmp);
+            g_assert(futile_sort_coords(coords, sizes[s], thread_counts[t]));
+            for (size_t i = 0; i < sizes[s]; i++) {
+                g_assert(futile_coord_equal(&coords[i], &expected[i]));
+            }
+        }
+    }
+
+    futile_coord_s dups[] = {{1, 2, 3}, {1, 2, 3}, {2, 1, 3}, {0, 0, 4}, {0, 0, 4}};
+    g_assert_cmpuint(3, ==, futile_unique_coords(dups, 5));
+    g_assert(dups[1].x == 2 && dups[2].z == 4);
+
+    free(expected);
+    free(coords);
+}
+
+void noop(futile_coord_s *coord, void *ignored) {
+}
+
+unsigned int now() {
+    return time(NULL);
+}
+
+void test_timing_for_zoom_range_array() {
+    unsigned int start, took, zoom_start, zoom_until;
+    zoom_start = 0;
+    zoom_until = 16;
+
+    start = now();
+    futile_for_zoom_range(zoom_start, zoom_until, noop, NULL);
+    took = now() - start;
+    printf("\nfor zoom range: %u\n", took);
+
+    futile_coord_cursor_s cursor = {};
+    // cursor.zoom_start = zoom_start;
+    cursor.zoom_until = zoom_until;
+    size_t n = 100;
+    futile_coord_s *coords = malloc(sizeof(futile_coord_s) * n);
+    futile_coord_group_s group = {.coords=coords, .n=n};
+
+    start = now();
+    while (1) {
+        if (futile_for_zoom_range_array(&cursor, &group)) {
+            break;
+        }
+    }
+    free(coords);
+    took = now() - start;
+    printf("array: %u\n", took);
+}
+
+void test_timing_lnglat_to_coord_batch() {
+    const size_t n = 4000000;
+    const int zoom = 16;
+    futile_point_s *lnglats = malloc(sizeof(futile_point_s) * n);
+    futile_coord_s *coords = malloc(sizeof(futile_coord_s) * n);
+    srand(42);
+    for (size_t i = 0; i < n; i++) {
+        lnglats[i].x = random_range(-180, 180);
+        lnglats[i].y = random_range(-85.0511, 85.0511);
+    }
+
+    GTimer *timer = g_timer_new();
+    for (size_t i = 0; i < n; i++) {
+        futile_lnglat_to_coord(&lnglats[i], zoom, &coords[i]);
+    }
+    printf("\nlnglat->coord per point: %.1fM points/sec\n", n / g_timer_elapsed(timer, NULL) / 1e6);
+
+    for (int level = 0; level <= futile_simd_detect(); level++) {
+        futile_simd_set_level(level);
+        g_timer_start(timer);
+        futile_lnglat_to_coord_batch(lnglats, n, zoom, coords);
+        printf("lnglat->coord batch, simd level %d: %.1fM points/sec\n", level, n / g_timer_elapsed(timer, NULL) / 1e6);
+    }
+    futile_simd_set_level(futile_simd_detect());
+
+    g_timer_destroy(timer);
+    free(coords);
+    free(lnglats);
+}
+
+void test_timing_tile_batch() {
+    const size_t n = 4000000;
+    const uint32_t extent = 4096;
+    futile_coord_s coord = {.x=9647, .y=12320, .z=15};
+    futile_bounds_s bounds;
+    futile_coord_to_bounds(&coord, &bounds);
+    futile_point_s *lnglats = malloc(sizeof(futile_point_s) * n);
+    futile_point_s *mercs = malloc(sizeof(futile_point_s) * n);
+    futile_tile_point_s *out = malloc(sizeof(futile_tile_point_s) * n);
+    srand(42);
+    for (size_t i = 0; i < n; i++) {
+        lnglats[i].x = random_range(bounds.minx, bounds.maxx);
+        lnglats[i].y = random_range(bounds.miny, bounds.maxy);
+        futile_lnglat_to_mercator(&lnglats[i], &mercs[i]);
+    }
+
+    GTimer *timer = g_timer_new();
+    for (int level = 0; level <= futile_simd_detect(); level++) {
+        futile_simd_set_level(level);
+        g_timer_start(timer);
+        futile_mercator_to_tile_batch(&coord, extent, 64, mercs, n, false, out);
+        double merc_rate = n / g_timer_elapsed(timer, NULL) / 1e6;
+        g_timer_start(timer);
+        size_t n_out = futile_lnglat_to_tile_batch(&coord, extent, 64, lnglats, n, true, out);
+        double lnglat_rate = n / g_timer_elapsed(timer, NULL) / 1e6;
+        printf("%stile batch, simd level %d: mercator %.1fM points/sec, lnglat with dedup %.1fM points/sec (%zu kept)\n",
+               level == 0 ? "\n" : "", level, merc_rate, lnglat_rate, n_out);
+    }
+    futile_simd_set_level(futile_simd_detect());
+
+    g_timer_destroy(timer);
+    free(out);
+    free(mercs);
+    free(lnglats);
+}
+
+void test_timing_mercator_batch() {
+    const size_t n = 4000000;
+    const char *names[] = {"exact", "1e-9", "1e-6"};
+    futile_point_s *lnglats = malloc(sizeof(futile_point_s) * n);
+    futile_point_s *mercs = malloc(sizeof(futile_point_s) * n);
+    srand(42);
+    for (size_t i = 0; i < n; i++) {
+        lnglats[i].x = random_range(-180, 180);
+        lnglats[i].y = random_range(-85.0511, 85.0511);
+    }
+
+    GTimer *timer = g_timer_new();
+    printf("\n");
+    for (int accuracy = FUTILE_ACCURACY_EXACT; accuracy <= FUTILE_ACCURACY_1E6; accuracy++) {
+        g_timer_start(timer);
+        futile_lnglat_to_mercator_batch(lnglats, n, accuracy, mercs);
+        double forward_rate = n / g_timer_elapsed(timer, NULL) / 1e6;
+        g_timer_start(timer);
+        futile_mercator_to_lnglat_batch(mercs, n, accuracy, lnglats);
+        double inverse_rate = n / g_timer_elapsed(timer, NULL) / 1e6;
+        printf("mercator batch, %s: forward %.1fM points/sec, inverse %.1fM points/sec\n", names[accuracy], forward_rate, inverse_rate);
+    }
+
+    g_timer_destroy(timer);
+    free(mercs);
+    free(lnglats);
+}
+
+void test_timing_coord_to_bounds_batch() {
+    const size_t n = 4000000;
+    const unsigned int zoom = 16;
+    futile_coord_s *coords = malloc(sizeof(futile_coord_s) * n);
+    futile_bounds_s *bounds = malloc(sizeof(futile_bounds_s) * n);
+    srand(42);
+    for (size_t i = 0; i < n; i++) {
+        coords[i] = (futile_coord_s){.x=rand() % 65536, .y=rand() % 65536, .z=zoom};
+    }
+
+    GTimer *timer = g_timer_new();
+    for (size_t i = 0; i < n; i++) {
+        futile_coord_to_bounds(&coords[i], &bounds[i]);
+    }
+    printf("\ncoord->bounds per coord: %.1fM coords/sec\n", n / g_timer_elapsed(timer, NULL) / 1e6);
+
+    for (int level = 0; level <= futile_simd_detect(); level++) {
+        futile_simd_set_level(level);
+        g_timer_start(timer);
+        futile_coord_to_bounds_batch(coords, n, NULL, bounds);
+        printf("coord->bounds batch, simd level %d: %.1fM coords/sec\n", level, n / g_timer_elapsed(timer, NULL) / 1e6);
+    }
+    futile_simd_set_level(futile_simd_detect());
+
+    double *table_lats = malloc(sizeof(double) * futile_lat_table_size(zoom));
+    futile_lat_table_s table;
+    g_timer_start(timer);
+    futile_lat_table_init(&table, zoom, table_lats);
+    printf("lat table init, zoom %u: %.3f sec\n", zoom, g_timer_elapsed(timer, NULL));
+    g_timer_start(timer);
+    futile_coord_to_bounds_batch(coords, n, &table, bounds);
+    printf("coord->bounds batch with table: %.1fM coords/sec\n", n / g_timer_elapsed(timer, NULL) / 1e6);
+
+    g_timer_start(timer);
+    size_t n_range = futile_coord_range_to_bounds(zoom, 0, 0, 1999, 1999, NULL, bounds);
+    printf("coord range->bounds: %.1fM coords/sec\n", n_range / g_timer_elapsed(timer, NULL) / 1e6);
+
+    g_timer_destroy(timer);
+    free(table_lats);
+    free(bounds);
+    free(coords);
+}
+
+void test_timing_coord_parse_format() {
+    const size_t n = 4000000;
+    futile_coord_s *coords = malloc(sizeof(futile_coord_s) * n);
+    char *buf = malloc((FUTILE_COORD_STR_MAX + 1) * n);
+    srand(42);
+    for (size_t i = 0; i < n; i++) {
+        coords[i] = (futile_coord_s){.x=rand() % 65536, .y=rand() % 65536, .z=16};
+    }
+
+    GTimer *timer = g_timer_new();
+    char *p = buf;
+    for (size_t i = 0; i < n; i++) {
+        p += sprintf(p, "%d/%d/%d\n", coords[i].z, coords[i].x, coords[i].y);
+    }
+    printf("\nsprintf: %.1fM lines/sec\n", n / g_timer_elapsed(timer, NULL) / 1e6);
+
+    g_timer_start(timer);
+    size_t n_buf = futile_coord_format_lines(coords, n, buf, (FUTILE_COORD_STR_MAX + 1) * n, NULL);
+    printf("futile_coord_format_lines: %.1fM lines/sec\n", n / g_timer_elapsed(timer, NULL) / 1e6);
+
+    g_timer_start(timer);
+    p = buf;
+    for (size_t i = 0; i < n; i++) {
+        // sscanf does a strlen of its input, so go line by line as
+        // reading with fgets would
+        char line[FUTILE_COORD_STR_MAX + 2];
+        char *newline = memchr(p, '\n', buf + n_buf - p);
+        memcpy(line, p, newline - p);
+        line[newline - p] = '\0';
+        int x, y, z;
+        sscanf(line, "%10d/%10d/%10d", &z, &x, &y);
+        p = newline + 1;
+    }
+    printf("sscanf: %.1fM lines/sec\n", n / g_timer_elapsed(timer, NULL) / 1e6);
+
+    g_timer_start(timer);
+    futile_coord_group_s group = {.coords=coords, .n=n};
+    futile_coord_parse_lines(buf, n_buf, &group, NULL, NULL);
+    printf("futile_coord_parse_lines: %.1fM lines/sec\n", n / g_timer_elapsed(timer, NULL) / 1e6);
+    g_assert_cmpint(n, ==, group.n);
+
+    g_timer_destroy(timer);
+    free(buf);
+    free(coords);
+}
+
+void test_timing_read_tile_list() {
+    const size_t n = 16000000;
+    const size_t n_per_write = 100000;
+    futile_coord_s *coords = malloc(sizeof(futile_coord_s) * n_per_write);
+    char *buf = malloc((FUTILE_COORD_STR_MAX + 1) * n_per_write);
+    char *path = strdup("/tmp/futile-bench-XXXXXX");
+    int fd = mkstemp(path);
+    g_assert(fd >= 0);
+    srand(42);
+    for (size_t written = 0; written < n; written += n_per_write) {
+        for (size_t i = 0; i < n_per_write; i++) {
+            coords[i] = (futile_coord_s){.x=rand() % 65536, .y=rand() % 65536, .z=16};
+        }
+        size_t n_buf = futile_coord_format_lines(coords, n_per_write, buf, (FUTILE_COORD_STR_MAX + 1) * n_per_write, NULL);
+        g_assert(write(fd, buf, n_buf) == (ssize_t)n_buf);
+    }
+    close(fd);
+
+    unsigned int n_threads[] = {1, 2, 4, 8, 0};
+    for (unsigned int i = 0; i < sizeof(n_threads) / sizeof(n_threads[0]); i++) {
+        _tile_list_userdata userdata = {.lock=PTHREAD_MUTEX_INITIALIZER};
+        futile_tile_list_options_s options = {
+            .n_threads=n_threads[i],
+            .marshall=true,
+            .on_chunk=_on_tile_list_chunk,
+            .userdata=&userdata
+        };
+        GTimer *timer = g_timer_new();
+        g_assert(futile_read_tile_list(path, &options));
+        printf("%sread tile list, %u threads: %.1fM lines/sec\n", i ? "" : "\n", n_threads[i], n / g_timer_elapsed(timer, NULL) / 1e6);
+        g_timer_destroy(timer);
+        g_assert_cmpint(n, ==, userdata.n_coords);
+    }
+
+    unlink(path);
+    free(path);
+    free(buf);
+    free(coords);
+}
+
+// futile_coord_to_quadkey as it was implemented before Morton codes
+static void bitwise_coord_to_quadkey(futile_coord_s *coord, char *quadkey) {
+    int n = 0;
+    int x = coord->x;
+    int y = coord->y;
+    for (int i = coord->z; i > 0; i--) {
+        char digit = '0';
+        int mask = 1 << (i - 1);
+        if ((x & mask) != 0) {
+            digit++;
+        }
+        if ((y & mask) != 0) {
+            digit += 2;
+        }
+        quadkey[n++] = digit;
+    }
+    quadkey[n] = '\0';
+}
+
+void test_timing_quadkey() {
+    const size_t n = 4000000;
+    const uint32_t zoom = 18;
+    futile_coord_s *coords = malloc(sizeof(futile_coord_s) * n);
+    char *buf = malloc((zoom + 1) * n);
+    srand(42);
+    for (size_t i = 0; i < n; i++) {
+        coords[i] = (futile_coord_s){.x=rand() % (1 << zoom), .y=rand() % (1 << zoom), .z=zoom};
+    }
+
+    GTimer *timer = g_timer_new();
+    for (size_t i = 0; i < n; i++) {
+        bitwise_coord_to_quadkey(&coords[i], buf + i * (zoom + 1));
+    }
+    printf("\ncoord->quadkey bit by bit: %.1fM keys/sec\n", n / g_timer_elapsed(timer, NULL) / 1e6);
+
+    for (int level = 0; level <= futile_simd_detect(); level += FUTILE_SIMD_AVX2) {
+        futile_simd_set_level(level);
+        g_timer_start(timer);
+        size_t n_buf = futile_coord_to_quadkey_lines(coords, n, buf, (zoom + 1) * n, NULL);
+        printf("coord->quadkey lines, simd level %d: %.1fM keys/sec\n", level, n / g_timer_elapsed(timer, NULL) / 1e6);
+
+        g_timer_start(timer);
+        futile_coord_group_s group = {.coords=coords, .n=n};
+        futile_quadkey_parse_lines(buf, n_buf, &group, NULL, NULL);
+        printf("quadkey->coord lines, simd level %d: %.1fM keys/sec\n", level, n / g_timer_elapsed(timer, NULL) / 1e6);
+
+        uint64_t *codes = (uint64_t *)buf;
+        g_timer_start(timer);
+        futile_morton_encode_batch(coords, n, codes);
+        futile_morton_decode_batch(codes, n, zoom, coords);
+        printf("morton encode+decode, simd level %d: %.1fM coords/sec\n", level, n / g_timer_elapsed(timer, NULL) / 1e6);
+    }
+    futile_simd_set_level(futile_simd_detect());
+
+    g_timer_destroy(timer);
+    free(buf);
+    free(coords);
+}
+
+void test_timing_tile_set() {
+    const size_t max_ids = 4 * 300 * 300 + 20000;
+    uint64_t *a = malloc(sizeof(uint64_t) * max_ids);
+    uint64_t *b = malloc(sizeof(uint64_t) * max_ids);
+    uint64_t *merged = malloc(sizeof(uint64_t) * 2 * max_ids);
+    futile_tile_set_s lhs, rhs, out;
+    size_t n_a = fill_tile_set(&lhs, a, 1);
+    size_t n_b = fill_tile_set(&rhs, b, 2);
+    futile_tile_set_optimize(&lhs);
+    futile_tile_set_optimize(&rhs);
+    printf("\ntile set: %.2f bytes/tile, sorted array: 8 bytes/tile\n", (double)futile_tile_set_size_bytes(&lhs) / n_a);
+
+    const int n_rounds = 100;
+    GTimer *timer = g_timer_new();
+    for (int i = 0; i < n_rounds; i++) {
+        reference_set_op(a, n_a, b, n_b, 0, merged);
+    }
+    printf("sorted array union: %.1fM tiles/sec\n", n_rounds * (n_a + n_b) / g_timer_elapsed(timer, NULL) / 1e6);
+
+    for (int level = 0; level <= futile_simd_detect(); level++) {
+        futile_simd_set_level(level);
+        g_timer_start(timer);
+        for (int i = 0; i < n_rounds; i++) {
+            futile_tile_set_union(&lhs, &rhs, &out);
+            futile_tile_set_free(&out);
+        }
+        printf("tile set union, simd level %d: %.1fM tiles/sec\n", level, n_rounds * (n_a + n_b) / g_timer_elapsed(timer, NULL) / 1e6);
+    }
+    futile_simd_set_level(futile_simd_detect());
+
+    g_timer_destroy(timer);
+    futile_tile_set_free(&lhs);
+    futile_tile_set_free(&rhs);
+    free(merged);
+    free(b);
+    free(a);
+}
+
+void test_timing_rollup() {
+    const size_t n = 2000000;
+    futile_coord_s *leaves = malloc(sizeof(futile_coord_s) * n);
+    uint64_t *ids = malloc(sizeof(uint64_t) * n);
+    srand(42);
+    for (size_t i = 0; i < n; i++) {
+        leaves[i] = (futile_coord_s){19000 + rand() % 3000, 24000 + rand() % 2000, 16};
+        ids[i] = futile_coord_marshall_int(&leaves[i]);
+    }
+
+    struct _rollup_reference reference = {.ids = malloc(sizeof(uint64_t) * n * 16)};
+    GTimer *timer = g_timer_new();
+    for (size_t i = 0; i < n; i++) {
+        futile_for_coord_parents(&leaves[i], 1, _add_rollup_reference, &reference);
+    }
+    size_t n_unique = sort_unique_ids(reference.ids, reference.n);
+    printf("\nper leaf parents and sort: %.2f sec, %zu unique tiles\n", g_timer_elapsed(timer, NULL), n_unique);
+
+    unsigned int thread_counts[] = {1, 0};
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+        futile_rollup_s rollup;
+        g_timer_start(timer);
+        futile_rollup_ints(ids, n, 0, thread_counts[t], &rollup);
+        printf("rollup, %u threads (0 is one per cpu): %.2f sec\n", thread_counts[t], g_timer_elapsed(timer, NULL));
+        futile_rollup_free(&rollup);
+    }
+
+    g_timer_destroy(timer);
+    free(reference.ids);
+    free(ids);
+    free(leaves);
+}
+
+void test_timing_sort() {
+    const size_t n = 10000000;
+    uint64_t *source = malloc(sizeof(uint64_t) * n);
+    uint64_t *ids = malloc(sizeof(uint64_t) * n);
+    srand(42);
+    for (size_t i = 0; i < n; i++) {
+        futile_coord_s coord = {rand() % 65536, rand() % 65536, 16};
+        source[i] = futile_coord_marshall_int(&coord);
+    }
+
+    memcpy(ids, source, sizeof(uint64_t) * n);
+    GTimer *timer = g_timer_new();
+    qsort(ids, n, sizeof(uint64_t), uint64_cmp);
+    printf("\nqsort marshalled ids: %.1fM ids/sec\n", n / g_timer_elapsed(timer, NULL) / 1e6);
+
+    unsigned int thread_counts[] = {1, 0};
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+        memcpy(ids, source, sizeof(uint64_t) * n);
+        g_timer_start(timer);
+        futile_sort_ids(ids, n, thread_counts[t]);
+        printf("radix sort marshalled ids, %u threads (0 is one per cpu): %.1fM ids/sec\n",
+               thread_counts[t], n / g_timer_elapsed(timer, NULL) / 1e6);
+    }
+
+    futile_coord_s *coords = (futile_coord_s *)source;
+    size_t n_coords = n * sizeof(uint64_t) / sizeof(futile_coord_s);
+    for (size_t i = 0; i < n_coords; i++) {
+        coords[i] = (futile_coord_s){rand() % 65536, rand() % 65536, 16};
+    }
+    g_timer_start(timer);
+    futile_sort_coords(coords, n_coords, 1);
+    printf("radix sort coords: %.1fM coords/sec\n", n_coords / g_timer_elapsed(timer, NULL) / 1e6);
+
+    g_timer_destroy(timer);
+    free(ids);
+    free(source);
+}
+
+void test_timing_for_zoom_range_parallel() {
+    const unsigned int zoom_until = 12;
+    uint64_t n_visited = 0;
+    GTimer *timer = g_timer_new();
+    futile_for_zoom_range(0, zoom_until, _count_coords, &n_visited);
+    printf("\nfor zoom range: %.1fM coords/sec\n", n_visited / g_timer_elapsed(timer, NULL) / 1e6);
+
+    unsigned int n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t *counts = calloc(n_threads, sizeof(uint64_t) * 8);
+    void **thread_userdata = calloc(n_threads, sizeof(void *));
+    for (unsigned int i = 0; i < n_threads; i++) {
+        // a cache line per counter
+        thread_userdata[i] = &counts[i * 8];
+    }
+    futile_parallel_options_s options = {.n_threads = n_threads, .thread_userdata = thread_userdata};
+    g_timer_start(timer);
+    futile_for_zoom_range_parallel(0, zoom_until, _count_coords, &options);
+    printf("for zoom range parallel, %u threads: %.1fM coords/sec\n", n_threads, n_visited / g_timer_elapsed(timer, NULL) / 1e6);
+
+    g_timer_destroy(timer);
+    free(thread_userdata);
+    free(counts);
+}
+
+// cost grows towards the south east corner, so an even split up front
+// would leave most threads idle
+void _skewed_cost(futile_coord_s *coord, void *userdata) {
+    unsigned int n = 1 + ((coord->x + coord->y) >> (coord->z > 4 ? coord->z - 4 : 0));
+    volatile uint64_t sum = 0;
+    for (unsigned int i = 0; i < n * n; i++) {
+        sum += i;
+    }
+    (*(uint64_t *)userdata)++;
+}
+
+void test_timing_for_bounds_parallel() {
+    futile_bounds_s world = {-180, -85, 180, 85};
+    const unsigned int zoom_until = 11;
+    uint64_t n_visited = 0;
+    GTimer *timer = g_timer_new();
+    futile_for_bounds(&world, 0, zoom_until, _skewed_cost, &n_visited);
+    printf("\nfor bounds, skewed cost: %.1fM coords/sec\n", n_visited / g_timer_elapsed(timer, NULL) / 1e6);
+
+    unsigned int n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t *counts = calloc(n_threads, sizeof(uint64_t) * 8);
+    void **thread_userdata = calloc(n_threads, sizeof(void *));
+    futile_worker_stats_s *stats = calloc(n_threads, sizeof(futile_worker_stats_s));
+    for (unsigned int i = 0; i < n_threads; i++) {
+        thread_userdata[i] = &counts[i * 8];
+    }
+    futile_parallel_options_s options = {.n_threads = n_threads, .thread_userdata = thread_userdata};
+    g_timer_start(timer);
+    futile_for_bounds_parallel(&world, 0, zoom_until, _skewed_cost, &options, stats);
+    printf("for bounds parallel, %u threads: %.1fM coords/sec\n", n_threads, n_visited / g_timer_elapsed(timer, NULL) / 1e6);
+    for (unsigned int i = 0; i < n_threads; i++) {
+        printf("  worker %u: %llu coords, %llu subtrees, %llu steals, %llu failed\n", i,
+               (unsigned long long)stats[i].n_coords, (unsigned long long)stats[i].n_subtrees,
+               (unsigned long long)stats[i].n_steals, (unsigned long long)stats[i].n_failed_steals);
+    }
+
+    g_timer_destroy(timer);
+    free(stats);
+    free(thread_userdata);
+    free(counts);
+}
+
+void _count_cover_runs(futile_coord_run_s *run, void *userdata) {
+    (*(uint64_t *)userdata) += run->until_x - run->start_x + 1;
+}
+
+void test_timing_cover() {
+    // a wobbly coastline like ring around the alps
+    const size_t n = 50000;
+    futile_point_s *lnglats = calloc(n, sizeof(futile_point_s));
+    for (size_t i = 0; i < n; i++) {
+        double a = 2 * M_PI * i / n, r = 3 + 0.3 * sin(a * 200) + 0.1 * sin(a * 3001);
+        lnglats[i] = (futile_point_s){10 + r * cos(a), 46 + 0.7 * r * sin(a)};
+    }
+    size_t ring_ends[] = {n};
+    uint64_t n_coords = 0;
+    GTimer *timer = g_timer_new();
+    futile_cover_polygon(lnglats, ring_ends, 1, 0, 14, _count_cover_runs, &n_coords);
+    double elapsed = g_timer_elapsed(timer, NULL);
+    printf("\ncover polygon, %zu vertices to z14: %.3f sec, %llu coords\n", n, elapsed, (unsigned long long)n_coords);
+
+    n_coords = 0;
+    g_timer_start(timer);
+    futile_cover_linestring(lnglats, n, 0, 14, _count_cover_runs, &n_coords);
+    elapsed = g_timer_elapsed(timer, NULL);
+    printf("cover linestring, %zu vertices to z14: %.3f sec, %llu coords\n", n, elapsed, (unsigned long long)n_coords);
+
+    uint64_t n_fine = 0;
+    futile_cover_polygon(lnglats, ring_ends, 1, 16, 16, _count_cover_runs, &n_fine);
+    n_coords = 0;
+    g_timer_start(timer);
+    futile_cover_polygon_mixed(lnglats, ring_ends, 1, 16, 0, _count_coords, &n_coords);
+    elapsed = g_timer_elapsed(timer, NULL);
+    printf("cover polygon mixed, %zu vertices at z16: %.3f sec, %llu coords for %llu at z16\n", n, elapsed, (unsigned long long)n_coords, (unsigned long long)n_fine);
+
+    g_timer_destroy(timer);
+    free(lnglats);
+}
+
+void test_timing_cover_bounds() {
+    // changed feature bboxes clustered over a city, as from a diff
+    const size_t n = 100000;
+    futile_bounds_s *bounds = calloc(n, sizeof(futile_bounds_s));
+    srand(7);
+    for (size_t i = 0; i < n; i++) {
+        double lng = random_range(-0.5, 0.3), lat = random_range(51.3, 51.7);
+        bounds[i] = (futile_bounds_s){lng, lat, lng + random_range(0, 0.02), lat + random_range(0, 0.01)};
+    }
+    uint64_t n_visited = 0;
+    GTimer *timer = g_timer_new();
+    for (size_t i = 0; i < n; i++) {
+        futile_for_bounds(&bounds[i], 10, 14, _count_coords, &n_visited);
+    }
+    double elapsed = g_timer_elapsed(timer, NULL);
+    printf("\nfor bounds, %zu bboxes z10-z14: %.3f sec, %llu coords\n", n, elapsed, (unsigned long long)n_visited);
+
+    uint64_t n_coords = 0;
+    g_timer_start(timer);
+    futile_cover_bounds(bounds, n, 10, 14, _count_cover_runs, &n_coords);
+    elapsed = g_timer_elapsed(timer, NULL);
+    printf("cover bounds, %zu bboxes z10-z14: %.3f sec, %llu coords\n", n, elapsed, (unsigned long long)n_coords);
+
+    g_timer_destroy(timer);
+    free(bounds);
+}
+
+void test_timing_bucket_points() {
+    const size_t n = 1 << 22;
+    futile_point_s *lnglats = calloc(n, sizeof(futile_point_s));
+    fill_event_points(lnglats, n);
+    futile_coord_s *coords = calloc(n, sizeof(futile_coord_s));
+    uint64_t *ids = calloc(n, sizeof(uint64_t));
+
+    GTimer *timer = g_timer_new();
+    futile_lnglat_to_coord_batch(lnglats, n, 16, coords);
+    for (size_t i = 0; i < n; i++) {
+        ids[i] = futile_coord_to_zorder(&coords[i]);
+    }
+    qsort(ids, n, sizeof(uint64_t), uint64_cmp);
+    printf("\nproject and qsort: %.1fM points/sec\n", n / g_timer_elapsed(timer, NULL) / 1e6);
+
+    unsigned int n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    futile_bucket_zoom_s bucket, coarse;
+    g_timer_start(timer);
+    futile_bucket_points(lnglats, n, 16, n_threads, NULL, &bucket);
+    printf("bucket points, %u threads: %.1fM points/sec, %zu tiles\n", n_threads, n / g_timer_elapsed(timer, NULL) / 1e6, bucket.n);
+    g_timer_start(timer);
+    for (int zoom = 15; zoom >= 0; zoom--) {
+        futile_bucket_coarsen(&bucket, zoom, &coarse);
+        futile_bucket_free(&bucket);
+        bucket = coarse;
+    }
+    printf("coarsen z15 to z0: %.3f sec\n", g_timer_elapsed(timer, NULL));
+    futile_bucket_free(&bucket);
+
+    size_t *order = calloc(n, sizeof(size_t));
+    g_timer_start(timer);
+    futile_bucket_points(lnglats, n, 16, n_threads, order, &bucket);
+    printf("bucket points with order, %u threads: %.1fM points/sec\n", n_threads, n / g_timer_elapsed(timer, NULL) / 1e6);
+    futile_bucket_free(&bucket);
+
+    g_timer_destroy(timer);
+    free(order);
+    free(ids);
+    free(coords);
+    free(lnglats);
+}
+
+typedef struct {
+    futile_tile_cache_s *cache;
+    unsigned int seed;
+    size_t n_ops;
+    size_t n_hits;
+    uint32_t *hit_ns;
+} cache_bench_s;
+
+// skewed keys: the square of a uniform variable favours low indexes,
+// standing in for popular tiles
+static uint64_t skewed_cache_key(unsigned int *seed) {
+    double u = rand_r(seed) / (RAND_MAX + 1.0);
+    return cache_key(u * u * 100000);
+}
+
+static void *cache_bench_worker(void *userdata) {
+    cache_bench_s *bench = userdata;
+    unsigned char data[2048] = {0};
+    for (size_t i = 0; i < bench->n_ops; i++) {
+        uint64_t key = skewed_cache_key(&bench->seed);
+        uint64_t start = now_ns();
+        futile_tile_cache_value_s *value = futile_tile_cache_get(bench->cache, key);
+        if (value) {
+            futile_tile_cache_release(value);
+            bench->hit_ns[bench->n_hits++] = now_ns() - start;
+        } else {
+            futile_tile_cache_put(bench->cache, key, data, 256 + rand_r(&bench->seed) % 1792);
+        }
+    }
+    return NULL;
+}
+
+static int uint32_cmp(const void *lhs, const void *rhs) {
+    uint32_t a = *(const uint32_t *)lhs, b = *(const uint32_t *)rhs;
+    return (a > b) - (a < b);
+}
+
+void test_timing_tile_cache() {
+    const size_t n_ops = 2000000;
+    unsigned int thread_counts[] = {1, 4, 16};
+    uint64_t start = now_ns();
+    for (int i = 0; i < 1000000; i++) {
+        now_ns();
+    }
+    printf("\nclock overhead in the latencies below: %.0f ns\n", (now_ns() - start) / 1e6);
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+        unsigned int n_threads = thread_counts[t];
+        futile_tile_cache_s cache;
+        futile_tile_cache_init(&cache, 64 << 20, 0);
+        pthread_t threads[n_threads];
+        cache_bench_s benches[n_threads];
+        start = now_ns();
+        for (unsigned int i = 0; i < n_threads; i++) {
+            benches[i] = (cache_bench_s){.cache=&cache, .seed=i + 1, .n_ops=n_ops / n_threads};
+            benches[i].hit_ns = malloc(sizeof(uint32_t) * benches[i].n_ops);
+            pthread_create(&threads[i], NULL, cache_bench_worker, &benches[i]);
+        }
+        size_t n_hits = 0;
+        for (unsigned int i = 0; i < n_threads; i++) {
+            pthread_join(threads[i], NULL);
+            n_hits += benches[i].n_hits;
+        }
+        double elapsed = (now_ns() - start) / 1e9;
+        uint32_t *hit_ns = malloc(sizeof(uint32_t) * (n_hits ? n_hits : 1));
+        size_t offset = 0;
+        for (unsigned int i = 0; i < n_threads; i++) {
+            memcpy(hit_ns + offset, benches[i].hit_ns, sizeof(uint32_t) * benches[i].n_hits);
+            offset += benches[i].n_hits;
+            free(benches[i].hit_ns);
+        }
+        qsort(hit_ns, n_hits, sizeof(uint32_t), uint32_cmp);
+        futile_tile_cache_stats_s stats;
+        futile_tile_cache_stats(&cache, &stats);
+        printf("tile cache, %u threads: %.1fM ops/sec, %.0f%% hits, %" PRIu64 " evictions, hit ns p50 %u p90 %u p99 %u p99.9 %u\n",
+               n_threads, n_ops / elapsed / 1e6, 100.0 * n_hits / n_ops, stats.n_evictions,
+               hit_ns[n_hits / 2], hit_ns[n_hits * 9 / 10], hit_ns[n_hits * 99 / 100], hit_ns[n_hits * 999 / 1000]);
+        free(hit_ns);
+        futile_tile_cache_free(&cache);
+    }
+}
+
+typedef struct {
+    futile_dedup_set_s *set;
+    size_t n;
+    unsigned int seed;
+    bool use_batches;
+} dedup_bench_s;
+
+static void *dedup_bench_worker(void *userdata) {
+    dedup_bench_s *bench = userdata;
+    uint64_t batch[256];
+    for (size_t i = 0; i < bench->n; i += 256) {
+        for (int j = 0; j < 256; j++) {
+            batch[j] = skewed_cache_key(&bench->seed);
+        }
+        if (bench->use_batches) {
+            futile_dedup_set_add_many(bench->set, batch, 256);
+        } else {
+            for (int j = 0; j < 256; j++) {
+                futile_dedup_set_add(bench->set, batch[j]);
+            }
+        }
+    }
+    return NULL;
+}
+
+void test_timing_dedup_set() {
+    const size_t n = 1 << 24;
+    unsigned int thread_counts[] = {1, 4};
+    printf("\n");
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+        for (int use_batches = 0; use_batches <= 1; use_batches++) {
+            unsigned int n_threads = thread_counts[t];
+            futile_dedup_set_s set;
+            futile_dedup_set_init(&set, 200000);
+            uint64_t *out = malloc(sizeof(uint64_t) * futile_dedup_set_slots(&set));
+            pthread_t threads[n_threads];
+            dedup_bench_s benches[n_threads];
+            uint64_t start = now_ns();
+            for (unsigned int i = 0; i < n_threads; i++) {
+                benches[i] = (dedup_bench_s){.set=&set, .n=n / n_threads, .seed=i + 1, .use_batches=use_batches};
+                pthread_create(&threads[i], NULL, dedup_bench_worker, &benches[i]);
+            }
+            for (unsigned int i = 0; i < n_threads; i++) {
+                pthread_join(threads[i], NULL);
+            }
+            double elapsed = (now_ns() - start) / 1e9;
+            size_t n_unique = futile_dedup_set_drain(&set, out);
+            printf("dedup set, %u threads, %s: %.1fM ids/sec, %zu unique\n",
+                   n_threads, use_batches ? "batches of 256" : "one at a time", n / elapsed / 1e6, n_unique);
+            free(out);
+            futile_dedup_set_free(&set);
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/coord/zoom/down-one", test_coord_zoom_down_one);
     g_test_add_func("/coord/zoom/down-two", test_coord_zoom_down_two);
     g_test_add_func("/coord/zoom/up", test_coord_zoom_up);
     g_test_add_func("/coord/coord-parent-invalid", test_coord_parent_invalid);
@@ -620,21 +4042,51 @@ int main(int argc, char *argv[]) {
     g_test_add_func("/coord/deserialize-ok", test_coord_deserialize_ok);
     g_test_add_func("/coord/deserialize-ok-trailing-newline", test_coord_deserialize_ok_trailing_newline);
     g_test_add_func("/coord/coord_print", test_coord_print);
+    g_test_add_func("/coord/format", test_coord_format);
+    g_test_add_func("/coord/parse", test_coord_parse);
+    g_test_add_func("/coord/parse-matches-sscanf", test_coord_parse_matches_sscanf);
+    g_test_add_func("/coord/parse-lines", test_coord_parse_lines);
+    g_test_add_func("/coord/parse-lines-resume", test_coord_parse_lines_resume);
+    g_test_add_func("/coord/format-lines", test_coord_format_lines);
+    g_test_add_func("/coord/read-tile-list", test_read_tile_list);
+    g_test_add_func("/coord/read-tile-list-missing", test_read_tile_list_missing);
     g_test_add_func("/coord/coord_cmp", test_coord_cmp);
     g_test_add_func("/coord/coord_equal", test_coord_equal);
     g_test_add_func("/coord/marshall/int", test_coord_marshall_up_to_zoom_5);
     g_test_add_func("/coord/marshall/examples", test_coord_marshall_examples);
     g_test_add_func("/coord/int/zoom-up/examples", test_coord_int_zoom_up_examples);
     g_test_add_func("/coord/int/zoom-up/small-range", test_coord_int_zoom_up_small_range);
+    g_test_add_func("/coord/morton/examples", test_coord_morton_examples);
+    g_test_add_func("/coord/morton/roundtrip", test_coord_morton_roundtrip);
+    g_test_add_func("/coord/zorder/examples", test_coord_zorder_examples);
+    g_test_add_func("/coord/zorder/relatives", test_coord_zorder_relatives);
+    g_test_add_func("/coord/hilbert/examples", test_coord_hilbert_examples);
+    g_test_add_func("/coord/hilbert/roundtrip", test_coord_hilbert_roundtrip);
+    g_test_add_func("/coord/sort/ids", test_coord_sort_ids);
+    g_test_add_func("/coord/sort/coords", test_coord_sort_coords);
 
     g_test_add_func("/geo/explode-bounds", test_explode_bounds);
     g_test_add_func("/geo/coord->lnglat", test_coord_to_lnglat);
     g_test_add_func("/geo/lnglat->coord", test_lnglat_to_coord);
+    g_test_add_func("/geo/lnglat->coord/batch", test_lnglat_to_coord_batch);
+    g_test_add_func("/geo/lnglat->coord/batch-random", test_lnglat_to_coord_batch_random);
+    g_test_add_func("/geo/lnglat->coord/batch-clamp", test_lnglat_to_coord_batch_clamp);
+    g_test_add_func("/geo/lnglat->coord/batch-soa", test_lnglat_to_coord_batch_soa);
+    g_test_add_func("/geo/mercator->tile/batch", test_mercator_to_tile_batch);
+    g_test_add_func("/geo/lnglat->tile/batch", test_lnglat_to_tile_batch);
+    g_test_add_func("/geo/tile-batch/drop-duplicates", test_tile_batch_drop_duplicates);
     g_test_add_func("/geo/coord->bounds", test_coord_to_bounds);
+    g_test_add_func("/geo/coord->lnglat/batch", test_coord_to_lnglat_batch);
+    g_test_add_func("/geo/coord->bounds/batch", test_coord_to_bounds_batch);
+    g_test_add_func("/geo/coord-range->bounds", test_coord_range_to_bounds);
     g_test_add_func("/geo/bounds->coords", test_bounds_to_multiple_coords);
     g_test_add_func("/geo/bounds->coord", test_bounds_to_single_coord);
     g_test_add_func("/geo/mercator->wgs84", test_mercator_to_wgs84);
     g_test_add_func("/geo/wgs84->mercator", test_wgs84_to_mercator);
+    g_test_add_func("/geo/mercator/batch", test_mercator_batch);
+    g_test_add_func("/geo/world/lnglat", test_world_lnglat);
+    g_test_add_func("/geo/world/mercator", test_world_mercator);
+    g_test_add_func("/geo/world/bounds", test_world_bounds);
     g_test_add_func("/geo/coord->mercator", test_coord_to_mercator);
     g_test_add_func("/geo/mercator->coord", test_mercator_to_coord);
     g_test_add_func("/geo/mercator-coord-roundtrip", test_coord_mercator_roundtrip);
@@ -642,17 +4094,73 @@ int main(int argc, char *argv[]) {
     g_test_add_func("/geo/mercator-bounds->coord", test_mercator_bounds_to_coords);
     g_test_add_func("/geo/coord->quadkey", test_coord_to_quadkey);
     g_test_add_func("/geo/quadkey->coord", test_quadkey_to_coord);
+    g_test_add_func("/geo/coord->quadkey-n", test_coord_to_quadkey_n);
+    g_test_add_func("/geo/quadkey->coord/invalid", test_quadkey_to_coord_invalid);
+    g_test_add_func("/geo/quadkey/lines-roundtrip", test_quadkey_lines_roundtrip);
+    g_test_add_func("/geo/quadkey/parse-lines-errors", test_quadkey_parse_lines_errors);
 
     g_test_add_func("/tile/zoom-range", test_tile_for_zoom_range);
     g_test_add_func("/tile/zoom-range-array", test_tile_for_zoom_range_array);
     g_test_add_func("/tile/zoom-range-array-multiple", test_tile_for_zoom_range_array_multiple);
+    g_test_add_func("/tile/zoom-range-parallel", test_tile_for_zoom_range_parallel);
+    g_test_add_func("/tile/zoom-range-parallel/cancel", test_tile_for_zoom_range_parallel_cancel);
     g_test_add_func("/tile/coord-zoom-range", test_tile_for_coord_zoom_range);
     g_test_add_func("/tile/coord-parents", test_tile_parents);
     g_test_add_func("/tile/n-for-zoom", test_tile_n_for_zoom);
     g_test_add_func("/tile/for-tile/bounds", test_tile_for_bounds);
     g_test_add_func("/tile/for-tile/bounds/low-zooms", test_tile_for_bounds_low_zooms);
+    g_test_add_func("/tile/zoom-range-hilbert", test_tile_for_zoom_range_hilbert);
+    g_test_add_func("/tile/for-tile/bounds-hilbert", test_tile_for_bounds_hilbert);
+    g_test_add_func("/tile/for-tile/bounds-parallel", test_tile_for_bounds_parallel);
+    g_test_add_func("/tile/for-tile/bounds-parallel/cancel", test_tile_for_bounds_parallel_cancel);
+    g_test_add_func("/tile/cursor/bounds", test_tile_bounds_cursor);
+    g_test_add_func("/tile/cursor/coord-range", test_tile_coord_range_cursor);
+    g_test_add_func("/tile/n-for-bounds", test_tile_n_for_bounds);
+    g_test_add_func("/tile/metatile", test_tile_metatile);
+    g_test_add_func("/tile/for-metatile", test_tile_for_metatile);
+    g_test_add_func("/tile/shard", test_tile_bounds_shard);
+    g_test_add_func("/tile/cover/points", test_tile_cover_points);
+    g_test_add_func("/tile/cover/linestring", test_tile_cover_linestring);
+    g_test_add_func("/tile/cover/polygon", test_tile_cover_polygon);
+    g_test_add_func("/tile/cover/polygon-mixed", test_tile_cover_polygon_mixed);
+    g_test_add_func("/tile/cover/bounds", test_tile_cover_bounds);
+    g_test_add_func("/tile/set/basic", test_tile_set_basic);
+    g_test_add_func("/tile/set/algebra", test_tile_set_algebra);
+    g_test_add_func("/tile/set/add-runs", test_tile_set_add_runs);
+    g_test_add_func("/tile/set/size", test_tile_set_size);
+    g_test_add_func("/tile/rollup", test_tile_rollup);
+    g_test_add_func("/tile/rollup/edges", test_tile_rollup_edges);
+    g_test_add_func("/tile/bucket", test_tile_bucket_points);
+    g_test_add_func("/tile/cache/basic", test_tile_cache_basic);
+    g_test_add_func("/tile/cache/evict", test_tile_cache_evict);
+    g_test_add_func("/tile/cache/threads", test_tile_cache_threads);
+    g_test_add_func("/tile/dedup-set/basic", test_tile_dedup_set_basic);
+    g_test_add_func("/tile/dedup-set/threads", test_tile_dedup_set_threads);
+    g_test_add_func("/tile/expiry/basic", test_tile_expiry_basic);
+    g_test_add_func("/tile/expiry/threads", test_tile_expiry_threads);
 
     // g_test_add_func("/timing/for-zoom-range-array", test_timing_for_zoom_range_array);
 
+    // benchmarks only run in perf mode, see make bench
+    if (g_test_perf()) {
+        g_test_add_func("/timing/lnglat->coord-batch", test_timing_lnglat_to_coord_batch);
+        g_test_add_func("/timing/tile-batch", test_timing_tile_batch);
+        g_test_add_func("/timing/mercator-batch", test_timing_mercator_batch);
+        g_test_add_func("/timing/coord->bounds-batch", test_timing_coord_to_bounds_batch);
+        g_test_add_func("/timing/coord-parse-format", test_timing_coord_parse_format);
+        g_test_add_func("/timing/read-tile-list", test_timing_read_tile_list);
+        g_test_add_func("/timing/quadkey", test_timing_quadkey);
+        g_test_add_func("/timing/tile-set", test_timing_tile_set);
+        g_test_add_func("/timing/rollup", test_timing_rollup);
+        g_test_add_func("/timing/sort", test_timing_sort);
+        g_test_add_func("/timing/zoom-range-parallel", test_timing_for_zoom_range_parallel);
+        g_test_add_func("/timing/bounds-parallel", test_timing_for_bounds_parallel);
+        g_test_add_func("/timing/cover", test_timing_cover);
+        g_test_add_func("/timing/cover-bounds", test_timing_cover_bounds);
+        g_test_add_func("/timing/bucket", test_timing_bucket_points);
+        g_test_add_func("/timing/tile-cache", test_timing_tile_cache);
+        g_test_add_func("/timing/dedup-set", test_timing_dedup_set);
+    }
+
     return g_test_run();
 }